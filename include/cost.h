@@ -0,0 +1,42 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Cost of the server which is charged to its clients.
+ * The table has a fixed number of clients, the cheapest one is replaced by a new client.
+ */
+struct cost_entry {
+	int pid;
+	int uid;
+	unsigned long long bytes; /* Received */
+	unsigned long long requests; /* Decoded packets */
+	unsigned long long decode_ns;
+	unsigned long long callback_ns;
+};
+
+/*
+ * Get the entry of the client, it is valid until the next call.
+ * Counters of a new entry are 0.
+ */
+extern struct cost_entry *cost_get(int pid, int uid);
+
+/*
+ * Copy the most expensive entries (decode_ns + callback_ns), in the descending order.
+ * Returns the number of copied entries.
+ */
+extern int cost_top(struct cost_entry *entries, int count);
+
+/* End of a file */
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Records which are sent from the running server to its successor.
+ */
+enum handover_type {
+	HANDOVER_LISTEN = 0x1, /* fds[0] is the listening socket */
+	HANDOVER_CONNECTION = 0x2, /* fds[0] is the connection, others are its received fds. data is not dispatched yet */
+	HANDOVER_END = 0x3,
+};
+
+struct handover_record {
+	int type;
+	int version; /* Protocol of the connection */
+	int features;
+	int from_pid;
+	int size; /* Size of the data */
+	int nr_fds;
+};
+
+/*
+ * Create the socket which waits a successor.
+ */
+extern int handover_create_server(const char *path);
+
+/*
+ * Accept a successor, it should be a process of the same user.
+ * Returns a blocking connection.
+ */
+extern int handover_accept(int server_fd);
+
+/*
+ * Connect to the running server.
+ * Returns -ENOENT if there is no server to take over.
+ */
+extern int handover_connect(const char *path);
+
+/*
+ * Send a record, nr_fds of the record should not be larger than SECOM_MAX_FDS.
+ */
+extern int handover_send(int fd, const struct handover_record *record, const char *data, const int *fds);
+
+/*
+ * Receive a record, data should be released by the caller.
+ * fds should have room for SECOM_MAX_FDS.
+ */
+extern int handover_recv(int fd, struct handover_record *record, char **data, int *fds);
+
+/* End of a file */
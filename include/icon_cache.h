@@ -0,0 +1,49 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Start the loader thread.
+ * Returns the fd which becomes readable when a load is done,
+ * icon_cache_dispatch should be called then.
+ */
+extern int icon_cache_init(void *(*load)(const char *path, int *size, void *data), void (*unload)(void *handle, void *data), int max_size, void *data);
+extern int icon_cache_is_enabled(void);
+
+/*
+ * Load the icon on the loader thread, if it is not cached yet.
+ * Returns a job, and the "done" is invoked from the icon_cache_dispatch.
+ * Returns NULL if there is nothing to wait. (cached, not a file, ...)
+ */
+extern void *icon_cache_request(const char *path, void (*done)(void *data), void *data);
+
+/*
+ * The "done" of the job will not be invoked.
+ */
+extern void icon_cache_cancel(void *job);
+
+/*
+ * Invoke the "done" of finished jobs.
+ */
+extern int icon_cache_dispatch(void);
+
+/*
+ * Get a reference of the loaded icon, or NULL.
+ * Referenced icons are not evicted until icon_cache_put.
+ */
+extern void *icon_cache_get(const char *path);
+extern int icon_cache_put(const void *handle);
+
+/* End of a file */
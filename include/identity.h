@@ -0,0 +1,47 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define IDENTITY_NAME_LEN 256
+
+/*
+ * Identity of a process, empty string if it is not resolved.
+ */
+struct identity {
+	int pid;
+	unsigned long long start_time; /* To tell a reused pid */
+	char appid[IDENTITY_NAME_LEN];
+	char pkgname[IDENTITY_NAME_LEN];
+};
+
+/*
+ * Replace the default resolver, which reads the /proc.
+ * Cached identities are dropped.
+ */
+extern void identity_set_resolver(int (*resolve)(int pid, char *appid, int appid_size, char *pkgname, int pkgname_size, void *data), void *data);
+
+/*
+ * Get the identity of a process, from the cache if it is still the same process.
+ * Returns -ESRCH if the process is gone.
+ */
+extern int identity_get(int pid, struct identity *identity);
+
+/*
+ * Drop identities of processes which are exited.
+ */
+extern void identity_purge(void);
+extern int identity_count(void);
+
+/* End of a file */
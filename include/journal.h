@@ -0,0 +1,43 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Open the journal (create it if it doesn't exist),
+ * and invoke the replay callback for every request which is not done.
+ * Replayed requests are regarded as done after the callback returns.
+ */
+extern int journal_init(const char *path, void (*replay)(int pid, const char *buffer, int size, void *data), void *data);
+extern int journal_fini(void);
+extern int journal_is_enabled(void);
+
+/*
+ * Write a received request, it is durable after the next journal_commit.
+ * Returns the id of the record (>0) or negative errno.
+ */
+extern int journal_begin(int pid, const char *buffer, int size);
+
+/*
+ * Mark a request as done, it will not be replayed.
+ */
+extern int journal_done(int id);
+
+/*
+ * Flush written records to the storage, one sync for every records since the last commit.
+ * The journal is truncated if every request is done.
+ */
+extern int journal_commit(void);
+
+/* End of a file */
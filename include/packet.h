@@ -0,0 +1,186 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Wire format of the shortcut protocol.
+ *
+ * v1: Fixed size header (struct packet, host layout) + payload.
+ *     Every connection starts with this format.
+ *
+ * v2: Compact frame,
+ *     +-------+------+-------+-----+----------+------+------+---------------------+
+ *     | magic | type | flags | seq | body_len | arg0 | arg1 | TLV fields ...      |
+ *     | 1     | 1    | 1     | var | var      | var  | var  | tag, var len, bytes |
+ *     +-------+------+-------+-----+----------+------+------+---------------------+
+ *     magic is 0xB0 | version, every "var" is an unsigned LEB128 varint,
+ *     args are zigzag encoded. Unknown tags are skipped.
+ *
+ * Client sends a PACKET_HELLO in v1 format to negotiate the version and
+ * features. If the server replies PACKET_HELLO, following packets of
+ * the connection are in v2 format. Old servers drop the connection.
+ */
+
+#define PACKET_VERSION 2
+#define PACKET_MAX_PAYLOAD (1024 * 1024)
+
+enum packet_type {
+	PACKET_ERR = 0x0,
+	PACKET_REQ,
+	PACKET_ACK,
+	PACKET_QUERY, /* Answered by the server itself */
+	PACKET_ENTRY, /* One of results of PACKET_QUERY */
+	PACKET_UPDATE,
+	PACKET_REMOVE,
+	PACKET_HELLO, /* Version and feature negotiation */
+	PACKET_RING, /* Attach a shared ring, requests follow through it (v2) */
+	PACKET_SUBSCRIBE, /* Events follow through the connection (v2) */
+	PACKET_EVENT, /* Change of a shortcut, sent to subscribers (v2) */
+	PACKET_MAX = 0xFF, /* MAX */
+};
+
+enum query_kind {
+	QUERY_EXISTS = 0x0,
+	QUERY_LIST,
+};
+
+enum field_id {
+	FIELD_PKGNAME = 0x0,
+	FIELD_NAME,
+	FIELD_EXEC,
+	FIELD_ICON,
+	FIELD_NEW_NAME,
+	FIELD_MAX,
+};
+
+enum packet_feature {
+	FEATURE_BATCH = 0x01, /* Several requests per connection */
+	FEATURE_SEQPACKET = 0x02, /* Reserved */
+	FEATURE_FD_PASSING = 0x04, /* fds of contents are passed by SCM_RIGHTS */
+	FEATURE_SHM_RING = 0x08, /* Requests are sent through a shared ring */
+	FEATURE_SUBSCRIPTION = 0x10, /* Events of accepted requests */
+	FEATURE_CREDIT = 0x20, /* Requests of the ring are limited by credits which are returned with ACKs */
+	FEATURE_NO_REPLY = 0x40, /* Requests can be sent without waiting ACKs, the client closes the connection after the send */
+};
+
+/*
+ * Kind of a PACKET_EVENT, same with SHORTCUT_EVENT_XXX.
+ */
+enum event_kind {
+	EVENT_ADD = 0x0,
+	EVENT_UPDATE,
+	EVENT_REMOVE,
+	EVENT_OVERFLOW, /* Events are dropped, the subscriber should query the registry again */
+};
+
+/*
+ * Flags of a message, only v2 carries these.
+ * Attached fds are passed with the frame, in the order of flags.
+ */
+enum message_flag {
+	MESSAGE_FLAG_CONTENT_FD = 0x01, /* content_info is in a sealed memfd */
+	MESSAGE_FLAG_ICON_FD = 0x02, /* icon is a readable fd */
+	MESSAGE_FLAG_RING_FDS = 0x04, /* memfd of a ring and its eventfd */
+	MESSAGE_FLAG_NO_REPLY = 0x08, /* ACK is not sent, with the FEATURE_NO_REPLY */
+	MESSAGE_FLAG_MASK = 0x0F,
+};
+
+/*
+ * Priority class of a request, in the upper bits of the flags byte (v2).
+ * v1 packets are MESSAGE_PRIORITY_NORMAL.
+ */
+enum message_priority {
+	MESSAGE_PRIORITY_NORMAL = 0x0,
+	MESSAGE_PRIORITY_INTERACTIVE = 0x1,
+	MESSAGE_PRIORITY_BULK = 0x2,
+	MESSAGE_PRIORITY_MAX,
+};
+
+#define MESSAGE_PRIORITY_SHIFT 4
+
+/*
+ * Size includes the NUL, 0 means NULL.
+ * Decoded fields are pointing the given buffer.
+ */
+struct field {
+	const char *ptr;
+	int size;
+};
+
+/*
+ * Decoded form of a packet.
+ */
+struct message {
+	unsigned int seq;
+	int type;
+	int flags;
+	int priority;
+
+	int shortcut_type; /* REQ, ENTRY, UPDATE, EVENT */
+	int mask; /* UPDATE, EVENT */
+	int kind; /* QUERY, EVENT */
+	int ret; /* ACK */
+	int credits; /* ACK (v2), requests which the peer can send more, with the FEATURE_CREDIT */
+	int version; /* HELLO */
+	int features; /* HELLO */
+	unsigned long long deadline; /* REQ, UPDATE, REMOVE. CLOCK_MONOTONIC in ms, 0 if there is no deadline (v2) */
+
+	struct field field[FIELD_MAX];
+};
+
+extern void message_init(struct message *msg, int type, unsigned int seq);
+extern void message_set_field(struct message *msg, int id, const char *str);
+
+/*
+ * ptr doesn't need to be terminated, it should be valid until the message is encoded.
+ */
+extern void message_set_field_n(struct message *msg, int id, const char *ptr, int len);
+
+/*
+ * Returns the size of the encoded packet.
+ */
+extern int packet_size_v1(const struct message *msg);
+extern int packet_size_v2(const struct message *msg);
+
+/*
+ * Buffer should have enough space (packet_size_vX).
+ * Returns the size of the encoded packet.
+ */
+extern int packet_encode_v1(const struct message *msg, char *buffer);
+extern int packet_encode_v2(const struct message *msg, char *buffer);
+
+/*
+ * Returns the size of consumed bytes,
+ * 0 if the buffer doesn't have a complete packet yet, or -EINVAL.
+ */
+extern int packet_decode_v1(const char *buffer, int size, struct message *msg);
+extern int packet_decode_v2(const char *buffer, int size, struct message *msg);
+
+/*
+ * Get the seq and type from the header.
+ * Returns the size of the whole packet, 0 if the header is not complete yet, or -EINVAL.
+ */
+extern int packet_peek(int version, const char *buffer, int size, unsigned int *seq, int *type);
+
+/*
+ * Get the priority from the header, the header should be complete.
+ */
+extern int packet_priority(int version, const char *buffer, int size);
+
+extern int packet_size(int version, const struct message *msg);
+extern int packet_encode(int version, const struct message *msg, char *buffer);
+extern int packet_decode(int version, const char *buffer, int size, struct message *msg);
+
+/* End of a file */
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Workers which run jobs of the main loop, e.g. thread-safe callbacks of the homescreen.
+ * Jobs of the same key are run one at a time, in the order of submission.
+ */
+
+/*
+ * Start workers.
+ * Returns the fd which becomes readable when a job is done,
+ * pool_dispatch should be called then.
+ */
+extern int pool_init(int workers);
+extern int pool_is_enabled(void);
+
+/*
+ * "run" is invoked on a worker, and the "done" is invoked from the pool_dispatch after that.
+ * key can be NULL, it is same with "".
+ */
+extern int pool_submit(const char *key, void (*run)(void *data), void (*done)(void *data), void *data);
+
+/*
+ * Invoke the "done" of finished jobs.
+ */
+extern int pool_dispatch(void);
+
+/*
+ * Jobs which are submitted, and not dispatched yet.
+ */
+extern int pool_count(void);
+
+/* End of a file */
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Resolved target of a SHORTCUT_FILE or SHORTCUT_DATA request.
+ * Fields are not changed while it is referenced.
+ */
+struct prefetch_target {
+	const char *path; /* NULL if the data is not a file */
+	const char *mime;
+	const char *appid; /* Handler, NULL if it is not resolved */
+	long long size;
+	long long mtime;
+};
+
+/*
+ * Start workers.
+ * Returns the fd which becomes readable when a job is done,
+ * prefetch_dispatch should be called then.
+ */
+extern int prefetch_init(int workers, int (*resolve)(const char *target, const char *mime, char *appid, int appid_size, void *data), void *data);
+extern int prefetch_is_enabled(void);
+
+/*
+ * Resolve the target on a worker, if it is not cached yet.
+ * Returns a job, and the "done" is invoked from the prefetch_dispatch.
+ * Returns NULL if there is nothing to wait. (cached, not a file, ...)
+ * done can be NULL, to warm the cache for a following request.
+ */
+extern void *prefetch_request(int type, const char *content, void (*done)(void *data), void *data);
+
+/*
+ * The "done" of the job will not be invoked.
+ */
+extern void prefetch_cancel(void *job);
+
+/*
+ * Invoke the "done" of finished jobs.
+ */
+extern int prefetch_dispatch(void);
+
+/*
+ * Get a reference of the resolved target, or NULL.
+ */
+extern const struct prefetch_target *prefetch_get(int type, const char *content);
+extern void prefetch_put(const struct prefetch_target *target);
+
+/* End of a file */
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * View of a registered shortcut.
+ * Every pointer is pointing the mapped area directly,
+ * So it is only valid until the callback returns.
+ */
+struct registry_entry {
+	const char *pkgname;
+	const char *name;
+	const char *exec;
+	const char *icon;
+	int type;
+};
+
+/*
+ * Map the registry file. (create it if it doesn't exist)
+ * If the path is NULL, the registry is kept in the anonymous memory.
+ * Records of the anonymous registry are moved to the file when it is mapped later.
+ */
+extern int registry_init(const char *path);
+extern int registry_fini(void);
+extern int registry_is_enabled(void);
+
+/*
+ * Append a record, the record which has the same (pkgname, name) is replaced.
+ */
+extern int registry_add(const char *pkgname, const char *name, int type, const char *exec, const char *icon);
+extern int registry_remove(const char *pkgname, const char *name);
+
+/*
+ * Append a new record which has the changed fields (SHORTCUT_UPDATE_XXX),
+ * Returns -ENOENT if there is no record for (pkgname, name).
+ */
+extern int registry_update(const char *pkgname, const char *name, int mask, const char *new_name, int type, const char *exec, const char *icon);
+
+/*
+ * Returns 1 if there is a record for (pkgname, name), or 0.
+ * If the callback is given, it is invoked for the found record.
+ */
+extern int registry_find(const char *pkgname, const char *name, int (*cb)(const struct registry_entry *entry, void *data), void *data);
+
+/*
+ * Iterate live records in the order of registration.
+ * If the callback returns negative value, the iteration is stopped.
+ * Callback should not modify the registry.
+ */
+extern int registry_foreach(int (*cb)(const struct registry_entry *entry, void *data), void *data);
+
+/*
+ * Iterate live records of a package, from the newest one. (using the pkgname index)
+ * If the pkgname is NULL, this is same with the registry_foreach.
+ */
+extern int registry_foreach_pkgname(const char *pkgname, int (*cb)(const struct registry_entry *entry, void *data), void *data);
+
+/* End of a file */
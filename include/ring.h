@@ -0,0 +1,122 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Requests through the shared ring, with their credits.
+ * The client publishes requests to the ring, ACKs come back through its connection.
+ * The server drains the ring into the inbox of the connection.
+ * Connections and the main loop are of the caller.
+ */
+struct message;
+struct shortcut_queue_stats;
+
+/*
+ * Client, one ring for a process.
+ * The ring is created first, its fds are passed to the server by the handshake.
+ */
+extern int ring_client_create(int size, int *fd, int *event_fd);
+
+/*
+ * After the handshake, conn_fd is of the connection of ACKs (for traces).
+ * credits is -1 if the server doesn't limit requests.
+ */
+extern int ring_client_start(int conn_fd, int credits);
+
+/*
+ * Returns -EAGAIN if the ring is full, the request should be sent through a new connection.
+ * If the server limits requests by credits, the request is queued here instead,
+ * and -EBUSY is returned if the queue is full.
+ * data is given back by the ring_client_ack or the ring_client_take.
+ */
+extern int ring_client_send(const struct message *msg, void *data);
+
+/*
+ * Returns data of the request which is acknowledged, or NULL if it is not waiting its ACK.
+ * Credits of the ACK are returned to the ring.
+ */
+extern void *ring_client_ack(unsigned int seq, int credits);
+
+/*
+ * Publish queued requests in order, while there are credits and a space of the ring.
+ */
+extern void ring_client_publish(void);
+
+/*
+ * Destroy the ring. Requests which are left are taken by the ring_client_take.
+ */
+extern void ring_client_close(void);
+
+/*
+ * Returns data of a request which is left (waiting its ACK first, then queued ones), or NULL.
+ */
+extern void *ring_client_take(unsigned int *seq);
+
+extern void ring_client_stats(struct shortcut_queue_stats *stats);
+
+/*
+ * Server, one for each connection which has a ring.
+ * fds are taken if it succeeds.
+ * If credit is not 0, requests which can be outstanding are limited by the window.
+ */
+struct ring_server;
+extern int ring_server_attach(struct ring_server **server, int fd, int event_fd, int credit);
+extern void ring_server_detach(struct ring_server *server);
+
+/*
+ * fds to pass the ring to another process, they are kept by the server.
+ */
+extern void ring_server_fds(struct ring_server *server, int *fd, int *event_fd);
+
+/*
+ * Copy records to the deliver, until the ring is empty.
+ * deliver returns 1 if it is full, draining is paused then (records are kept in the ring).
+ * It is also paused while requests exceed the window.
+ */
+extern int ring_server_drain(struct ring_server *server, int (*deliver)(const char *record, int size, void *data), void *data);
+
+/*
+ * Drain the paused ring again, if the backlog (bytes) has room and the client has credits.
+ */
+extern int ring_server_resume(struct ring_server *server, int backlog, int (*deliver)(const char *record, int size, void *data), void *data);
+
+/*
+ * Size of the data of the ring, the backlog should be bounded by it.
+ */
+extern int ring_server_size(struct ring_server *server);
+
+/*
+ * A request of the ring is acknowledged.
+ * Returns 1 if its credit should be returned with the ACK.
+ */
+extern int ring_server_ack(struct ring_server *server);
+
+/*
+ * Requests which are passed by the predecessor, they hold credits.
+ */
+extern void ring_server_hold(struct ring_server *server, int outstanding);
+
+/*
+ * 0 if requests are not limited.
+ */
+extern int ring_server_window(struct ring_server *server);
+extern int ring_server_outstanding(struct ring_server *server);
+
+/*
+ * Most outstanding requests of a ring, since the start.
+ */
+extern int ring_server_max_outstanding(void);
+
+/* End of a file */
@@ -14,11 +14,23 @@
  * limitations under the License.
  */
 
+/*
+ * Maximum number of fds which can be passed with a message
+ */
+#define SECOM_MAX_FDS 8
+
+struct iovec;
+
 /*
  * Create client connection
  */
 extern int secom_create_client(const char *peer);
 
+/*
+ * Create non-blocking client connection, errno is EAGAIN if the backlog of the server is full
+ */
+extern int secom_create_client_nonblock(const char *peer);
+
 /*
  * Create server connection
  */
@@ -35,11 +47,38 @@ extern int secom_put_connection_handle(int conn_handle);
  */
 extern int secom_send(int conn, const char *buffer, int size);
 
+/*
+ * Send data with fds (SCM_RIGHTS), fds are attached to the first byte of the data.
+ */
+extern int secom_send_fds(int conn, const char *buffer, int size, const int *fds, int nr_fds);
+
 /*
  * Recv data from the connected peer. and its PID value
  */
 extern int secom_recv(int conn, char *buffer, int size, int *sender_pid);
 
+/*
+ * Recv data, its PID value and the passed fds.
+ * nr_fds is the capacity of fds, and it is updated to the number of received fds.
+ * Received fds have the FD_CLOEXEC, fds over the capacity are closed.
+ */
+extern int secom_recv_fds(int conn, char *buffer, int size, int *sender_pid, int *fds, int *nr_fds);
+
+/*
+ * Send data without blocking, for streams which are not answered.
+ */
+extern int secom_sendv(int conn, const struct iovec *iov, int count);
+
+/*
+ * Size of data in the receive queue.
+ */
+extern int secom_pending(int conn);
+
+/*
+ * pid and uid of the connected peer.
+ */
+extern int secom_peer_credentials(int conn, int *pid, int *uid);
+
 /*
  * Destroy a connection
  */
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Single-producer/single-consumer ring of packets in a shared memfd.
+ * The producer creates the ring and passes its memfd and eventfd to the consumer.
+ * The eventfd is written only if the consumer is idle.
+ */
+struct shm_ring_header;
+
+struct shm_ring {
+	struct shm_ring_header *header;
+	char *data;
+	unsigned int size; /* Of the data, power of 2 */
+	unsigned int pos; /* Local copy of the position of this side */
+	int map_size;
+	int fd; /* memfd, -1 after it is passed */
+	int event_fd;
+};
+
+/*
+ * Producer, size is rounded up to a power of 2.
+ */
+extern int shm_ring_create(struct shm_ring *ring, int size);
+
+/*
+ * Consumer, the ring takes fds if it succeeds.
+ */
+extern int shm_ring_attach(struct shm_ring *ring, int fd, int event_fd);
+
+extern void shm_ring_destroy(struct shm_ring *ring);
+
+/*
+ * Producer, returns a contiguous space for a record, or NULL if the ring is full.
+ * The record is published by the shm_ring_commit.
+ */
+extern char *shm_ring_reserve(struct shm_ring *ring, int size);
+extern int shm_ring_commit(struct shm_ring *ring, int size);
+
+/*
+ * Consumer, returns the next record or NULL if the ring is empty, -EINVAL in *size if the ring is broken.
+ * The record is valid until the shm_ring_consume.
+ */
+extern const char *shm_ring_peek(struct shm_ring *ring, int *size);
+extern void shm_ring_consume(struct shm_ring *ring, int size);
+
+/*
+ * Consumer, clear the eventfd and mark this idle.
+ * Returns -EAGAIN if records are published meanwhile, the consumer should drain them again.
+ */
+extern int shm_ring_wait(struct shm_ring *ring);
+
+/* End of a file */
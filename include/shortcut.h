@@ -68,6 +68,81 @@ typedef int (*request_cb_t)(const char *pkgname, const char *name, int type, con
  */
 typedef int (*result_cb_t)(int ret, int pid, void *data);
 
+/**
+ * @brief This function prototype is used to define a callback function for the update reqeust.
+ *        Only the fields which are specified by the mask are changed.
+ * @param[in] pkgname Package name of the shortcut.
+ * @param[in] name Name of the shortcut.
+ * @param[in] mask Changed fields, combination of SHORTCUT_UPDATE_XXX.
+ * @param[in] new_name New name, valid if SHORTCUT_UPDATE_NAME is set.
+ * @param[in] type New type, valid if SHORTCUT_UPDATE_TYPE is set.
+ * @param[in] content_info New content info, valid if SHORTCUT_UPDATE_CONTENT_INFO is set.
+ * @param[in] icon New icon, valid if SHORTCUT_UPDATE_ICON is set.
+ * @param[in] pid Process ID of who request the update.
+ * @param[in] data Callback data.
+ * @return int Returns 0, if succeed to update the shortcut, or returns proper errno.
+ * @see shortcut_set_update_cb
+ * @pre None
+ * @post None
+ * @remarks None
+ */
+typedef int (*update_cb_t)(const char *pkgname, const char *name, int mask, const char *new_name, int type, const char *content_info, const char *icon, int pid, void *data);
+
+/**
+ * @brief This function prototype is used to define a callback function for the remove reqeust.
+ * @param[in] pkgname Package name of the shortcut.
+ * @param[in] name Name of the shortcut.
+ * @param[in] pid Process ID of who request the remove.
+ * @param[in] data Callback data.
+ * @return int Returns 0, if succeed to remove the shortcut, or returns proper errno.
+ * @see shortcut_set_remove_cb
+ * @pre None
+ * @post None
+ * @remarks None
+ */
+typedef int (*remove_cb_t)(const char *pkgname, const char *name, int pid, void *data);
+
+/**
+ * @brief This function prototype is used to define a callback function for iterating the registry.
+ * @param[in] pkgname Package name of the registered shortcut.
+ * @param[in] name Name of the registered shortcut.
+ * @param[in] type Type of the registered shortcut.
+ * @param[in] content_info Specific information of the registered shortcut.
+ * @param[in] icon Absolute path of an icon file for this shortcut.
+ * @param[in] data Callback data.
+ * @return int Returns negative value to stop the iteration, or 0 to continue.
+ * @see shortcut_registry_foreach()
+ * @pre None
+ * @post None
+ * @remarks Every string is pointing the mapped registry, it is only valid in the callback.
+ */
+typedef int (*shortcut_registry_cb_t)(const char *pkgname, const char *name, int type, const char *content_info, const char *icon, void *data);
+
+/**
+ * @brief This function prototype is used to define a loader of the icon cache.
+ * @param[in] icon Path of an icon file.
+ * @param[out] size Memory size of the loaded icon, used for the limit of the cache.
+ * @param[in] data Callback data.
+ * @return void* Handle of the decoded (and scaled) icon, or NULL if it fails.
+ * @see shortcut_icon_cache_enable()
+ * @pre None
+ * @post None
+ * @remarks This is invoked on the loader thread, not in the main loop.
+ */
+typedef void *(*shortcut_icon_load_cb_t)(const char *icon, int *size, void *data);
+
+/**
+ * @brief This function prototype is used to define a function to release a loaded icon.
+ * @param[in] handle Handle which is returned by the loader.
+ * @param[in] data Callback data.
+ * @return None
+ * @see shortcut_icon_cache_enable()
+ * @pre None
+ * @post None
+ * @remarks This can be invoked on the loader thread.
+ */
+typedef void (*shortcut_icon_unload_cb_t)(void *handle, void *data);
+
 /**
  * @brief Basically, three types of shortcut is defined.
  *        Every homescreen developer should support these types of shortcut.
@@ -82,6 +157,207 @@ enum {
 	SHORTCUT_FILE = 0x02, /** < Launch the related package with given filename(content_info). */
 };
 
+/**
+ * @brief This function prototype is used to define a callback function which is invoked after the server is handed over.
+ * @param[in] data Callback data.
+ * @return None
+ * @see shortcut_set_handover_cb()
+ * @pre None
+ * @post None
+ * @remarks The homescreen can be terminated in this callback, its successor serves clients.
+ */
+typedef void (*shortcut_handover_cb_t)(void *data);
+
+/**
+ * @brief Identity of the process which sent the request.
+ */
+struct shortcut_identity {
+	int pid; /**< Process ID of the caller */
+	int uid; /**< User ID of the caller, -1 if it is unknown */
+	const char *appid; /**< Resolved application ID, NULL if it is unknown */
+	const char *pkgname; /**< Resolved package name, NULL if it is unknown */
+	int verified; /**< 1 if the pkgname of the request is the resolved package or application of the caller */
+};
+
+/**
+ * @brief This function prototype is used to define a callback function which resolves the identity of a process.
+ * @param[in] pid Process ID.
+ * @param[out] appid Buffer for the application ID, empty string if it is unknown.
+ * @param[in] appid_size Size of the appid buffer.
+ * @param[out] pkgname Buffer for the package name, empty string if it is unknown.
+ * @param[in] pkgname_size Size of the pkgname buffer.
+ * @param[in] data Callback data.
+ * @return int Returns 0 if it is resolved, or negative errno.
+ * @see shortcut_set_identity_resolver()
+ * @pre None
+ * @post None
+ * @remarks Result is cached until the process exits.
+ */
+typedef int (*shortcut_identity_resolve_cb_t)(int pid, char *appid, int appid_size, char *pkgname, int pkgname_size, void *data);
+
+/**
+ * @brief Resolved target of a SHORTCUT_FILE or SHORTCUT_DATA request.
+ */
+struct shortcut_target {
+	const char *path; /**< Path of the file, NULL if the content_info is not a file */
+	const char *mime; /**< Sniffed MIME type of the file, or x-scheme-handler/<scheme> of an URI */
+	const char *appid; /**< Application which handles the target, NULL if it is not resolved */
+	long long size; /**< Size of the file */
+	long long mtime; /**< Modification time of the file, in seconds */
+};
+
+/**
+ * @brief This function prototype is used to define a callback function which finds the application for a target.
+ * @param[in] target Path of the file, or "<scheme>:" of an URI.
+ * @param[in] mime MIME type of the target.
+ * @param[out] appid Buffer for the application ID.
+ * @param[in] appid_size Size of the appid buffer.
+ * @param[in] data Callback data.
+ * @return int Returns 0 if it is resolved, or negative errno.
+ * @see shortcut_prefetch_enable()
+ * @pre None
+ * @post None
+ * @remarks It is invoked on a worker thread, not in the main loop.
+ */
+typedef int (*shortcut_target_resolve_cb_t)(const char *target, const char *mime, char *appid, int appid_size, void *data);
+
+/**
+ * @brief Field of a request, it is terminated by NUL.
+ */
+struct shortcut_field {
+	const char *ptr; /**< NULL if it is not given */
+	int len; /**< Length without the NUL */
+};
+
+/**
+ * @brief Flags of a request.
+ */
+enum {
+	SHORTCUT_REQUEST_CONTENT_FD = 0x01, /**< content_info is mapped from the memory which is passed by the application */
+	SHORTCUT_REQUEST_ICON_FD = 0x02, /**< icon is a path of the fd which is passed by the application */
+	SHORTCUT_REQUEST_REPLAYED = 0x04, /**< Request is replayed from the journal or the spool, its application is not connected */
+};
+
+/**
+ * @brief View of an add_to_home request, it is valid only in the callback.
+ */
+struct shortcut_request_view {
+	unsigned int seq; /**< Sequence number of the request in its connection */
+	int type; /**< Type of the shortcut */
+	unsigned int flags; /**< SHORTCUT_REQUEST_XXX */
+	int priority; /**< SHORTCUT_PRIORITY_XXX */
+	struct shortcut_field pkgname;
+	struct shortcut_field name;
+	struct shortcut_field content_info;
+	struct shortcut_field icon;
+	const struct shortcut_identity *caller; /**< pid, uid and the resolved identity of the application */
+	unsigned long long received; /**< CLOCK_MONOTONIC in ms, when the request is received */
+	unsigned long long dispatched; /**< CLOCK_MONOTONIC in ms, when the callback is invoked */
+	unsigned long long deadline; /**< CLOCK_MONOTONIC in ms, 0 if the request has no deadline */
+	const struct shortcut_target *target; /**< Prefetched target, NULL if it is not resolved */
+};
+
+/**
+ * @brief This function prototype is used to define a callback function for the add_to_home request, with lengths of fields and metadata.
+ * @param[in] view Request, it is valid only in the callback.
+ * @param[in] data Callback data.
+ * @return int Returns 0, if succeed to handles the add_to_home request, or returns proper errno.
+ * @see shortcut_set_request_cb_ex
+ * @pre None
+ * @post None
+ * @remarks Fields are not copied, the callback should copy them to keep.
+ */
+typedef int (*request_ex_cb_t)(const struct shortcut_request_view *view, void *data);
+
+/**
+ * @brief Fields which can be changed by the shortcut_update.
+ */
+enum {
+	SHORTCUT_UPDATE_NAME = 0x01, /**< Rename the shortcut */
+	SHORTCUT_UPDATE_TYPE = 0x02, /**< Change the type of the shortcut */
+	SHORTCUT_UPDATE_CONTENT_INFO = 0x04, /**< Change the content_info */
+	SHORTCUT_UPDATE_ICON = 0x08, /**< Change the icon */
+};
+
+/**
+ * @brief Kinds of events of the subscription.
+ */
+enum {
+	SHORTCUT_EVENT_ADD = 0x0, /**< Shortcut is added, or replaced */
+	SHORTCUT_EVENT_UPDATE = 0x1, /**< Fields in the mask are changed */
+	SHORTCUT_EVENT_REMOVE = 0x2, /**< Shortcut is removed */
+	SHORTCUT_EVENT_OVERFLOW = 0x3, /**< Events are dropped, the subscriber was too slow. Query the registry again */
+	SHORTCUT_EVENT_CLOSED = 0x4, /**< Homescreen is gone, the subscription is finished */
+};
+
+/**
+ * @brief Change of a shortcut which is accepted by the homescreen, it is valid only in the callback.
+ */
+struct shortcut_event {
+	int event; /**< SHORTCUT_EVENT_XXX */
+	unsigned int seq; /**< Sequence number of the event, events which are superseded in a batch are skipped */
+	const char *pkgname;
+	const char *name;
+	int type; /**< ADD, or UPDATE with SHORTCUT_UPDATE_TYPE */
+	const char *content_info; /**< ADD, or UPDATE with SHORTCUT_UPDATE_CONTENT_INFO */
+	const char *icon; /**< ADD, or UPDATE with SHORTCUT_UPDATE_ICON */
+	int mask; /**< SHORTCUT_UPDATE_XXX, for UPDATE */
+	const char *new_name; /**< UPDATE with SHORTCUT_UPDATE_NAME */
+};
+
+/**
+ * @brief This function prototype is used to define a callback function for events of the subscription.
+ * @param[in] event Event, it is valid only in the callback.
+ * @param[in] data Callback data.
+ * @return int Ignored.
+ * @see shortcut_subscribe
+ * @pre None
+ * @post None
+ * @remarks None
+ */
+typedef int (*shortcut_event_cb_t)(const struct shortcut_event *event, void *data);
+
+/**
+ * @brief Cost of the homescreen which is charged to a client, for finding expensive clients.
+ */
+struct shortcut_client_cost {
+	int pid;
+	int uid;
+	unsigned long long bytes; /**< Received from the client */
+	unsigned long long requests; /**< Decoded packets */
+	unsigned long long decode_ns; /**< Time for decoding its packets */
+	unsigned long long callback_ns; /**< Time in request_cb, update_cb and remove_cb for its requests */
+};
+
+/**
+ * @brief Depth of request queues, for monitoring.
+ */
+struct shortcut_queue_stats {
+	int connections; /**< Rings which are limited by credits */
+	int window; /**< Requests which can be outstanding, for a ring */
+	int outstanding; /**< Requests which are sent, and not acknowledged yet */
+	int queued; /**< Requests which wait to be sent (client), or dispatched (homescreen) */
+	int queued_bytes; /**< Size of queued requests */
+	int max_queued; /**< Deepest queue since the start */
+};
+
+/**
+ * @brief Priority classes of requests, the homescreen dispatches requests of higher class first.
+ */
+enum {
+	SHORTCUT_PRIORITY_NORMAL = 0x0, /**< Default */
+	SHORTCUT_PRIORITY_INTERACTIVE = 0x1, /**< Requested by the user, who is waiting the result */
+	SHORTCUT_PRIORITY_BULK = 0x2, /**< Importing, synchronizing, ... */
+};
+
+/**
+ * @brief Transports of requests.
+ */
+enum {
+	SHORTCUT_TRANSPORT_UNIX = 0x0, /**< Default, a unix domain socket of the system */
+	SHORTCUT_TRANSPORT_LOOPBACK = 0x1, /**< Queues in this process, the homescreen and the application are in the same process */
+};
+
 /**
  * @fn int shortcut_set_request_cb(request_cb_t request_cb, void *data)
  *
@@ -107,7 +383,7 @@ enum {
  *
  * @post - If a request is sent from the application, the registered callback will be invoked.
  *
- * @remarks - None
+ * @remarks - The listening socket is taken from the socket activation (LISTEN_FDS), or from the running homescreen which waits a successor.
  *
  * @par Prospective Clients:
  * Homescreen
@@ -143,6 +419,35 @@ enum {
  */
 extern int shortcut_set_request_cb(request_cb_t request_cb, void *data);
 
+/**
+ * @fn int shortcut_set_request_cb_ex(request_ex_cb_t request_ex_cb, void *data)
+ *
+ * @brief Same as the shortcut_set_request_cb, but the callback gets lengths of fields and metadata of the request.
+ *
+ * @par Sync (or) Async:
+ * This is an asynchronous API.
+ *
+ * @param[in] request_ex_cb Callback function pointer which will be invoked when add_to_home is requested, NULL to use the request_cb again.
+ * @param[in] data Callback data to deliver to the callback function.
+ *
+ * @return Return Type (int)
+ * - 0 - callback function is successfully registered
+ * - < 0 - Failed to register the callback function for request.
+ *
+ * @see request_ex_cb_t
+ * @see shortcut_set_request_cb()
+ *
+ * @pre - None
+ *
+ * @post - If a request is sent from the application, the registered callback will be invoked instead of the request_cb.
+ *
+ * @remarks - Fields of the view are pointing the received packet, they don't need the strlen.
+ *
+ * @par Prospective Clients:
+ * Homescreen
+ */
+extern int shortcut_set_request_cb_ex(request_ex_cb_t request_ex_cb, void *data);
+
 /**
  * @fn int shortcut_add_to_home(const char *pkgname, const char *name, int type, const char *content_info, const char *icon, result_cb_t result_cb, void *data)
  *
@@ -166,6 +471,7 @@ extern int shortcut_set_request_cb(request_cb_t request_cb, void *data);
  *
  * @return Return Type (int)
  * - 0 - Succeed to send the request
+ * - -EBUSY - The homescreen is behind, and the queue of the ring is full. Try again after results arrive
  * - <0 - Failed to send the request
  *
  * @see result_cb_t
@@ -175,6 +481,9 @@ extern int shortcut_set_request_cb(request_cb_t request_cb, void *data);
  * @post - You have to check the return status from callback function which is passed by argument.
  *
  * @remarks - If a homescreen does not support this feature, you will get proper error code.
+ * @remarks - If the homescreen is not running, the request is spooled and delivered when it starts, the result_cb is invoked after that.
+ * @remarks - If the result_cb is NULL, and the homescreen is known to support it, the request is sent without waiting its result.
+ * The connection is closed right after the send, and the homescreen doesn't reply.
  *
  * @par Prospective Clients:
  * Inhouse Apps.
@@ -211,6 +520,1061 @@ extern int shortcut_set_request_cb(request_cb_t request_cb, void *data);
  */
 extern int shortcut_add_to_home(const char *pkgname, const char *name, int type, const char *content_info, const char *icon, result_cb_t result_cb, void *data);
 
+/**
+ * @fn int shortcut_add_to_home_n(const struct shortcut_field *pkgname, const struct shortcut_field *name, int type, const struct shortcut_field *content_info, const struct shortcut_field *icon, result_cb_t result_cb, void *data)
+ *
+ * @brief Same as the shortcut_add_to_home, but fields are given with their lengths.
+ *
+ * @par Sync (or) Async:
+ * This is an asynchronous API.
+ *
+ * @param[in] pkgname Package name of the owner of this shortcut.
+ * @param[in] name Name for created shortcut icon.
+ * @param[in] type 3 kinds of types are defined.
+ * @param[in] content_info Specific information for delivering to the homescreen.
+ * @param[in] icon Absolute path of an icon file.
+ * @param[in] result_cb Callback function to get the result.
+ * @param[in] data Callback data which will be used in callback function.
+ *
+ * @return Return Type (int)
+ * - 0 - Succeed to send the request
+ * - -EINVAL - Length of a field is negative
+ * - Others - Same as the shortcut_add_to_home
+ *
+ * @see shortcut_add_to_home()
+ *
+ * @pre - None
+ *
+ * @post - None
+ *
+ * @remarks - Fields don't need to be terminated by NUL, they are copied into the packet once. NULL or a field whose ptr is NULL is not given.
+ *
+ * @par Prospective Clients:
+ * Inhouse Apps, C++ wrappers (shortcut.hpp).
+ */
+extern int shortcut_add_to_home_n(const struct shortcut_field *pkgname, const struct shortcut_field *name, int type, const struct shortcut_field *content_info, const struct shortcut_field *icon, result_cb_t result_cb, void *data);
+
+/**
+ * @fn int shortcut_set_handover_cb(shortcut_handover_cb_t handover_cb, void *data)
+ *
+ * @brief Let a successor take the server over, without dropping any request.
+ *
+ * @par Sync (or) Async:
+ * This is an asynchronous API.
+ *
+ * @param[in] handover_cb Callback function pointer which will be invoked after a successor takes the server, NULL to refuse successors.
+ * @param[in] data Callback data to deliver to the callback function.
+ *
+ * @return Return Type (int)
+ * - 0 - Succeed to wait a successor
+ * - <0 - Failed to wait a successor
+ *
+ * @see shortcut_set_request_cb()
+ *
+ * @pre - None
+ *
+ * @post - When a new homescreen of the same user invokes shortcut_set_request_cb(), it takes the listening socket and every connection of this.
+ *
+ * @remarks - Requests which are received but not dispatched yet are dispatched by the successor, this doesn't invoke callbacks for them.
+ * @remarks - A connection which holds too many file descriptors is kept, this still serves it after the handover.
+ * @remarks - If the homescreen is started by the socket activation (LISTEN_FDS), the passed socket is used instead of creating a new one.
+ *
+ * @par Prospective Clients:
+ * Homescreen.
+ */
+extern int shortcut_set_handover_cb(shortcut_handover_cb_t handover_cb, void *data);
+
+/**
+ * @fn int shortcut_set_update_cb(update_cb_t update_cb, void *data)
+ *
+ * @brief Homescreen should use this function to service the shortcut update request.
+ *
+ * @par Sync (or) Async:
+ * This is an asynchronous API.
+ *
+ * @par Important Notes:
+ * - Should be used from the homescreen.
+ * - If it is not set, the update request gets -ENOSYS.
+ *
+ * @param[in] update_cb Callback function pointer which will be invoked when an update is requested.
+ * @param[in] data Callback data to deliver to the callback function.
+ *
+ * @return Return Type (int)
+ * - 0 - callback function is successfully registered
+ *
+ * @see update_cb_t
+ *
+ * @pre - shortcut_set_request_cb() should be called to start the service.
+ *
+ * @post - None
+ *
+ * @remarks - None
+ *
+ * @par Prospective Clients:
+ * Homescreen
+ */
+extern int shortcut_set_update_cb(update_cb_t update_cb, void *data);
+
+/**
+ * @fn int shortcut_set_remove_cb(remove_cb_t remove_cb, void *data)
+ *
+ * @brief Homescreen should use this function to service the shortcut remove request.
+ *
+ * @par Sync (or) Async:
+ * This is an asynchronous API.
+ *
+ * @par Important Notes:
+ * - Should be used from the homescreen.
+ * - If it is not set, the remove request gets -ENOSYS.
+ *
+ * @param[in] remove_cb Callback function pointer which will be invoked when a remove is requested.
+ * @param[in] data Callback data to deliver to the callback function.
+ *
+ * @return Return Type (int)
+ * - 0 - callback function is successfully registered
+ *
+ * @see remove_cb_t
+ *
+ * @pre - shortcut_set_request_cb() should be called to start the service.
+ *
+ * @post - None
+ *
+ * @remarks - None
+ *
+ * @par Prospective Clients:
+ * Homescreen
+ */
+extern int shortcut_set_remove_cb(remove_cb_t remove_cb, void *data);
+
+/**
+ * @fn int shortcut_registry_enable(const char *path)
+ *
+ * @brief Homescreen can use this function to keep the accepted shortcuts in a persistent registry.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @par Important Notes:
+ * - Should be used from the homescreen.
+ * - Every request which is succeeded (request_cb returns 0) is recorded, same (pkgname, name) is replaced.
+ * - Registry file is mapped to memory, so the homescreen can iterate it without parsing at its cold start.
+ *
+ * @param[in] path Absolute path of the registry file. It will be created if it doesn't exist.
+ *
+ * @return Return Type (int)
+ * - 0 - Registry is ready
+ * - < 0 - Failed to open the registry
+ *
+ * @see shortcut_registry_foreach()
+ *
+ * @pre - None
+ *
+ * @post - None
+ *
+ * @remarks - Replaced or removed records are reclaimed by the compaction in background.
+ *
+ * @par Prospective Clients:
+ * Homescreen
+ */
+extern int shortcut_registry_enable(const char *path);
+
+/**
+ * @fn int shortcut_registry_foreach(shortcut_registry_cb_t cb, void *data)
+ *
+ * @brief Iterate the registered shortcuts in the order of registration.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @par Important Notes:
+ * - Callback should not modify the registry.
+ *
+ * @param[in] cb Callback function which will be invoked for each registered shortcut.
+ * @param[in] data Callback data to deliver to the callback function.
+ *
+ * @return Return Type (int)
+ * - >= 0 - Number of visited shortcuts
+ * - < 0 - Registry is not enabled
+ *
+ * @see shortcut_registry_enable()
+ *
+ * @pre - shortcut_registry_enable() should be called first.
+ *
+ * @post - None
+ *
+ * @remarks - None
+ *
+ * @par Prospective Clients:
+ * Homescreen
+ */
+extern int shortcut_registry_foreach(shortcut_registry_cb_t cb, void *data);
+
+/**
+ * @fn int shortcut_registry_remove(const char *pkgname, const char *name)
+ *
+ * @brief Remove a shortcut from the registry, if the homescreen deletes it.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[in] pkgname Package name of the shortcut.
+ * @param[in] name Name of the shortcut.
+ *
+ * @return Return Type (int)
+ * - 0 - Succeed to remove
+ * - -ENOENT - There is no such shortcut
+ * - < 0 - Registry is not enabled
+ *
+ * @see shortcut_registry_enable()
+ *
+ * @pre - shortcut_registry_enable() should be called first.
+ *
+ * @post - None
+ *
+ * @remarks - None
+ *
+ * @par Prospective Clients:
+ * Homescreen
+ */
+extern int shortcut_registry_remove(const char *pkgname, const char *name);
+
+/**
+ * @fn int shortcut_exists(const char *pkgname, const char *name)
+ *
+ * @brief Check whether a shortcut is already added, without sending the add_to_home request.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @par Important Notes:
+ * - The homescreen answers this from its registry, its request callback is not invoked.
+ *
+ * @param[in] pkgname Package name of owner of the shortcut.
+ * @param[in] name Name of the shortcut.
+ *
+ * @return Return Type (int)
+ * - 1 - Shortcut exists
+ * - 0 - Shortcut doesn't exist
+ * - -EACCES - The package is not of the caller
+ * - -ECONNABORTED - The homescreen doesn't support queries, or it doesn't answer in 3 seconds
+ * - < 0 - Failed to query
+ *
+ * @see shortcut_list_by_pkgname()
+ *
+ * @pre - None
+ *
+ * @post - None
+ *
+ * @remarks - The caller is blocked until the homescreen answers, each wait for its reply is limited to 3 seconds.
+ * @remarks - A process of another user than the homescreen can only query its own package.
+ *
+ * @par Prospective Clients:
+ * Inhouse Apps.
+ */
+extern int shortcut_exists(const char *pkgname, const char *name);
+
+/**
+ * @fn int shortcut_list_by_pkgname(const char *pkgname, shortcut_registry_cb_t cb, void *data)
+ *
+ * @brief Get the list of added shortcuts of a package.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @par Important Notes:
+ * - The homescreen answers this from its registry, its request callback is not invoked.
+ * - Shortcuts are listed from the newest one.
+ *
+ * @param[in] pkgname Package name of owner of shortcuts.
+ * @param[in] cb Callback function which will be invoked for each shortcut, returns negative value to stop.
+ * @param[in] data Callback data to deliver to the callback function.
+ *
+ * @return Return Type (int)
+ * - >= 0 - Number of shortcuts of the package
+ * - -EACCES - The package is not of the caller
+ * - -ECONNABORTED - The homescreen doesn't support queries, or it doesn't answer in 3 seconds
+ * - < 0 - Failed to query
+ *
+ * @see shortcut_foreach()
+ *
+ * @pre - None
+ *
+ * @post - None
+ *
+ * @remarks - The caller is blocked until the homescreen answers, each wait for its reply is limited to 3 seconds.
+ * @remarks - A process of another user than the homescreen can only query its own package.
+ *
+ * @par Prospective Clients:
+ * Inhouse Apps.
+ */
+extern int shortcut_list_by_pkgname(const char *pkgname, shortcut_registry_cb_t cb, void *data);
+
+/**
+ * @fn int shortcut_foreach(shortcut_registry_cb_t cb, void *data)
+ *
+ * @brief Iterate every added shortcut, in the order of registration.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[in] cb Callback function which will be invoked for each shortcut, returns negative value to stop.
+ * @param[in] data Callback data to deliver to the callback function.
+ *
+ * @return Return Type (int)
+ * - >= 0 - Number of shortcuts
+ * - -EACCES - The caller is not of the same user as the homescreen
+ * - -ECONNABORTED - The homescreen doesn't support queries, or it doesn't answer in 3 seconds
+ * - < 0 - Failed to query
+ *
+ * @see shortcut_list_by_pkgname()
+ *
+ * @pre - None
+ *
+ * @post - None
+ *
+ * @remarks - The caller is blocked until the homescreen answers, each wait for its reply is limited to 3 seconds.
+ * @remarks - Every package is listed, so it is only for processes of the same user as the homescreen, or the system.
+ *
+ * @par Prospective Clients:
+ * Inhouse Apps.
+ */
+extern int shortcut_foreach(shortcut_registry_cb_t cb, void *data);
+
+/**
+ * @fn int shortcut_update(const char *pkgname, const char *name, int mask, const char *new_name, int type, const char *content_info, const char *icon, result_cb_t result_cb, void *data)
+ *
+ * @brief Change some fields of an added shortcut, only the changed fields are sent.
+ *
+ * @par Sync (or) Async:
+ * This is an asynchronous API.
+ *
+ * @param[in] pkgname Package name of owner of the shortcut.
+ * @param[in] name Name of the shortcut.
+ * @param[in] mask Fields to change, combination of SHORTCUT_UPDATE_XXX.
+ * @param[in] new_name New name, used if SHORTCUT_UPDATE_NAME is set.
+ * @param[in] type New type, used if SHORTCUT_UPDATE_TYPE is set.
+ * @param[in] content_info New content info, used if SHORTCUT_UPDATE_CONTENT_INFO is set.
+ * @param[in] icon New icon, used if SHORTCUT_UPDATE_ICON is set.
+ * @param[in] result_cb Callback function pointer which will be invoked after the request.
+ * @param[in] data Callback data to deliver to the callback function.
+ *
+ * @return Return Type (int)
+ * - 0 - Succeed to send the request
+ * - -EINVAL - mask is empty
+ * - <0 - Failed to send the request
+ *
+ * @see shortcut_remove()
+ *
+ * @pre - None
+ *
+ * @post - You have to check the return status from callback function which is passed by argument.
+ *
+ * @remarks - If a homescreen does not support this, the result_cb gets -ENOSYS or -ECONNABORTED.
+ *
+ * @par Prospective Clients:
+ * Inhouse Apps.
+ */
+extern int shortcut_update(const char *pkgname, const char *name, int mask, const char *new_name, int type, const char *content_info, const char *icon, result_cb_t result_cb, void *data);
+
+/**
+ * @fn int shortcut_remove(const char *pkgname, const char *name, result_cb_t result_cb, void *data)
+ *
+ * @brief Remove an added shortcut.
+ *
+ * @par Sync (or) Async:
+ * This is an asynchronous API.
+ *
+ * @param[in] pkgname Package name of owner of the shortcut.
+ * @param[in] name Name of the shortcut.
+ * @param[in] result_cb Callback function pointer which will be invoked after the request.
+ * @param[in] data Callback data to deliver to the callback function.
+ *
+ * @return Return Type (int)
+ * - 0 - Succeed to send the request
+ * - <0 - Failed to send the request
+ *
+ * @see shortcut_update()
+ *
+ * @pre - None
+ *
+ * @post - You have to check the return status from callback function which is passed by argument.
+ *
+ * @remarks - If a homescreen does not support this, the result_cb gets -ENOSYS or -ECONNABORTED.
+ *
+ * @par Prospective Clients:
+ * Inhouse Apps.
+ */
+extern int shortcut_remove(const char *pkgname, const char *name, result_cb_t result_cb, void *data);
+
+/**
+ * @fn int shortcut_spool_count(void)
+ *
+ * @brief Get the number of requests which are spooled while the homescreen is not running.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @return Return Type (int)
+ * - >=0 - Number of spooled requests which are not delivered yet
+ *
+ * @see shortcut_add_to_home()
+ *
+ * @pre - None
+ *
+ * @post - None
+ *
+ * @remarks - Spooled requests are delivered when the homescreen invokes shortcut_set_request_cb().
+ * @remarks - Requests with file descriptors (shortcut_add_to_home_with_fd) are not spooled.
+ *
+ * @par Prospective Clients:
+ * Inhouse Apps, Homescreen.
+ */
+extern int shortcut_spool_count(void);
+
+/**
+ * @fn int shortcut_set_priority(int priority)
+ *
+ * @brief Set the priority class of following requests of this process.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[in] priority One of SHORTCUT_PRIORITY_XXX.
+ *
+ * @return Return Type (int)
+ * - 0 - Succeed to set
+ * - -EINVAL - Invalid priority
+ *
+ * @see shortcut_add_to_home()
+ *
+ * @pre - None
+ *
+ * @post - shortcut_add_to_home, shortcut_update and shortcut_remove send requests with this priority.
+ *
+ * @remarks - The homescreen shares the time fairly between processes, in proportion to their priorities.
+ * @remarks - SHORTCUT_PRIORITY_INTERACTIVE is regarded as SHORTCUT_PRIORITY_NORMAL, if the process is not of the same user as the homescreen.
+ *
+ * @par Prospective Clients:
+ * Inhouse Apps.
+ */
+extern int shortcut_set_priority(int priority);
+
+/**
+ * @fn int shortcut_set_transport(int transport)
+ *
+ * @brief Change the transport of requests of this process, to benchmark or test the protocol without the kernel.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[in] transport One of SHORTCUT_TRANSPORT_XXX.
+ *
+ * @return Return Type (int)
+ * - 0 - Succeed to set
+ * - -EINVAL - Invalid transport
+ * - -EBUSY - The server, a ring or a subscription is opened
+ *
+ * @see shortcut_set_request_cb()
+ *
+ * @pre - It should be called before the server is created, and before requests are sent.
+ *
+ * @post - The server and requests of this process use the transport.
+ *
+ * @remarks - Requests of the loopback are only delivered to the server in the same process, the caller is this process.
+ * @remarks - A synchronous query (e.g. shortcut_exists) waits the server, it can't be answered if the server runs in the same thread.
+ * @remarks - The server can't be handed over with the loopback.
+ *
+ * @par Prospective Clients:
+ * Benchmarks and tests.
+ */
+extern int shortcut_set_transport(int transport);
+
+/**
+ * @fn int shortcut_set_timeout(int timeout)
+ *
+ * @brief Set the time limit of following requests of this process.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[in] timeout Time limit in milliseconds, 0 for no limit.
+ *
+ * @return Return Type (int)
+ * - 0 - Succeed to set
+ * - -EINVAL - Invalid timeout
+ *
+ * @see shortcut_expired_count()
+ *
+ * @pre - None
+ *
+ * @post - If the result is not delivered in time, the result_cb gets -ETIMEDOUT.
+ *
+ * @remarks - The deadline is sent with the request, the homescreen drops it without invoking callbacks after the deadline.
+ * @remarks - An old homescreen doesn't know the deadline, but the result_cb still gets -ETIMEDOUT in time.
+ *
+ * @par Prospective Clients:
+ * Inhouse Apps.
+ */
+extern int shortcut_set_timeout(int timeout);
+
+/**
+ * @fn int shortcut_expired_count(void)
+ *
+ * @brief Get the number of requests which are dropped by the homescreen, because their deadline is passed.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @return Return Type (int)
+ * - >=0 - Number of expired requests since the homescreen started
+ *
+ * @see shortcut_set_timeout()
+ *
+ * @pre - None
+ *
+ * @post - None
+ *
+ * @remarks - None
+ *
+ * @par Prospective Clients:
+ * Homescreen.
+ */
+extern int shortcut_expired_count(void);
+
+/**
+ * @fn int shortcut_ring_open(int size)
+ *
+ * @brief Send following requests of this process through a ring in the shared memory, instead of a connection for each.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[in] size Size of the ring in bytes, it is rounded up to a power of 2 (4KB ~ 16MB).
+ *
+ * @return Return Type (int)
+ * - 0 - Ring is opened
+ * - -EALREADY - Ring is already opened
+ * - -ECONNREFUSED - Homescreen is not running
+ * - -ENOTSUP - Homescreen doesn't support the ring
+ * - -ENOSYS - This platform doesn't support the ring
+ *
+ * @see shortcut_ring_close()
+ *
+ * @pre - Homescreen is running.
+ *
+ * @post - shortcut_add_to_home, shortcut_update and shortcut_remove publish requests to the ring.
+ *
+ * @remarks - The homescreen is woken up only if it is idle, so a burst of requests costs one wakeup.
+ * @remarks - If the ring is full, or contents are passed as fds, the request is sent through its own connection as before.
+ * @remarks - Results are delivered in the order of requests. If the homescreen is gone, waiting requests get -ECONNABORTED and the ring is closed.
+ * @remarks - Deadlines of requests are checked by the homescreen, the timeout of this doesn't fire for requests in the ring.
+ * @remarks - The homescreen can limit outstanding requests by credits, which are returned with results.
+ * If credits are exhausted, requests are queued in this process (1024 requests, 1MB), and -EBUSY is returned if the queue is full.
+ *
+ * @par Prospective Clients:
+ * Services which send requests continuously, e.g. store and sync daemons.
+ */
+extern int shortcut_ring_open(int size);
+
+/**
+ * @fn int shortcut_ring_close(void)
+ *
+ * @brief Close the ring, following requests are sent through connections.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @return Return Type (int)
+ * - 0 - Ring is closed
+ * - -ENOENT - Ring is not opened
+ *
+ * @see shortcut_ring_open()
+ *
+ * @pre - None
+ *
+ * @post - Requests which are waiting their results get -ECANCELED.
+ *
+ * @remarks - None
+ *
+ * @par Prospective Clients:
+ * Services which send requests continuously.
+ */
+extern int shortcut_ring_close(void);
+
+/**
+ * @fn int shortcut_client_queue_stats(struct shortcut_queue_stats *stats)
+ *
+ * @brief Get the depth of the queue of the ring, which waits credits of the homescreen.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[out] stats Stats of the ring of this process.
+ *
+ * @return Return Type (int)
+ * - 0 - Succeed
+ * - -EINVAL - stats is NULL
+ *
+ * @see shortcut_ring_open()
+ * @see shortcut_server_queue_stats()
+ *
+ * @pre - None
+ *
+ * @post - None
+ *
+ * @remarks - connections is 0 if the ring is not opened, or the homescreen doesn't limit it. max_queued is kept after the ring is closed.
+ *
+ * @par Prospective Clients:
+ * Services which send requests continuously.
+ */
+extern int shortcut_client_queue_stats(struct shortcut_queue_stats *stats);
+
+/**
+ * @fn int shortcut_server_queue_stats(struct shortcut_queue_stats *stats)
+ *
+ * @brief Get the depth of queues of requests which are received from rings, summed over clients.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[out] stats Stats of rings of clients.
+ *
+ * @return Return Type (int)
+ * - 0 - Succeed
+ * - -EINVAL - stats is NULL
+ *
+ * @see shortcut_set_request_cb()
+ * @see shortcut_client_queue_stats()
+ *
+ * @pre - None
+ *
+ * @post - None
+ *
+ * @remarks - max_queued is the most outstanding requests of a client.
+ * @remarks - Requests which are kept in rings, because their clients exceed the window, are not counted.
+ *
+ * @par Prospective Clients:
+ * Homescreen.
+ */
+extern int shortcut_server_queue_stats(struct shortcut_queue_stats *stats);
+
+/**
+ * @fn int shortcut_server_cost_stats(struct shortcut_client_cost *costs, int count)
+ *
+ * @brief Get the most expensive clients, by the time which is spent for their requests.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[out] costs Array for clients, in the descending order of decode_ns + callback_ns.
+ * @param[in] count Size of the array.
+ *
+ * @return Return Type (int)
+ * - >=0 - Number of clients which are filled
+ * - -EINVAL - costs is NULL, or count is not positive
+ * - -ENOMEM - Out of memory
+ *
+ * @see shortcut_server_queue_stats()
+ *
+ * @pre - None
+ *
+ * @post - None
+ *
+ * @remarks - Costs are kept for 64 clients since the homescreen started. If it is full, the cheapest client is replaced by a new one.
+ * @remarks - Costs of a client are charged to its pid and uid, a reused pid of the same user continues the entry.
+ *
+ * @par Prospective Clients:
+ * Homescreen.
+ */
+extern int shortcut_server_cost_stats(struct shortcut_client_cost *costs, int count);
+
+/**
+ * @fn int shortcut_subscribe(shortcut_event_cb_t event_cb, void *data)
+ *
+ * @brief Receive changes of shortcuts which are accepted by the homescreen.
+ *
+ * @par Sync (or) Async:
+ * This is an asynchronous API.
+ *
+ * @param[in] event_cb Invoked for each event, in the main loop.
+ * @param[in] data Callback data.
+ *
+ * @return Return Type (int)
+ * - 0 - Subscribed
+ * - -EINVAL - event_cb is NULL
+ * - -EALREADY - This process already subscribes
+ * - -ECONNREFUSED - Homescreen is not running
+ * - -ENOTSUP - Homescreen doesn't support the subscription
+ *
+ * @see shortcut_unsubscribe()
+ *
+ * @pre - Homescreen is running.
+ *
+ * @post - Events are delivered after the request_cb, update_cb or remove_cb of the homescreen returns 0.
+ *
+ * @remarks - Events of a burst are sent in a batch through one connection, an ADD or REMOVE supersedes waiting events of the same shortcut.
+ * @remarks - If this doesn't read events for a long time, waiting events are dropped and SHORTCUT_EVENT_OVERFLOW is delivered.
+ * @remarks - If the homescreen is gone, SHORTCUT_EVENT_CLOSED is delivered and the subscription is finished.
+ *
+ * @par Prospective Clients:
+ * Widgets, lock screen and other views of shortcuts.
+ */
+extern int shortcut_subscribe(shortcut_event_cb_t event_cb, void *data);
+
+/**
+ * @fn int shortcut_unsubscribe(void)
+ *
+ * @brief Finish the subscription.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @return Return Type (int)
+ * - 0 - Unsubscribed
+ * - -ENOENT - This process doesn't subscribe
+ *
+ * @see shortcut_subscribe()
+ *
+ * @pre - None
+ *
+ * @post - event_cb is not invoked after this.
+ *
+ * @remarks - None
+ *
+ * @par Prospective Clients:
+ * Widgets, lock screen and other views of shortcuts.
+ */
+extern int shortcut_unsubscribe(void);
+
+/**
+ * @fn const struct shortcut_identity *shortcut_caller_identity(void)
+ *
+ * @brief Get the identity of the process which sent the request, in the request, update or remove callback.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @return Return Type (const struct shortcut_identity *)
+ * - Identity of the caller, it is only valid in the callback
+ * - NULL - Not in a callback
+ *
+ * @see shortcut_set_identity_resolver()
+ *
+ * @pre - None
+ *
+ * @post - None
+ *
+ * @remarks - The identity is resolved once for a connection, and cached by the pid and its start time until the process exits.
+ * @remarks - By default, the package is the SMACK label of the process or the directory of the installed application, and the application is the name of its executable.
+ * @remarks - For a request from the spool, the pid cannot be trusted. It is not resolved, and the caller is not verified. The uid is of the owner of the spooled file.
+ *
+ * @par Prospective Clients:
+ * Homescreen.
+ */
+extern const struct shortcut_identity *shortcut_caller_identity(void);
+
+/**
+ * @fn int shortcut_set_identity_resolver(shortcut_identity_resolve_cb_t resolve_cb, void *data)
+ *
+ * @brief Replace the resolver of identities, e.g. to query the package manager.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[in] resolve_cb Callback function pointer which resolves the identity of a process, NULL for the default one.
+ * @param[in] data Callback data to deliver to the callback function.
+ *
+ * @return Return Type (int)
+ * - 0 - Succeed to set
+ *
+ * @see shortcut_caller_identity()
+ *
+ * @pre - None
+ *
+ * @post - Cached identities are dropped.
+ *
+ * @remarks - The resolver is invoked once for a process, not for every request.
+ *
+ * @par Prospective Clients:
+ * Homescreen.
+ */
+extern int shortcut_set_identity_resolver(shortcut_identity_resolve_cb_t resolve_cb, void *data);
+
+/**
+ * @fn int shortcut_journal_enable(const char *path)
+ *
+ * @brief Write received requests to a journal before they are dispatched, and replay unfinished ones.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[in] path Path of the journal file.
+ *
+ * @return Return Type (int)
+ * - >=0 - Number of requests which are replayed
+ * - -EALREADY - Already enabled
+ * - <0 - Failed to enable
+ *
+ * @see shortcut_set_request_cb()
+ *
+ * @pre - Callbacks should be set before this, requests of the previous run are replayed to them.
+ *
+ * @post - None
+ *
+ * @remarks - Requests which are received in an iteration of the main loop are synced at once, and dispatched after it.
+ * @remarks - A replayed request is delivered with the pid of its original sender, there is no one to get the result.
+ * @remarks - A request can be replayed even if its callback has been invoked, if the homescreen is killed before the request is marked as done.
+ *
+ * @par Prospective Clients:
+ * Homescreen.
+ */
+extern int shortcut_journal_enable(const char *path);
+
+/**
+ * @fn int shortcut_icon_cache_enable(shortcut_icon_load_cb_t load_cb, shortcut_icon_unload_cb_t unload_cb, int max_size, void *data)
+ *
+ * @brief Load icons of requests on a thread and cache them, before the request_cb is invoked.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[in] load_cb Function to decode and scale an icon file.
+ * @param[in] unload_cb Function to release a loaded icon.
+ * @param[in] max_size Limit of the total size of cached icons.
+ * @param[in] data Callback data to deliver to the load_cb and unload_cb.
+ *
+ * @return Return Type (int)
+ * - 0 - Succeed to enable
+ * - -EINVAL - Invalid argument
+ * - -EALREADY - Already enabled
+ * - <0 - Failed to enable
+ *
+ * @see shortcut_icon_cache_get()
+ *
+ * @pre - None
+ *
+ * @post - Call the shortcut_icon_cache_get in the request_cb to get the loaded icon.
+ *
+ * @remarks - Icons are keyed by the file (device, inode, mtime and size), so modified files are loaded again.
+ * @remarks - The least recently used icons are released if the total size is over the max_size.
+ *
+ * @par Prospective Clients:
+ * Homescreen.
+ */
+extern int shortcut_icon_cache_enable(shortcut_icon_load_cb_t load_cb, shortcut_icon_unload_cb_t unload_cb, int max_size, void *data);
+
+/**
+ * @fn int shortcut_prefetch_enable(int workers, shortcut_target_resolve_cb_t resolve_cb, void *data)
+ *
+ * @brief Resolve targets of SHORTCUT_FILE and SHORTCUT_DATA requests on worker threads, before the request_cb is invoked.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[in] workers Number of worker threads, 1 to 8.
+ * @param[in] resolve_cb Callback function pointer which finds the application for a target, can be NULL.
+ * @param[in] data Callback data to deliver to the resolve_cb.
+ *
+ * @return Return Type (int)
+ * - 0 - Succeed to enable
+ * - -EINVAL - Invalid argument
+ * - -EALREADY - Already enabled
+ * - <0 - Failed to enable
+ *
+ * @see shortcut_request_target()
+ *
+ * @pre - None
+ *
+ * @post - Call the shortcut_request_target in the request_cb to get the resolved target.
+ *
+ * @remarks - A file is stat'ed and its MIME type is sniffed from its first bytes, other data is resolved by its URI scheme.
+ * @remarks - Targets are cached by the path, mtime and size of the file, so a modified file is resolved again.
+ * @remarks - Targets of following requests of a connection are prefetched while a request is dispatched.
+ * @remarks - Requests which are replayed from the journal or the spool are not deferred, their targets are given only if they are cached.
+ *
+ * @par Prospective Clients:
+ * Homescreen.
+ */
+extern int shortcut_prefetch_enable(int workers, shortcut_target_resolve_cb_t resolve_cb, void *data);
+
+/**
+ * @fn const struct shortcut_target *shortcut_request_target(void)
+ *
+ * @brief Get the resolved target of the request, in the request callback.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @return Return Type (const struct shortcut_target *)
+ * - Target of the request, it is only valid in the callback
+ * - NULL - Not in a request callback, or the target is not resolved
+ *
+ * @see shortcut_prefetch_enable()
+ *
+ * @pre - None
+ *
+ * @post - None
+ *
+ * @remarks - The request_cb_ex gets the same one in its view.
+ *
+ * @par Prospective Clients:
+ * Homescreen.
+ */
+extern const struct shortcut_target *shortcut_request_target(void);
+
+/**
+ * @fn int shortcut_parallel_enable(int workers)
+ *
+ * @brief Invoke the request callback on worker threads, requests of different packages are handled in parallel.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[in] workers Number of worker threads, 1 to 16.
+ *
+ * @return Return Type (int)
+ * - 0 - Succeed to enable
+ * - -EINVAL - Invalid argument
+ * - -EALREADY - Already enabled
+ * - <0 - Failed to enable
+ *
+ * @see shortcut_set_request_cb()
+ * @see shortcut_set_request_cb_ex()
+ *
+ * @pre - The request_cb (or the request_cb_ex) should be thread-safe, it can be invoked for other packages at the same time.
+ *
+ * @post - None
+ *
+ * @remarks - Requests of the same package name are invoked one at a time, in the order of their arrival.
+ * @remarks - Each connection still waits the ACK of its request before the next one is dispatched.
+ * @remarks - shortcut_caller_identity and shortcut_request_target work in the callback, on the worker.
+ * @remarks - The registry and subscribers are updated, and the ACK is sent, on the main loop after the callback returns.
+ * @remarks - Other callbacks and requests which are replayed from the journal or the spool are invoked on the main loop.
+ *
+ * @par Prospective Clients:
+ * Homescreen.
+ */
+extern int shortcut_parallel_enable(int workers);
+
+/**
+ * @fn void *shortcut_icon_cache_get(const char *icon)
+ *
+ * @brief Get the loaded icon from the cache.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[in] icon Path of an icon file, which is given to the request_cb.
+ *
+ * @return Return Type (void *)
+ * - Handle of the loaded icon
+ * - NULL - Not cached (failed to load, evicted, or the cache is not enabled)
+ *
+ * @see shortcut_icon_cache_put()
+ *
+ * @pre - None
+ *
+ * @post - Release the reference using shortcut_icon_cache_put.
+ *
+ * @remarks - Icon is not evicted while it is referenced.
+ *
+ * @par Prospective Clients:
+ * Homescreen.
+ */
+extern void *shortcut_icon_cache_get(const char *icon);
+
+/**
+ * @fn int shortcut_icon_cache_put(void *handle)
+ *
+ * @brief Release a reference of the icon which is gotten by shortcut_icon_cache_get.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[in] handle Handle of the loaded icon.
+ *
+ * @return Return Type (int)
+ * - 0 - Succeed to release
+ * - -ENOENT - Not a referenced icon
+ *
+ * @see shortcut_icon_cache_get()
+ *
+ * @pre - None
+ *
+ * @post - None
+ *
+ * @remarks - None
+ *
+ * @par Prospective Clients:
+ * Homescreen.
+ */
+extern int shortcut_icon_cache_put(void *handle);
+
+/**
+ * @fn int shortcut_add_to_home_with_fd(const char *pkgname, const char *name, int type, int content_fd, int icon_fd, result_cb_t result_cb, void *data)
+ *
+ * @brief Same as shortcut_add_to_home, but the content info and the icon are passed as fds.
+ *
+ * @par Sync (or) Async:
+ * This is an asynchronous API.
+ *
+ * @param[in] pkgname Package name of owner of the shortcut.
+ * @param[in] name Name of the shortcut.
+ * @param[in] type Type of the shortcut.
+ * @param[in] content_fd Sealed memfd which has the content info (terminated by NUL), or -1.
+ * @param[in] icon_fd Readable fd of the icon, or -1.
+ * @param[in] result_cb Callback function pointer which will be invoked after the request.
+ * @param[in] data Callback data to deliver to the callback function.
+ *
+ * @return Return Type (int)
+ * - 0 - Succeed to send the request
+ * - -EINVAL - Both of fds are not given
+ * - -ENOTSUP - The homescreen is known not to support the fd passing
+ * - <0 - Failed to send the request
+ *
+ * @see shortcut_create_content_fd()
+ *
+ * @pre - None
+ *
+ * @post - You have to check the return status from callback function which is passed by argument.
+ *
+ * @remarks - fds are duplicated, so the caller can close them after this returns.
+ * @remarks - The homescreen maps the content without copying, and gets "/proc/self/fd/N" as the icon.
+ * @remarks - If a homescreen does not support this, the result_cb gets -ENOTSUP.
+ *
+ * @par Prospective Clients:
+ * Inhouse Apps.
+ */
+extern int shortcut_add_to_home_with_fd(const char *pkgname, const char *name, int type, int content_fd, int icon_fd, result_cb_t result_cb, void *data);
+
+/**
+ * @fn int shortcut_create_content_fd(const char *content_info)
+ *
+ * @brief Create a sealed memfd which has the content info, for the shortcut_add_to_home_with_fd.
+ *
+ * @par Sync (or) Async:
+ * This is a synchronous API.
+ *
+ * @param[in] content_info Content info, including large SHORTCUT_DATA.
+ *
+ * @return Return Type (int)
+ * - >=0 - fd, the caller should close it
+ * - -ENOSYS - memfd is not supported
+ * - <0 - Failed to create
+ *
+ * @see shortcut_add_to_home_with_fd()
+ *
+ * @pre - None
+ *
+ * @post - None
+ *
+ * @remarks - None
+ *
+ * @par Prospective Clients:
+ * Inhouse Apps.
+ */
+extern int shortcut_create_content_fd(const char *content_info);
+
 extern int add_to_home_shortcut(const char *pkgname, const char *name, int type, const char *content_info, const char *icon, result_cb_t result_cb, void *data);
 
 #ifdef __cplusplus
@@ -0,0 +1,367 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SHORTCUT_HPP__
+#define __SHORTCUT_HPP__
+
+/**
+ * @addtogroup APPLICATION_FRAMEWORK
+ * @{
+ */
+
+/**
+ * @defgroup SHORTCUT_CXX Add to home (shortcut) for C++17
+ * @brief Header only layer on the shortcut API.
+ *        Fields are std::string_view, they are encoded into the packet without copies.
+ *        Results are delivered to a move-only shortcut::result, in the main loop.
+ *        Handlers of the homescreen are kept in a small buffer, not in the heap.
+ */
+
+#include <cstddef>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
+
+#include <shortcut.h>
+
+namespace shortcut {
+
+namespace detail {
+
+/**
+ * @brief Move-only callable in a fixed buffer.
+ *        Callable which doesn't fit the buffer is rejected at the compile time.
+ */
+template <typename Signature, std::size_t Size = 4 * sizeof(void *)>
+class inplace_function;
+
+template <typename R, typename... Args, std::size_t Size>
+class inplace_function<R(Args...), Size> {
+public:
+	inplace_function() noexcept = default;
+
+	template <typename F, typename Fn = std::decay_t<F>,
+		typename = std::enable_if_t<!std::is_same_v<Fn, inplace_function>>>
+	inplace_function(F &&f)
+	{
+		static_assert(sizeof(Fn) <= Size, "Callable is too large, capture less or capture a pointer");
+		static_assert(alignof(Fn) <= alignof(std::max_align_t), "Callable is over-aligned");
+		static_assert(std::is_nothrow_move_constructible_v<Fn>, "Callable should be nothrow movable");
+
+		new (m_storage) Fn(std::forward<F>(f));
+		m_invoke = [](void *self, Args... args) -> R {
+			return (*static_cast<Fn *>(self))(std::forward<Args>(args)...);
+		};
+		m_manage = [](void *dst, void *src) noexcept {
+			if (dst)
+				new (dst) Fn(std::move(*static_cast<Fn *>(src)));
+			static_cast<Fn *>(src)->~Fn();
+		};
+	}
+
+	inplace_function(inplace_function &&other) noexcept
+	{
+		move_from(other);
+	}
+
+	inplace_function &operator=(inplace_function &&other) noexcept
+	{
+		if (this != &other) {
+			reset();
+			move_from(other);
+		}
+		return *this;
+	}
+
+	inplace_function(const inplace_function &) = delete;
+	inplace_function &operator=(const inplace_function &) = delete;
+
+	~inplace_function()
+	{
+		reset();
+	}
+
+	explicit operator bool() const noexcept
+	{
+		return m_invoke != nullptr;
+	}
+
+	R operator()(Args... args)
+	{
+		return m_invoke(m_storage, std::forward<Args>(args)...);
+	}
+
+	void reset() noexcept
+	{
+		if (m_manage)
+			m_manage(nullptr, m_storage);
+		m_invoke = nullptr;
+		m_manage = nullptr;
+	}
+
+private:
+	void move_from(inplace_function &other) noexcept
+	{
+		if (other.m_manage)
+			other.m_manage(m_storage, other.m_storage);
+		m_invoke = other.m_invoke;
+		m_manage = other.m_manage;
+		other.m_invoke = nullptr;
+		other.m_manage = nullptr;
+	}
+
+	alignas(std::max_align_t) unsigned char m_storage[Size];
+	R (*m_invoke)(void *, Args...) = nullptr;
+	void (*m_manage)(void *dst, void *src) noexcept = nullptr;
+};
+
+inline struct shortcut_field to_field(std::string_view str) noexcept
+{
+	/* Default constructed view has no data, the field is not given */
+	return { str.data(), static_cast<int>(str.size()) };
+}
+
+inline std::string_view to_view(const struct shortcut_field &field) noexcept
+{
+	return field.ptr ? std::string_view(field.ptr, field.len) : std::string_view();
+}
+
+} /* namespace detail */
+
+/**
+ * @brief Result of a request, it is ready when the homescreen replies.
+ *        The state is shared by this and the library until the result is delivered,
+ *        destroying this before that doesn't cancel the request.
+ */
+class result {
+public:
+	using continuation = detail::inplace_function<void(int)>;
+
+	result() noexcept = default;
+
+	result(result &&other) noexcept : m_state(std::exchange(other.m_state, nullptr))
+	{
+	}
+
+	result &operator=(result &&other) noexcept
+	{
+		if (this != &other) {
+			release();
+			m_state = std::exchange(other.m_state, nullptr);
+		}
+		return *this;
+	}
+
+	result(const result &) = delete;
+	result &operator=(const result &) = delete;
+
+	~result()
+	{
+		release();
+	}
+
+	bool valid() const noexcept
+	{
+		return m_state != nullptr;
+	}
+
+	bool ready() const noexcept
+	{
+		return m_state && m_state->ready;
+	}
+
+	/**
+	 * @brief 0 or negative errno of the request, valid if it is ready.
+	 */
+	int get() const noexcept
+	{
+		return m_state->ret;
+	}
+
+	/**
+	 * @brief Invoke the callable with the result, at once if it is ready.
+	 */
+	template <typename F>
+	void then(F &&f)
+	{
+		if (m_state->ready) {
+			std::forward<F>(f)(m_state->ret);
+			return;
+		}
+
+		m_state->then = continuation(std::forward<F>(f));
+	}
+
+#if defined(__cpp_impl_coroutine)
+	bool await_ready() const noexcept
+	{
+		return ready();
+	}
+
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		then([handle](int) { handle.resume(); });
+	}
+
+	int await_resume() const noexcept
+	{
+		return get();
+	}
+#endif
+
+private:
+	friend result add_to_home(std::string_view, std::string_view, int, std::string_view, std::string_view);
+
+	struct state {
+		int refcnt;
+		int ready;
+		int ret;
+		continuation then;
+	};
+
+	static int result_cb(int ret, int pid, void *data)
+	{
+		state *s = static_cast<state *>(data);
+
+		(void)pid;
+		s->ready = 1;
+		s->ret = ret;
+		if (s->then)
+			s->then(ret);
+
+		if (--s->refcnt == 0)
+			delete s;
+		return 0;
+	}
+
+	void release() noexcept
+	{
+		if (m_state && --m_state->refcnt == 0)
+			delete m_state;
+		m_state = nullptr;
+	}
+
+	state *m_state = nullptr;
+};
+
+/**
+ * @brief Request add_to_home, a field which is default constructed is not given.
+ * @see shortcut_add_to_home_n()
+ */
+inline result add_to_home(std::string_view pkgname, std::string_view name, int type,
+		std::string_view content_info = std::string_view(), std::string_view icon = std::string_view())
+{
+	struct shortcut_field fields[4] = {
+		detail::to_field(pkgname),
+		detail::to_field(name),
+		detail::to_field(content_info),
+		detail::to_field(icon),
+	};
+	result r;
+	int ret;
+
+	/* One for the result, one for the library */
+	r.m_state = new result::state{ 2, 0, 0, {} };
+
+	ret = shortcut_add_to_home_n(&fields[0], &fields[1], type, &fields[2], &fields[3], &result::result_cb, r.m_state);
+	if (ret < 0) {
+		/* result_cb is not invoked */
+		r.m_state->refcnt = 1;
+		r.m_state->ready = 1;
+		r.m_state->ret = ret;
+	}
+
+	return r;
+}
+
+/**
+ * @brief add_to_home request which is delivered to the homescreen, valid only in the handler.
+ */
+class request {
+public:
+	explicit request(const struct shortcut_request_view &view) noexcept : m_view(view)
+	{
+	}
+
+	std::string_view pkgname() const noexcept { return detail::to_view(m_view.pkgname); }
+	std::string_view name() const noexcept { return detail::to_view(m_view.name); }
+	std::string_view content_info() const noexcept { return detail::to_view(m_view.content_info); }
+	std::string_view icon() const noexcept { return detail::to_view(m_view.icon); }
+
+	unsigned int seq() const noexcept { return m_view.seq; }
+	int type() const noexcept { return m_view.type; }
+	unsigned int flags() const noexcept { return m_view.flags; }
+	int priority() const noexcept { return m_view.priority; }
+	int pid() const noexcept { return m_view.caller ? m_view.caller->pid : -1; }
+	int uid() const noexcept { return m_view.caller ? m_view.caller->uid : -1; }
+	const struct shortcut_identity *caller() const noexcept { return m_view.caller; }
+	unsigned long long received() const noexcept { return m_view.received; }
+	unsigned long long dispatched() const noexcept { return m_view.dispatched; }
+	unsigned long long deadline() const noexcept { return m_view.deadline; }
+	const struct shortcut_target *target() const noexcept { return m_view.target; }
+
+	const struct shortcut_request_view &view() const noexcept { return m_view; }
+
+private:
+	const struct shortcut_request_view &m_view;
+};
+
+namespace detail {
+
+using request_handler = inplace_function<int(const request &)>;
+
+/* The library has one request callback for a process */
+inline request_handler &request_handler_slot() noexcept
+{
+	static request_handler handler;
+	return handler;
+}
+
+inline int request_ex_cb(const struct shortcut_request_view *view, void *data)
+{
+	request_handler &handler = *static_cast<request_handler *>(data);
+	return handler(request(*view));
+}
+
+} /* namespace detail */
+
+/**
+ * @brief Serve add_to_home requests with the callable, int (const shortcut::request &).
+ *        The callable replaces the previous one.
+ * @see shortcut_set_request_cb_ex()
+ */
+template <typename F>
+int set_request_handler(F &&f)
+{
+	detail::request_handler &slot = detail::request_handler_slot();
+
+	slot = detail::request_handler(std::forward<F>(f));
+	return shortcut_set_request_cb_ex(&detail::request_ex_cb, &slot);
+}
+
+} /* namespace shortcut */
+
+/**
+ * @}
+ */
+
+#endif
+/* End of a file */
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define SPOOL_NAME_LEN 64
+
+/*
+ * Put a request to the spool, the name of the spooled request is returned.
+ * Returns -EAGAIN if the spool is full.
+ */
+extern int spool_write(int pid, const char *buffer, int size, char *name);
+
+/*
+ * Returns 0 if the result is delivered (it is removed after reading), -EINPROGRESS if the request is still spooled,
+ * or -ENOENT if both of the request and its result are gone.
+ */
+extern int spool_read_result(const char *name, int *ret, int *server_pid);
+
+/*
+ * Deliver every spooled request in the order of spooling, and write their results.
+ * pid is told by the name of the request, anyone can spoof it. uid is of the owner of its file.
+ * Returns the number of delivered requests.
+ */
+extern int spool_drain(int (*deliver)(int pid, int uid, const char *buffer, int size, void *data), void *data);
+
+/*
+ * Returns the number of spooled requests.
+ */
+extern int spool_count(void);
+
+/* End of a file */
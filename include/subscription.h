@@ -0,0 +1,50 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Events of accepted requests, for subscribers.
+ * Events are encoded once into a batch (v2), every subscriber queues a reference of the batch.
+ */
+struct subscriber;
+
+/*
+ * fd is not owned by the subscriber, events are sent by the sendv of the transport.
+ */
+struct transport;
+extern struct subscriber *subscription_add(const struct transport *transport, int fd);
+extern void subscription_remove(struct subscriber *sub);
+extern int subscription_count(void);
+
+/*
+ * Encode an event (PACKET_EVENT) into the pending batch, the seq is given by this.
+ * ADD and REMOVE have the whole state of the shortcut, pending events of the shortcut are dropped.
+ * Returns the size of the pending batch, or -errno.
+ */
+extern int subscription_event(const struct message *msg);
+
+/*
+ * Queue the pending batch to every subscriber.
+ * A subscriber which has too many bytes in its queue loses them, and gets an EVENT_OVERFLOW.
+ */
+extern int subscription_publish(void);
+
+/*
+ * Send queued batches.
+ * Returns 1 if some are left (the socket is full), 0 if the queue is empty, or -errno.
+ */
+extern int subscription_flush(struct subscriber *sub);
+
+/* End of a file */
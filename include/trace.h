@@ -0,0 +1,79 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Static tracepoints (USDT) of the request lifecycle.
+ *
+ * If the sys/sdt.h is available, every probe is compiled to a single "nop"
+ * instruction and a note section entry, so it costs nothing until
+ * the perf/bpftrace attaches to it. (provider: "shortcut")
+ *
+ * Otherwise, every probe is compiled out.
+ */
+
+#if defined(HAVE_SYS_SDT_H)
+#include <sys/sdt.h>
+
+/* Server: a new connection is accepted */
+#define TRACE_ACCEPT(fd) \
+	DTRACE_PROBE1(shortcut, accept, fd)
+
+/* Server: header of a packet is parsed */
+#define TRACE_HEADER(seq, pid, type, payload_size) \
+	DTRACE_PROBE4(shortcut, header, seq, pid, type, payload_size)
+
+/* Server: payload of a packet is completely received */
+#define TRACE_PAYLOAD(seq, pid, payload_size) \
+	DTRACE_PROBE3(shortcut, payload, seq, pid, payload_size)
+
+/* Server: right before/after invoking the request_cb */
+#define TRACE_CB_ENTRY(seq, pid, shortcut_type) \
+	DTRACE_PROBE3(shortcut, cb_entry, seq, pid, shortcut_type)
+
+#define TRACE_CB_EXIT(seq, pid, ret) \
+	DTRACE_PROBE3(shortcut, cb_exit, seq, pid, ret)
+
+/* Server: a request is dropped, its deadline is passed */
+#define TRACE_EXPIRED(seq, pid) \
+	DTRACE_PROBE2(shortcut, expired, seq, pid)
+
+/* Server: an ACK packet is sent */
+#define TRACE_ACK_SEND(seq, pid, ret, size) \
+	DTRACE_PROBE4(shortcut, ack_send, seq, pid, ret, size)
+
+/* Client: a request packet is sent */
+#define TRACE_CLIENT_SEND(seq, fd, size) \
+	DTRACE_PROBE3(shortcut, client_send, seq, fd, size)
+
+/* Client: result of a request is delivered to the result_cb */
+#define TRACE_CLIENT_RESULT(seq, pid, ret) \
+	DTRACE_PROBE3(shortcut, client_result, seq, pid, ret)
+
+#else
+
+#define TRACE_ACCEPT(fd) do { } while (0)
+#define TRACE_HEADER(seq, pid, type, payload_size) do { } while (0)
+#define TRACE_PAYLOAD(seq, pid, payload_size) do { } while (0)
+#define TRACE_CB_ENTRY(seq, pid, shortcut_type) do { } while (0)
+#define TRACE_CB_EXIT(seq, pid, ret) do { } while (0)
+#define TRACE_EXPIRED(seq, pid) do { } while (0)
+#define TRACE_ACK_SEND(seq, pid, ret, size) do { } while (0)
+#define TRACE_CLIENT_SEND(seq, fd, size) do { } while (0)
+#define TRACE_CLIENT_RESULT(seq, pid, ret) do { } while (0)
+
+#endif
+
+/* End of a file */
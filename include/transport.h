@@ -0,0 +1,78 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Transport of packets.
+ * Handles are fds which can be watched by the main loop, they become readable when data or a connection arrives.
+ * Functions return -1 and set the errno on failure, as the socket functions do.
+ */
+struct iovec;
+
+struct transport {
+	const char *name;
+
+	int (*connect)(const char *peer);
+
+	/*
+	 * Non-blocking handle, errno is EAGAIN if the peer can't take a connection now.
+	 */
+	int (*connect_nonblock)(const char *peer);
+	int (*listen)(const char *peer);
+	int (*accept)(int server);
+
+	/*
+	 * fds are attached to the first byte of the data, the caller keeps its copies.
+	 */
+	int (*send)(int conn, const char *buffer, int size, const int *fds, int nr_fds);
+
+	/*
+	 * Never blocks, errno is EAGAIN if nothing can be sent.
+	 */
+	int (*sendv)(int conn, const struct iovec *iov, int count);
+
+	/*
+	 * nr_fds is the capacity of fds, and it is updated to the number of received fds.
+	 * Returns 0 if the peer is disconnected.
+	 */
+	int (*recv)(int conn, char *buffer, int size, int *sender_pid, int *fds, int *nr_fds);
+
+	/*
+	 * Size of data which can be received without blocking.
+	 */
+	int (*pending)(int conn);
+
+	int (*credentials)(int conn, int *pid, int *uid);
+	int (*close)(int conn);
+};
+
+/*
+ * AF_UNIX stream sockets, secom_socket.c
+ */
+extern const struct transport transport_unix;
+
+/*
+ * Queues in this process, for benchmarks and tests of the protocol.
+ * Peers are only found in the process, the data is not copied to the kernel.
+ */
+extern const struct transport transport_loopback;
+
+/*
+ * Use the transport for following connections, e.g. a wrapper of the transport_unix which injects faults.
+ * Returns -EBUSY if the server, a ring or a subscription is opened. main.c
+ */
+extern int transport_install(const struct transport *transport);
+
+/* End of a file */
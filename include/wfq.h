@@ -0,0 +1,45 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Weighted fair queue of ready items, one flow for each sender.
+ * Entries are embedded in items, an item can be queued once at a time.
+ */
+struct wfq_flow;
+
+struct wfq_entry {
+	unsigned long long tag; /* Virtual finish time */
+	unsigned long long order; /* Of arrival, for the same tag */
+	int index; /* In the heap, 0 if it is not queued */
+	struct wfq_flow *flow;
+	void *data;
+};
+
+/*
+ * Queue an entry of the flow, the weight is relative to other flows.
+ */
+extern int wfq_push(struct wfq_entry *entry, int flow, int weight);
+
+/*
+ * Returns the entry which has the earliest finish time, or NULL if the queue is empty.
+ */
+extern struct wfq_entry *wfq_pop(void);
+
+extern void wfq_remove(struct wfq_entry *entry);
+extern int wfq_is_queued(const struct wfq_entry *entry);
+extern int wfq_count(void);
+
+/* End of a file */
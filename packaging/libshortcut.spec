@@ -49,3 +49,4 @@ rm -rf %{buildroot}
 %{_includedir}/shortcut/SLP_shortcut_PG.h
 %{_includedir}/shortcut/shortcut.h
 %{_libdir}/pkgconfig/shortcut.pc
+%{_datadir}/shortcut/shortcut-latency.bt
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Cost table, a fixed array of clients.
+ *
+ * Clients are found by a linear scan, the last one is checked first since packets of a connection come in a row.
+ * If the table is full, the cheapest client is replaced.
+ * So a client which keeps costing stays in the table, and a burst of short-lived clients doesn't grow it.
+ */
+
+#include <string.h>
+
+#include <cost.h>
+
+
+
+#define COST_MAX 64
+
+
+
+static struct info {
+	struct cost_entry entries[COST_MAX];
+	int count;
+	int last; /* Index of the last found entry */
+} s_info = {
+	.count = 0,
+	.last = 0,
+};
+
+
+
+static inline
+unsigned long long total_ns(const struct cost_entry *entry)
+{
+	return entry->decode_ns + entry->callback_ns;
+}
+
+
+
+struct cost_entry *cost_get(int pid, int uid)
+{
+	struct cost_entry *entry;
+	int victim;
+	int i;
+
+	entry = &s_info.entries[s_info.last];
+	if (s_info.count && entry->pid == pid && entry->uid == uid)
+		return entry;
+
+	for (i = 0; i < s_info.count; i++) {
+		entry = &s_info.entries[i];
+		if (entry->pid == pid && entry->uid == uid) {
+			s_info.last = i;
+			return entry;
+		}
+	}
+
+	if (s_info.count < COST_MAX) {
+		victim = s_info.count++;
+	} else {
+		victim = 0;
+		for (i = 1; i < COST_MAX; i++) {
+			if (total_ns(&s_info.entries[i]) < total_ns(&s_info.entries[victim]))
+				victim = i;
+		}
+	}
+
+	entry = &s_info.entries[victim];
+	memset(entry, 0, sizeof(*entry));
+	entry->pid = pid;
+	entry->uid = uid;
+	s_info.last = victim;
+	return entry;
+}
+
+
+
+int cost_top(struct cost_entry *entries, int count)
+{
+	struct cost_entry entry;
+	int nr;
+	int i;
+	int j;
+
+	nr = 0;
+	for (i = 0; i < s_info.count; i++) {
+		entry = s_info.entries[i];
+
+		/* Insertion into the sorted result, it is short */
+		for (j = nr; j > 0 && total_ns(&entries[j - 1]) < total_ns(&entry); j--) {
+			if (j < count)
+				entries[j] = entries[j - 1];
+		}
+
+		if (j < count) {
+			entries[j] = entry;
+			if (nr < count)
+				nr++;
+		}
+	}
+
+	return nr;
+}
+
+/* End of a file */
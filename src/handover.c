@@ -0,0 +1,254 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Handover of the server to its successor.
+ *
+ * The running server waits a successor on a SOCK_SEQPACKET socket, which is only for its user.
+ * A record is a packet of the struct handover_record with its fds,
+ * and its data follows in packets of HANDOVER_CHUNK.
+ * Both of peers check that the other is a process of the same user.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <dlog.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <secom_socket.h>
+#include <handover.h>
+
+
+
+#define HANDOVER_CHUNK 16384
+#define HANDOVER_TIMEOUT 3 /* seconds */
+#define HANDOVER_MAX_SIZE (64 * 1024 * 1024)
+
+
+
+extern int errno;
+
+
+
+static inline
+int make_address(const char *path, struct sockaddr_un *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		LOGE("%s is too long\n", path);
+		return -EINVAL;
+	}
+
+	strcpy(addr->sun_path, path);
+	addr->sun_family = AF_UNIX;
+	return 0;
+}
+
+
+
+/*
+ * A handover is done at once, it should not block the peer forever.
+ */
+static inline
+int prepare_socket(int fd)
+{
+	struct timeval tv;
+	struct ucred cred;
+	socklen_t len;
+
+	len = sizeof(cred);
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+		LOGE("Failed to get the peer (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	if (cred.uid != getuid()) {
+		LOGE("Peer %d is not the same user (%d)\n", cred.pid, cred.uid);
+		return -EPERM;
+	}
+
+	tv.tv_sec = HANDOVER_TIMEOUT;
+	tv.tv_usec = 0;
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0
+			|| setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0)
+		LOGE("Failed to set the timeout (%s)\n", strerror(errno));
+
+	return 0;
+}
+
+
+
+int handover_create_server(const char *path)
+{
+	struct sockaddr_un addr;
+	mode_t mask;
+	int fd;
+
+	if (make_address(path, &addr) < 0)
+		return -EINVAL;
+
+	fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (fd < 0) {
+		LOGE("Failed to create a socket (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	unlink(path);
+
+	/* Only for the user of this process */
+	mask = umask(0077);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+		LOGE("Failed to listen %s (%s)\n", path, strerror(errno));
+		umask(mask);
+		close(fd);
+		return -EIO;
+	}
+	umask(mask);
+
+	return fd;
+}
+
+
+
+int handover_accept(int server_fd)
+{
+	int fd;
+
+	fd = accept4(server_fd, NULL, NULL, SOCK_CLOEXEC);
+	if (fd < 0) {
+		LOGE("Failed to accept (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	if (prepare_socket(fd) < 0) {
+		close(fd);
+		return -EPERM;
+	}
+
+	return fd;
+}
+
+
+
+int handover_connect(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (make_address(path, &addr) < 0)
+		return -EINVAL;
+
+	fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		LOGE("Failed to create a socket (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -ENOENT;
+	}
+
+	if (prepare_socket(fd) < 0) {
+		close(fd);
+		return -EPERM;
+	}
+
+	return fd;
+}
+
+
+
+int handover_send(int fd, const struct handover_record *record, const char *data, const int *fds)
+{
+	int offset;
+	int size;
+
+	if (record->nr_fds < 0 || record->nr_fds > SECOM_MAX_FDS || record->size < 0)
+		return -EINVAL;
+
+	if (secom_send_fds(fd, (const char *)record, sizeof(*record), fds, record->nr_fds) != sizeof(*record))
+		return -EIO;
+
+	for (offset = 0; offset < record->size; offset += size) {
+		size = record->size - offset;
+		if (size > HANDOVER_CHUNK)
+			size = HANDOVER_CHUNK;
+
+		if (secom_send(fd, data + offset, size) != size)
+			return -EIO;
+	}
+
+	return 0;
+}
+
+
+
+int handover_recv(int fd, struct handover_record *record, char **data, int *fds)
+{
+	int nr_fds;
+	int offset;
+	int ret;
+
+	*data = NULL;
+	nr_fds = SECOM_MAX_FDS;
+	ret = secom_recv_fds(fd, (char *)record, sizeof(*record), NULL, fds, &nr_fds);
+	if (ret != sizeof(*record) || nr_fds != record->nr_fds
+			|| record->size < 0 || record->size > HANDOVER_MAX_SIZE) {
+		LOGE("Invalid record\n");
+		goto err;
+	}
+
+	if (record->size == 0)
+		return 0;
+
+	*data = malloc(record->size);
+	if (!*data) {
+		LOGE("Heap: %s\n", strerror(errno));
+		goto err;
+	}
+
+	for (offset = 0; offset < record->size; offset += ret) {
+		ret = secom_recv(fd, *data + offset, record->size - offset, NULL);
+		if (ret <= 0) {
+			LOGE("Data is truncated\n");
+			free(*data);
+			*data = NULL;
+			goto err;
+		}
+	}
+
+	return 0;
+
+err:
+	while (nr_fds > 0)
+		close(fds[--nr_fds]);
+	return -EIO;
+}
+
+
+
+/* End of a file */
@@ -0,0 +1,639 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Cache of decoded icons.
+ *
+ * Icons are loaded (decoded and scaled by the given loader) on a thread,
+ * so the main loop of the homescreen is not blocked by them.
+ * Entries are keyed by the identity of the file (device, inode, mtime, size),
+ * so the same file is loaded once even if it is named by different paths,
+ * and a modified file is loaded again.
+ *
+ * Loaded icons are kept in the LRU order,
+ * the least recently used ones are evicted if the total size is over the limit.
+ * Referenced icons are not evicted.
+ *
+ * There is only one loader thread, jobs are done in the order of requests.
+ * So a job for an icon which is being loaded by a previous job finds it in the cache.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <errno.h>
+#include <dlog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include <sys/stat.h>
+
+#include <icon_cache.h>
+
+
+
+#define NR_BUCKETS 256
+
+#define BUCKET(hash) ((hash) & (NR_BUCKETS - 1))
+
+
+
+extern int errno;
+
+
+
+struct icon_key {
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	long mtime_nsec;
+	off_t size;
+};
+
+
+
+struct icon_entry {
+	struct icon_key key;
+	uint32_t hash;
+	struct icon_entry *next; /* Chain of the key */
+	struct icon_entry *handle_next; /* Chain of the handle */
+	struct icon_entry *lru_prev;
+	struct icon_entry *lru_next;
+
+	void *handle;
+	int size;
+	int refcnt;
+};
+
+
+
+struct icon_job {
+	struct icon_key key;
+	char *path;
+	void (*done)(void *data);
+	void *data;
+	struct icon_job *next;
+};
+
+
+
+static struct info {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t loader;
+	int enabled;
+	int pipe[2];
+
+	void *(*load)(const char *path, int *size, void *data);
+	void (*unload)(void *handle, void *data);
+	void *data;
+	int max_size;
+	int size;
+
+	struct icon_entry *bucket[NR_BUCKETS];
+	struct icon_entry *handle_bucket[NR_BUCKETS];
+	struct icon_entry *lru_head; /* Most recently used */
+	struct icon_entry *lru_tail;
+
+	struct icon_job *queue_head;
+	struct icon_job *queue_tail;
+	struct icon_job *done_head;
+	struct icon_job *done_tail;
+} s_info = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.enabled = 0,
+	.pipe = { -1, -1 },
+	.size = 0,
+};
+
+
+
+static inline
+uint32_t hash_key(const struct icon_key *key)
+{
+	const unsigned char *ptr = (const unsigned char *)key;
+	uint32_t hash = 2166136261u;
+	int i;
+
+	/* FNV-1a, the key is zeroed before it is filled, so the padding is stable */
+	for (i = 0; i < sizeof(*key); i++) {
+		hash ^= ptr[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+
+static inline
+uint32_t hash_handle(const void *handle)
+{
+	uintptr_t value = (uintptr_t)handle;
+
+	return (uint32_t)(value ^ (value >> 16)) * 2654435761u;
+}
+
+
+
+static inline
+int make_key(const char *path, struct icon_key *key)
+{
+	struct stat st;
+
+	if (!path || stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+		return -ENOENT;
+
+	memset(key, 0, sizeof(*key));
+	key->dev = st.st_dev;
+	key->ino = st.st_ino;
+	key->mtime = st.st_mtim.tv_sec;
+	key->mtime_nsec = st.st_mtim.tv_nsec;
+	key->size = st.st_size;
+	return 0;
+}
+
+
+
+static inline
+struct icon_entry *find_entry(const struct icon_key *key)
+{
+	struct icon_entry *entry;
+
+	entry = s_info.bucket[BUCKET(hash_key(key))];
+	while (entry) {
+		if (!memcmp(&entry->key, key, sizeof(*key)))
+			return entry;
+
+		entry = entry->next;
+	}
+
+	return NULL;
+}
+
+
+
+static inline
+struct icon_entry *find_handle(const void *handle)
+{
+	struct icon_entry *entry;
+
+	entry = s_info.handle_bucket[BUCKET(hash_handle(handle))];
+	while (entry) {
+		if (entry->handle == handle)
+			return entry;
+
+		entry = entry->handle_next;
+	}
+
+	return NULL;
+}
+
+
+
+static inline
+void lru_unlink(struct icon_entry *entry)
+{
+	if (entry->lru_prev)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		s_info.lru_head = entry->lru_next;
+
+	if (entry->lru_next)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		s_info.lru_tail = entry->lru_prev;
+
+	entry->lru_prev = NULL;
+	entry->lru_next = NULL;
+}
+
+
+
+static inline
+void lru_push(struct icon_entry *entry)
+{
+	entry->lru_prev = NULL;
+	entry->lru_next = s_info.lru_head;
+	if (s_info.lru_head)
+		s_info.lru_head->lru_prev = entry;
+	else
+		s_info.lru_tail = entry;
+
+	s_info.lru_head = entry;
+}
+
+
+
+static inline
+void link_entry(struct icon_entry *entry)
+{
+	struct icon_entry **bucket;
+
+	bucket = &s_info.bucket[BUCKET(entry->hash)];
+	entry->next = *bucket;
+	*bucket = entry;
+
+	bucket = &s_info.handle_bucket[BUCKET(hash_handle(entry->handle))];
+	entry->handle_next = *bucket;
+	*bucket = entry;
+
+	lru_push(entry);
+	s_info.size += entry->size;
+}
+
+
+
+static inline
+void unlink_entry(struct icon_entry *entry)
+{
+	struct icon_entry **ptr;
+
+	ptr = &s_info.bucket[BUCKET(entry->hash)];
+	while (*ptr != entry)
+		ptr = &(*ptr)->next;
+	*ptr = entry->next;
+
+	ptr = &s_info.handle_bucket[BUCKET(hash_handle(entry->handle))];
+	while (*ptr != entry)
+		ptr = &(*ptr)->handle_next;
+	*ptr = entry->handle_next;
+
+	lru_unlink(entry);
+	s_info.size -= entry->size;
+}
+
+
+
+/*
+ * Unlink entries over the limit, from the least recently used one.
+ * Unlinked entries are returned as a list, to unload them without the lock.
+ */
+static inline
+struct icon_entry *evict(void)
+{
+	struct icon_entry *entry;
+	struct icon_entry *prev;
+	struct icon_entry *evicted = NULL;
+
+	entry = s_info.lru_tail;
+	while (entry && s_info.size > s_info.max_size) {
+		prev = entry->lru_prev;
+		if (entry->refcnt == 0) {
+			unlink_entry(entry);
+			entry->next = evicted;
+			evicted = entry;
+		}
+		entry = prev;
+	}
+
+	return evicted;
+}
+
+
+
+static inline
+void unload_entries(struct icon_entry *entry)
+{
+	struct icon_entry *next;
+
+	while (entry) {
+		next = entry->next;
+		if (s_info.unload)
+			s_info.unload(entry->handle, s_info.data);
+		free(entry);
+		entry = next;
+	}
+}
+
+
+
+static inline
+void wakeup_main(void)
+{
+	char ch = 0;
+
+	if (write(s_info.pipe[1], &ch, sizeof(ch)) != sizeof(ch) && errno != EAGAIN)
+		LOGE("Failed to wake up the main loop (%s)\n", strerror(errno));
+}
+
+
+
+static inline
+void load_icon(struct icon_job *job)
+{
+	struct icon_entry *entry;
+	struct icon_entry *evicted;
+	void *handle;
+	int size;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0)
+		return;
+
+	entry = find_entry(&job->key);
+	pthread_mutex_unlock(&s_info.lock);
+
+	/* Loaded by a previous job */
+	if (entry)
+		return;
+
+	size = 0;
+	handle = s_info.load(job->path, &size, s_info.data);
+	if (!handle) {
+		LOGD("Failed to load %s\n", job->path);
+		return;
+	}
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		LOGE("Heap: %s\n", strerror(errno));
+		if (s_info.unload)
+			s_info.unload(handle, s_info.data);
+		return;
+	}
+
+	memcpy(&entry->key, &job->key, sizeof(entry->key));
+	entry->hash = hash_key(&job->key);
+	entry->handle = handle;
+	entry->size = size;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		unload_entries(entry);
+		return;
+	}
+
+	link_entry(entry);
+	evicted = evict();
+	pthread_mutex_unlock(&s_info.lock);
+
+	unload_entries(evicted);
+}
+
+
+
+static
+void *loader_main(void *arg)
+{
+	struct icon_job *job;
+
+	while (1) {
+		if (pthread_mutex_lock(&s_info.lock) != 0) {
+			LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+			break;
+		}
+
+		while (!s_info.queue_head)
+			pthread_cond_wait(&s_info.cond, &s_info.lock);
+
+		job = s_info.queue_head;
+		s_info.queue_head = job->next;
+		if (!s_info.queue_head)
+			s_info.queue_tail = NULL;
+		pthread_mutex_unlock(&s_info.lock);
+
+		load_icon(job);
+
+		if (pthread_mutex_lock(&s_info.lock) != 0)
+			break;
+
+		job->next = NULL;
+		if (s_info.done_tail)
+			s_info.done_tail->next = job;
+		else
+			s_info.done_head = job;
+		s_info.done_tail = job;
+		pthread_mutex_unlock(&s_info.lock);
+
+		wakeup_main();
+	}
+
+	return NULL;
+}
+
+
+
+int icon_cache_init(void *(*load)(const char *path, int *size, void *data), void (*unload)(void *handle, void *data), int max_size, void *data)
+{
+	pthread_attr_t attr;
+	int ret;
+
+	if (!load || max_size <= 0)
+		return -EINVAL;
+
+	if (s_info.enabled)
+		return -EALREADY;
+
+	if (pipe2(s_info.pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+		LOGE("Failed to create a pipe (%s)\n", strerror(errno));
+		return -EFAULT;
+	}
+
+	s_info.load = load;
+	s_info.unload = unload;
+	s_info.data = data;
+	s_info.max_size = max_size;
+
+	/* Loader lives with the process */
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	ret = pthread_create(&s_info.loader, &attr, loader_main, NULL);
+	pthread_attr_destroy(&attr);
+	if (ret != 0) {
+		LOGE("Failed to create the loader (%s)\n", strerror(ret));
+		close(s_info.pipe[0]);
+		close(s_info.pipe[1]);
+		s_info.pipe[0] = -1;
+		s_info.pipe[1] = -1;
+		return -EFAULT;
+	}
+
+	s_info.enabled = 1;
+	return s_info.pipe[0];
+}
+
+
+
+int icon_cache_is_enabled(void)
+{
+	return s_info.enabled;
+}
+
+
+
+void *icon_cache_request(const char *path, void (*done)(void *data), void *data)
+{
+	struct icon_job *job;
+	struct icon_key key;
+
+	if (!s_info.enabled || make_key(path, &key) < 0)
+		return NULL;
+
+	job = calloc(1, sizeof(*job));
+	if (!job) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	job->path = strdup(path);
+	if (!job->path) {
+		LOGE("Heap: %s\n", strerror(errno));
+		free(job);
+		return NULL;
+	}
+
+	job->key = key;
+	job->done = done;
+	job->data = data;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		free(job->path);
+		free(job);
+		return NULL;
+	}
+
+	if (find_entry(&key)) {
+		pthread_mutex_unlock(&s_info.lock);
+		free(job->path);
+		free(job);
+		return NULL;
+	}
+
+	if (s_info.queue_tail)
+		s_info.queue_tail->next = job;
+	else
+		s_info.queue_head = job;
+	s_info.queue_tail = job;
+
+	pthread_cond_signal(&s_info.cond);
+	pthread_mutex_unlock(&s_info.lock);
+	return job;
+}
+
+
+
+void icon_cache_cancel(void *job)
+{
+	struct icon_job *icon_job = job;
+
+	/* Jobs are freed by the dispatcher, which runs in the same thread */
+	icon_job->done = NULL;
+}
+
+
+
+int icon_cache_dispatch(void)
+{
+	struct icon_job *job;
+	struct icon_job *next;
+	char buffer[64];
+	int count;
+
+	while (read(s_info.pipe[0], buffer, sizeof(buffer)) > 0);
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return -EFAULT;
+	}
+
+	job = s_info.done_head;
+	s_info.done_head = NULL;
+	s_info.done_tail = NULL;
+	pthread_mutex_unlock(&s_info.lock);
+
+	count = 0;
+	while (job) {
+		next = job->next;
+		if (job->done) {
+			job->done(job->data);
+			count++;
+		}
+
+		free(job->path);
+		free(job);
+		job = next;
+	}
+
+	return count;
+}
+
+
+
+void *icon_cache_get(const char *path)
+{
+	struct icon_entry *entry;
+	struct icon_key key;
+
+	if (!s_info.enabled || make_key(path, &key) < 0)
+		return NULL;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return NULL;
+	}
+
+	entry = find_entry(&key);
+	if (!entry) {
+		pthread_mutex_unlock(&s_info.lock);
+		return NULL;
+	}
+
+	entry->refcnt++;
+	lru_unlink(entry);
+	lru_push(entry);
+	pthread_mutex_unlock(&s_info.lock);
+
+	return entry->handle;
+}
+
+
+
+int icon_cache_put(const void *handle)
+{
+	struct icon_entry *entry;
+	struct icon_entry *evicted;
+
+	if (!s_info.enabled || !handle)
+		return -EINVAL;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return -EFAULT;
+	}
+
+	entry = find_handle(handle);
+	if (!entry || entry->refcnt == 0) {
+		pthread_mutex_unlock(&s_info.lock);
+		return -ENOENT;
+	}
+
+	entry->refcnt--;
+	evicted = entry->refcnt ? NULL : evict();
+	pthread_mutex_unlock(&s_info.lock);
+
+	unload_entries(evicted);
+	return 0;
+}
+
+
+
+/* End of a file */
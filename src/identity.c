@@ -0,0 +1,378 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Cache of process identities, LRU keyed by the pid and its start time.
+ *
+ * The default resolver reads the /proc,
+ * the package is the SMACK label of the process, or the directory of the installed application
+ * (/opt/apps/<package>/bin/...), and the application is the name of its executable.
+ *
+ * A cached identity is valid while the start time of the pid is not changed,
+ * so a reused pid is resolved again.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <dlog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include <identity.h>
+
+
+
+#define CACHE_MAX 64
+#define CACHE_BUCKETS 64
+
+
+
+extern int errno;
+
+
+
+struct entry {
+	struct identity identity;
+	struct entry *prev; /* LRU, the head is the most recently used */
+	struct entry *next;
+	struct entry *hash_next;
+};
+
+
+
+static struct info {
+	struct entry *head;
+	struct entry *tail;
+	struct entry *buckets[CACHE_BUCKETS];
+	int count;
+	int (*resolve)(int pid, char *appid, int appid_size, char *pkgname, int pkgname_size, void *data);
+	void *data;
+} s_info = {
+	.head = NULL,
+	.tail = NULL,
+	.count = 0,
+	.resolve = NULL,
+	.data = NULL,
+};
+
+
+
+/*
+ * Returns the size of read data, it is terminated by NUL.
+ */
+static inline
+int read_proc(int pid, const char *name, char *buffer, int size)
+{
+	char path[64];
+	int fd;
+	int ret;
+
+	snprintf(path, sizeof(path), "/proc/%d/%s", pid, name);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	ret = read(fd, buffer, size - 1);
+	close(fd);
+	if (ret < 0)
+		return -EIO;
+
+	buffer[ret] = '\0';
+	return ret;
+}
+
+
+
+/*
+ * 22nd field of the /proc/PID/stat, the comm (2nd) can have spaces.
+ */
+static inline
+int get_start_time(int pid, unsigned long long *start_time)
+{
+	char buffer[512];
+	char *ptr;
+	int field;
+
+	if (read_proc(pid, "stat", buffer, sizeof(buffer)) < 0)
+		return -ESRCH;
+
+	ptr = strrchr(buffer, ')');
+	if (!ptr)
+		return -EINVAL;
+
+	for (field = 2; field < 22 && ptr; field++)
+		ptr = strchr(ptr + 1, ' ');
+
+	if (!ptr || sscanf(ptr + 1, "%llu", start_time) != 1)
+		return -EINVAL;
+
+	return 0;
+}
+
+
+
+static inline
+void copy_name(char *dest, int size, const char *src, int len)
+{
+	if (len >= size)
+		len = size - 1;
+
+	memcpy(dest, src, len);
+	dest[len] = '\0';
+}
+
+
+
+static
+int default_resolve(int pid, char *appid, int appid_size, char *pkgname, int pkgname_size, void *data)
+{
+	static const char *app_dirs[] = { "/opt/apps/", "/usr/apps/", NULL };
+	static const char *system_labels[] = { "unconfined", "kernel", NULL };
+	char buffer[512];
+	const char *ptr;
+	const char *end;
+	int len;
+	int i;
+
+	appid[0] = '\0';
+	pkgname[0] = '\0';
+
+	/* Labels of system processes are not packages */
+	len = read_proc(pid, "attr/current", buffer, sizeof(buffer));
+	if (len > 0) {
+		len = strcspn(buffer, "\n");
+		buffer[len] = '\0';
+		for (i = 0; system_labels[i]; i++) {
+			if (!strncmp(buffer, system_labels[i], strlen(system_labels[i])))
+				break;
+		}
+
+		if (len > 1 && !system_labels[i])
+			copy_name(pkgname, pkgname_size, buffer, len);
+	}
+
+	if (read_proc(pid, "cmdline", buffer, sizeof(buffer)) <= 0)
+		return pkgname[0] ? 0 : -ESRCH;
+
+	ptr = strrchr(buffer, '/');
+	ptr = ptr ? ptr + 1 : buffer;
+	copy_name(appid, appid_size, ptr, strlen(ptr));
+
+	if (pkgname[0])
+		return 0;
+
+	for (i = 0; app_dirs[i]; i++) {
+		len = strlen(app_dirs[i]);
+		if (strncmp(buffer, app_dirs[i], len))
+			continue;
+
+		ptr = buffer + len;
+		end = strchr(ptr, '/');
+		if (end)
+			copy_name(pkgname, pkgname_size, ptr, end - ptr);
+		break;
+	}
+
+	return 0;
+}
+
+
+
+static inline
+void unlink_lru(struct entry *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		s_info.head = entry->next;
+
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		s_info.tail = entry->prev;
+
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+
+
+static inline
+void push_lru(struct entry *entry)
+{
+	entry->next = s_info.head;
+	if (s_info.head)
+		s_info.head->prev = entry;
+	s_info.head = entry;
+
+	if (!s_info.tail)
+		s_info.tail = entry;
+}
+
+
+
+static inline
+void remove_entry(struct entry *entry)
+{
+	struct entry **ptr;
+
+	ptr = &s_info.buckets[(unsigned int)entry->identity.pid % CACHE_BUCKETS];
+	while (*ptr != entry)
+		ptr = &(*ptr)->hash_next;
+	*ptr = entry->hash_next;
+
+	unlink_lru(entry);
+	s_info.count--;
+	free(entry);
+}
+
+
+
+static inline
+struct entry *find_entry(int pid)
+{
+	struct entry *entry;
+
+	entry = s_info.buckets[(unsigned int)pid % CACHE_BUCKETS];
+	while (entry && entry->identity.pid != pid)
+		entry = entry->hash_next;
+
+	return entry;
+}
+
+
+
+static inline
+struct entry *add_entry(int pid, unsigned long long start_time)
+{
+	struct entry *entry;
+	int bucket;
+	int ret;
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	entry->identity.pid = pid;
+	entry->identity.start_time = start_time;
+
+	if (s_info.resolve)
+		ret = s_info.resolve(pid, entry->identity.appid, sizeof(entry->identity.appid),
+				entry->identity.pkgname, sizeof(entry->identity.pkgname), s_info.data);
+	else
+		ret = default_resolve(pid, entry->identity.appid, sizeof(entry->identity.appid),
+				entry->identity.pkgname, sizeof(entry->identity.pkgname), NULL);
+
+	if (ret < 0) {
+		free(entry);
+		return NULL;
+	}
+
+	if (s_info.count >= CACHE_MAX)
+		remove_entry(s_info.tail);
+
+	bucket = (unsigned int)pid % CACHE_BUCKETS;
+	entry->hash_next = s_info.buckets[bucket];
+	s_info.buckets[bucket] = entry;
+	push_lru(entry);
+	s_info.count++;
+	return entry;
+}
+
+
+
+static inline
+void clear_cache(void)
+{
+	while (s_info.head)
+		remove_entry(s_info.head);
+}
+
+
+
+void identity_set_resolver(int (*resolve)(int pid, char *appid, int appid_size, char *pkgname, int pkgname_size, void *data), void *data)
+{
+	clear_cache();
+	s_info.resolve = resolve;
+	s_info.data = data;
+}
+
+
+
+int identity_get(int pid, struct identity *identity)
+{
+	unsigned long long start_time;
+	struct entry *entry;
+
+	if (pid <= 0)
+		return -EINVAL;
+
+	entry = find_entry(pid);
+
+	if (get_start_time(pid, &start_time) < 0) {
+		if (entry)
+			remove_entry(entry);
+		return -ESRCH;
+	}
+
+	if (entry && entry->identity.start_time != start_time) {
+		/* pid is reused */
+		remove_entry(entry);
+		entry = NULL;
+	}
+
+	if (entry) {
+		unlink_lru(entry);
+		push_lru(entry);
+	} else {
+		entry = add_entry(pid, start_time);
+		if (!entry)
+			return -ESRCH;
+	}
+
+	memcpy(identity, &entry->identity, sizeof(*identity));
+	return 0;
+}
+
+
+
+void identity_purge(void)
+{
+	unsigned long long start_time;
+	struct entry *entry;
+	struct entry *next;
+
+	for (entry = s_info.head; entry; entry = next) {
+		next = entry->next;
+		if (get_start_time(entry->identity.pid, &start_time) < 0 || start_time != entry->identity.start_time)
+			remove_entry(entry);
+	}
+}
+
+
+
+int identity_count(void)
+{
+	return s_info.count;
+}
+
+
+
+/* End of a file */
@@ -0,0 +1,423 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Write-ahead journal of received requests.
+ *
+ * File layout (host byte order, the file is a local one)
+ *
+ * +--------+----------------------------+----------------------------+-----
+ * | header | record header | payload    | record header | payload    | ...
+ * +--------+----------------------------+----------------------------+-----
+ *
+ * A BEGIN record has a received request as its payload,
+ * a DONE record (no payload) marks the BEGIN record which has the same id.
+ * Records are only appended, a broken record (interrupted write) ends the journal.
+ *
+ * BEGIN records which don't have the DONE record are replayed by the next journal_init.
+ * Records are synced by the journal_commit, so a burst of requests costs one sync.
+ * If every request is done, the journal is truncated at the commit.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <dlog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+#include <journal.h>
+
+
+
+#define JOURNAL_MAGIC "SCJOURNL"
+#define JOURNAL_VERSION 1
+#define TRUNCATE_THRESHOLD (64 * 1024)
+#define MAX_RECORD (2 * 1024 * 1024)
+
+
+
+extern int errno;
+
+
+
+struct journal_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+
+
+struct journal_record {
+	uint32_t size; /* Size of the payload */
+	uint32_t checksum; /* Of the rest of the header and the payload */
+	int32_t id;
+	int32_t kind;
+	int32_t pid;
+};
+
+
+
+enum {
+	RECORD_BEGIN = 0x1,
+	RECORD_DONE = 0x2,
+};
+
+
+
+static struct info {
+	int fd;
+	int last_id;
+	int pending; /* BEGIN records which are not done */
+	int dirty;
+	off_t size;
+} s_info = {
+	.fd = -1,
+	.last_id = 0,
+	.pending = 0,
+	.dirty = 0,
+	.size = 0,
+};
+
+
+
+static inline
+uint32_t checksum(const struct journal_record *record, const char *payload)
+{
+	const unsigned char *ptr;
+	uint32_t hash = 2166136261u;
+	int size;
+
+	/* FNV-1a */
+	ptr = (const unsigned char *)&record->id;
+	size = sizeof(*record) - ((const char *)&record->id - (const char *)record);
+	while (size--) {
+		hash ^= *ptr++;
+		hash *= 16777619u;
+	}
+
+	ptr = (const unsigned char *)payload;
+	size = record->size;
+	while (size--) {
+		hash ^= *ptr++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+
+static inline
+int write_record(int kind, int id, int pid, const char *payload, int size)
+{
+	struct journal_record record;
+	struct iovec iov[2];
+	ssize_t ret;
+
+	record.size = size;
+	record.id = id;
+	record.kind = kind;
+	record.pid = pid;
+	record.checksum = checksum(&record, payload);
+
+	iov[0].iov_base = &record;
+	iov[0].iov_len = sizeof(record);
+	iov[1].iov_base = (void *)payload;
+	iov[1].iov_len = size;
+
+	/* O_APPEND, a record is written at once */
+	ret = writev(s_info.fd, iov, size ? 2 : 1);
+	if (ret != sizeof(record) + size) {
+		LOGE("Failed to write a record (%s)\n", strerror(errno));
+		if (ret > 0 && ftruncate(s_info.fd, s_info.size) < 0)
+			LOGE("Failed to drop the broken record (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	s_info.size += ret;
+	s_info.dirty = 1;
+	return 0;
+}
+
+
+
+static inline
+int reset_file(int fd)
+{
+	struct journal_header header;
+
+	if (ftruncate(fd, 0) < 0) {
+		LOGE("Failed to truncate the journal (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+	header.version = JOURNAL_VERSION;
+
+	if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+		LOGE("Failed to write the header (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	if (fdatasync(fd) < 0)
+		LOGE("Failed to sync the journal (%s)\n", strerror(errno));
+
+	s_info.size = sizeof(header);
+	return 0;
+}
+
+
+
+static inline
+int is_done(const char *map, off_t size, off_t offset, int id)
+{
+	const struct journal_record *record;
+
+	while (offset + (off_t)sizeof(*record) <= size) {
+		record = (const struct journal_record *)(map + offset);
+		if (record->kind == RECORD_DONE && record->id == id)
+			return 1;
+
+		offset += sizeof(*record) + record->size;
+	}
+
+	return 0;
+}
+
+
+
+/*
+ * Returns the size of valid records.
+ */
+static inline
+off_t validate(const char *map, off_t size)
+{
+	const struct journal_record *record;
+	off_t offset;
+
+	offset = sizeof(struct journal_header);
+	while (offset + (off_t)sizeof(*record) <= size) {
+		record = (const struct journal_record *)(map + offset);
+		if (record->size > MAX_RECORD || offset + (off_t)sizeof(*record) + record->size > size)
+			break;
+
+		if (record->checksum != checksum(record, (const char *)(record + 1)))
+			break;
+
+		offset += sizeof(*record) + record->size;
+	}
+
+	return offset;
+}
+
+
+
+static inline
+int replay_file(int fd, void (*replay)(int pid, const char *buffer, int size, void *data), void *data)
+{
+	const struct journal_header *header;
+	const struct journal_record *record;
+	struct stat st;
+	char *map;
+	off_t offset;
+	off_t size;
+	int count;
+
+	if (fstat(fd, &st) < 0) {
+		LOGE("Failed to get the size of journal (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	if (st.st_size < (off_t)sizeof(*header))
+		return 0;
+
+	map = malloc(st.st_size);
+	if (!map) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return -ENOMEM;
+	}
+
+	if (pread(fd, map, st.st_size, 0) != st.st_size) {
+		LOGE("Failed to read the journal (%s)\n", strerror(errno));
+		free(map);
+		return -EIO;
+	}
+
+	header = (const struct journal_header *)map;
+	if (memcmp(header->magic, JOURNAL_MAGIC, sizeof(header->magic)) || header->version != JOURNAL_VERSION) {
+		LOGE("Invalid journal, it is discarded\n");
+		free(map);
+		return 0;
+	}
+
+	size = validate(map, st.st_size);
+	if (size != st.st_size)
+		LOGD("Broken tail of the journal is ignored (%lld bytes)\n", (long long)(st.st_size - size));
+
+	count = 0;
+	offset = sizeof(*header);
+	while (offset < size) {
+		record = (const struct journal_record *)(map + offset);
+		offset += sizeof(*record) + record->size;
+
+		if (record->kind != RECORD_BEGIN || is_done(map, size, offset, record->id))
+			continue;
+
+		LOGD("Replay the request %d of %d\n", record->id, record->pid);
+		replay(record->pid, (const char *)(record + 1), record->size, data);
+		count++;
+	}
+
+	free(map);
+	return count;
+}
+
+
+
+int journal_init(const char *path, void (*replay)(int pid, const char *buffer, int size, void *data), void *data)
+{
+	int count;
+	int fd;
+
+	if (!path || !replay)
+		return -EINVAL;
+
+	if (s_info.fd >= 0)
+		return -EALREADY;
+
+	fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		LOGE("Failed to open %s (%s)\n", path, strerror(errno));
+		return -EIO;
+	}
+
+	count = replay_file(fd, replay, data);
+	if (count < 0) {
+		close(fd);
+		return count;
+	}
+
+	/* Every request is done now */
+	if (reset_file(fd) < 0) {
+		close(fd);
+		return -EIO;
+	}
+
+	s_info.fd = fd;
+	s_info.last_id = 0;
+	s_info.pending = 0;
+	s_info.dirty = 0;
+	return count;
+}
+
+
+
+int journal_fini(void)
+{
+	if (s_info.fd < 0)
+		return -EINVAL;
+
+	journal_commit();
+
+	if (close(s_info.fd) < 0)
+		LOGE("Failed to close the journal (%s)\n", strerror(errno));
+
+	s_info.fd = -1;
+	return 0;
+}
+
+
+
+int journal_is_enabled(void)
+{
+	return s_info.fd >= 0;
+}
+
+
+
+int journal_begin(int pid, const char *buffer, int size)
+{
+	int id;
+	int ret;
+
+	if (s_info.fd < 0 || size < 0 || size > MAX_RECORD)
+		return -EINVAL;
+
+	id = s_info.last_id + 1;
+	if (id <= 0)
+		id = 1;
+
+	ret = write_record(RECORD_BEGIN, id, pid, buffer, size);
+	if (ret < 0)
+		return ret;
+
+	s_info.last_id = id;
+	s_info.pending++;
+	return id;
+}
+
+
+
+int journal_done(int id)
+{
+	int ret;
+
+	if (s_info.fd < 0 || id <= 0)
+		return -EINVAL;
+
+	ret = write_record(RECORD_DONE, id, 0, NULL, 0);
+	if (ret < 0)
+		return ret;
+
+	s_info.pending--;
+	return 0;
+}
+
+
+
+int journal_commit(void)
+{
+	if (s_info.fd < 0)
+		return -EINVAL;
+
+	if (!s_info.dirty)
+		return 0;
+
+	/* Nothing to replay, drop records instead of syncing them */
+	if (s_info.pending == 0 && s_info.size > TRUNCATE_THRESHOLD) {
+		s_info.dirty = 0;
+		return reset_file(s_info.fd);
+	}
+
+	if (fdatasync(s_info.fd) < 0) {
+		LOGE("Failed to sync the journal (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	s_info.dirty = 0;
+	return 0;
+}
+
+
+
+/* End of a file */
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
+#include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <errno.h>
@@ -22,17 +24,65 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
+#include <time.h>
+#include <poll.h>
 
 #include <secom_socket.h>
+#include <transport.h>
 #include <shortcut.h>
+#include <trace.h>
+#include <registry.h>
+#include <packet.h>
+#include <icon_cache.h>
+#include <journal.h>
+#include <spool.h>
+#include <handover.h>
+#include <wfq.h>
+#include <identity.h>
+#include <ring.h>
+#include <subscription.h>
+#include <prefetch.h>
+#include <cost.h>
+#include <pool.h>
 
 #include <sys/socket.h>
-#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 
 
 
 #define EAPI __attribute__((visibility("default")))
 
+#define QUERY_TIMEOUT 3 /* seconds */
+#define SPOOL_POLL_INTERVAL 1000 /* ms */
+#define LISTEN_FDS_START 3 /* The first fd which is passed by the socket activation */
+#define SPOOL_RECHECK_DELAY 5000 /* ms, for requests which are spooled while the server is starting */
+#define RECV_CHUNK 4096
+#define IDENTITY_PURGE_INTERVAL 30000 /* ms, identities of exited processes are dropped */
+#define DISPATCH_BATCH 4 /* Requests which are dispatched in an iteration of the main loop */
+#define PREFETCH_LOOKAHEAD 8 /* Following requests in the inbox, whose targets are prefetched */
+#define EVENT_COALESCE_DELAY 16 /* ms, events of a burst are sent in a batch */
+#define EVENT_BATCH_SIZE (64 * 1024) /* Pending batch is sent at once if it is larger than this */
+#define FALLBACK_EXPIRY 60000 /* ms, v1 is used after a fallback, then the v2 is tried again */
+
+/* Weights of priority classes */
+#define WEIGHT_INTERACTIVE 16
+#define WEIGHT_NORMAL 4
+#define WEIGHT_BULK 1
+
+/* Features which are supported by this library */
+#if defined(HAVE_MEMFD_CREATE)
+#define SERVER_FEATURES (FEATURE_BATCH | FEATURE_FD_PASSING | FEATURE_SHM_RING | FEATURE_SUBSCRIPTION | FEATURE_CREDIT | FEATURE_NO_REPLY)
+#else
+#define SERVER_FEATURES (FEATURE_BATCH | FEATURE_FD_PASSING | FEATURE_SUBSCRIPTION | FEATURE_NO_REPLY)
+#endif
+#define CLIENT_FEATURES (FEATURE_FD_PASSING | FEATURE_CREDIT | FEATURE_NO_REPLY)
+
+/* Content fd should not be changed while the server is using it */
+#define CONTENT_SEALS (F_SEAL_SHRINK | F_SEAL_WRITE)
+
 
 
 extern int errno;
@@ -46,6 +96,27 @@ struct server_cb {
 
 
 
+struct request_ex_cb {
+	request_ex_cb_t request_ex_cb;
+	void *data;
+};
+
+
+
+struct update_cb {
+	update_cb_t update_cb;
+	void *data;
+};
+
+
+
+struct remove_cb {
+	remove_cb_t remove_cb;
+	void *data;
+};
+
+
+
 struct client_cb {
 	result_cb_t result_cb;
 	void *data;
@@ -53,719 +124,4806 @@ struct client_cb {
 
 
 
+struct handover_cb {
+	shortcut_handover_cb_t handover_cb;
+	void *data;
+};
+
+
+
+struct event_cb {
+	shortcut_event_cb_t event_cb;
+	void *data;
+};
+
+
+
+struct spool_wait {
+	char name[SPOOL_NAME_LEN];
+	unsigned long long deadline;
+	struct client_cb *client_cb;
+	struct spool_wait *next;
+};
+
+
+
+/*
+ * request_cb which is invoked on a worker of the pool.
+ * It has copies of what the callback uses, the connection can be closed while it runs.
+ */
+struct callback_job {
+	struct connection_state *state; /* NULL if the connection is closed */
+	char *buffer; /* Fields of the msg are pointing it */
+	struct message msg;
+	int flags;
+	unsigned long long received;
+	int pid;
+	int uid;
+	const char *exec;
+	int exec_len;
+	int content_size; /* exec is mapped from the content fd, if it is not 0 */
+	int icon_fd; /* Taken from the connection */
+	char icon_path[32];
+	const char *icon;
+	int icon_len;
+	struct identity identity;
+	struct shortcut_identity caller;
+	const struct prefetch_target *prefetch_target;
+	struct shortcut_target target;
+	unsigned long long ns; /* Time in the callback */
+	int ret;
+};
+
+
+
 static struct info {
 	pthread_mutex_t server_mutex;
 	int server_fd;
+	guint server_id;
 	const char *socket_file;
+	const char *handover_file;
+	int handover_fd;
+	guint handover_id;
+	struct handover_cb handover_cb;
+	struct connection_state *conn_list; /* Connections of the server */
 	struct server_cb server_cb;
+	struct request_ex_cb request_ex_cb;
+	struct update_cb update_cb;
+	struct remove_cb remove_cb;
 	unsigned int seq;
+	int server_version; /* 0 if it is not negotiated yet */
+	int server_features;
+	unsigned long long fallback_expire; /* ms, when the server_version is 1 by the fallback */
+	guint commit_id; /* Idle source of the group commit */
+	struct connection_state *commit_list; /* Waiting the group commit */
+	guint spool_id; /* Timer for results of spooled requests */
+	struct spool_wait *spool_list;
+	guint dispatch_id; /* Idle source of the dispatch queue */
+	int priority; /* Of requests of this client */
+	int timeout; /* ms, of requests of this client. 0 if there is no deadline */
+	unsigned int expired; /* Requests which are dropped after their deadline */
+	guint purge_id; /* Timer for the identity cache */
+	struct connection_state *ring_state; /* Connection of the ring for ACKs, requests of this client are sent through the ring if it is opened */
+	guint event_id; /* Timer of the pending batch of events */
+	guint close_id; /* Idle source which closes connections of failed subscribers */
+	struct connection_state *event_state; /* Connection of the subscription of this client */
+	struct event_cb event_cb;
+	const struct transport *transport; /* Of connections of the server and clients */
+	struct connection_state *flush_list; /* Have replies in the outbox */
+	guint flush_id; /* Idle source of the flush */
+	unsigned long long callback_begin; /* ns, of the callback which is being invoked */
 } s_info = {
 	.server_mutex = PTHREAD_MUTEX_INITIALIZER,
 	.server_fd = -1,
+	.server_id = 0,
 	.socket_file = "/tmp/.shortcut",
+	.handover_file = "/tmp/.shortcut.handover",
+	.handover_fd = -1,
+	.handover_id = 0,
+	.conn_list = NULL,
 	.seq = 0,
+	.server_version = 0,
+	.server_features = 0,
+	.fallback_expire = 0,
+	.commit_id = 0,
+	.commit_list = NULL,
+	.spool_id = 0,
+	.spool_list = NULL,
+	.dispatch_id = 0,
+	.priority = MESSAGE_PRIORITY_NORMAL,
+	.timeout = 0,
+	.expired = 0,
+	.purge_id = 0,
+	.ring_state = NULL,
+	.event_id = 0,
+	.close_id = 0,
+	.event_state = NULL,
+	.transport = &transport_unix,
+	.flush_list = NULL,
+	.flush_id = 0,
+	.callback_begin = 0,
 };
 
 
 
-struct packet {
-	struct {
-		unsigned int seq;
-		enum {
-			PACKET_ERR = 0x0,
-			PACKET_REQ,
-			PACKET_ACK,
-			PACKET_MAX = 0xFF, /* MAX */
-		} type;
-
-		int payload_size;
-
-		union {
-			struct {
-				int shortcut_type;
-				struct {
-					int pkgname;
-					int name;
-					int exec;
-					int icon;
-				} field_size;
-			} req;
-
-			struct {
-				int ret;
-			} ack;
-		} data;
-	} head;
-
-	char payload[];
+/*
+ * Of the callback which is being invoked.
+ * request_cb can be invoked on workers of the pool, each thread has its own.
+ */
+static __thread const struct shortcut_identity *s_caller = NULL;
+static __thread const struct shortcut_target *s_target = NULL;
+
+
+
+struct buffer {
+	char *data;
+	int size;
+	int length;
 };
 
 
 
 struct connection_state {
 	void *data;
-	struct packet packet;
-	enum {
-		BEGIN,
-		HEADER,
-		PAYLOAD,
-		END,
-		ERROR,
-	} state;
-	int length;
+	int version;
+	int features;
 	int from_pid;
-	char *payload;
+	int peeked; /* Header of the current packet is traced */
+	struct buffer inbox;
+
+	/* Received fds, taken by messages in order */
+	int fds[SECOM_MAX_FDS];
+	int nr_fds;
+
+	/* fds of the message being dispatched */
+	int content_fd;
+	int icon_fd;
+	int ring_fds[2];
+
+	/* Requests of the peer are also received through it */
+	struct ring_server *ring;
+	guint ring_id;
+	int credit_grant; /* Credits which are returned with the next ACK */
+	guint out_id; /* Waits the socket to be writable, dispatching waits the peer to read replies */
+	int hangup; /* Peer is gone, received requests are dispatched without replies */
+	int close_pending; /* Closed by the idle source, it can be being dispatched */
+
+	/* Replies which are not sent yet, they are sent at once after the dispatching */
+	struct buffer outbox;
+	int flush_pending;
+	struct connection_state *flush_next;
+
+	/* Events are sent to the peer */
+	struct subscriber *subscriber;
+	guint event_out_id; /* Waits the socket to be writable */
+
+	/* Request which is deferred, following packets wait it */
+	int conn_fd;
+	guint id;
+	int uid;
+	unsigned long long received; /* CLOCK_MONOTONIC in ms, when the inbox is filled from empty */
+	struct identity *identity; /* Of the peer, resolved once */
+	struct wfq_entry queue; /* Has a packet to dispatch */
+	struct connection_state *conn_prev;
+	struct connection_state *conn_next;
+	struct message deferred;
+	char *deferred_buffer;
+	int deferred_size;
+	void *icon_job; /* Waiting its icon */
+	int icon_checked;
+	void *target_job; /* Waiting its target to be resolved */
+	int target_checked;
+	struct callback_job *callback_job; /* request_cb is running on the pool */
+	int journal_id;
+	int commit_pending; /* Waiting the group commit */
+	struct connection_state *commit_next;
+	int result; /* Of the request which is not from a connection */
+
+	/* Client side */
+	unsigned int seq;
+	unsigned long long deadline;
+	guint timeout_id;
+	int hello_sent;
+	char *fallback; /* v1 packet, for the server which doesn't know the hello */
+	int fallback_size;
+	struct buffer pending; /* v2 packet with fds, sent after the hello */
+	int send_fds[SECOM_MAX_FDS];
+	int nr_send_fds;
 };
 
 
 
 static inline
-gboolean check_reply_service(int conn_fd, struct connection_state *state)
+int buffer_reserve(struct buffer *buf, int size)
 {
-	struct client_cb *client_cb = state->data;
+	char *data;
+	int new_size;
 
-	if (client_cb->result_cb) {
-		/* If the callback return FAILURE,
-		 * remove itself from the callback list */
-		client_cb->result_cb(state->packet.head.data.ack.ret,
-					state->from_pid, client_cb->data);
-	}
+	if (buf->length + size <= buf->size)
+		return 0;
 
-	state->state = BEGIN;
-	state->length = 0;
-	state->from_pid = 0;
+	new_size = buf->size ? buf->size : RECV_CHUNK;
+	while (new_size < buf->length + size)
+		new_size <<= 1;
 
-	/* NOTE: If we want close the connection, returns FALSE */
-	return FALSE;
+	data = realloc(buf->data, new_size);
+	if (!data) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return -ENOMEM;
+	}
+
+	buf->data = data;
+	buf->size = new_size;
+	return 0;
 }
 
 
 
 static inline
-gboolean do_reply_service(int conn_fd, struct connection_state *state)
+void buffer_consume(struct buffer *buf, int size)
 {
-	int ret;
-	struct packet send_packet;
-
-	ret = -ENOSYS;
-	if (s_info.server_cb.request_cb) {
-		char *pkgname;
-		char *name;
-		char *exec;
-		char *icon;
-
-		if (state->packet.head.data.req.field_size.pkgname)
-			pkgname = state->payload;
-		else
-			pkgname = NULL;
-
-		if (state->packet.head.data.req.field_size.name)
-			name = state->payload + state->packet.head.data.req.field_size.pkgname;
-		else
-			name = NULL;
-
-		if (state->packet.head.data.req.field_size.exec) {
-			exec = state->payload + state->packet.head.data.req.field_size.pkgname;
-			exec += state->packet.head.data.req.field_size.name;
-		} else {
-			exec = NULL;
-		}
-
-		if (state->packet.head.data.req.field_size.icon) {
-			icon = state->payload + state->packet.head.data.req.field_size.pkgname;
-			icon += state->packet.head.data.req.field_size.name;
-			icon += state->packet.head.data.req.field_size.exec;
-		} else {
-			icon = NULL;
-		}
+	buf->length -= size;
+	if (buf->length > 0)
+		memmove(buf->data, buf->data + size, buf->length);
+}
 
-		LOGD("Pkgname: [%s] Type: [%x], Name: [%s], Exec: [%s], Icon: [%s]\n",
-				pkgname,
-				state->packet.head.data.req.shortcut_type,
-				name,
-				exec,
-				icon);
 
-		ret = s_info.server_cb.request_cb(
-				pkgname,
-				name,
-				state->packet.head.data.req.shortcut_type,
-				exec,
-				icon,
-				state->from_pid,
-				s_info.server_cb.data);
-	}
 
-	send_packet.head.type = PACKET_ACK;
-	send_packet.head.payload_size = 0;
-	send_packet.head.seq = state->packet.head.seq;
-	send_packet.head.data.ack.ret = ret;
+static inline
+int buffer_append(struct buffer *buf, int version, const struct message *msg)
+{
+	int size;
 
-	if (secom_send(conn_fd, (const char*)&send_packet, sizeof(send_packet)) != sizeof(send_packet)) {
-		LOGE("Faield to send ack packet\n");
-		return FALSE;
-	}
+	size = packet_size(version, msg);
+	if (buffer_reserve(buf, size) < 0)
+		return -ENOMEM;
 
-	state->state = BEGIN;
-	state->length = 0;
-	state->from_pid = 0;
-	return TRUE;
+	buf->length += packet_encode(version, msg, buf->data + buf->length);
+	return size;
 }
 
 
 
 static inline
-gboolean filling_payload(int conn_fd, struct connection_state *state)
+unsigned long long monotonic_ms(void)
 {
-	if (state->length < state->packet.head.payload_size) {
-		int ret;
-		int check_pid;
+	struct timespec ts;
 
-		ret = secom_recv(conn_fd,
-			state->payload + state->length,
-			state->packet.head.payload_size - state->length,
-			&check_pid);
-		if (ret < 0)
-			return FALSE;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
 
-		if (state->from_pid != check_pid) {
-			LOGD("PID is not matched (%d, expected %d)\n",
-						check_pid, state->from_pid);
-			return FALSE;
-		}
 
-		state->length += ret;
-	}
 
-	if (state->length == state->packet.head.payload_size) {
-		state->length = 0;
-		state->state = END;
-	}
+static inline
+unsigned long long monotonic_ns(void)
+{
+	struct timespec ts;
 
-	return TRUE;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
 }
 
 
 
 static inline
-gboolean deal_error_packet(int conn_fd, struct connection_state *state)
+void close_fds(int *fds, int *nr_fds)
 {
-	if (state->length < state->packet.head.payload_size) {
-		int ret;
-		char *buf;
-		int check_pid;
+	while (*nr_fds > 0) {
+		(*nr_fds)--;
+		if (close(fds[*nr_fds]) < 0)
+			LOGE("Failed to close fd (%s)\n", strerror(errno));
+	}
+}
 
-		buf = alloca(state->packet.head.payload_size - state->length);
 
-		ret = secom_recv(conn_fd,
-			buf,
-			state->packet.head.payload_size - state->length,
-			&check_pid);
-		if (ret < 0)
-			return FALSE;
 
-		if (check_pid != state->from_pid)
-			LOGD("PID is not matched (%d, expected %d)\n",
-						check_pid, state->from_pid);
+static inline
+struct connection_state *create_state(void)
+{
+	struct connection_state *state;
 
-		state->length += ret;
+	state = calloc(1, sizeof(*state));
+	if (!state) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return NULL;
 	}
 
-	if (state->length < state->packet.head.payload_size)
-		return TRUE;
-
-	/* Now, drop this connection */
-	return FALSE;
+	state->content_fd = -1;
+	state->icon_fd = -1;
+	state->ring_fds[0] = -1;
+	state->ring_fds[1] = -1;
+	state->uid = -1;
+	return state;
 }
 
 
 
 static inline
-gboolean filling_header(int conn_fd, struct connection_state *state)
+void destroy_state(struct connection_state *state)
 {
-	if (state->length < sizeof(state->packet)) {
-		int ret;
-		int check_pid;
+	struct connection_state **ptr;
 
-		ret = secom_recv(conn_fd,
-			((char*)&state->packet) + state->length, 
-			sizeof(state->packet) - state->length,
-			&check_pid);
-		if (ret < 0)
-			return FALSE;
+	if (state->icon_job)
+		icon_cache_cancel(state->icon_job);
 
-		if (state->from_pid == 0)
-			state->from_pid = check_pid;
+	if (state->target_job)
+		prefetch_cancel(state->target_job);
 
-		if (state->from_pid != check_pid) {
-			LOGD("PID is not matched (%d, expected %d)\n",
-						check_pid, state->from_pid);
-			return FALSE;
-		}
+	/* Running one cannot be cancelled, it is finished without the connection */
+	if (state->callback_job)
+		state->callback_job->state = NULL;
+
+	if (state->timeout_id)
+		g_source_remove(state->timeout_id);
 
-		state->length += ret;
+	wfq_remove(&state->queue);
+
+	if (state->conn_prev)
+		state->conn_prev->conn_next = state->conn_next;
+	else if (s_info.conn_list == state)
+		s_info.conn_list = state->conn_next;
+
+	if (state->conn_next)
+		state->conn_next->conn_prev = state->conn_prev;
+
+	if (state->commit_pending) {
+		ptr = &s_info.commit_list;
+		while (*ptr != state)
+			ptr = &(*ptr)->commit_next;
+		*ptr = state->commit_next;
 	}
 
-	if (state->length < sizeof(state->packet))
-		return TRUE;
+	if (state->flush_pending) {
+		ptr = &s_info.flush_list;
+		while (*ptr != state)
+			ptr = &(*ptr)->flush_next;
+		*ptr = state->flush_next;
+	}
 
-	if (state->packet.head.type == PACKET_ACK) {
-		state->length = 0;
+	/* Peer is gone, the request is dropped as it would be without the journal */
+	if (state->journal_id)
+		journal_done(state->journal_id);
 
-		if (state->packet.head.payload_size)
-			state->state = ERROR;
-		else
-			state->state = END;
-	} else if (state->packet.head.type == PACKET_REQ) {
-		/* Let's take the next part. */
-		state->state = PAYLOAD;
-		state->length = 0;
+	if (state->content_fd >= 0)
+		close(state->content_fd);
 
-		state->payload = calloc(1, state->packet.head.payload_size);
-		if (!state->payload) {
-			LOGE("Heap: %s\n", strerror(errno));
-			return FALSE;
-		}
-	} else {
-		LOGE("Invalid packet type\n");
-		return FALSE;
+	if (state->icon_fd >= 0)
+		close(state->icon_fd);
+
+	if (state->ring_fds[0] >= 0)
+		close(state->ring_fds[0]);
+
+	if (state->ring_fds[1] >= 0)
+		close(state->ring_fds[1]);
+
+	if (state->ring) {
+		if (state->ring_id)
+			g_source_remove(state->ring_id);
+		ring_server_detach(state->ring);
 	}
 
-	return TRUE;
+	if (state->out_id)
+		g_source_remove(state->out_id);
+
+	if (state->subscriber)
+		subscription_remove(state->subscriber);
+
+	if (state->event_out_id)
+		g_source_remove(state->event_out_id);
+
+	free(state->identity);
+	free(state->deferred_buffer);
+	close_fds(state->fds, &state->nr_fds);
+	close_fds(state->send_fds, &state->nr_send_fds);
+	free(state->inbox.data);
+	free(state->outbox.data);
+	free(state->pending.data);
+	free(state->fallback);
+	free(state);
 }
 
 
 
-static
-gboolean client_connection_cb(GIOChannel *src, GIOCondition cond, gpointer data)
+/*
+ * Returns the size of received data, 0 if the peer is disconnected.
+ */
+static inline
+int read_inbox(int conn_fd, struct connection_state *state)
 {
-	int conn_fd;
-	gboolean ret;
 	int read_size;
-	struct connection_state *state = data;
-	struct client_cb *client_cb = state->data;
-
-	if (!(cond & G_IO_IN)) {
-		LOGE("Condition value is unexpected value\n");
-		ret = FALSE;
-		goto out;
-	}
+	int check_pid;
+	int nr_fds;
+	int ret;
 
-	conn_fd = g_io_channel_unix_get_fd(src);
+	read_size = s_info.transport->pending(conn_fd);
+	if (read_size < 0)
+		return -EIO;
 
-	if (ioctl(conn_fd, FIONREAD, &read_size) < 0) {
-		LOGE("Failed to get q size\n");
-		ret = FALSE;
-		goto out;
-	}
+	if (read_size == 0)
+		return 0;
 
-	if (read_size == 0) {
-		if (client_cb->result_cb) {
-			/* If the callback return FAILURE,
-			 * remove itself from the callback list */
-			client_cb->result_cb(-ECONNABORTED,
-					state->from_pid, client_cb->data);
-		}
-		ret = FALSE;
-		goto out;
-	}
+	if (buffer_reserve(&state->inbox, read_size) < 0)
+		return -ENOMEM;
 
-	switch (state->state) {
-	case BEGIN:
-		state->state = HEADER;
-	case HEADER:
-		ret = filling_header(conn_fd, state);
-		break;
-	case ERROR:
-		ret = deal_error_packet(conn_fd, state);
-		break;
-	default:
-		ret = FALSE;
-		break;
-	}
+	nr_fds = SECOM_MAX_FDS - state->nr_fds;
+	ret = s_info.transport->recv(conn_fd, state->inbox.data + state->inbox.length, read_size,
+					&check_pid, state->fds + state->nr_fds, &nr_fds);
+	state->nr_fds += nr_fds;
+	if (ret <= 0)
+		return -EIO;
 
-	if (state->state == END)
-		ret = check_reply_service(conn_fd, state);
+	if (state->from_pid == 0)
+		state->from_pid = check_pid;
 
-out:
-	if (ret == FALSE) {
-		close(conn_fd);
-		free(state->data);
-		free(state);
+	if (state->from_pid != check_pid) {
+		LOGD("PID is not matched (%d, expected %d)\n",
+					check_pid, state->from_pid);
+		return -EINVAL;
 	}
 
+	state->inbox.length += ret;
 	return ret;
 }
 
 
 
-static
-gboolean connection_cb(GIOChannel *src, GIOCondition cond, gpointer data)
+/*
+ * Returns the size of the decoded packet, 0 if there is no complete packet.
+ */
+static inline
+int next_message(struct connection_state *state, struct message *msg)
 {
-	int conn_fd;
-	struct connection_state *state = data;
-	gboolean ret;
-	int read_size;
-
-	if (!(cond & G_IO_IN)) {
-		ret = FALSE;
-		goto out;
-	}
+	unsigned int seq;
+	int type;
+	int ret;
 
-	conn_fd = g_io_channel_unix_get_fd(src);
+	if (!state->peeked) {
+		ret = packet_peek(state->version, state->inbox.data, state->inbox.length, &seq, &type);
+		if (ret <= 0)
+			return ret;
 
-	if (ioctl(conn_fd, FIONREAD, &read_size) < 0) {
-		LOGE("Failed to get q size\n");
-		ret = FALSE;
-		goto out;
+		TRACE_HEADER(seq, state->from_pid, type, ret);
+		state->peeked = 1;
 	}
 
-	if (read_size == 0) {
-		LOGE("Disconnected\n");
-		ret = FALSE;
-		goto out;
+	ret = packet_decode(state->version, state->inbox.data, state->inbox.length, msg);
+	if (ret > 0) {
+		TRACE_PAYLOAD(msg->seq, state->from_pid, ret);
+		state->peeked = 0;
 	}
 
-	switch (state->state) {
-	case BEGIN:
-		state->state = HEADER;
-	case HEADER:
-		ret = filling_header(conn_fd, state);
-		break;
-	case PAYLOAD:
-		ret = filling_payload(conn_fd, state);
-		break;
-	default:
-		LOGE("[%s:%d] Invalid state(%x)\n",
-					__func__, __LINE__, state->state);
-		ret = FALSE;
-		break;
-	}
+	return ret;
+}
 
-	if (state->state == END) {
-		ret = do_reply_service(conn_fd, state);
-		if (state->payload) {
-			free(state->payload);
-			state->payload = NULL;
-		}
 
-		memset(&state->packet, 0, sizeof(state->packet));
-	}
 
-out:
-	if (ret == FALSE) {
-		secom_put_connection_handle(conn_fd);
+/*
+ * Don't let the caller be blocked forever by a stuck homescreen.
+ */
+static inline
+int recv_timed(int conn_fd, char *buffer, int size, int *sender_pid)
+{
+	struct pollfd pfd;
+	int ret;
 
-		if (state->payload)
-			free(state->payload);
+	pfd.fd = conn_fd;
+	pfd.events = POLLIN;
+	do {
+		ret = poll(&pfd, 1, QUERY_TIMEOUT * 1000);
+	} while (ret < 0 && errno == EINTR);
 
-		free(state);
+	if (ret <= 0) {
+		LOGE("Failed to wait the server (%s)\n", ret ? strerror(errno) : "timed out");
+		return -1;
 	}
 
-	return ret;
+	return s_info.transport->recv(conn_fd, buffer, size, sender_pid, NULL, NULL);
 }
 
 
 
-static
-gboolean accept_cb(GIOChannel *src, GIOCondition cond, gpointer data)
+static inline
+int send_message(int conn_fd, int version, const struct message *msg)
 {
-	int server_fd;
-	int connection_fd;
-	GIOChannel *gio;
-	guint id;
-	struct connection_state *state;
+	char *buffer;
+	int size;
 
-	server_fd = g_io_channel_unix_get_fd(src);
-	if (server_fd != s_info.server_fd) {
-		LOGE("Unknown FD is gotten.\n");
-		/* NOTE:
-		 * In this case, don't try to do anything. 
-		 * This is not recoverble error */
-		return FALSE;
+	size = packet_size(version, msg);
+	buffer = malloc(size);
+	if (!buffer) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return -ENOMEM;
 	}
 
-	if (!(cond & G_IO_IN)) {
-		close(s_info.server_fd);
-		s_info.server_fd = -1;
-		return FALSE;
-	}
+	packet_encode(version, msg, buffer);
 
-	connection_fd = secom_get_connection_handle(server_fd);
-	if (connection_fd < 0) {
-		/* Error log will be printed from
-		 * get_connection_handle function */
-		return FALSE;
-	}
+	if (s_info.transport->send(conn_fd, buffer, size, NULL, 0) != size)
+		size = -EIO;
 
-	if (fcntl(connection_fd, F_SETFD, FD_CLOEXEC) < 0)
-		LOGE("Error: %s\n", strerror(errno));
+	free(buffer);
+	return size;
+}
 
-	if (fcntl(connection_fd, F_SETFL, O_NONBLOCK) < 0)
-		LOGE("Error: %s\n", strerror(errno));
 
-	gio = g_io_channel_unix_new(connection_fd);
-	if (!gio) {
-		LOGE("Failed to create a new connection channel\n");
-		secom_put_connection_handle(connection_fd);
-		return FALSE;
-	}
 
-	state = calloc(1, sizeof(*state));
-	if (!state) {
-		LOGE("Heap: %s\n", strerror(errno));
-		secom_put_connection_handle(connection_fd);
-		return FALSE;
-	}
+static inline
+int take_fd(struct connection_state *state)
+{
+	int fd;
 
-	state->state = BEGIN;
-	id = g_io_add_watch(gio,
-			G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+	if (state->nr_fds == 0)
+		return -1;
+
+	fd = state->fds[0];
+	state->nr_fds--;
+	memmove(state->fds, state->fds + 1, state->nr_fds * sizeof(int));
+	return fd;
+}
+
+
+
+/*
+ * Take fds of the message from the received ones.
+ * Returns -EINVAL if the peer didn't pass the fds it announced.
+ */
+static inline
+int take_message_fds(struct connection_state *state, const struct message *msg)
+{
+	if (msg->flags & MESSAGE_FLAG_CONTENT_FD) {
+		state->content_fd = take_fd(state);
+		if (state->content_fd < 0)
+			return -EINVAL;
+	}
+
+	if (msg->flags & MESSAGE_FLAG_ICON_FD) {
+		state->icon_fd = take_fd(state);
+		if (state->icon_fd < 0)
+			return -EINVAL;
+	}
+
+	if (msg->flags & MESSAGE_FLAG_RING_FDS) {
+		state->ring_fds[0] = take_fd(state);
+		state->ring_fds[1] = take_fd(state);
+		if (state->ring_fds[0] < 0 || state->ring_fds[1] < 0)
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+
+
+static inline
+void release_message_fds(struct connection_state *state)
+{
+	if (state->content_fd >= 0 && close(state->content_fd) < 0)
+		LOGE("Failed to close fd (%s)\n", strerror(errno));
+
+	if (state->icon_fd >= 0 && close(state->icon_fd) < 0)
+		LOGE("Failed to close fd (%s)\n", strerror(errno));
+
+	if (state->ring_fds[0] >= 0 && close(state->ring_fds[0]) < 0)
+		LOGE("Failed to close fd (%s)\n", strerror(errno));
+
+	if (state->ring_fds[1] >= 0 && close(state->ring_fds[1]) < 0)
+		LOGE("Failed to close fd (%s)\n", strerror(errno));
+
+	state->content_fd = -1;
+	state->icon_fd = -1;
+	state->ring_fds[0] = -1;
+	state->ring_fds[1] = -1;
+}
+
+
+
+/*
+ * Map the content_info from a sealed memfd.
+ * The content should be terminated by NUL, it is used as a string without copying.
+ */
+#if defined(HAVE_MEMFD_CREATE)
+static inline
+int map_content(int fd, const char **content, int *size)
+{
+	struct stat st;
+	char *ptr;
+	int seals;
+
+	seals = fcntl(fd, F_GET_SEALS);
+	if (seals < 0 || (seals & CONTENT_SEALS) != CONTENT_SEALS) {
+		LOGE("Content is not sealed\n");
+		return -EPERM;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		LOGE("Failed to get the size of content (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	if (st.st_size <= 0 || st.st_size > PACKET_MAX_PAYLOAD * 64) {
+		LOGE("Invalid size of content: %lld\n", (long long)st.st_size);
+		return -EINVAL;
+	}
+
+	ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (ptr == MAP_FAILED) {
+		LOGE("Failed to map the content (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	if (ptr[st.st_size - 1] != '\0') {
+		LOGE("Content is not terminated\n");
+		munmap(ptr, st.st_size);
+		return -EINVAL;
+	}
+
+	*content = ptr;
+	*size = st.st_size;
+	return 0;
+}
+#else
+static inline
+int map_content(int fd, const char **content, int *size)
+{
+	return -ENOSYS;
+}
+#endif
+
+
+
+static gboolean flush_cb(gpointer data);
+
+
+
+/*
+ * Replies which are produced in an iteration of the main loop are sent in a write.
+ */
+static inline
+void schedule_flush(struct connection_state *state)
+{
+	if (!state->flush_pending) {
+		state->flush_pending = 1;
+		state->flush_next = s_info.flush_list;
+		s_info.flush_list = state;
+	}
+
+	if (!s_info.flush_id)
+		s_info.flush_id = g_idle_add(flush_cb, NULL);
+}
+
+
+
+static inline
+int queue_reply(struct connection_state *state, const struct message *msg)
+{
+	int size;
+
+	if (state->hangup)
+		return 0;
+
+	size = buffer_append(&state->outbox, state->version, msg);
+	if (size < 0)
+		return size;
+
+	schedule_flush(state);
+	return size;
+}
+
+
+
+static inline
+gboolean send_ack(int conn_fd, struct connection_state *state, const struct message *msg, int ret)
+{
+	struct message ack;
+	int size;
+
+	/* Replayed or spooled one, nobody waits the result here */
+	if (conn_fd < 0) {
+		state->result = ret;
+		return TRUE;
+	}
+
+	/* Credit of the request is returned with its ACK, or the next one */
+	if (state->ring && ring_server_ack(state->ring))
+		state->credit_grant++;
+
+	/* Fire and forget, the client may be gone already */
+	if (msg->flags & MESSAGE_FLAG_NO_REPLY)
+		return TRUE;
+
+	message_init(&ack, PACKET_ACK, msg->seq);
+	ack.ret = ret;
+	ack.credits = state->credit_grant;
+	state->credit_grant = 0;
+
+	size = queue_reply(state, &ack);
+	if (size < 0) {
+		LOGE("Faield to send ack packet\n");
+		return FALSE;
+	}
+
+	TRACE_ACK_SEND(msg->seq, state->from_pid, ret, size);
+	return TRUE;
+}
+
+
+
+static inline int flush_output(struct connection_state *state);
+
+
+
+static inline
+gboolean do_hello_service(int conn_fd, struct connection_state *state, const struct message *msg)
+{
+	struct message hello;
+
+	message_init(&hello, PACKET_HELLO, msg->seq);
+	hello.version = msg->version < PACKET_VERSION ? msg->version : PACKET_VERSION;
+	hello.features = msg->features & SERVER_FEATURES;
+
+	/* Reply is sent in the format of the hello, following packets will use the new one */
+	if (queue_reply(state, &hello) < 0) {
+		LOGE("Failed to send the hello\n");
+		return FALSE;
+	}
+
+	/*
+	 * Sent before the request is dispatched (or journaled), not with its ACK.
+	 * Client which doesn't get this knows that its request is not taken, see fallback_to_v1.
+	 */
+	if (flush_output(state) < 0)
+		return FALSE;
+
+	state->version = hello.version;
+	state->features = hello.features;
+	LOGD("Protocol v%d (features %x) for %d\n", state->version, state->features, state->from_pid);
+	return TRUE;
+}
+
+
+
+/*
+ * Keep a copy of the message, which is dispatched later.
+ */
+static inline
+int defer_message(struct connection_state *state, const struct message *msg)
+{
+	int size;
+
+	size = packet_size_v2(msg);
+	state->deferred_buffer = malloc(size);
+	if (!state->deferred_buffer) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return -ENOMEM;
+	}
+
+	packet_encode_v2(msg, state->deferred_buffer);
+	if (packet_decode_v2(state->deferred_buffer, size, &state->deferred) != size) {
+		free(state->deferred_buffer);
+		state->deferred_buffer = NULL;
+		return -EFAULT;
+	}
+
+	state->deferred_size = size;
+	return 0;
+}
+
+
+
+static inline
+void drop_deferred(struct connection_state *state)
+{
+	free(state->deferred_buffer);
+	state->deferred_buffer = NULL;
+	state->deferred_size = 0;
+}
+
+
+
+static void icon_loaded_cb(void *data);
+static void target_loaded_cb(void *data);
+
+
+
+static
+gboolean purge_cb(gpointer data)
+{
+	identity_purge();
+	if (identity_count())
+		return TRUE;
+
+	s_info.purge_id = 0;
+	return FALSE;
+}
+
+
+
+/*
+ * Identity of the peer is resolved once for a connection.
+ */
+static inline
+void resolve_identity(struct connection_state *state)
+{
+	if (state->identity)
+		return;
+
+	state->identity = malloc(sizeof(*state->identity));
+	if (state->identity && identity_get(state->from_pid, state->identity) < 0) {
+		/* Not resolved, don't try again */
+		memset(state->identity, 0, sizeof(*state->identity));
+		state->identity->pid = state->from_pid;
+	}
+
+	if (!s_info.purge_id && identity_count())
+		s_info.purge_id = g_timeout_add(IDENTITY_PURGE_INTERVAL, purge_cb, NULL);
+}
+
+
+
+static inline
+void fill_caller(struct shortcut_identity *caller, const struct identity *identity, int pid, int uid, const char *pkgname)
+{
+	memset(caller, 0, sizeof(*caller));
+	caller->pid = pid;
+	caller->uid = uid;
+	if (identity) {
+		caller->appid = identity->appid[0] ? identity->appid : NULL;
+		caller->pkgname = identity->pkgname[0] ? identity->pkgname : NULL;
+	}
+
+	if (pkgname) {
+		caller->verified = (caller->pkgname && !strcmp(pkgname, caller->pkgname))
+				|| (caller->appid && !strcmp(pkgname, caller->appid));
+	}
+}
+
+
+
+/*
+ * Callbacks can get the caller by the shortcut_caller_identity.
+ */
+static inline
+void begin_callback(struct connection_state *state, const char *pkgname, struct shortcut_identity *caller)
+{
+	resolve_identity(state);
+	fill_caller(caller, state->identity, state->from_pid, state->uid, pkgname);
+
+	s_caller = caller;
+	s_info.callback_begin = monotonic_ns();
+}
+
+
+
+/*
+ * Time in the callback is charged to the client.
+ */
+static inline
+void end_callback(struct connection_state *state)
+{
+	cost_get(state->from_pid, state->uid)->callback_ns += monotonic_ns() - s_info.callback_begin;
+	s_caller = NULL;
+}
+
+
+
+/*
+ * If the icon is passed as a fd, the request_cb gets "/proc/self/fd/N" for the icon.
+ * It is valid only in the callback, the server can open it to keep the icon.
+ *
+ * If the icon cache is enabled, the request_cb is deferred until the icon is loaded,
+ * following packets of the connection wait it.
+ */
+static inline
+void set_view_field(struct shortcut_field *field, const char *ptr, int len)
+{
+	field->ptr = ptr;
+	field->len = ptr ? len : 0;
+}
+
+
+
+static inline
+int request_flags(int conn_fd, const struct connection_state *state)
+{
+	int flags = 0;
+
+	if (state->content_fd >= 0)
+		flags |= SHORTCUT_REQUEST_CONTENT_FD;
+	if (state->icon_fd >= 0)
+		flags |= SHORTCUT_REQUEST_ICON_FD;
+	if (conn_fd < 0)
+		flags |= SHORTCUT_REQUEST_REPLAYED;
+
+	return flags;
+}
+
+
+
+/*
+ * Fields of the view are pointing the inbox or the mapped content, nothing is copied.
+ * It doesn't touch the connection, this is also invoked on workers of the pool.
+ */
+static inline
+int invoke_request_cb(const struct message *msg, int flags, unsigned long long received, int pid,
+		const char *exec, int exec_len, const char *icon, int icon_len, const struct shortcut_identity *caller)
+{
+	struct shortcut_request_view view;
+
+	if (!s_info.request_ex_cb.request_ex_cb) {
+		return s_info.server_cb.request_cb(
+				msg->field[FIELD_PKGNAME].ptr,
+				msg->field[FIELD_NAME].ptr,
+				msg->shortcut_type,
+				exec,
+				icon,
+				pid,
+				s_info.server_cb.data);
+	}
+
+	memset(&view, 0, sizeof(view));
+	view.seq = msg->seq;
+	view.type = msg->shortcut_type;
+	view.priority = msg->priority;
+	view.caller = caller;
+	view.received = received;
+	view.dispatched = monotonic_ms();
+	view.deadline = msg->deadline;
+	view.target = s_target;
+	view.flags = flags;
+
+	set_view_field(&view.pkgname, msg->field[FIELD_PKGNAME].ptr, msg->field[FIELD_PKGNAME].size - 1);
+	set_view_field(&view.name, msg->field[FIELD_NAME].ptr, msg->field[FIELD_NAME].size - 1);
+	set_view_field(&view.content_info, exec, exec_len);
+	set_view_field(&view.icon, icon, icon_len);
+
+	return s_info.request_ex_cb.request_ex_cb(&view, s_info.request_ex_cb.data);
+}
+
+
+
+static void publish_events(void);
+static gboolean publish_cb(gpointer data);
+
+
+
+/*
+ * Events of accepted requests are kept for a while, a burst is sent in a batch.
+ */
+static inline
+void publish_event(int kind, const char *pkgname, const char *name, int type, const char *exec, const char *icon, int mask, const char *new_name)
+{
+	struct message msg;
+	int size;
+
+	if (!subscription_count())
+		return;
+
+	message_init(&msg, PACKET_EVENT, 0);
+	msg.kind = kind;
+	msg.mask = mask;
+	msg.shortcut_type = type;
+	message_set_field(&msg, FIELD_PKGNAME, pkgname);
+	message_set_field(&msg, FIELD_NAME, name);
+	message_set_field(&msg, FIELD_EXEC, exec);
+	message_set_field(&msg, FIELD_ICON, icon);
+	message_set_field(&msg, FIELD_NEW_NAME, new_name);
+
+	size = subscription_event(&msg);
+	if (size < 0) {
+		LOGE("Event of %s is dropped\n", pkgname);
+		return;
+	}
+
+	if (size >= EVENT_BATCH_SIZE) {
+		if (s_info.event_id)
+			g_source_remove(s_info.event_id);
+		s_info.event_id = 0;
+		publish_events();
+	} else if (!s_info.event_id) {
+		s_info.event_id = g_timeout_add(EVENT_COALESCE_DELAY, publish_cb, NULL);
+	}
+}
+
+
+
+/*
+ * Warm the cache for targets of following requests in the inbox.
+ * Requests whose content is passed as a fd are resolved when they are dispatched.
+ */
+static inline
+void prefetch_following(struct connection_state *state)
+{
+	struct message msg;
+	int offset;
+	int count;
+	int size;
+
+	offset = 0;
+	for (count = 0; count < PREFETCH_LOOKAHEAD && offset < state->inbox.length; count++) {
+		size = packet_decode(state->version, state->inbox.data + offset, state->inbox.length - offset, &msg);
+		if (size <= 0)
+			break;
+
+		if (msg.type == PACKET_REQ && !(msg.flags & MESSAGE_FLAG_CONTENT_FD))
+			prefetch_request(msg.shortcut_type, msg.field[FIELD_EXEC].ptr, NULL, NULL);
+
+		offset += size;
+	}
+}
+
+
+
+static inline
+void set_target(struct shortcut_target *public_target, const struct prefetch_target *target)
+{
+	public_target->path = target->path;
+	public_target->mime = target->mime;
+	public_target->appid = target->appid;
+	public_target->size = target->size;
+	public_target->mtime = target->mtime;
+}
+
+
+
+static
+void callback_run(void *data)
+{
+	struct callback_job *job = data;
+	unsigned long long begin;
+
+	TRACE_CB_ENTRY(job->msg.seq, job->pid, job->msg.shortcut_type);
+
+	s_caller = &job->caller;
+	s_target = job->prefetch_target ? &job->target : NULL;
+	begin = monotonic_ns();
+	job->ret = invoke_request_cb(&job->msg, job->flags, job->received, job->pid,
+			job->exec, job->exec_len, job->icon, job->icon_len, &job->caller);
+	job->ns = monotonic_ns() - begin;
+	s_target = NULL;
+	s_caller = NULL;
+
+	TRACE_CB_EXIT(job->msg.seq, job->pid, job->ret);
+}
+
+
+
+static inline void finish_deferred(struct connection_state *state, gboolean ret);
+
+
+
+/*
+ * Accepted one is added to the registry even if its connection is closed, as it is done in the callback.
+ * ACK is sent on the connection of the request, which waits this.
+ */
+static
+void callback_done(void *data)
+{
+	struct callback_job *job = data;
+	struct connection_state *state;
+	const char *pkgname = job->msg.field[FIELD_PKGNAME].ptr;
+	const char *name = job->msg.field[FIELD_NAME].ptr;
+	/* Path of the passed icon is meaningless after this */
+	const char *icon = job->icon_fd >= 0 ? NULL : job->icon;
+
+	cost_get(job->pid, job->uid)->callback_ns += job->ns;
+
+	if (job->ret == 0) {
+		if (registry_add(pkgname, name, job->msg.shortcut_type, job->exec, icon) < 0)
+			LOGE("Failed to update the registry\n");
+
+		publish_event(EVENT_ADD, pkgname, name, job->msg.shortcut_type, job->exec, icon, 0, NULL);
+	}
+
+	if (job->content_size)
+		munmap((void *)job->exec, job->content_size);
+
+	if (job->icon_fd >= 0 && close(job->icon_fd) < 0)
+		LOGE("Failed to close fd (%s)\n", strerror(errno));
+
+	prefetch_put(job->prefetch_target);
+
+	/* Taken after the others, the connection is cleared from the job if it is closed by them */
+	state = job->state;
+	if (state) {
+		state->callback_job = NULL;
+		finish_deferred(state, send_ack(state->conn_fd, state, &state->deferred, job->ret));
+	}
+
+	free(job->buffer);
+	free(job);
+}
+
+
+
+/*
+ * Run the request_cb on the pool, requests of a package are invoked in order.
+ * The request is deferred, following packets of the connection wait its ACK.
+ */
+static inline
+int submit_callback(int conn_fd, struct connection_state *state, const struct message *msg,
+		const char *exec, int exec_len, int content_size, const struct prefetch_target *target)
+{
+	struct callback_job *job;
+	int size;
+	int ret;
+
+	job = calloc(1, sizeof(*job));
+	if (!job) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return -ENOMEM;
+	}
+
+	size = packet_size_v2(msg);
+	job->buffer = malloc(size);
+	if (!job->buffer) {
+		LOGE("Heap: %s\n", strerror(errno));
+		free(job);
+		return -ENOMEM;
+	}
+
+	packet_encode_v2(msg, job->buffer);
+	if (packet_decode_v2(job->buffer, size, &job->msg) != size
+			|| (msg != &state->deferred && defer_message(state, msg) < 0)) {
+		free(job->buffer);
+		free(job);
+		return -EFAULT;
+	}
+
+	job->state = state;
+	job->flags = request_flags(conn_fd, state);
+	job->received = state->received;
+	job->pid = state->from_pid;
+	job->uid = state->uid;
+
+	if (content_size) {
+		job->exec = exec;
+		job->exec_len = exec_len;
+		job->content_size = content_size;
+	} else {
+		job->exec = job->msg.field[FIELD_EXEC].ptr;
+		job->exec_len = job->msg.field[FIELD_EXEC].size - 1;
+	}
+
+	job->icon_fd = state->icon_fd;
+	if (job->icon_fd >= 0) {
+		job->icon_len = snprintf(job->icon_path, sizeof(job->icon_path), "/proc/self/fd/%d", job->icon_fd);
+		job->icon = job->icon_path;
+	} else {
+		job->icon = job->msg.field[FIELD_ICON].ptr;
+		job->icon_len = job->msg.field[FIELD_ICON].size - 1;
+	}
+
+	resolve_identity(state);
+	if (state->identity)
+		job->identity = *state->identity;
+	fill_caller(&job->caller, state->identity ? &job->identity : NULL,
+			job->pid, job->uid, job->msg.field[FIELD_PKGNAME].ptr);
+
+	job->prefetch_target = target;
+	if (target)
+		set_target(&job->target, target);
+
+	ret = pool_submit(job->msg.field[FIELD_PKGNAME].ptr, callback_run, callback_done, job);
+	if (ret < 0) {
+		if (msg != &state->deferred)
+			drop_deferred(state);
+		free(job->buffer);
+		free(job);
+		return ret;
+	}
+
+	/* Closed by the job, it may be used after the connection is closed */
+	state->icon_fd = -1;
+	state->callback_job = job;
+	return 0;
+}
+
+
+
+static inline
+gboolean do_reply_service(int conn_fd, struct connection_state *state, const struct message *msg)
+{
+	struct shortcut_identity caller;
+	const struct prefetch_target *target;
+	struct shortcut_target public_target;
+	char icon_path[32];
+	void *job;
+	int content_size = 0;
+	int exec_len;
+	int icon_len;
+	int ret;
+
+	ret = -ENOSYS;
+	if (s_info.server_cb.request_cb || s_info.request_ex_cb.request_ex_cb) {
+		const char *pkgname = msg->field[FIELD_PKGNAME].ptr;
+		const char *name = msg->field[FIELD_NAME].ptr;
+		const char *exec = msg->field[FIELD_EXEC].ptr;
+		const char *icon = msg->field[FIELD_ICON].ptr;
+
+		/* Sizes of fields include the NUL */
+		exec_len = msg->field[FIELD_EXEC].size - 1;
+		icon_len = msg->field[FIELD_ICON].size - 1;
+
+		if (state->icon_fd >= 0) {
+			icon_len = snprintf(icon_path, sizeof(icon_path), "/proc/self/fd/%d", state->icon_fd);
+			icon = icon_path;
+		}
+
+		if (!state->icon_checked && icon_cache_is_enabled()) {
+			state->icon_checked = 1;
+			if (msg == &state->deferred || defer_message(state, msg) == 0) {
+				state->icon_job = icon_cache_request(icon, icon_loaded_cb, state);
+				if (state->icon_job)
+					return TRUE;
+
+				if (msg != &state->deferred)
+					drop_deferred(state);
+			}
+		}
+
+		if (!state->target_checked && state->content_fd < 0 && prefetch_is_enabled()) {
+			state->target_checked = 1;
+			job = prefetch_request(msg->shortcut_type, exec, target_loaded_cb, state);
+			if (job) {
+				/* Following requests are resolved while this one waits */
+				prefetch_following(state);
+
+				if (msg == &state->deferred || defer_message(state, msg) == 0) {
+					state->target_job = job;
+					return TRUE;
+				}
+
+				prefetch_cancel(job);
+			}
+		}
+
+		if (state->content_fd >= 0) {
+			ret = map_content(state->content_fd, &exec, &content_size);
+			if (ret < 0)
+				return send_ack(conn_fd, state, msg, ret);
+
+			exec_len = content_size - 1;
+		}
+
+		LOGD("Pkgname: [%s] Type: [%x], Name: [%s], Exec: [%s], Icon: [%s]\n",
+				pkgname,
+				msg->shortcut_type,
+				name,
+				exec,
+				icon);
+
+		target = prefetch_get(msg->shortcut_type, exec);
+
+		/* Replayed ones are invoked here, they are not from a connection */
+		if (conn_fd >= 0 && pool_is_enabled()
+				&& submit_callback(conn_fd, state, msg, exec, exec_len, content_size, target) == 0)
+			return TRUE;
+
+		if (target) {
+			set_target(&public_target, target);
+			s_target = &public_target;
+		}
+
+		TRACE_CB_ENTRY(msg->seq, state->from_pid, msg->shortcut_type);
+
+		begin_callback(state, pkgname, &caller);
+		ret = invoke_request_cb(msg, request_flags(conn_fd, state), state->received, state->from_pid,
+				exec, exec_len, icon, icon_len, &caller);
+		end_callback(state);
+		s_target = NULL;
+		prefetch_put(target);
+
+		TRACE_CB_EXIT(msg->seq, state->from_pid, ret);
+
+		if (ret == 0) {
+			/* Path of the passed icon is meaningless after this */
+			if (registry_add(pkgname, name, msg->shortcut_type, exec,
+					state->icon_fd >= 0 ? NULL : icon) < 0)
+				LOGE("Failed to update the registry\n");
+
+			publish_event(EVENT_ADD, pkgname, name, msg->shortcut_type, exec,
+					state->icon_fd >= 0 ? NULL : icon, 0, NULL);
+		}
+
+		if (content_size)
+			munmap((void *)exec, content_size);
+	}
+
+	return send_ack(conn_fd, state, msg, ret);
+}
+
+
+
+static inline
+gboolean do_update_service(int conn_fd, struct connection_state *state, const struct message *msg)
+{
+	struct shortcut_identity caller;
+	int ret;
+
+	ret = -ENOSYS;
+	if (s_info.update_cb.update_cb) {
+		const char *pkgname = msg->field[FIELD_PKGNAME].ptr;
+		const char *name = msg->field[FIELD_NAME].ptr;
+
+		LOGD("Update Pkgname: [%s] Name: [%s], Mask: [%x]\n", pkgname, name, msg->mask);
+
+		TRACE_CB_ENTRY(msg->seq, state->from_pid, msg->shortcut_type);
+
+		begin_callback(state, pkgname, &caller);
+		ret = s_info.update_cb.update_cb(
+				pkgname,
+				name,
+				msg->mask,
+				msg->field[FIELD_NEW_NAME].ptr,
+				msg->shortcut_type,
+				msg->field[FIELD_EXEC].ptr,
+				msg->field[FIELD_ICON].ptr,
+				state->from_pid,
+				s_info.update_cb.data);
+		end_callback(state);
+
+		TRACE_CB_EXIT(msg->seq, state->from_pid, ret);
+
+		if (ret == 0) {
+			if (registry_update(pkgname, name, msg->mask,
+					msg->field[FIELD_NEW_NAME].ptr,
+					msg->shortcut_type,
+					msg->field[FIELD_EXEC].ptr,
+					msg->field[FIELD_ICON].ptr) < 0)
+				LOGD("Registry is not updated\n");
+
+			publish_event(EVENT_UPDATE, pkgname, name, msg->shortcut_type,
+					msg->field[FIELD_EXEC].ptr,
+					msg->field[FIELD_ICON].ptr,
+					msg->mask,
+					msg->field[FIELD_NEW_NAME].ptr);
+		}
+	}
+
+	return send_ack(conn_fd, state, msg, ret);
+}
+
+
+
+static inline
+gboolean do_remove_service(int conn_fd, struct connection_state *state, const struct message *msg)
+{
+	struct shortcut_identity caller;
+	int ret;
+
+	ret = -ENOSYS;
+	if (s_info.remove_cb.remove_cb) {
+		const char *pkgname = msg->field[FIELD_PKGNAME].ptr;
+		const char *name = msg->field[FIELD_NAME].ptr;
+
+		LOGD("Remove Pkgname: [%s] Name: [%s]\n", pkgname, name);
+
+		TRACE_CB_ENTRY(msg->seq, state->from_pid, -1);
+
+		begin_callback(state, pkgname, &caller);
+		ret = s_info.remove_cb.remove_cb(
+				pkgname,
+				name,
+				state->from_pid,
+				s_info.remove_cb.data);
+		end_callback(state);
+
+		TRACE_CB_EXIT(msg->seq, state->from_pid, ret);
+
+		if (ret == 0) {
+			if (registry_remove(pkgname, name) < 0)
+				LOGD("Registry is not updated\n");
+
+			publish_event(EVENT_REMOVE, pkgname, name, 0, NULL, NULL, 0, NULL);
+		}
+	}
+
+	return send_ack(conn_fd, state, msg, ret);
+}
+
+
+
+struct query_result {
+	struct buffer *buffer;
+	int version;
+	unsigned int seq;
+};
+
+
+
+static
+int query_entry_cb(const struct registry_entry *entry, void *data)
+{
+	struct query_result *result = data;
+	struct message msg;
+
+	message_init(&msg, PACKET_ENTRY, result->seq);
+	msg.shortcut_type = entry->type;
+	message_set_field(&msg, FIELD_PKGNAME, entry->pkgname);
+	message_set_field(&msg, FIELD_NAME, entry->name);
+	message_set_field(&msg, FIELD_EXEC, entry->exec);
+	message_set_field(&msg, FIELD_ICON, entry->icon);
+
+	if (buffer_append(result->buffer, result->version, &msg) < 0)
+		return -ENOMEM;
+
+	return 0;
+}
+
+
+
+/*
+ * Processes of the same user, or the system, can query every package.
+ * Others can only query their own package, it is verified by the identity of the peer.
+ */
+static inline
+int query_allowed(struct connection_state *state, const char *pkgname)
+{
+	struct shortcut_identity caller;
+
+	if (state->uid == 0 || state->uid == getuid())
+		return 1;
+
+	if (!pkgname)
+		return 0;
+
+	resolve_identity(state);
+	fill_caller(&caller, state->identity, state->from_pid, state->uid, pkgname);
+	return caller.verified;
+}
+
+
+
+/*
+ * Queries are answered from the registry, the request_cb is not invoked.
+ * Every entry of the result is sent as a PACKET_ENTRY,
+ * and the ACK (ret is the number of entries) terminates the result.
+ */
+static inline
+gboolean do_query_service(int conn_fd, struct connection_state *state, const struct message *msg)
+{
+	struct query_result result;
+	struct message ack;
+	int length;
+	int ret;
+
+	/* Entries are encoded into the outbox, the ACK follows them */
+	length = state->outbox.length;
+	result.buffer = &state->outbox;
+	result.version = state->version;
+	result.seq = msg->seq;
+
+	if (!query_allowed(state, msg->field[FIELD_PKGNAME].ptr)) {
+		LOGE("Query of %s is not allowed to %d\n", msg->field[FIELD_PKGNAME].ptr ? msg->field[FIELD_PKGNAME].ptr : "every package", state->from_pid);
+		ret = -EACCES;
+	} else {
+		switch (msg->kind) {
+		case QUERY_EXISTS:
+			ret = registry_find(msg->field[FIELD_PKGNAME].ptr, msg->field[FIELD_NAME].ptr, NULL, NULL);
+			break;
+		case QUERY_LIST:
+			ret = registry_foreach_pkgname(msg->field[FIELD_PKGNAME].ptr, query_entry_cb, &result);
+			break;
+		default:
+			ret = -EINVAL;
+			break;
+		}
+	}
+
+	message_init(&ack, PACKET_ACK, msg->seq);
+	ack.ret = ret;
+	if (queue_reply(state, &ack) < 0) {
+		LOGE("Failed to send the result of query\n");
+		state->outbox.length = length;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+
+/*
+ * Caller doesn't wait the result of a request after its deadline,
+ * it is dropped without invoking the callback.
+ */
+static inline
+int is_expired(const struct message *msg)
+{
+	return msg->deadline && monotonic_ms() > msg->deadline;
+}
+
+
+
+static gboolean ring_cb(GIOChannel *src, GIOCondition cond, gpointer data);
+
+
+
+/*
+ * Requests of the client are received through the ring, ACKs are sent through the connection.
+ * fds are taken if it succeeds.
+ */
+static inline
+int attach_ring(struct connection_state *state, int fd, int event_fd, int credit)
+{
+	GIOChannel *gio;
+	int ret;
+
+	/* Before the ring takes fds, they are kept for the caller if it fails */
+	gio = g_io_channel_unix_new(event_fd);
+	if (!gio)
+		return -EFAULT;
+
+	ret = ring_server_attach(&state->ring, fd, event_fd, credit);
+	if (ret < 0) {
+		g_io_channel_unref(gio);
+		return ret;
+	}
+
+	state->ring_id = g_io_add_watch(gio,
+			G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+			(GIOFunc)ring_cb, state);
+	g_io_channel_unref(gio);
+	return 0;
+}
+
+
+
+static inline
+gboolean do_ring_service(int conn_fd, struct connection_state *state, const struct message *msg)
+{
+	int ret;
+
+	if (conn_fd < 0 || state->ring || !(state->features & FEATURE_SHM_RING) || state->ring_fds[0] < 0) {
+		ret = -EINVAL;
+	} else {
+		ret = attach_ring(state, state->ring_fds[0], state->ring_fds[1], state->features & FEATURE_CREDIT);
+		if (ret == 0) {
+			state->ring_fds[0] = -1;
+			state->ring_fds[1] = -1;
+
+			/* Whole window is granted with the ACK of the ring */
+			state->credit_grant = ring_server_window(state->ring);
+		}
+	}
+
+	LOGD("Ring of %d is attached (%d)\n", state->from_pid, ret);
+	return send_ack(conn_fd, state, msg, ret);
+}
+
+
+
+/*
+ * Connection of a subscriber receives events after the ACK.
+ */
+static inline
+gboolean do_subscribe_service(int conn_fd, struct connection_state *state, const struct message *msg)
+{
+	if (conn_fd < 0 || state->subscriber || !(state->features & FEATURE_SUBSCRIPTION))
+		return send_ack(conn_fd, state, msg, -EINVAL);
+
+	if (send_ack(conn_fd, state, msg, 0) == FALSE)
+		return FALSE;
+
+	state->subscriber = subscription_add(s_info.transport, conn_fd);
+	if (!state->subscriber)
+		return FALSE;
+
+	LOGD("%d subscribes events\n", state->from_pid);
+	return TRUE;
+}
+
+
+
+static inline
+gboolean dispatch_message(int conn_fd, struct connection_state *state, const struct message *msg)
+{
+	if (is_expired(msg)) {
+		s_info.expired++;
+		LOGD("Request %u of %d is expired\n", msg->seq, state->from_pid);
+		TRACE_EXPIRED(msg->seq, state->from_pid);
+		return send_ack(conn_fd, state, msg, -ETIMEDOUT);
+	}
+
+	switch (msg->type) {
+	case PACKET_HELLO:
+		return do_hello_service(conn_fd, state, msg);
+	case PACKET_REQ:
+		return do_reply_service(conn_fd, state, msg);
+	case PACKET_QUERY:
+		return do_query_service(conn_fd, state, msg);
+	case PACKET_UPDATE:
+		return do_update_service(conn_fd, state, msg);
+	case PACKET_REMOVE:
+		return do_remove_service(conn_fd, state, msg);
+	case PACKET_RING:
+		if (state->version < 2)
+			break;
+		return do_ring_service(conn_fd, state, msg);
+	case PACKET_SUBSCRIBE:
+		if (state->version < 2)
+			break;
+		return do_subscribe_service(conn_fd, state, msg);
+	default:
+		break;
+	}
+
+	if (state->version < 2) {
+		LOGE("Invalid packet type\n");
+		return FALSE;
+	}
+
+	/* Newer client, let it know that this is not supported */
+	return send_ack(conn_fd, state, msg, -ENOSYS);
+}
+
+
+
+static inline
+int is_waiting(struct connection_state *state)
+{
+	return state->icon_job || state->target_job || state->callback_job || state->commit_pending;
+}
+
+
+
+static gboolean dispatch_cb(gpointer data);
+
+
+
+/*
+ * Interactive class is only for processes of the same user, or the system.
+ */
+static inline
+int packet_weight(struct connection_state *state)
+{
+	switch (packet_priority(state->version, state->inbox.data, state->inbox.length)) {
+	case MESSAGE_PRIORITY_INTERACTIVE:
+		if (state->uid == 0 || state->uid == getuid())
+			return WEIGHT_INTERACTIVE;
+		return WEIGHT_NORMAL;
+	case MESSAGE_PRIORITY_BULK:
+		return WEIGHT_BULK;
+	default:
+		return WEIGHT_NORMAL;
+	}
+}
+
+
+
+/*
+ * Put the connection to the dispatch queue, if it has a complete packet.
+ * Packets of a connection are dispatched in order, so it is queued once at a time.
+ */
+static inline
+gboolean queue_connection(struct connection_state *state)
+{
+	unsigned int seq;
+	int type;
+	int size;
+
+	/* Replies are not limited by the peer (e.g. requests of the ring), the peer should read them */
+	if (is_waiting(state) || state->out_id || wfq_is_queued(&state->queue))
+		return TRUE;
+
+	size = packet_peek(state->version, state->inbox.data, state->inbox.length, &seq, &type);
+	if (size < 0) {
+		LOGE("[%s:%d] Invalid packet\n", __func__, __LINE__);
+		return FALSE;
+	}
+
+	/* Nothing to dispatch for the peer which is gone */
+	if (size == 0 || size > state->inbox.length)
+		return state->hangup ? FALSE : TRUE;
+
+	state->queue.data = state;
+	if (wfq_push(&state->queue, state->from_pid, packet_weight(state)) < 0)
+		return FALSE;
+
+	if (!s_info.dispatch_id)
+		s_info.dispatch_id = g_idle_add(dispatch_cb, NULL);
+
+	return TRUE;
+}
+
+
+
+static inline
+void close_connection(struct connection_state *state)
+{
+	/* Removed already, if the peer hung up */
+	if (state->id)
+		g_source_remove(state->id);
+	s_info.transport->close(state->conn_fd);
+	destroy_state(state);
+}
+
+
+
+/*
+ * Returns 1 if some are left (the socket is full), 0 if the outbox is empty, or -errno.
+ */
+static inline
+int flush_output(struct connection_state *state)
+{
+	struct iovec iov;
+	int ret;
+
+	/* Replies of the peer which is gone are dropped */
+	if (state->hangup)
+		state->outbox.length = 0;
+
+	while (state->outbox.length) {
+		iov.iov_base = state->outbox.data;
+		iov.iov_len = state->outbox.length;
+
+		ret = s_info.transport->sendv(state->conn_fd, &iov, 1);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 1;
+
+			/* Received requests are still dispatched, e.g. fire and forget ones */
+			if (errno == EPIPE || errno == ECONNRESET) {
+				LOGD("Peer %d is gone\n", state->from_pid);
+				state->hangup = 1;
+				state->outbox.length = 0;
+				return 0;
+			}
+
+			LOGE("Failed to send replies (%s)\n", strerror(errno));
+			return -EIO;
+		}
+
+		buffer_consume(&state->outbox, ret);
+	}
+
+	return 0;
+}
+
+
+
+static gboolean writable_cb(GIOChannel *src, GIOCondition cond, gpointer data);
+
+
+
+/*
+ * Replies which are left in the outbox are sent when the socket is writable.
+ */
+static inline
+gboolean send_outbox(struct connection_state *state)
+{
+	GIOChannel *gio;
+	int ret;
+
+	if (state->out_id)
+		return TRUE;
+
+	ret = flush_output(state);
+	if (ret <= 0)
+		return ret == 0;
+
+	gio = g_io_channel_unix_new(state->conn_fd);
+	if (!gio)
+		return FALSE;
+
+	state->out_id = g_io_add_watch(gio, G_IO_OUT | G_IO_ERR | G_IO_HUP, (GIOFunc)writable_cb, state);
+	g_io_channel_unref(gio);
+	return TRUE;
+}
+
+
+
+static
+void flush_outputs(void)
+{
+	struct connection_state *state;
+
+	if (s_info.flush_id) {
+		g_source_remove(s_info.flush_id);
+		s_info.flush_id = 0;
+	}
+
+	while ((state = s_info.flush_list)) {
+		s_info.flush_list = state->flush_next;
+		state->flush_pending = 0;
+
+		if (send_outbox(state) == FALSE)
+			close_connection(state);
+	}
+}
+
+
+
+static
+gboolean flush_cb(gpointer data)
+{
+	/* Removed by returning FALSE */
+	s_info.flush_id = 0;
+	flush_outputs();
+	return FALSE;
+}
+
+
+
+static gboolean subscriber_out_cb(GIOChannel *src, GIOCondition cond, gpointer data);
+static gboolean flush_subscriber(struct connection_state *state);
+
+
+
+static
+gboolean writable_cb(GIOChannel *src, GIOCondition cond, gpointer data)
+{
+	struct connection_state *state = data;
+
+	/* Removed by returning FALSE */
+	state->out_id = 0;
+	if (send_outbox(state) == FALSE)
+		close_connection(state);
+	else if (state->out_id)
+		return FALSE;
+	else if (state->subscriber && flush_subscriber(state) == FALSE)
+		close_connection(state);
+	else if (queue_connection(state) == FALSE)
+		close_connection(state);
+
+	return FALSE;
+}
+
+
+
+/*
+ * Events which are left in the queue are sent when the socket is writable.
+ * Replies in the outbox are sent before them.
+ */
+static
+gboolean flush_subscriber(struct connection_state *state)
+{
+	GIOChannel *gio;
+	int ret;
+
+	if (state->event_out_id)
+		return TRUE;
+
+	if (send_outbox(state) == FALSE)
+		return FALSE;
+
+	if (state->out_id)
+		return TRUE;
+
+	ret = subscription_flush(state->subscriber);
+	if (ret <= 0)
+		return ret == 0;
+
+	gio = g_io_channel_unix_new(state->conn_fd);
+	if (!gio)
+		return FALSE;
+
+	state->event_out_id = g_io_add_watch(gio, G_IO_OUT | G_IO_ERR | G_IO_HUP, (GIOFunc)subscriber_out_cb, state);
+	g_io_channel_unref(gio);
+	return TRUE;
+}
+
+
+
+static
+gboolean subscriber_out_cb(GIOChannel *src, GIOCondition cond, gpointer data)
+{
+	struct connection_state *state = data;
+
+	/* Removed by returning FALSE */
+	state->event_out_id = 0;
+	if (flush_subscriber(state) == FALSE)
+		close_connection(state);
+
+	return FALSE;
+}
+
+
+
+static
+gboolean close_cb(gpointer data)
+{
+	struct connection_state *state;
+	struct connection_state *next;
+
+	s_info.close_id = 0;
+	for (state = s_info.conn_list; state; state = next) {
+		next = state->conn_next;
+		if (state->close_pending)
+			close_connection(state);
+	}
+
+	return FALSE;
+}
+
+
+
+/*
+ * Events are published while a request is dispatched, when the pending batch is full.
+ * Failed subscribers are not closed here, one of them can be the connection which is being dispatched.
+ */
+static
+void publish_events(void)
+{
+	struct connection_state *state;
+
+	if (subscription_publish() <= 0)
+		return;
+
+	for (state = s_info.conn_list; state; state = state->conn_next) {
+		if (state->close_pending || !state->subscriber || flush_subscriber(state) == TRUE)
+			continue;
+
+		state->close_pending = 1;
+		if (!s_info.close_id)
+			s_info.close_id = g_idle_add(close_cb, NULL);
+	}
+}
+
+
+
+static
+gboolean publish_cb(gpointer data)
+{
+	s_info.event_id = 0;
+	publish_events();
+	return FALSE;
+}
+
+
+
+static inline int resume_ring(struct connection_state *state);
+
+
+
+/*
+ * Dispatch the deferred message again, after what it waits is ready.
+ */
+static inline
+void resume_deferred(struct connection_state *state)
+{
+	finish_deferred(state, dispatch_message(state->conn_fd, state, &state->deferred));
+}
+
+
+
+/*
+ * Release the deferred message after it is dispatched, and go on to following packets.
+ */
+static inline
+void finish_deferred(struct connection_state *state, gboolean ret)
+{
+	if (is_waiting(state))
+		return;
+
+	if (state->journal_id) {
+		journal_done(state->journal_id);
+		state->journal_id = 0;
+	}
+
+	release_message_fds(state);
+	drop_deferred(state);
+	state->icon_checked = 0;
+	state->target_checked = 0;
+
+	/* Its ACK may return the credit which the ring waits */
+	if (ret == TRUE && resume_ring(state) < 0)
+		ret = FALSE;
+
+	/* Packets which are received during the waiting */
+	if (ret == TRUE)
+		ret = queue_connection(state);
+
+	if (ret == FALSE)
+		close_connection(state);
+}
+
+
+
+/*
+ * Copy a record of the ring to the inbox, it is dispatched as a received packet.
+ * Returns 1 if the inbox has a ring of packets already.
+ */
+static
+int deliver_record(const char *record, int size, void *data)
+{
+	struct connection_state *state = data;
+
+	if (state->inbox.length >= ring_server_size(state->ring))
+		return 1;
+
+	if (!state->inbox.length)
+		state->received = monotonic_ms();
+
+	if (buffer_reserve(&state->inbox, size) < 0)
+		return -ENOMEM;
+
+	memcpy(state->inbox.data + state->inbox.length, record, size);
+	state->inbox.length += size;
+	cost_get(state->from_pid, state->uid)->bytes += size;
+	return 0;
+}
+
+
+
+static inline
+int drain_ring(struct connection_state *state)
+{
+	return ring_server_drain(state->ring, deliver_record, state);
+}
+
+
+
+/*
+ * Drain the paused ring again, if the inbox has room and the client has credits.
+ */
+static inline
+int resume_ring(struct connection_state *state)
+{
+	if (!state->ring)
+		return 0;
+
+	return ring_server_resume(state->ring, state->inbox.length, deliver_record, state);
+}
+
+
+
+static
+gboolean ring_cb(GIOChannel *src, GIOCondition cond, gpointer data)
+{
+	struct connection_state *state = data;
+
+	if (!(cond & G_IO_IN) || drain_ring(state) < 0 || queue_connection(state) == FALSE) {
+		/* Removed by returning FALSE */
+		state->ring_id = 0;
+		close_connection(state);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+
+static
+void icon_loaded_cb(void *data)
+{
+	struct connection_state *state = data;
+
+	state->icon_job = NULL;
+	resume_deferred(state);
+}
+
+
+
+static
+void target_loaded_cb(void *data)
+{
+	struct connection_state *state = data;
+
+	state->target_job = NULL;
+	resume_deferred(state);
+}
+
+
+
+/*
+ * Group commit, one sync for every requests which are received in this iteration of the main loop.
+ */
+static
+gboolean commit_cb(gpointer data)
+{
+	struct connection_state *state;
+	struct connection_state *next;
+	struct connection_state *list;
+
+	s_info.commit_id = 0;
+	if (journal_commit() < 0)
+		LOGE("Failed to commit the journal\n");
+
+	/* List is in the reverse order of arrival */
+	list = NULL;
+	state = s_info.commit_list;
+	s_info.commit_list = NULL;
+	while (state) {
+		next = state->commit_next;
+		state->commit_next = list;
+		list = state;
+		state = next;
+	}
+
+	state = list;
+	while (state) {
+		next = state->commit_next;
+		state->commit_next = NULL;
+		state->commit_pending = 0;
+		resume_deferred(state);
+		state = next;
+	}
+
+	return FALSE;
+}
+
+
+
+static inline
+int is_journaled(const struct message *msg)
+{
+	/* fds cannot be kept in the journal, fire and forget ones are journaled as others */
+	if (!journal_is_enabled() || (msg->flags & (MESSAGE_FLAG_CONTENT_FD | MESSAGE_FLAG_ICON_FD | MESSAGE_FLAG_RING_FDS)))
+		return 0;
+
+	return msg->type == PACKET_REQ || msg->type == PACKET_UPDATE || msg->type == PACKET_REMOVE;
+}
+
+
+
+/*
+ * Write the request to the journal, it is dispatched after the group commit.
+ */
+static inline
+gboolean journal_message(int conn_fd, struct connection_state *state, const struct message *msg)
+{
+	int id;
+
+	if (defer_message(state, msg) < 0)
+		return dispatch_message(conn_fd, state, msg);
+
+	id = journal_begin(state->from_pid, state->deferred_buffer, state->deferred_size);
+	if (id < 0) {
+		LOGE("Failed to write the journal, dispatch it without\n");
+		drop_deferred(state);
+		return dispatch_message(conn_fd, state, msg);
+	}
+
+	state->journal_id = id;
+	state->commit_pending = 1;
+	state->commit_next = s_info.commit_list;
+	s_info.commit_list = state;
+
+	if (!s_info.commit_id)
+		s_info.commit_id = g_idle_add(commit_cb, NULL);
+
+	return TRUE;
+}
+
+
+
+/*
+ * Decoding is charged to the client, with the request.
+ */
+static inline
+int decode_message(struct connection_state *state, struct message *msg)
+{
+	struct cost_entry *cost;
+	unsigned long long begin;
+	int size;
+
+	begin = monotonic_ns();
+	size = next_message(state, msg);
+	if (size > 0) {
+		cost = cost_get(state->from_pid, state->uid);
+		cost->decode_ns += monotonic_ns() - begin;
+		cost->requests++;
+	}
+
+	return size;
+}
+
+
+
+/*
+ * Dispatch received packets, until a request is deferred or the budget is exhausted.
+ */
+static inline
+gboolean process_inbox(int conn_fd, struct connection_state *state, int budget)
+{
+	struct message msg;
+	gboolean ret;
+	int size = 0;
+
+	ret = TRUE;
+	while (budget > 0 && !is_waiting(state) && (size = decode_message(state, &msg)) > 0) {
+		budget--;
+
+		if (take_message_fds(state, &msg) < 0) {
+			LOGE("fds are not passed\n");
+			ret = send_ack(conn_fd, state, &msg, -EINVAL);
+		} else if (is_journaled(&msg)) {
+			ret = journal_message(conn_fd, state, &msg);
+		} else {
+			ret = dispatch_message(conn_fd, state, &msg);
+		}
+
+		/* Deferred one keeps its fds */
+		if (!is_waiting(state)) {
+			release_message_fds(state);
+			drop_deferred(state);
+			state->icon_checked = 0;
+			state->target_checked = 0;
+		}
+
+		buffer_consume(&state->inbox, size);
+		if (ret == FALSE)
+			return FALSE;
+	}
+
+	if (size < 0) {
+		LOGE("[%s:%d] Invalid packet\n", __func__, __LINE__);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+
+/*
+ * Dispatch a packet of connections in the order of the queue,
+ * received packets are queued between iterations.
+ */
+static
+gboolean dispatch_cb(gpointer data)
+{
+	struct connection_state *state;
+	struct wfq_entry *entry;
+	int count;
+
+	for (count = 0; count < DISPATCH_BATCH; count++) {
+		entry = wfq_pop();
+		if (!entry)
+			break;
+
+		state = entry->data;
+		if (process_inbox(state->conn_fd, state, 1) == FALSE)
+			close_connection(state);
+		else if (resume_ring(state) < 0)
+			close_connection(state);
+		else if (queue_connection(state) == FALSE)
+			close_connection(state);
+	}
+
+	/* ACKs of the batch */
+	flush_outputs();
+
+	if (wfq_count())
+		return TRUE;
+
+	s_info.dispatch_id = 0;
+	return FALSE;
+}
+
+
+
+static
+gboolean connection_cb(GIOChannel *src, GIOCondition cond, gpointer data)
+{
+	int conn_fd;
+	struct connection_state *state = data;
+	gboolean ret;
+	int size;
+
+	conn_fd = g_io_channel_unix_get_fd(src);
+
+	if (!(cond & G_IO_IN)) {
+		ret = FALSE;
+		goto out;
+	}
+
+	if (!state->inbox.length)
+		state->received = monotonic_ms();
+
+	size = read_inbox(conn_fd, state);
+	if (size == 0) {
+		LOGE("Disconnected\n");
+		state->hangup = 1;
+		if (state->out_id) {
+			g_source_remove(state->out_id);
+			state->out_id = 0;
+		}
+
+		/* Requests which are received are dispatched, and it is closed after them */
+		ret = queue_connection(state);
+		if (ret == TRUE) {
+			/* Removed by returning FALSE */
+			state->id = 0;
+			return FALSE;
+		}
+
+		goto out;
+	}
+
+	if (size < 0) {
+		ret = FALSE;
+		goto out;
+	}
+
+	cost_get(state->from_pid, state->uid)->bytes += size;
+	ret = queue_connection(state);
+
+out:
+	if (ret == FALSE) {
+		s_info.transport->close(conn_fd);
+		destroy_state(state);
+	}
+
+	return ret;
+}
+
+
+
+static inline
+int peer_uid(int conn_fd)
+{
+	int uid;
+
+	if (s_info.transport->credentials(conn_fd, NULL, &uid) < 0)
+		return -1;
+
+	return uid;
+}
+
+
+
+/*
+ * Watch a connection of the server.
+ * The caller should close the conn_fd if this fails.
+ */
+static inline
+struct connection_state *add_connection(int conn_fd, int version)
+{
+	GIOChannel *gio;
+	guint id;
+	struct connection_state *state;
+
+	if (fcntl(conn_fd, F_SETFD, FD_CLOEXEC) < 0)
+		LOGE("Error: %s\n", strerror(errno));
+
+	if (fcntl(conn_fd, F_SETFL, O_NONBLOCK) < 0)
+		LOGE("Error: %s\n", strerror(errno));
+
+	gio = g_io_channel_unix_new(conn_fd);
+	if (!gio) {
+		LOGE("Failed to create a new connection channel\n");
+		return NULL;
+	}
+
+	state = create_state();
+	if (!state) {
+		g_io_channel_unref(gio);
+		return NULL;
+	}
+
+	state->version = version;
+	state->uid = peer_uid(conn_fd);
+	id = g_io_add_watch(gio,
+			G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
 			(GIOFunc)connection_cb, state);
+	if (id < 0) {
+		LOGE("Failed to create g_io watch\n");
+		free(state);
+		g_io_channel_unref(gio);
+		return NULL;
+	}
+
+	state->conn_fd = conn_fd;
+	state->id = id;
+	state->conn_next = s_info.conn_list;
+	if (s_info.conn_list)
+		s_info.conn_list->conn_prev = state;
+	s_info.conn_list = state;
+
+	g_io_channel_unref(gio);
+	return state;
+}
+
+
+
+static
+gboolean accept_cb(GIOChannel *src, GIOCondition cond, gpointer data)
+{
+	int server_fd;
+	int connection_fd;
+
+	server_fd = g_io_channel_unix_get_fd(src);
+	if (server_fd != s_info.server_fd) {
+		LOGE("Unknown FD is gotten.\n");
+		/* NOTE:
+		 * In this case, don't try to do anything.
+		 * This is not recoverble error */
+		return FALSE;
+	}
+
+	if (!(cond & G_IO_IN)) {
+		s_info.transport->close(s_info.server_fd);
+		s_info.server_fd = -1;
+		s_info.server_id = 0;
+		return FALSE;
+	}
+
+	connection_fd = s_info.transport->accept(server_fd);
+	if (connection_fd < 0) {
+		/* Error log will be printed from
+		 * get_connection_handle function */
+		return FALSE;
+	}
+
+	TRACE_ACCEPT(connection_fd);
+
+	/* Every connection begins with v1, until the hello is exchanged */
+	if (!add_connection(connection_fd, 1)) {
+		s_info.transport->close(connection_fd);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+
+static inline int init_client(struct client_cb *client_cb, const struct message *msg, const int *fds, int nr_fds);
+
+
+
+static inline
+void client_result(struct connection_state *state, int ret)
+{
+	struct client_cb *client_cb = state->data;
+
+	TRACE_CLIENT_RESULT(state->seq, state->from_pid, ret);
+
+	if (client_cb->result_cb) {
+		/* If the callback return FAILURE,
+		 * remove itself from the callback list */
+		client_cb->result_cb(ret, state->from_pid, client_cb->data);
+	}
+}
+
+
+
+/*
+ * The server dropped the connection before replying the hello.
+ * Old one doesn't know the v2, it drops the hello without reading the request.
+ * New one replies the hello before it dispatches the request, so the request is not taken either way.
+ * Send it again in v1, the v1 is used for a while (a new one may be restarting), then the v2 is tried again.
+ * Returns 0 if the request is taken by the new connection.
+ */
+static inline
+int fallback_to_v1(struct connection_state *state)
+{
+	struct message msg;
+	int ret;
+
+	/* Connection of the known v2 server is just broken */
+	if (!state->hello_sent || s_info.server_version > 1)
+		return -EINVAL;
+
+	if (!s_info.server_version) {
+		LOGE("Server closed the connection before the hello, v1 is used for %d ms\n", FALLBACK_EXPIRY);
+		s_info.server_version = 1;
+		s_info.fallback_expire = monotonic_ms() + FALLBACK_EXPIRY;
+	}
+
+	/* fds cannot be passed in v1 */
+	if (state->pending.length)
+		return -ENOTSUP;
+
+	if (!state->fallback || packet_decode_v1(state->fallback, state->fallback_size, &msg) <= 0)
+		return -EINVAL;
+
+	/* v1 doesn't carry it, only for the timeout of the client */
+	msg.deadline = state->deadline;
+
+	ret = init_client(state->data, &msg, NULL, 0);
+	if (ret < 0)
+		return ret;
+
+	/* client_cb is moved to the new connection */
+	state->data = NULL;
+	return 0;
+}
+
+
+
+/*
+ * Send the request which is waiting the hello, with its fds.
+ */
+static inline
+int send_pending(int conn_fd, struct connection_state *state)
+{
+	int ret;
+
+	if (state->version < 2 || !(state->features & FEATURE_FD_PASSING)) {
+		LOGE("Server doesn't support the fd passing\n");
+		client_result(state, -ENOTSUP);
+		return -ENOTSUP;
+	}
+
+	ret = s_info.transport->send(conn_fd, state->pending.data, state->pending.length,
+					state->send_fds, state->nr_send_fds);
+	if (ret != state->pending.length) {
+		LOGE("Failed to send the request\n");
+		client_result(state, -EFAULT);
+		return -EFAULT;
+	}
+
+	TRACE_CLIENT_SEND(state->seq, conn_fd, ret);
+	state->pending.length = 0;
+	close_fds(state->send_fds, &state->nr_send_fds);
+	return 0;
+}
+
+
+
+static
+gboolean client_connection_cb(GIOChannel *src, GIOCondition cond, gpointer data)
+{
+	int conn_fd;
+	gboolean ret;
+	struct connection_state *state = data;
+	struct message msg;
+	int size;
+
+	conn_fd = g_io_channel_unix_get_fd(src);
+
+	if (!(cond & G_IO_IN)) {
+		LOGE("Condition value is unexpected value\n");
+		ret = FALSE;
+		goto out;
+	}
+
+	/* Server can be handed over to its successor, the result is from the last one */
+	state->from_pid = 0;
+
+	size = read_inbox(conn_fd, state);
+	if (size <= 0) {
+		size = fallback_to_v1(state);
+		if (size < 0)
+			client_result(state, size == -ENOTSUP ? -ENOTSUP : -ECONNABORTED);
+		ret = FALSE;
+		goto out;
+	}
+
+	ret = TRUE;
+	while ((size = next_message(state, &msg)) > 0) {
+		if (msg.type == PACKET_HELLO) {
+			state->version = msg.version < 2 ? 1 : msg.version;
+			state->features = msg.features;
+			state->hello_sent = 0;
+			s_info.server_version = state->version;
+			s_info.server_features = state->features;
+			s_info.fallback_expire = 0;
+			free(state->fallback);
+			state->fallback = NULL;
+
+			if (state->pending.length && send_pending(conn_fd, state) < 0)
+				ret = FALSE;
+		} else if (msg.type == PACKET_ACK) {
+			client_result(state, msg.ret);
+			/* NOTE: If we want close the connection, returns FALSE */
+			ret = FALSE;
+		} else {
+			LOGE("Invalid packet type\n");
+			client_result(state, -EFAULT);
+			ret = FALSE;
+		}
+
+		buffer_consume(&state->inbox, size);
+		if (ret == FALSE)
+			break;
+	}
+
+	if (size < 0) {
+		LOGE("[%s:%d] Invalid packet\n", __func__, __LINE__);
+		client_result(state, -EFAULT);
+		ret = FALSE;
+	}
+
+out:
+	if (ret == FALSE) {
+		s_info.transport->close(conn_fd);
+		free(state->data);
+		destroy_state(state);
+	}
+
+	return ret;
+}
+
+
+
+/*
+ * Send the request in the outbox, fds go with its first bytes unless the request waits the hello.
+ * Returns 1 if some are left (the socket is full), 0 if the outbox is empty, or -errno.
+ */
+static inline
+int client_flush(struct connection_state *state)
+{
+	int nr_fds;
+	int ret;
+
+	nr_fds = state->pending.length ? 0 : state->nr_send_fds;
+	while (state->outbox.length) {
+		ret = s_info.transport->send(state->conn_fd, state->outbox.data, state->outbox.length,
+						state->send_fds, nr_fds);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 1;
+
+			return -EIO;
+		}
+
+		if (nr_fds) {
+			close_fds(state->send_fds, &state->nr_send_fds);
+			nr_fds = 0;
+		}
+
+		buffer_consume(&state->outbox, ret);
+	}
+
+	if (!state->pending.length)
+		close_fds(state->send_fds, &state->nr_send_fds);
+
+	return 0;
+}
+
+
+
+static
+gboolean client_writable_cb(GIOChannel *src, GIOCondition cond, gpointer data)
+{
+	struct connection_state *state = data;
+	int ret;
+
+	ret = (cond & G_IO_OUT) ? client_flush(state) : -EIO;
+	if (ret > 0)
+		return TRUE;
+
+	/* Removed by returning FALSE */
+	state->out_id = 0;
+	if (ret < 0) {
+		LOGE("Failed to send the request\n");
+		client_result(state, -EFAULT);
+		g_source_remove(state->id);
+		s_info.transport->close(state->conn_fd);
+		free(state->data);
+		destroy_state(state);
+	}
+
+	return FALSE;
+}
+
+
+
+/*
+ * Server drops the request if it is not dispatched yet.
+ */
+static
+gboolean client_timeout_cb(gpointer data)
+{
+	struct connection_state *state = data;
+
+	state->timeout_id = 0;
+	LOGD("Request %u is timed out\n", state->seq);
+	client_result(state, -ETIMEDOUT);
+
+	g_source_remove(state->id);
+	s_info.transport->close(state->conn_fd);
+	free(state->data);
+	destroy_state(state);
+	return FALSE;
+}
+
+
+
+/*
+ * Encode a request with the hello if the server supports (or may support) v2.
+ * A request which has fds waits the reply of the hello,
+ * unless the server is known to support the fd passing.
+ */
+static inline
+int encode_request(struct connection_state *state, const struct message *msg, struct buffer *out)
+{
+	struct message hello;
+
+	if (s_info.fallback_expire && monotonic_ms() >= s_info.fallback_expire) {
+		LOGD("Fallback to v1 is expired, try the v2 again\n");
+		s_info.server_version = 0;
+		s_info.server_features = 0;
+		s_info.fallback_expire = 0;
+	}
+
+	if (s_info.server_version == 1) {
+		if (msg->flags & (MESSAGE_FLAG_CONTENT_FD | MESSAGE_FLAG_ICON_FD))
+			return -ENOTSUP;
+
+		state->version = 1;
+		return buffer_append(out, 1, msg) < 0 ? -ENOMEM : 0;
+	}
+
+	if (msg->flags & (MESSAGE_FLAG_CONTENT_FD | MESSAGE_FLAG_ICON_FD)) {
+		if (!(s_info.server_features & FEATURE_FD_PASSING)) {
+			if (buffer_append(&state->pending, PACKET_VERSION, msg) < 0)
+				return -ENOMEM;
+		}
+	} else if (s_info.server_version == 0) {
+		/* Keep the v1 packet, in case of the server is old one */
+		state->fallback_size = packet_size_v1(msg);
+		state->fallback = malloc(state->fallback_size);
+		if (!state->fallback) {
+			LOGE("Heap: %s\n", strerror(errno));
+			return -ENOMEM;
+		}
+		packet_encode_v1(msg, state->fallback);
+	}
+
+	/* Hello is always in v1, and the request follows it without waiting the reply */
+	message_init(&hello, PACKET_HELLO, msg->seq);
+	hello.version = PACKET_VERSION;
+	hello.features = CLIENT_FEATURES;
+	if (buffer_append(out, 1, &hello) < 0)
+		return -ENOMEM;
+
+	state->hello_sent = 1;
+	state->version = 1;
+	if (state->pending.length)
+		return 0;
+
+	return buffer_append(out, PACKET_VERSION, msg) < 0 ? -ENOMEM : 0;
+}
+
+
+
+static inline int init_client(struct client_cb *client_cb, const struct message *msg, const int *fds, int nr_fds)
+{
+	GIOChannel *gio;
+	guint id;
+	int client_fd;
+	struct connection_state *state;
+	struct buffer out;
+	int ret;
+
+	state = create_state();
+	if (!state)
+		return -ENOMEM;
+
+	/* fds of the caller can be closed as soon as this returns */
+	while (state->nr_send_fds < nr_fds) {
+		int fd;
+
+		fd = fcntl(fds[state->nr_send_fds], F_DUPFD_CLOEXEC, 0);
+		if (fd < 0) {
+			LOGE("Failed to dup fd (%s)\n", strerror(errno));
+			destroy_state(state);
+			return -EBADF;
+		}
+
+		state->send_fds[state->nr_send_fds++] = fd;
+	}
+
+	memset(&out, 0, sizeof(out));
+	ret = encode_request(state, msg, &out);
+	if (ret < 0) {
+		free(out.data);
+		destroy_state(state);
+		return ret;
+	}
+
+	state->seq = msg->seq;
+
+	client_fd = s_info.transport->connect(s_info.socket_file);
+	if (client_fd < 0) {
+		LOGE("Failed to make the client FD\n");
+		free(out.data);
+		destroy_state(state);
+		return -ECONNREFUSED;
+	}
+
+	if (fcntl(client_fd, F_SETFD, FD_CLOEXEC) < 0)
+		LOGE("Error: %s\n", strerror(errno));
+
+	/* Stalled server should not block the caller, the rest is sent when the socket is writable */
+	if (fcntl(client_fd, F_SETFL, O_NONBLOCK) < 0)
+		LOGE("Error: %s\n", strerror(errno));
+
+	state->conn_fd = client_fd;
+	state->outbox = out;
+	ret = client_flush(state);
+	if (ret < 0) {
+		LOGE("Failed to send all packet\n");
+		destroy_state(state);
+		s_info.transport->close(client_fd);
+		return -EFAULT;
+	}
+
+	TRACE_CLIENT_SEND(msg->seq, client_fd, out.length - state->outbox.length);
+
+	gio = g_io_channel_unix_new(client_fd);
+	if (!gio) {
+		destroy_state(state);
+		s_info.transport->close(client_fd);
+		return -EFAULT;
+	}
+
+	state->data = client_cb;
+
+	id = g_io_add_watch(gio,
+		G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+		(GIOFunc)client_connection_cb, state);
+	if (id < 0) {
+		GError *err = NULL;
+		LOGE("Failed to create g_io watch\n");
+		destroy_state(state);
+		g_io_channel_unref(gio);
+		g_io_channel_shutdown(gio, TRUE, &err);
+		s_info.transport->close(client_fd);
+		return -EFAULT;
+	}
+
+	state->id = id;
+	if (ret > 0) {
+		state->out_id = g_io_add_watch(gio, G_IO_OUT | G_IO_ERR | G_IO_HUP, (GIOFunc)client_writable_cb, state);
+		if (!state->out_id) {
+			LOGE("Failed to create g_io watch\n");
+			g_source_remove(id);
+			destroy_state(state);
+			g_io_channel_unref(gio);
+			s_info.transport->close(client_fd);
+			return -EFAULT;
+		}
+	}
+
+	state->deadline = msg->deadline;
+	if (state->deadline) {
+		unsigned long long now = monotonic_ms();
+
+		state->timeout_id = g_timeout_add(state->deadline > now ? state->deadline - now : 0,
+						client_timeout_cb, state);
+	}
+
+	g_io_channel_unref(gio);
+	return client_fd;
+}
+
+
+
+/*
+ * Listening socket which is passed by the socket activation (LISTEN_FDS).
+ */
+static inline
+int inherited_server_fd(void)
+{
+	const char *env;
+	socklen_t len;
+	int listening;
+	int type;
+
+	env = getenv("LISTEN_PID");
+	if (!env || atoi(env) != getpid())
+		return -ENOENT;
+
+	env = getenv("LISTEN_FDS");
+	if (!env || atoi(env) < 1)
+		return -ENOENT;
+
+	if (atoi(env) > 1)
+		LOGD("Only the first one of %s sockets is used\n", env);
+
+	/* Not for child processes */
+	unsetenv("LISTEN_PID");
+	unsetenv("LISTEN_FDS");
+	unsetenv("LISTEN_FDNAMES");
+
+	len = sizeof(type);
+	if (getsockopt(LISTEN_FDS_START, SOL_SOCKET, SO_TYPE, &type, &len) < 0 || type != SOCK_STREAM) {
+		LOGE("Passed socket is not a stream one\n");
+		return -EINVAL;
+	}
+
+	len = sizeof(listening);
+	if (getsockopt(LISTEN_FDS_START, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) < 0 || !listening) {
+		LOGE("Passed socket is not listening\n");
+		return -EINVAL;
+	}
+
+	LOGD("Socket is activated\n");
+	return LISTEN_FDS_START;
+}
+
+
+
+/*
+ * Pass a connection with the packets which are not dispatched yet.
+ * The deferred request is encoded again in front of them, with its fds.
+ */
+static inline
+int hand_over_connection(int fd, struct connection_state *state)
+{
+	struct handover_record record;
+	struct buffer data;
+	int fds[SECOM_MAX_FDS];
+	int nr_fds;
+	int ret;
+	int i;
+
+	/* Records which are not dispatched yet are passed with the inbox */
+	if (state->ring && drain_ring(state) < 0)
+		return -EINVAL;
+
+	/* Replies and events in the queue cannot be passed, this keeps the connection until they are sent */
+	if (flush_output(state) != 0)
+		return -EBUSY;
+
+	/* Request on the pool is acknowledged by this */
+	if (state->callback_job)
+		return -EBUSY;
+
+	if (state->subscriber && subscription_flush(state->subscriber) != 0)
+		return -EBUSY;
+
+	nr_fds = 0;
+	fds[nr_fds++] = state->conn_fd;
+
+	if (state->content_fd >= 0)
+		fds[nr_fds++] = state->content_fd;
+
+	if (state->icon_fd >= 0)
+		fds[nr_fds++] = state->icon_fd;
+
+	if (nr_fds + state->nr_fds + (state->ring ? 2 : 0) > SECOM_MAX_FDS)
+		return -E2BIG;
+
+	for (i = 0; i < state->nr_fds; i++)
+		fds[nr_fds++] = state->fds[i];
+
+	/* The last two fds are of the ring */
+	if (state->ring) {
+		ring_server_fds(state->ring, &fds[nr_fds], &fds[nr_fds + 1]);
+		nr_fds += 2;
+	}
+
+	memset(&data, 0, sizeof(data));
+	if (state->deferred_buffer && buffer_append(&data, state->version, &state->deferred) < 0)
+		return -ENOMEM;
+
+	if (buffer_reserve(&data, state->inbox.length) < 0) {
+		free(data.data);
+		return -ENOMEM;
+	}
+
+	if (state->inbox.length) {
+		memcpy(data.data + data.length, state->inbox.data, state->inbox.length);
+		data.length += state->inbox.length;
+	}
+
+	memset(&record, 0, sizeof(record));
+	record.type = HANDOVER_CONNECTION;
+	record.version = state->version;
+	record.features = state->features & ~(FEATURE_SHM_RING | FEATURE_SUBSCRIPTION);
+	record.features |= (state->ring ? FEATURE_SHM_RING : 0) | (state->subscriber ? FEATURE_SUBSCRIPTION : 0);
+	record.from_pid = state->from_pid;
+	record.size = data.length;
+	record.nr_fds = nr_fds;
+
+	ret = handover_send(fd, &record, data.data, fds);
+	free(data.data);
+	return ret;
+}
+
+
+
+static inline
+void fini_handover(void)
+{
+	if (s_info.handover_fd < 0)
+		return;
+
+	close(s_info.handover_fd);
+	s_info.handover_fd = -1;
+	s_info.handover_id = 0;
+	unlink(s_info.handover_file);
+}
+
+
+
+/*
+ * A successor takes the listening socket and every connection.
+ * Connections which cannot be passed are kept, this still serves them.
+ */
+static
+gboolean handover_accept_cb(GIOChannel *src, GIOCondition cond, gpointer data)
+{
+	struct handover_record record;
+	struct connection_state *state;
+	struct connection_state *next;
+	int count;
+	int fd;
+
+	if (!(cond & G_IO_IN)) {
+		fini_handover();
+		return FALSE;
+	}
+
+	fd = handover_accept(s_info.handover_fd);
+	if (fd < 0)
+		return TRUE;
+
+	memset(&record, 0, sizeof(record));
+	record.type = HANDOVER_LISTEN;
+	record.nr_fds = 1;
+	if (s_info.server_fd < 0 || handover_send(fd, &record, NULL, &s_info.server_fd) < 0) {
+		LOGE("Failed to hand over the server\n");
+		close(fd);
+		return TRUE;
+	}
+
+	/* Pending events are sent to subscribers before they are passed */
+	if (s_info.event_id) {
+		g_source_remove(s_info.event_id);
+		s_info.event_id = 0;
+	}
+	publish_events();
+
+	/* Successor accepts clients from now */
+	g_source_remove(s_info.server_id);
+	s_info.server_id = 0;
+	s_info.transport->close(s_info.server_fd);
+	s_info.server_fd = -1;
+
+	count = 0;
+	for (state = s_info.conn_list; state; state = next) {
+		next = state->conn_next;
+		if (hand_over_connection(fd, state) < 0) {
+			LOGE("Connection of %d is kept\n", state->from_pid);
+			continue;
+		}
+
+		close_connection(state);
+		count++;
+	}
+
+	/* Successor waits its successor on the same path */
+	fini_handover();
+
+	memset(&record, 0, sizeof(record));
+	record.type = HANDOVER_END;
+	if (handover_send(fd, &record, NULL, NULL) < 0)
+		LOGE("Failed to finish the handover\n");
+
+	close(fd);
+	LOGD("Server is handed over with %d connections\n", count);
+
+	if (s_info.handover_cb.handover_cb)
+		s_info.handover_cb.handover_cb(s_info.handover_cb.data);
+
+	return FALSE;
+}
+
+
+
+static inline
+int init_handover(void)
+{
+	GIOChannel *gio;
+
+	if (s_info.handover_fd >= 0)
+		return 0;
+
+	s_info.handover_fd = handover_create_server(s_info.handover_file);
+	if (s_info.handover_fd < 0)
+		return s_info.handover_fd;
+
+	gio = g_io_channel_unix_new(s_info.handover_fd);
+	if (!gio) {
+		fini_handover();
+		return -EFAULT;
+	}
+
+	s_info.handover_id = g_io_add_watch(gio,
+			G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+			(GIOFunc)handover_accept_cb, NULL);
+	g_io_channel_unref(gio);
+	return 0;
+}
+
+
+
+/*
+ * Complete packets in the inbox.
+ */
+static inline
+int count_packets(const struct connection_state *state)
+{
+	unsigned int seq;
+	int offset;
+	int count;
+	int type;
+	int size;
+
+	offset = 0;
+	count = 0;
+	while (offset < state->inbox.length) {
+		size = packet_peek(state->version, state->inbox.data + offset, state->inbox.length - offset, &seq, &type);
+		if (size <= 0 || size > state->inbox.length - offset)
+			break;
+
+		offset += size;
+		count++;
+	}
+
+	return count;
+}
+
+
+
+static inline
+int adopt_connection(const struct handover_record *record, const char *data, int *fds)
+{
+	struct connection_state *state;
+	int nr_fds;
+	int i;
+
+	nr_fds = record->nr_fds;
+	if ((record->features & FEATURE_SHM_RING) && nr_fds < 3) {
+		close_fds(fds, &nr_fds);
+		return -EINVAL;
+	}
+
+	state = add_connection(fds[0], record->version);
+	if (!state) {
+		close_fds(fds, &nr_fds);
+		return -EFAULT;
+	}
+
+	state->features = record->features;
+	state->from_pid = record->from_pid;
+
+	if (record->features & FEATURE_SUBSCRIPTION) {
+		state->subscriber = subscription_add(s_info.transport, fds[0]);
+		if (!state->subscriber) {
+			for (i = 1; i < nr_fds; i++)
+				close(fds[i]);
+			close_connection(state);
+			return -ENOMEM;
+		}
+	}
+
+	if (record->features & FEATURE_SHM_RING) {
+		nr_fds -= 2;
+		if (attach_ring(state, fds[nr_fds], fds[nr_fds + 1], record->features & FEATURE_CREDIT) < 0) {
+			close(fds[nr_fds]);
+			close(fds[nr_fds + 1]);
+			for (i = 1; i < nr_fds; i++)
+				close(fds[i]);
+			close_connection(state);
+			return -EINVAL;
+		}
+	}
+
+	for (i = 1; i < nr_fds; i++)
+		state->fds[state->nr_fds++] = fds[i];
+
+	if (record->size > 0) {
+		if (buffer_reserve(&state->inbox, record->size) < 0) {
+			close_connection(state);
+			return -ENOMEM;
+		}
+
+		memcpy(state->inbox.data, data, record->size);
+		state->inbox.length = record->size;
+		state->received = monotonic_ms();
+	}
+
+	/* Passed requests are not acknowledged yet, they hold credits of the client */
+	if (state->ring)
+		ring_server_hold(state->ring, count_packets(state));
+
+	/* Records which are published after the predecessor drained the ring */
+	if (state->ring && drain_ring(state) < 0) {
+		close_connection(state);
+		return -EINVAL;
+	}
+
+	/* Dispatched from the idle, after callbacks are set */
+	if (queue_connection(state) == FALSE) {
+		close_connection(state);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+
+
+/*
+ * Take the listening socket and connections over from the running server.
+ * Returns the listening socket, or negative errno if there is no server to take over.
+ */
+static inline
+int take_over_server(void)
+{
+	struct handover_record record;
+	int fds[SECOM_MAX_FDS];
+	char *data;
+	int server_fd;
+	int count;
+	int fd;
+
+	fd = handover_connect(s_info.handover_file);
+	if (fd < 0)
+		return fd;
+
+	server_fd = -EIO;
+	count = 0;
+	while (handover_recv(fd, &record, &data, fds) == 0) {
+		if (record.type == HANDOVER_END)
+			break;
+
+		if (record.type == HANDOVER_LISTEN && record.nr_fds == 1 && server_fd < 0) {
+			server_fd = fds[0];
+		} else if (record.type == HANDOVER_CONNECTION && record.nr_fds > 0) {
+			if (adopt_connection(&record, data, fds) == 0)
+				count++;
+		} else {
+			LOGE("Unknown record (%d)\n", record.type);
+			close_fds(fds, &record.nr_fds);
+		}
+
+		free(data);
+	}
+
+	close(fd);
+	LOGD("Server is taken over with %d connections\n", count);
+	return server_fd;
+}
+
+
+
+static inline
+int init_server(void)
+{
+	GIOChannel *gio;
+	guint id;
+
+	if (s_info.server_fd != -1) {
+		LOGE("Already initialized\n");
+		return 0;
+	}
+
+	if (pthread_mutex_lock(&s_info.server_mutex) != 0) {
+		LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return -EFAULT;
+	}
+
+	/* There is no gap for clients, if the socket is passed */
+	if (s_info.transport == &transport_unix) {
+		s_info.server_fd = inherited_server_fd();
+		if (s_info.server_fd < 0)
+			s_info.server_fd = take_over_server();
+	}
+
+	if (s_info.server_fd < 0) {
+		unlink(s_info.socket_file);
+		s_info.server_fd = s_info.transport->listen(s_info.socket_file);
+	}
+
+	if (s_info.server_fd < 0) {
+		LOGE("Failed to open a socket (%s)\n", strerror(errno));
+		if (pthread_mutex_unlock(&s_info.server_mutex) != 0)
+			LOGE("[%s:%d] Failed to do unlock mutex (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return -EFAULT;
+	}
+
+	if (fcntl(s_info.server_fd, F_SETFD, FD_CLOEXEC) < 0)
+		LOGE("Error: %s\n", strerror(errno));
+
+	if (fcntl(s_info.server_fd, F_SETFL, O_NONBLOCK) < 0)
+		LOGE("Error: %s\n", strerror(errno));
+
+	gio = g_io_channel_unix_new(s_info.server_fd);
+	if (!gio) {
+		s_info.transport->close(s_info.server_fd);
+		s_info.server_fd = -1;
+		if (pthread_mutex_unlock(&s_info.server_mutex) != 0)
+			LOGE("[%s:%d] Failed to do unlock mutex (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return -EFAULT;
+	}
+
+	id = g_io_add_watch(gio,
+			G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+			(GIOFunc)accept_cb, NULL);
+	if (id < 0) {
+		GError *err = NULL;
+		LOGE("Failed to create g_io watch\n");
+		g_io_channel_unref(gio);
+		g_io_channel_shutdown(gio, TRUE, &err);
+		s_info.transport->close(s_info.server_fd);
+		s_info.server_fd = -1;
+		if (pthread_mutex_unlock(&s_info.server_mutex) != 0)
+			LOGE("[%s:%d] Failed to do unlock mutex (%s)\n",
+					__func__, __LINE__, strerror(errno));
+
+		return -EFAULT;
+	}
+
+	s_info.server_id = id;
+	g_io_channel_unref(gio);
+
+	if (pthread_mutex_unlock(&s_info.server_mutex) != 0) {
+		GError *err = NULL;
+		g_io_channel_shutdown(gio, TRUE, &err);
+		LOGE("[%s:%d] Failed to do unlock mutex (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		/* NOTE:
+		 * We couldn't make a lock for this statements.
+		 * We already meet the unrecoverble error
+		 */
+		s_info.transport->close(s_info.server_fd);
+		s_info.server_fd = -1;
+		return -EFAULT;
+	}
+
+	/* Only sockets can be passed to a successor */
+	if (s_info.handover_cb.handover_cb && s_info.transport == &transport_unix && init_handover() < 0)
+		LOGE("Failed to wait a successor\n");
+
+	return 0;
+}
+
+
+
+/*
+ * Dispatch a request which is not from a connection.
+ * Identity is not resolved for an untrusted pid (of the spool), the caller is not verified.
+ * Returns the result of the request.
+ */
+static inline
+int dispatch_offline(int pid, int uid, int trusted, const char *buffer, int size)
+{
+	struct connection_state *state;
+	struct message msg;
+	int ret;
+
+	if (packet_decode_v2(buffer, size, &msg) != size) {
+		LOGE("Invalid request\n");
+		return -EINVAL;
+	}
+
+	state = create_state();
+	if (!state)
+		return -ENOMEM;
+
+	state->conn_fd = -1;
+	state->version = PACKET_VERSION;
+	state->from_pid = pid;
+	state->uid = uid;
+	state->received = monotonic_ms();
+	state->icon_checked = 1;
+	state->target_checked = 1;
+	state->result = -EFAULT;
+
+	if (!trusted) {
+		state->identity = calloc(1, sizeof(*state->identity));
+		if (!state->identity) {
+			LOGE("Heap: %s\n", strerror(errno));
+			destroy_state(state);
+			return -ENOMEM;
+		}
+
+		state->identity->pid = pid;
+	}
+
+	dispatch_message(-1, state, &msg);
+	ret = state->result;
+	destroy_state(state);
+	return ret;
+}
+
+
+
+static
+void replay_cb(int pid, const char *buffer, int size, void *data)
+{
+	dispatch_offline(pid, -1, 1, buffer, size);
+}
+
+
+
+static
+int spool_deliver_cb(int pid, int uid, const char *buffer, int size, void *data)
+{
+	return dispatch_offline(pid, uid, 0, buffer, size);
+}
+
+
+
+static
+gboolean spool_drain_cb(gpointer data)
+{
+	int count;
+
+	count = spool_drain(spool_deliver_cb, NULL);
+	if (count > 0)
+		LOGD("%d spooled requests are delivered\n", count);
+
+	return FALSE;
+}
+
+
+
+static inline
+int start_server(void)
+{
+	int ret;
+
+	if (s_info.server_fd >= 0)
+		return 0;
+
+	/* Queries are served from this, even if the persistent one is not enabled */
+	if (registry_init(NULL) < 0)
+		LOGE("Failed to initialize the registry\n");
+
+	ret = init_server();
+	if (ret != 0) {
+		LOGE("Failed to initialize the server\n");
+		return ret;
+	}
+
+	/* After other callbacks are set */
+	g_idle_add(spool_drain_cb, NULL);
+	g_timeout_add(SPOOL_RECHECK_DELAY, spool_drain_cb, NULL);
+	return ret;
+}
+
+
+
+EAPI int shortcut_set_request_cb(request_cb_t request_cb, void *data)
+{
+	s_info.server_cb.request_cb = request_cb;
+	s_info.server_cb.data = data;
+	return start_server();
+}
+
+
+
+EAPI int shortcut_set_request_cb_ex(request_ex_cb_t request_ex_cb, void *data)
+{
+	s_info.request_ex_cb.request_ex_cb = request_ex_cb;
+	s_info.request_ex_cb.data = data;
+	return start_server();
+}
+
+
+
+EAPI int shortcut_set_handover_cb(shortcut_handover_cb_t handover_cb, void *data)
+{
+	s_info.handover_cb.handover_cb = handover_cb;
+	s_info.handover_cb.data = data;
+
+	if (!handover_cb) {
+		fini_handover();
+		return 0;
+	}
+
+	/* Or, it is created with the server */
+	if (s_info.server_fd < 0)
+		return 0;
+
+	if (s_info.transport != &transport_unix)
+		return -ENOTSUP;
+
+	return init_handover();
+}
+
+
+
+EAPI int shortcut_set_update_cb(update_cb_t update_cb, void *data)
+{
+	s_info.update_cb.update_cb = update_cb;
+	s_info.update_cb.data = data;
+	return 0;
+}
+
+
+
+EAPI int shortcut_set_remove_cb(remove_cb_t remove_cb, void *data)
+{
+	s_info.remove_cb.remove_cb = remove_cb;
+	s_info.remove_cb.data = data;
+	return 0;
+}
+
+
+
+static
+gboolean icon_cache_cb(GIOChannel *src, GIOCondition cond, gpointer data)
+{
+	if (!(cond & G_IO_IN)) {
+		LOGE("Icon cache is broken\n");
+		return FALSE;
+	}
+
+	icon_cache_dispatch();
+	return TRUE;
+}
+
+
+
+EAPI int shortcut_icon_cache_enable(shortcut_icon_load_cb_t load_cb, shortcut_icon_unload_cb_t unload_cb, int max_size, void *data)
+{
+	GIOChannel *gio;
+	guint id;
+	int fd;
+
+	fd = icon_cache_init(load_cb, unload_cb, max_size, data);
+	if (fd < 0)
+		return fd;
+
+	gio = g_io_channel_unix_new(fd);
+	if (!gio) {
+		LOGE("Failed to create a channel\n");
+		return -EFAULT;
+	}
+
+	id = g_io_add_watch(gio, G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL, (GIOFunc)icon_cache_cb, NULL);
+	if (id < 0) {
+		GError *err = NULL;
+		LOGE("Failed to create g_io watch\n");
+		g_io_channel_unref(gio);
+		g_io_channel_shutdown(gio, TRUE, &err);
+		return -EFAULT;
+	}
+
+	g_io_channel_unref(gio);
+	return 0;
+}
+
+
+
+static
+gboolean prefetch_cb(GIOChannel *src, GIOCondition cond, gpointer data)
+{
+	if (!(cond & G_IO_IN)) {
+		LOGE("Prefetch is broken\n");
+		return FALSE;
+	}
+
+	prefetch_dispatch();
+	return TRUE;
+}
+
+
+
+EAPI int shortcut_prefetch_enable(int workers, shortcut_target_resolve_cb_t resolve_cb, void *data)
+{
+	GIOChannel *gio;
+	guint id;
+	int fd;
+
+	fd = prefetch_init(workers, resolve_cb, data);
+	if (fd < 0)
+		return fd;
+
+	gio = g_io_channel_unix_new(fd);
+	if (!gio) {
+		LOGE("Failed to create a channel\n");
+		return -EFAULT;
+	}
+
+	id = g_io_add_watch(gio, G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL, (GIOFunc)prefetch_cb, NULL);
+	if (id < 0) {
+		GError *err = NULL;
+		LOGE("Failed to create g_io watch\n");
+		g_io_channel_unref(gio);
+		g_io_channel_shutdown(gio, TRUE, &err);
+		return -EFAULT;
+	}
+
+	g_io_channel_unref(gio);
+	return 0;
+}
+
+
+
+EAPI const struct shortcut_target *shortcut_request_target(void)
+{
+	return s_target;
+}
+
+
+
+static
+gboolean pool_cb(GIOChannel *src, GIOCondition cond, gpointer data)
+{
+	if (!(cond & G_IO_IN)) {
+		LOGE("Pool is broken\n");
+		return FALSE;
+	}
+
+	pool_dispatch();
+	return TRUE;
+}
+
+
+
+EAPI int shortcut_parallel_enable(int workers)
+{
+	GIOChannel *gio;
+	guint id;
+	int fd;
+
+	fd = pool_init(workers);
+	if (fd < 0)
+		return fd;
+
+	gio = g_io_channel_unix_new(fd);
+	if (!gio) {
+		LOGE("Failed to create a channel\n");
+		return -EFAULT;
+	}
+
+	id = g_io_add_watch(gio, G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL, (GIOFunc)pool_cb, NULL);
 	if (id < 0) {
 		GError *err = NULL;
 		LOGE("Failed to create g_io watch\n");
-		free(state);
 		g_io_channel_unref(gio);
 		g_io_channel_shutdown(gio, TRUE, &err);
-		secom_put_connection_handle(connection_fd);
+		return -EFAULT;
+	}
+
+	g_io_channel_unref(gio);
+	return 0;
+}
+
+
+
+EAPI int shortcut_spool_count(void)
+{
+	return spool_count();
+}
+
+
+
+EAPI int shortcut_set_priority(int priority)
+{
+	if (priority < 0 || priority >= MESSAGE_PRIORITY_MAX)
+		return -EINVAL;
+
+	s_info.priority = priority;
+	return 0;
+}
+
+
+
+int transport_install(const struct transport *transport)
+{
+	if (s_info.server_fd >= 0 || s_info.ring_state || s_info.event_state)
+		return -EBUSY;
+
+	s_info.transport = transport;
+	return 0;
+}
+
+
+
+EAPI int shortcut_set_transport(int transport)
+{
+	const struct transport *table[] = {
+		[SHORTCUT_TRANSPORT_UNIX] = &transport_unix,
+		[SHORTCUT_TRANSPORT_LOOPBACK] = &transport_loopback,
+	};
+
+	if (transport < 0 || transport >= sizeof(table) / sizeof(table[0]))
+		return -EINVAL;
+
+	return transport_install(table[transport]);
+}
+
+
+
+EAPI int shortcut_set_timeout(int timeout)
+{
+	if (timeout < 0)
+		return -EINVAL;
+
+	s_info.timeout = timeout;
+	return 0;
+}
+
+
+
+EAPI int shortcut_expired_count(void)
+{
+	return s_info.expired;
+}
+
+
+
+EAPI const struct shortcut_identity *shortcut_caller_identity(void)
+{
+	return s_caller;
+}
+
+
+
+EAPI int shortcut_set_identity_resolver(shortcut_identity_resolve_cb_t resolve_cb, void *data)
+{
+	identity_set_resolver(resolve_cb, data);
+	return 0;
+}
+
+
+
+EAPI int shortcut_journal_enable(const char *path)
+{
+	return journal_init(path, replay_cb, NULL);
+}
+
+
+
+EAPI void *shortcut_icon_cache_get(const char *icon)
+{
+	return icon_cache_get(icon);
+}
+
+
+
+EAPI int shortcut_icon_cache_put(void *handle)
+{
+	return icon_cache_put(handle);
+}
+
+
+
+struct registry_foreach_data {
+	shortcut_registry_cb_t cb;
+	void *data;
+};
+
+
+
+static
+int registry_foreach_cb(const struct registry_entry *entry, void *data)
+{
+	struct registry_foreach_data *foreach_data = data;
+
+	return foreach_data->cb(entry->pkgname, entry->name, entry->type,
+				entry->exec, entry->icon, foreach_data->data);
+}
+
+
+
+EAPI int shortcut_registry_enable(const char *path)
+{
+	if (!path)
+		return -EINVAL;
+
+	return registry_init(path);
+}
+
+
+
+EAPI int shortcut_registry_foreach(shortcut_registry_cb_t cb, void *data)
+{
+	struct registry_foreach_data foreach_data;
+
+	if (!cb)
+		return -EINVAL;
+
+	foreach_data.cb = cb;
+	foreach_data.data = data;
+	return registry_foreach(registry_foreach_cb, &foreach_data);
+}
+
+
+
+EAPI int shortcut_registry_remove(const char *pkgname, const char *name)
+{
+	return registry_remove(pkgname, name);
+}
+
+
+
+/*
+ * Queries are sent in v1, without the hello.
+ * A server which doesn't know queries drops the packet and the connection, it is -ECONNABORTED then.
+ * It blocks the caller until the server answers, recv_timed bounds each wait by QUERY_TIMEOUT.
+ */
+static inline
+int send_query(int kind, const char *pkgname, const char *name, shortcut_registry_cb_t cb, void *data)
+{
+	struct connection_state state;
+	struct message msg;
+	int client_fd;
+	int stopped;
+	int size;
+	int ret;
+
+	message_init(&msg, PACKET_QUERY, s_info.seq++);
+	msg.kind = kind;
+	message_set_field(&msg, FIELD_PKGNAME, pkgname);
+	message_set_field(&msg, FIELD_NAME, name);
+
+	client_fd = s_info.transport->connect(s_info.socket_file);
+	if (client_fd < 0) {
+		LOGE("Failed to make the client FD\n");
+		return -EFAULT;
+	}
+
+	if (send_message(client_fd, 1, &msg) < 0) {
+		LOGE("Failed to send a query\n");
+		s_info.transport->close(client_fd);
+		return -EFAULT;
+	}
+
+	memset(&state, 0, sizeof(state));
+	state.version = 1;
+
+	stopped = 0;
+	ret = -ECONNABORTED;
+	while (1) {
+		size = next_message(&state, &msg);
+		if (size < 0) {
+			LOGE("Invalid packet\n");
+			ret = -EFAULT;
+			break;
+		}
+
+		if (size == 0) {
+			if (buffer_reserve(&state.inbox, RECV_CHUNK) < 0) {
+				ret = -ENOMEM;
+				break;
+			}
+
+			size = recv_timed(client_fd, state.inbox.data + state.inbox.length, RECV_CHUNK, NULL);
+			if (size <= 0) {
+				ret = -ECONNABORTED;
+				break;
+			}
+
+			state.inbox.length += size;
+			continue;
+		}
+
+		if (msg.type == PACKET_ACK) {
+			ret = msg.ret;
+			break;
+		}
+
+		if (msg.type != PACKET_ENTRY) {
+			LOGE("Invalid packet type\n");
+			ret = -EFAULT;
+			break;
+		}
+
+		if (cb && !stopped) {
+			stopped = cb(msg.field[FIELD_PKGNAME].ptr,
+					msg.field[FIELD_NAME].ptr,
+					msg.shortcut_type,
+					msg.field[FIELD_EXEC].ptr,
+					msg.field[FIELD_ICON].ptr, data) < 0;
+		}
+
+		buffer_consume(&state.inbox, size);
+	}
+
+	free(state.inbox.data);
+	s_info.transport->close(client_fd);
+	return ret;
+}
+
+
+
+EAPI int shortcut_exists(const char *pkgname, const char *name)
+{
+	return send_query(QUERY_EXISTS, pkgname, name, NULL, NULL);
+}
+
+
+
+EAPI int shortcut_list_by_pkgname(const char *pkgname, shortcut_registry_cb_t cb, void *data)
+{
+	if (!pkgname)
+		return -EINVAL;
+
+	return send_query(QUERY_LIST, pkgname, NULL, cb, data);
+}
+
+
+
+EAPI int shortcut_foreach(shortcut_registry_cb_t cb, void *data)
+{
+	return send_query(QUERY_LIST, NULL, NULL, cb, data);
+}
+
+
+
+static
+gboolean spool_poll_cb(gpointer data)
+{
+	struct spool_wait **ptr;
+	struct spool_wait *wait;
+	int server_pid;
+	int result;
+	int ret;
+
+	ptr = &s_info.spool_list;
+	while (*ptr) {
+		wait = *ptr;
+		ret = spool_read_result(wait->name, &result, &server_pid);
+		if (ret == -EINPROGRESS && (!wait->deadline || monotonic_ms() <= wait->deadline)) {
+			ptr = &wait->next;
+			continue;
+		}
+
+		if (ret == -EINPROGRESS) {
+			/* Server will drop it */
+			result = -ETIMEDOUT;
+			server_pid = -1;
+		} else if (ret < 0) {
+			/* Delivered, but the result is gone */
+			result = -ECONNABORTED;
+			server_pid = -1;
+		}
+
+		*ptr = wait->next;
+		if (wait->client_cb->result_cb)
+			wait->client_cb->result_cb(result, server_pid, wait->client_cb->data);
+		free(wait->client_cb);
+		free(wait);
+	}
+
+	if (s_info.spool_list)
+		return TRUE;
+
+	s_info.spool_id = 0;
+	return FALSE;
+}
+
+
+
+/*
+ * The server is not running, keep the request in the spool.
+ * The result_cb is invoked when the server delivers it.
+ */
+static inline
+int spool_request(const struct message *msg, struct client_cb *client_cb)
+{
+	struct spool_wait **ptr;
+	struct spool_wait *wait;
+	char *buffer;
+	int size;
+	int ret;
+
+	wait = calloc(1, sizeof(*wait));
+	if (!wait) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return -ENOMEM;
+	}
+
+	size = packet_size_v2(msg);
+	buffer = malloc(size);
+	if (!buffer) {
+		LOGE("Heap: %s\n", strerror(errno));
+		free(wait);
+		return -ENOMEM;
+	}
+
+	packet_encode_v2(msg, buffer);
+	ret = spool_write(getpid(), buffer, size, wait->name);
+	free(buffer);
+	if (ret < 0) {
+		free(wait);
+		return ret;
+	}
+
+	LOGD("Server is not running, %s is spooled\n", wait->name);
+
+	if (!client_cb->result_cb) {
+		free(client_cb);
+		free(wait);
+		return 0;
+	}
+
+	wait->client_cb = client_cb;
+	wait->deadline = msg->deadline;
+
+	/* Results are delivered in the order of requests */
+	ptr = &s_info.spool_list;
+	while (*ptr)
+		ptr = &(*ptr)->next;
+	*ptr = wait;
+
+	if (!s_info.spool_id)
+		s_info.spool_id = g_timeout_add(SPOOL_POLL_INTERVAL, spool_poll_cb, NULL);
+
+	return 0;
+}
+
+
+
+/*
+ * Wait a message of the ring connection, for its handshake.
+ * Returns the size of the message in the inbox.
+ */
+static inline
+int wait_message(int fd, struct connection_state *state, struct message *msg)
+{
+	int size;
+
+	while ((size = next_message(state, msg)) == 0) {
+		if (buffer_reserve(&state->inbox, RECV_CHUNK) < 0)
+			return -ENOMEM;
+
+		size = recv_timed(fd, state->inbox.data + state->inbox.length, RECV_CHUNK, &state->from_pid);
+		if (size <= 0)
+			return -ECONNABORTED;
+
+		state->inbox.length += size;
+	}
+
+	return size;
+}
+
+
+
+/*
+ * Requests which are waiting their ACKs get the ret.
+ * Requests are sent through new connections after this.
+ */
+static inline
+void finish_ring(int ret)
+{
+	struct connection_state *state = s_info.ring_state;
+	struct client_cb *client_cb;
+	unsigned int seq;
+
+	if (!state)
+		return;
+
+	s_info.ring_state = NULL;
+	ring_client_close();
+
+	if (state->id)
+		g_source_remove(state->id);
+	s_info.transport->close(state->conn_fd);
+
+	while ((client_cb = ring_client_take(&seq))) {
+		TRACE_CLIENT_RESULT(seq, state->from_pid, ret);
+		if (client_cb->result_cb)
+			client_cb->result_cb(ret, state->from_pid, client_cb->data);
+
+		free(client_cb);
+	}
+
+	destroy_state(state);
+}
+
+
+
+static
+gboolean ring_client_cb(GIOChannel *src, GIOCondition cond, gpointer data)
+{
+	struct connection_state *state = data;
+	struct client_cb *client_cb;
+	struct message msg;
+	int size;
+
+	/* Server can be handed over, ACKs are sent by the process which serves now */
+	state->from_pid = 0;
+	if (!(cond & G_IO_IN) || read_inbox(state->conn_fd, state) <= 0) {
+		LOGE("Ring is disconnected\n");
+		state->id = 0;
+		finish_ring(-ECONNABORTED);
+		return FALSE;
+	}
+
+	while ((size = next_message(state, &msg)) > 0) {
+		client_cb = msg.type == PACKET_ACK ? ring_client_ack(msg.seq, msg.credits) : NULL;
+		if (!client_cb) {
+			LOGE("Invalid packet\n");
+			size = -EINVAL;
+			break;
+		}
+
+		buffer_consume(&state->inbox, size);
+
+		TRACE_CLIENT_RESULT(msg.seq, state->from_pid, msg.ret);
+		if (client_cb->result_cb)
+			client_cb->result_cb(msg.ret, state->from_pid, client_cb->data);
+
+		free(client_cb);
+
+		/* Closed by the callback */
+		if (s_info.ring_state != state)
+			return FALSE;
+	}
+
+	if (size < 0) {
+		state->id = 0;
+		finish_ring(-EFAULT);
 		return FALSE;
 	}
 
-	g_io_channel_unref(gio);
-	return TRUE;
+	/* Credits are returned, and the ring is drained */
+	ring_client_publish();
+	return TRUE;
+}
+
+
+
+static inline
+void init_request(struct message *msg, int type)
+{
+	message_init(msg, type, s_info.seq++);
+	msg->priority = s_info.priority;
+	if (s_info.timeout)
+		msg->deadline = monotonic_ms() + s_info.timeout;
+}
+
+
+
+/*
+ * Request which nobody waits its result, the connection is closed right after the send.
+ * The server is known to support it by previous hellos, so the hello is not waited.
+ * It never blocks, -EAGAIN if the server is stalled, the request is sent by the normal path then.
+ */
+static inline
+int fire_request(const struct message *msg)
+{
+	struct message hello;
+	struct message req;
+	struct buffer out;
+	struct iovec iov;
+	int client_fd;
+	int size;
+	int ret;
+
+	req = *msg;
+	req.flags |= MESSAGE_FLAG_NO_REPLY;
+
+	message_init(&hello, PACKET_HELLO, msg->seq);
+	hello.version = PACKET_VERSION;
+	hello.features = CLIENT_FEATURES;
+
+	memset(&out, 0, sizeof(out));
+	if (buffer_append(&out, 1, &hello) < 0 || buffer_append(&out, PACKET_VERSION, &req) < 0) {
+		free(out.data);
+		return -ENOMEM;
+	}
+
+	client_fd = s_info.transport->connect_nonblock(s_info.socket_file);
+	if (client_fd < 0) {
+		ret = errno == EAGAIN ? -EAGAIN : -ECONNREFUSED;
+		free(out.data);
+		return ret;
+	}
+
+	iov.iov_base = out.data;
+	iov.iov_len = out.length;
+	size = s_info.transport->sendv(client_fd, &iov, 1);
+	if (size < 0)
+		ret = errno == EAGAIN ? -EAGAIN : -EFAULT;
+	else if (size != out.length)
+		ret = -EAGAIN; /* The server drops the partial packet with the connection */
+	else
+		ret = 0;
+
+	TRACE_CLIENT_SEND(msg->seq, client_fd, size);
+	s_info.transport->close(client_fd);
+	free(out.data);
+
+	if (ret == -EFAULT)
+		LOGE("Failed to send all packet\n");
+
+	return ret;
+}
+
+
+
+static inline
+int send_request(const struct message *msg, const int *fds, int nr_fds, result_cb_t result_cb, void *data)
+{
+	struct client_cb *client_cb;
+	int ret;
+
+	/* Requests of the ring are acknowledged anyway, credits come back with ACKs */
+	if (!result_cb && nr_fds == 0 && !s_info.ring_state && (s_info.server_features & FEATURE_NO_REPLY)) {
+		ret = fire_request(msg);
+		if (ret != -ECONNREFUSED && ret != -EAGAIN)
+			return ret;
+
+		/* Spooled until the server starts, or queued to the outbox of a connection until the server catches up */
+	}
+
+	client_cb = malloc(sizeof(*client_cb));
+	if (!client_cb) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return -ENOMEM;
+	}
+
+	client_cb->result_cb = result_cb;
+	client_cb->data = data;
+
+	if (s_info.ring_state && nr_fds == 0) {
+		ret = ring_client_send(msg, client_cb);
+		if (ret == 0)
+			return 0;
+
+		/* Server is behind, a new connection would not make it faster */
+		if (ret == -EBUSY) {
+			free(client_cb);
+			return ret;
+		}
+	}
+
+	ret = init_client(client_cb, msg, fds, nr_fds);
+	if (ret == -ECONNREFUSED && nr_fds == 0) {
+		ret = spool_request(msg, client_cb);
+		if (ret == 0)
+			return 0;
+	}
+
+	if (ret < 0) {
+		LOGE("Failed to init client FD\n");
+		free(client_cb);
+		return ret == -ENOTSUP || ret == -EBADF ? ret : -EFAULT;
+	}
+
+	return 0;
+}
+
+
+
+/*
+ * Connect to the server for a long-lived connection, the version is negotiated synchronously.
+ * Returns -ENOTSUP if the server doesn't support v2 or the features.
+ */
+static inline
+int open_session(int features, struct connection_state **session)
+{
+	struct connection_state *state;
+	struct message msg;
+	int client_fd;
+	int ret;
+
+	state = create_state();
+	if (!state)
+		return -ENOMEM;
+
+	client_fd = s_info.transport->connect(s_info.socket_file);
+	if (client_fd < 0) {
+		destroy_state(state);
+		return -ECONNREFUSED;
+	}
+
+	if (fcntl(client_fd, F_SETFD, FD_CLOEXEC) < 0)
+		LOGE("Error: %s\n", strerror(errno));
+
+	state->version = 1;
+	state->conn_fd = client_fd;
+
+	message_init(&msg, PACKET_HELLO, s_info.seq++);
+	msg.version = PACKET_VERSION;
+	msg.features = CLIENT_FEATURES | features;
+	if (send_message(client_fd, state->version, &msg) < 0) {
+		ret = -EFAULT;
+		goto err;
+	}
+
+	ret = wait_message(client_fd, state, &msg);
+	if (ret < 0)
+		goto err;
+
+	buffer_consume(&state->inbox, ret);
+	if (msg.type != PACKET_HELLO || msg.version < 2 || (msg.features & features) != features) {
+		LOGE("Server doesn't support features (%x)\n", features);
+		ret = -ENOTSUP;
+		goto err;
+	}
+
+	state->version = msg.version;
+	state->features = msg.features;
+	*session = state;
+	return 0;
+
+err:
+	s_info.transport->close(client_fd);
+	destroy_state(state);
+	return ret;
+}
+
+
+
+/*
+ * Send a message of the session, and wait its ACK.
+ * credits can be NULL, otherwise it gets the credits which are granted with the ACK.
+ */
+static inline
+int session_request(struct connection_state *state, const struct message *msg, const int *fds, int nr_fds, int *credits)
+{
+	struct message ack;
+	struct buffer out;
+	int ret;
+
+	memset(&out, 0, sizeof(out));
+	if (buffer_append(&out, state->version, msg) < 0)
+		return -ENOMEM;
+
+	ret = s_info.transport->send(state->conn_fd, out.data, out.length, fds, nr_fds);
+	free(out.data);
+	if (ret != out.length)
+		return -EFAULT;
+
+	ret = wait_message(state->conn_fd, state, &ack);
+	if (ret < 0)
+		return ret;
+
+	buffer_consume(&state->inbox, ret);
+	if (ack.type != PACKET_ACK || ack.seq != msg->seq)
+		return -EFAULT;
+
+	if (credits)
+		*credits = ack.credits;
+
+	return ack.ret;
 }
 
 
 
-static inline int init_client(struct client_cb *client_cb,
-					const char *packet, int packet_size)
+/*
+ * Following packets of the session are received in the main loop.
+ */
+static inline
+int start_session(struct connection_state *state, GIOFunc cb)
 {
 	GIOChannel *gio;
-	guint id;
-	int client_fd;
-	struct connection_state *state;
 
-	client_fd = secom_create_client(s_info.socket_file);
-	if (client_fd < 0) {
-		LOGE("Failed to make the client FD\n");
+	if (fcntl(state->conn_fd, F_SETFL, O_NONBLOCK) < 0)
+		LOGE("Error: %s\n", strerror(errno));
+
+	gio = g_io_channel_unix_new(state->conn_fd);
+	if (!gio)
 		return -EFAULT;
-	}
 
-	if (fcntl(client_fd, F_SETFD, FD_CLOEXEC) < 0)
-		LOGE("Error: %s\n", strerror(errno));
+	state->id = g_io_add_watch(gio,
+			G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+			cb, state);
+	g_io_channel_unref(gio);
+	return 0;
+}
 
-	if (fcntl(client_fd, F_SETFL, O_NONBLOCK) < 0)
-		LOGE("Error: %s\n", strerror(errno));
 
-	gio = g_io_channel_unix_new(client_fd);
-	if (!gio) {
-		close(client_fd);
-		return -EFAULT;
+
+/*
+ * Handshake is done synchronously, then requests are published to the ring,
+ * and ACKs are received through the connection.
+ */
+EAPI int shortcut_ring_open(int size)
+{
+	struct connection_state *state;
+	struct message msg;
+	int credits;
+	int fds[2];
+	int ret;
+
+	if (s_info.ring_state)
+		return -EALREADY;
+
+	ret = open_session(FEATURE_SHM_RING, &state);
+	if (ret < 0)
+		return ret;
+
+	ret = ring_client_create(size, &fds[0], &fds[1]);
+	if (ret < 0) {
+		LOGE("Failed to create the ring (%d)\n", ret);
+		s_info.transport->close(state->conn_fd);
+		destroy_state(state);
+		return ret;
 	}
 
-	state = calloc(1, sizeof(*state));
-	if (!state) {
-		LOGE("Error: %s\n", strerror(errno));
-		close(client_fd);
+	message_init(&msg, PACKET_RING, s_info.seq++);
+	msg.flags = MESSAGE_FLAG_RING_FDS;
+
+	ret = session_request(state, &msg, fds, 2, &credits);
+	if (ret < 0)
+		goto err;
+
+	ret = ring_client_start(state->conn_fd, (state->features & FEATURE_CREDIT) ? credits : -1);
+	if (ret < 0)
+		goto err;
+
+	ret = start_session(state, (GIOFunc)ring_client_cb);
+	if (ret < 0)
+		goto err;
+
+	s_info.ring_state = state;
+	return 0;
+
+err:
+	LOGE("Failed to open the ring (%d)\n", ret);
+	ring_client_close();
+	s_info.transport->close(state->conn_fd);
+	destroy_state(state);
+	return ret;
+}
+
+
+
+EAPI int shortcut_ring_close(void)
+{
+	if (!s_info.ring_state)
+		return -ENOENT;
+
+	finish_ring(-ECANCELED);
+	return 0;
+}
+
+
+
+EAPI int shortcut_client_queue_stats(struct shortcut_queue_stats *stats)
+{
+	if (!stats)
+		return -EINVAL;
+
+	memset(stats, 0, sizeof(*stats));
+	ring_client_stats(stats);
+	return 0;
+}
+
+
+
+EAPI int shortcut_server_cost_stats(struct shortcut_client_cost *costs, int count)
+{
+	struct cost_entry *entries;
+	int nr;
+	int i;
+
+	if (!costs || count <= 0)
+		return -EINVAL;
+
+	entries = malloc(sizeof(*entries) * count);
+	if (!entries) {
+		LOGE("Heap: %s\n", strerror(errno));
 		return -ENOMEM;
 	}
 
-	state->data = client_cb;
-
-	id = g_io_add_watch(gio,
-		G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
-		(GIOFunc)client_connection_cb, state);
-	if (id < 0) {
-		GError *err = NULL;
-		LOGE("Failed to create g_io watch\n");
-		free(state);
-		g_io_channel_unref(gio);
-		g_io_channel_shutdown(gio, TRUE, &err);
-		close(client_fd);
-		return -EFAULT;
+	nr = cost_top(entries, count);
+	for (i = 0; i < nr; i++) {
+		costs[i].pid = entries[i].pid;
+		costs[i].uid = entries[i].uid;
+		costs[i].bytes = entries[i].bytes;
+		costs[i].requests = entries[i].requests;
+		costs[i].decode_ns = entries[i].decode_ns;
+		costs[i].callback_ns = entries[i].callback_ns;
 	}
 
-	g_io_channel_unref(gio);
+	free(entries);
+	return nr;
+}
 
-	if (secom_send(client_fd, packet, packet_size) != packet_size) {
-		GError *err = NULL;
-		LOGE("Failed to send all packet "
-			"(g_io_channel is not cleared now\n");
-		free(state);
-		g_io_channel_shutdown(gio, TRUE, &err);
-		close(client_fd);
-		return -EFAULT;
+
+
+EAPI int shortcut_server_queue_stats(struct shortcut_queue_stats *stats)
+{
+	struct connection_state *state;
+
+	if (!stats)
+		return -EINVAL;
+
+	memset(stats, 0, sizeof(*stats));
+	for (state = s_info.conn_list; state; state = state->conn_next) {
+		if (!state->ring || !ring_server_window(state->ring))
+			continue;
+
+		stats->connections++;
+		stats->window = ring_server_window(state->ring);
+		stats->outstanding += ring_server_outstanding(state->ring);
+		stats->queued += count_packets(state);
+		stats->queued_bytes += state->inbox.length;
 	}
 
-	return client_fd;
+	stats->max_queued = ring_server_max_outstanding();
+	return 0;
 }
 
 
 
 static inline
-int init_server(void)
+void finish_subscription(void)
 {
-	GIOChannel *gio;
-	guint id;
+	struct connection_state *state = s_info.event_state;
 
-	if (s_info.server_fd != -1) {
-		LOGE("Already initialized\n");
-		return 0;
-	}
+	if (!state)
+		return;
 
-	if (pthread_mutex_lock(&s_info.server_mutex) != 0) {
-		LOGE("[%s:%d] Failed to get lock (%s)\n",
-					__func__, __LINE__, strerror(errno));
-		return -EFAULT;
-	}
+	s_info.event_state = NULL;
+	if (state->id)
+		g_source_remove(state->id);
 
-	unlink(s_info.socket_file);
-	s_info.server_fd = secom_create_server(s_info.socket_file);
+	s_info.transport->close(state->conn_fd);
+	destroy_state(state);
+}
 
-	if (s_info.server_fd < 0) {
-		LOGE("Failed to open a socket (%s)\n", strerror(errno));
-		if (pthread_mutex_unlock(&s_info.server_mutex) != 0)
-			LOGE("[%s:%d] Failed to do unlock mutex (%s)\n",
-					__func__, __LINE__, strerror(errno));
-		return -EFAULT;
-	}
 
-	if (fcntl(s_info.server_fd, F_SETFD, FD_CLOEXEC) < 0)
-		LOGE("Error: %s\n", strerror(errno));
 
-	if (fcntl(s_info.server_fd, F_SETFL, O_NONBLOCK) < 0)
-		LOGE("Error: %s\n", strerror(errno));
+static
+gboolean event_client_cb(GIOChannel *src, GIOCondition cond, gpointer data)
+{
+	struct connection_state *state = data;
+	struct shortcut_event event;
+	struct event_cb event_cb;
+	struct message msg;
+	int size;
 
-	gio = g_io_channel_unix_new(s_info.server_fd);
-	if (!gio) {
-		close(s_info.server_fd);
-		s_info.server_fd = -1;
-		if (pthread_mutex_unlock(&s_info.server_mutex) != 0)
-			LOGE("[%s:%d] Failed to do unlock mutex (%s)\n",
-					__func__, __LINE__, strerror(errno));
-		return -EFAULT;
+	/* Server can be handed over, events are sent by the process which serves now */
+	state->from_pid = 0;
+	if (!(cond & G_IO_IN) || read_inbox(state->conn_fd, state) <= 0) {
+		size = -ECONNABORTED;
+		goto out;
 	}
 
-	id = g_io_add_watch(gio,
-			G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
-			(GIOFunc)accept_cb, NULL);
-	if (id < 0) {
-		GError *err = NULL;
-		LOGE("Failed to create g_io watch\n");
-		g_io_channel_unref(gio);
-		g_io_channel_shutdown(gio, TRUE, &err);
-		close(s_info.server_fd);
-		s_info.server_fd = -1;
-		if (pthread_mutex_unlock(&s_info.server_mutex) != 0)
-			LOGE("[%s:%d] Failed to do unlock mutex (%s)\n",
-					__func__, __LINE__, strerror(errno));
+	while ((size = next_message(state, &msg)) > 0) {
+		if (msg.type != PACKET_EVENT) {
+			LOGE("Invalid packet\n");
+			size = -EINVAL;
+			break;
+		}
 
-		return -EFAULT;
+		memset(&event, 0, sizeof(event));
+		event.event = msg.kind;
+		event.seq = msg.seq;
+		event.pkgname = msg.field[FIELD_PKGNAME].ptr;
+		event.name = msg.field[FIELD_NAME].ptr;
+		event.type = msg.shortcut_type;
+		event.content_info = msg.field[FIELD_EXEC].ptr;
+		event.icon = msg.field[FIELD_ICON].ptr;
+		event.mask = msg.mask;
+		event.new_name = msg.field[FIELD_NEW_NAME].ptr;
+
+		/* Fields are pointing the inbox */
+		if (s_info.event_cb.event_cb)
+			s_info.event_cb.event_cb(&event, s_info.event_cb.data);
+
+		/* Closed by the callback */
+		if (s_info.event_state != state)
+			return FALSE;
+
+		buffer_consume(&state->inbox, size);
 	}
 
-	g_io_channel_unref(gio);
+	if (size == 0)
+		return TRUE;
 
-	if (pthread_mutex_unlock(&s_info.server_mutex) != 0) {
-		GError *err = NULL;
-		g_io_channel_shutdown(gio, TRUE, &err);
-		LOGE("[%s:%d] Failed to do unlock mutex (%s)\n",
-					__func__, __LINE__, strerror(errno));
-		/* NOTE:
-		 * We couldn't make a lock for this statements.
-		 * We already meet the unrecoverble error
-		 */
-		close(s_info.server_fd);
-		s_info.server_fd = -1;
-		return -EFAULT;
-	}
+out:
+	LOGE("Subscription is disconnected (%d)\n", size);
+	state->id = 0;
+	event_cb = s_info.event_cb;
+	finish_subscription();
 
-	return 0;
+	memset(&event, 0, sizeof(event));
+	event.event = SHORTCUT_EVENT_CLOSED;
+	if (event_cb.event_cb)
+		event_cb.event_cb(&event, event_cb.data);
+
+	return FALSE;
 }
 
 
 
-EAPI int shortcut_set_request_cb(request_cb_t request_cb, void *data)
+EAPI int shortcut_subscribe(shortcut_event_cb_t event_cb, void *data)
 {
+	struct connection_state *state;
+	struct message msg;
 	int ret;
-	s_info.server_cb.request_cb = request_cb;
-	s_info.server_cb.data = data;
 
-	ret = init_server();
-	if (ret != 0) {
-		LOGE("Failed to initialize the server\n");
+	if (!event_cb)
+		return -EINVAL;
+
+	if (s_info.event_state)
+		return -EALREADY;
+
+	ret = open_session(FEATURE_SUBSCRIPTION, &state);
+	if (ret < 0)
+		return ret;
+
+	message_init(&msg, PACKET_SUBSCRIBE, s_info.seq++);
+	ret = session_request(state, &msg, NULL, 0, NULL);
+	if (ret == 0)
+		ret = start_session(state, (GIOFunc)event_client_cb);
+
+	if (ret < 0) {
+		LOGE("Failed to subscribe (%d)\n", ret);
+		s_info.transport->close(state->conn_fd);
+		destroy_state(state);
+		return ret;
 	}
 
-	return ret;
+	s_info.event_cb.event_cb = event_cb;
+	s_info.event_cb.data = data;
+	s_info.event_state = state;
+	return 0;
+}
+
+
+
+EAPI int shortcut_unsubscribe(void)
+{
+	if (!s_info.event_state)
+		return -ENOENT;
+
+	finish_subscription();
+	s_info.event_cb.event_cb = NULL;
+	s_info.event_cb.data = NULL;
+	return 0;
 }
 
 
 
 EAPI int add_to_home_shortcut(const char *pkgname, const char *name, int type, const char *content_info, const char *icon, result_cb_t result_cb, void *data)
 {
-	struct packet *packet;
-	int pkgname_len;
-	int name_len;
-	int exec_len;
-	int icon_len;
-	int packet_size;
-	char *payload;
-	struct client_cb *client_cb;
-	int client_fd;
+	struct message msg;
 
-	pkgname_len = pkgname ? strlen(pkgname) + 1 : 0;
-	name_len = name ? strlen(name) + 1 : 0;
-	exec_len = content_info ? strlen(content_info) + 1 : 0;
-	icon_len = icon ? strlen(icon) + 1 : 0;
+	init_request(&msg, PACKET_REQ);
+	msg.shortcut_type = type;
+	message_set_field(&msg, FIELD_PKGNAME, pkgname);
+	message_set_field(&msg, FIELD_NAME, name);
+	message_set_field(&msg, FIELD_EXEC, content_info);
+	message_set_field(&msg, FIELD_ICON, icon);
 
-	packet_size = sizeof(*packet) + name_len + exec_len + icon_len + pkgname_len + 1;
+	return send_request(&msg, NULL, 0, result_cb, data);
+}
 
-	packet = alloca(packet_size);
-	if (!packet) {
-		LOGE("Heap: %s\n", strerror(errno));
-		return -ENOMEM;
+EAPI int shortcut_add_to_home(const char *pkgname, const char *name, int type, const char *content_info, const char *icon, result_cb_t result_cb, void *data)
+{
+	return add_to_home_shortcut(pkgname, name, type, content_info, icon, result_cb, data);
+}
+
+
+
+static inline
+void set_request_field(struct message *msg, int id, const struct shortcut_field *field)
+{
+	if (field)
+		message_set_field_n(msg, id, field->ptr, field->len);
+	else
+		message_set_field_n(msg, id, NULL, 0);
+}
+
+
+
+EAPI int shortcut_add_to_home_n(const struct shortcut_field *pkgname, const struct shortcut_field *name, int type, const struct shortcut_field *content_info, const struct shortcut_field *icon, result_cb_t result_cb, void *data)
+{
+	struct message msg;
+
+	if ((pkgname && pkgname->len < 0) || (name && name->len < 0)
+			|| (content_info && content_info->len < 0) || (icon && icon->len < 0))
+		return -EINVAL;
+
+	init_request(&msg, PACKET_REQ);
+	msg.shortcut_type = type;
+	set_request_field(&msg, FIELD_PKGNAME, pkgname);
+	set_request_field(&msg, FIELD_NAME, name);
+	set_request_field(&msg, FIELD_EXEC, content_info);
+	set_request_field(&msg, FIELD_ICON, icon);
+
+	return send_request(&msg, NULL, 0, result_cb, data);
+}
+
+
+
+EAPI int shortcut_add_to_home_with_fd(const char *pkgname, const char *name, int type, int content_fd, int icon_fd, result_cb_t result_cb, void *data)
+{
+	struct message msg;
+	int fds[2];
+	int nr_fds;
+
+	if (content_fd < 0 && icon_fd < 0)
+		return -EINVAL;
+
+	init_request(&msg, PACKET_REQ);
+	msg.shortcut_type = type;
+	message_set_field(&msg, FIELD_PKGNAME, pkgname);
+	message_set_field(&msg, FIELD_NAME, name);
+
+	/* Order of fds follows the order of flags */
+	nr_fds = 0;
+	if (content_fd >= 0) {
+		msg.flags |= MESSAGE_FLAG_CONTENT_FD;
+		fds[nr_fds++] = content_fd;
+	}
+
+	if (icon_fd >= 0) {
+		msg.flags |= MESSAGE_FLAG_ICON_FD;
+		fds[nr_fds++] = icon_fd;
 	}
 
-	packet->head.seq = s_info.seq++;
-	packet->head.type = PACKET_REQ;
-	packet->head.data.req.shortcut_type = type;
-	packet->head.data.req.field_size.pkgname = pkgname_len;
-	packet->head.data.req.field_size.name = name_len;
-	packet->head.data.req.field_size.exec = exec_len;
-	packet->head.data.req.field_size.icon = icon_len;
-	packet->head.payload_size = pkgname_len + name_len + exec_len + icon_len + 1;
+	return send_request(&msg, fds, nr_fds, result_cb, data);
+}
 
-	payload = packet->payload;
 
-	strncpy(payload, pkgname, pkgname_len);
-	payload += pkgname_len;
-	strncpy(payload, name, name_len);
-	payload += name_len;
-	strncpy(payload, content_info, exec_len);
-	payload += exec_len;
-	strncpy(payload, icon, icon_len);
 
-	client_cb = malloc(sizeof(*client_cb));
-	if (!client_cb) {
-		LOGE("Heap: %s\n", strerror(errno));
-		return -ENOMEM;
+EAPI int shortcut_create_content_fd(const char *content_info)
+{
+#if defined(HAVE_MEMFD_CREATE)
+	int size;
+	int fd;
+
+	if (!content_info)
+		return -EINVAL;
+
+	fd = memfd_create("shortcut", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		LOGE("Failed to create a memfd (%s)\n", strerror(errno));
+		return -EFAULT;
 	}
 
-	client_cb->result_cb = result_cb;
-	client_cb->data = data;
+	/* NUL is included, the server uses it as a string */
+	size = strlen(content_info) + 1;
+	if (write(fd, content_info, size) != size) {
+		LOGE("Failed to write the content (%s)\n", strerror(errno));
+		close(fd);
+		return -EIO;
+	}
 
-	if (init_client(client_cb, (const char*)packet, packet_size) < 0) {
-		LOGE("Failed to init client FD\n");
-		free(client_cb);
+	if (fcntl(fd, F_ADD_SEALS, CONTENT_SEALS | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+		LOGE("Failed to seal the content (%s)\n", strerror(errno));
+		close(fd);
 		return -EFAULT;
 	}
 
-	return 0;
+	return fd;
+#else
+	return -ENOSYS;
+#endif
 }
 
-EAPI int shortcut_add_to_home(const char *pkgname, const char *name, int type, const char *content_info, const char *icon, result_cb_t result_cb, void *data)
+
+
+EAPI int shortcut_update(const char *pkgname, const char *name, int mask, const char *new_name, int type, const char *content_info, const char *icon, result_cb_t result_cb, void *data)
 {
-	return add_to_home_shortcut(pkgname, name, type, content_info, icon, result_cb, data);
+	struct message msg;
+
+	if (!mask)
+		return -EINVAL;
+
+	init_request(&msg, PACKET_UPDATE);
+	msg.mask = mask;
+	msg.shortcut_type = type;
+	message_set_field(&msg, FIELD_PKGNAME, pkgname);
+	message_set_field(&msg, FIELD_NAME, name);
+
+	if (mask & SHORTCUT_UPDATE_NAME)
+		message_set_field(&msg, FIELD_NEW_NAME, new_name);
+
+	if (mask & SHORTCUT_UPDATE_CONTENT_INFO)
+		message_set_field(&msg, FIELD_EXEC, content_info);
+
+	if (mask & SHORTCUT_UPDATE_ICON)
+		message_set_field(&msg, FIELD_ICON, icon);
+
+	return send_request(&msg, NULL, 0, result_cb, data);
+}
+
+
+
+EAPI int shortcut_remove(const char *pkgname, const char *name, result_cb_t result_cb, void *data)
+{
+	struct message msg;
+
+	init_request(&msg, PACKET_REMOVE);
+	message_set_field(&msg, FIELD_PKGNAME, pkgname);
+	message_set_field(&msg, FIELD_NAME, name);
+
+	return send_request(&msg, NULL, 0, result_cb, data);
 }
 
 
@@ -0,0 +1,746 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <packet.h>
+
+
+
+#define MAGIC_MASK 0xF0
+#define MAGIC 0xB0
+#define MAX_VARINT 5
+
+/* Tags over the FIELD_MAX are not strings */
+#define TAG_DEADLINE 0x40 /* 8 bytes, little endian */
+#define DEADLINE_SIZE 8
+#define EVENT_MASK_SHIFT 4 /* arg0 of an EVENT is the kind and the mask of the update */
+
+
+
+/*
+ * Fields are packed in the payload in this order,
+ * size of each field includes the NUL, or 0 for NULL.
+ */
+struct field_size {
+	int pkgname;
+	int name;
+	int exec;
+	int icon;
+};
+
+
+
+struct update_field_size {
+	int pkgname;
+	int name;
+	int new_name;
+	int exec;
+	int icon;
+};
+
+
+
+/*
+ * v1 header, don't change the layout of this.
+ */
+struct packet {
+	struct {
+		unsigned int seq;
+		enum packet_type type;
+
+		int payload_size;
+
+		union {
+			struct {
+				int shortcut_type;
+				struct field_size field_size;
+			} req;
+
+			struct {
+				int ret;
+			} ack;
+
+			struct {
+				enum query_kind kind;
+				struct field_size field_size;
+			} query;
+
+			/*
+			 * Payload begins with the "struct update_field_size",
+			 * only changed fields are sent.
+			 */
+			struct {
+				int mask;
+				int shortcut_type;
+			} update;
+
+			struct {
+				int version;
+				int features;
+			} hello;
+		} data;
+	} head;
+
+	char payload[];
+};
+
+
+
+void message_init(struct message *msg, int type, unsigned int seq)
+{
+	memset(msg, 0, sizeof(*msg));
+	msg->type = type;
+	msg->seq = seq;
+}
+
+
+
+void message_set_field(struct message *msg, int id, const char *str)
+{
+	msg->field[id].ptr = str;
+	msg->field[id].size = str ? strlen(str) + 1 : 0;
+}
+
+
+
+void message_set_field_n(struct message *msg, int id, const char *ptr, int len)
+{
+	msg->field[id].ptr = ptr;
+	msg->field[id].size = ptr ? len + 1 : 0;
+}
+
+
+
+static inline
+int has_padding(int type)
+{
+	/* Old servers can not handle the empty payload of these */
+	return type == PACKET_REQ || type == PACKET_QUERY || type == PACKET_REMOVE;
+}
+
+
+
+/*
+ * Source of a field doesn't need to be terminated, the NUL is written here.
+ */
+static inline
+char *put_field(char *ptr, const struct field *field)
+{
+	if (!field->size)
+		return ptr;
+
+	memcpy(ptr, field->ptr, field->size - 1);
+	ptr[field->size - 1] = '\0';
+	return ptr + field->size;
+}
+
+
+
+int packet_size_v1(const struct message *msg)
+{
+	const struct field *field = msg->field;
+	int size;
+
+	size = sizeof(struct packet);
+
+	switch (msg->type) {
+	case PACKET_REQ:
+	case PACKET_ENTRY:
+		size += field[FIELD_PKGNAME].size + field[FIELD_NAME].size;
+		size += field[FIELD_EXEC].size + field[FIELD_ICON].size;
+		break;
+	case PACKET_QUERY:
+	case PACKET_REMOVE:
+		size += field[FIELD_PKGNAME].size + field[FIELD_NAME].size;
+		break;
+	case PACKET_UPDATE:
+		size += sizeof(struct update_field_size);
+		size += field[FIELD_PKGNAME].size + field[FIELD_NAME].size;
+		size += field[FIELD_NEW_NAME].size;
+		size += field[FIELD_EXEC].size + field[FIELD_ICON].size;
+		break;
+	default:
+		break;
+	}
+
+	if (has_padding(msg->type))
+		size++;
+
+	return size;
+}
+
+
+
+int packet_encode_v1(const struct message *msg, char *buffer)
+{
+	const struct field *field = msg->field;
+	struct update_field_size update_size;
+	struct packet *packet;
+	char *ptr;
+	int size;
+
+	size = packet_size_v1(msg);
+
+	packet = (struct packet *)buffer;
+	memset(packet, 0, sizeof(*packet));
+	packet->head.seq = msg->seq;
+	packet->head.type = msg->type;
+	packet->head.payload_size = size - sizeof(*packet);
+
+	ptr = packet->payload;
+	switch (msg->type) {
+	case PACKET_REQ:
+	case PACKET_ENTRY:
+		packet->head.data.req.shortcut_type = msg->shortcut_type;
+		packet->head.data.req.field_size.pkgname = field[FIELD_PKGNAME].size;
+		packet->head.data.req.field_size.name = field[FIELD_NAME].size;
+		packet->head.data.req.field_size.exec = field[FIELD_EXEC].size;
+		packet->head.data.req.field_size.icon = field[FIELD_ICON].size;
+		ptr = put_field(ptr, field + FIELD_PKGNAME);
+		ptr = put_field(ptr, field + FIELD_NAME);
+		ptr = put_field(ptr, field + FIELD_EXEC);
+		ptr = put_field(ptr, field + FIELD_ICON);
+		break;
+	case PACKET_QUERY:
+		packet->head.data.query.kind = msg->kind;
+		packet->head.data.query.field_size.pkgname = field[FIELD_PKGNAME].size;
+		packet->head.data.query.field_size.name = field[FIELD_NAME].size;
+		ptr = put_field(ptr, field + FIELD_PKGNAME);
+		ptr = put_field(ptr, field + FIELD_NAME);
+		break;
+	case PACKET_REMOVE:
+		packet->head.data.req.field_size.pkgname = field[FIELD_PKGNAME].size;
+		packet->head.data.req.field_size.name = field[FIELD_NAME].size;
+		ptr = put_field(ptr, field + FIELD_PKGNAME);
+		ptr = put_field(ptr, field + FIELD_NAME);
+		break;
+	case PACKET_UPDATE:
+		packet->head.data.update.mask = msg->mask;
+		packet->head.data.update.shortcut_type = msg->shortcut_type;
+		update_size.pkgname = field[FIELD_PKGNAME].size;
+		update_size.name = field[FIELD_NAME].size;
+		update_size.new_name = field[FIELD_NEW_NAME].size;
+		update_size.exec = field[FIELD_EXEC].size;
+		update_size.icon = field[FIELD_ICON].size;
+		memcpy(ptr, &update_size, sizeof(update_size));
+		ptr += sizeof(update_size);
+		ptr = put_field(ptr, field + FIELD_PKGNAME);
+		ptr = put_field(ptr, field + FIELD_NAME);
+		ptr = put_field(ptr, field + FIELD_NEW_NAME);
+		ptr = put_field(ptr, field + FIELD_EXEC);
+		ptr = put_field(ptr, field + FIELD_ICON);
+		break;
+	case PACKET_ACK:
+		packet->head.data.ack.ret = msg->ret;
+		break;
+	case PACKET_HELLO:
+		packet->head.data.hello.version = msg->version;
+		packet->head.data.hello.features = msg->features;
+		break;
+	default:
+		break;
+	}
+
+	if (has_padding(msg->type))
+		*ptr = '\0';
+
+	return size;
+}
+
+
+
+static inline
+int get_field(const char *payload, int payload_size, int *offset, int size, struct field *field)
+{
+	if (size < 0 || size > payload_size - *offset)
+		return -EINVAL;
+
+	if (!size) {
+		field->ptr = NULL;
+		field->size = 0;
+		return 0;
+	}
+
+	if (payload[*offset + size - 1] != '\0')
+		return -EINVAL;
+
+	field->ptr = payload + *offset;
+	field->size = size;
+	*offset += size;
+	return 0;
+}
+
+
+
+int packet_decode_v1(const char *buffer, int size, struct message *msg)
+{
+	struct update_field_size update_size;
+	struct packet packet;
+	const char *payload;
+	int payload_size;
+	int offset;
+	int ret;
+
+	if (size < sizeof(packet))
+		return 0;
+
+	memcpy(&packet, buffer, sizeof(packet));
+	payload_size = packet.head.payload_size;
+	if (payload_size < 0 || payload_size > PACKET_MAX_PAYLOAD)
+		return -EINVAL;
+
+	if (size - sizeof(packet) < payload_size)
+		return 0;
+
+	message_init(msg, packet.head.type, packet.head.seq);
+	payload = buffer + sizeof(packet);
+	offset = 0;
+	ret = 0;
+
+	switch (packet.head.type) {
+	case PACKET_REQ:
+	case PACKET_ENTRY:
+		msg->shortcut_type = packet.head.data.req.shortcut_type;
+		ret |= get_field(payload, payload_size, &offset, packet.head.data.req.field_size.pkgname, msg->field + FIELD_PKGNAME);
+		ret |= get_field(payload, payload_size, &offset, packet.head.data.req.field_size.name, msg->field + FIELD_NAME);
+		ret |= get_field(payload, payload_size, &offset, packet.head.data.req.field_size.exec, msg->field + FIELD_EXEC);
+		ret |= get_field(payload, payload_size, &offset, packet.head.data.req.field_size.icon, msg->field + FIELD_ICON);
+		break;
+	case PACKET_QUERY:
+		msg->kind = packet.head.data.query.kind;
+		ret |= get_field(payload, payload_size, &offset, packet.head.data.query.field_size.pkgname, msg->field + FIELD_PKGNAME);
+		ret |= get_field(payload, payload_size, &offset, packet.head.data.query.field_size.name, msg->field + FIELD_NAME);
+		break;
+	case PACKET_REMOVE:
+		ret |= get_field(payload, payload_size, &offset, packet.head.data.req.field_size.pkgname, msg->field + FIELD_PKGNAME);
+		ret |= get_field(payload, payload_size, &offset, packet.head.data.req.field_size.name, msg->field + FIELD_NAME);
+		break;
+	case PACKET_UPDATE:
+		if (payload_size < sizeof(update_size))
+			return -EINVAL;
+
+		memcpy(&update_size, payload, sizeof(update_size));
+		offset = sizeof(update_size);
+		msg->mask = packet.head.data.update.mask;
+		msg->shortcut_type = packet.head.data.update.shortcut_type;
+		ret |= get_field(payload, payload_size, &offset, update_size.pkgname, msg->field + FIELD_PKGNAME);
+		ret |= get_field(payload, payload_size, &offset, update_size.name, msg->field + FIELD_NAME);
+		ret |= get_field(payload, payload_size, &offset, update_size.new_name, msg->field + FIELD_NEW_NAME);
+		ret |= get_field(payload, payload_size, &offset, update_size.exec, msg->field + FIELD_EXEC);
+		ret |= get_field(payload, payload_size, &offset, update_size.icon, msg->field + FIELD_ICON);
+		break;
+	case PACKET_ACK:
+		/* Payload of an ACK is not used, just drop it */
+		msg->ret = packet.head.data.ack.ret;
+		break;
+	case PACKET_HELLO:
+		msg->version = packet.head.data.hello.version;
+		msg->features = packet.head.data.hello.features;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (ret < 0)
+		return -EINVAL;
+
+	return sizeof(packet) + payload_size;
+}
+
+
+
+static inline
+int varint_size(unsigned int value)
+{
+	int size = 1;
+
+	while (value >= 0x80) {
+		value >>= 7;
+		size++;
+	}
+
+	return size;
+}
+
+
+
+static inline
+char *put_varint(char *ptr, unsigned int value)
+{
+	while (value >= 0x80) {
+		*ptr++ = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+
+	*ptr++ = value;
+	return ptr;
+}
+
+
+
+/*
+ * Returns the size of the varint, 0 if it is not complete yet, or -EINVAL.
+ */
+static inline
+int get_varint(const char *ptr, int size, unsigned int *value)
+{
+	unsigned int result = 0;
+	int i;
+
+	for (i = 0; i < size && i < MAX_VARINT; i++) {
+		result |= (unsigned int)(ptr[i] & 0x7F) << (7 * i);
+		if (!(ptr[i] & 0x80)) {
+			*value = result;
+			return i + 1;
+		}
+	}
+
+	return i == MAX_VARINT ? -EINVAL : 0;
+}
+
+
+
+static inline
+unsigned int zigzag(int value)
+{
+	return ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+}
+
+
+
+static inline
+int unzigzag(unsigned int value)
+{
+	return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+
+
+static inline
+void get_args(const struct message *msg, int *arg0, int *arg1)
+{
+	switch (msg->type) {
+	case PACKET_REQ:
+	case PACKET_ENTRY:
+		*arg0 = msg->shortcut_type;
+		*arg1 = 0;
+		break;
+	case PACKET_UPDATE:
+		*arg0 = msg->mask;
+		*arg1 = msg->shortcut_type;
+		break;
+	case PACKET_QUERY:
+		*arg0 = msg->kind;
+		*arg1 = 0;
+		break;
+	case PACKET_ACK:
+		*arg0 = msg->ret;
+		*arg1 = msg->credits;
+		break;
+	case PACKET_HELLO:
+		*arg0 = msg->version;
+		*arg1 = msg->features;
+		break;
+	case PACKET_EVENT:
+		*arg0 = msg->kind | (msg->mask << EVENT_MASK_SHIFT);
+		*arg1 = msg->shortcut_type;
+		break;
+	default:
+		*arg0 = 0;
+		*arg1 = 0;
+		break;
+	}
+}
+
+
+
+static inline
+void set_args(struct message *msg, int arg0, int arg1)
+{
+	switch (msg->type) {
+	case PACKET_REQ:
+	case PACKET_ENTRY:
+		msg->shortcut_type = arg0;
+		break;
+	case PACKET_UPDATE:
+		msg->mask = arg0;
+		msg->shortcut_type = arg1;
+		break;
+	case PACKET_QUERY:
+		msg->kind = arg0;
+		break;
+	case PACKET_ACK:
+		msg->ret = arg0;
+		msg->credits = arg1;
+		break;
+	case PACKET_HELLO:
+		msg->version = arg0;
+		msg->features = arg1;
+		break;
+	case PACKET_EVENT:
+		msg->kind = arg0 & ((1 << EVENT_MASK_SHIFT) - 1);
+		msg->mask = arg0 >> EVENT_MASK_SHIFT;
+		msg->shortcut_type = arg1;
+		break;
+	default:
+		break;
+	}
+}
+
+
+
+static inline
+int body_size_v2(const struct message *msg)
+{
+	int arg0;
+	int arg1;
+	int size;
+	int i;
+
+	get_args(msg, &arg0, &arg1);
+	size = varint_size(zigzag(arg0)) + varint_size(zigzag(arg1));
+
+	for (i = 0; i < FIELD_MAX; i++) {
+		if (!msg->field[i].size)
+			continue;
+
+		size += 1 + varint_size(msg->field[i].size) + msg->field[i].size;
+	}
+
+	if (msg->deadline)
+		size += 2 + DEADLINE_SIZE;
+
+	return size;
+}
+
+
+
+int packet_size_v2(const struct message *msg)
+{
+	int body_size;
+
+	body_size = body_size_v2(msg);
+	return 3 + varint_size(msg->seq) + varint_size(body_size) + body_size;
+}
+
+
+
+int packet_encode_v2(const struct message *msg, char *buffer)
+{
+	char *ptr = buffer;
+	int arg0;
+	int arg1;
+	int i;
+
+	*ptr++ = MAGIC | PACKET_VERSION;
+	*ptr++ = msg->type;
+	*ptr++ = msg->flags | (msg->priority << MESSAGE_PRIORITY_SHIFT);
+	ptr = put_varint(ptr, msg->seq);
+	ptr = put_varint(ptr, body_size_v2(msg));
+
+	get_args(msg, &arg0, &arg1);
+	ptr = put_varint(ptr, zigzag(arg0));
+	ptr = put_varint(ptr, zigzag(arg1));
+
+	for (i = 0; i < FIELD_MAX; i++) {
+		if (!msg->field[i].size)
+			continue;
+
+		*ptr++ = i + 1; /* Tag 0 is reserved */
+		ptr = put_varint(ptr, msg->field[i].size);
+		ptr = put_field(ptr, msg->field + i);
+	}
+
+	if (msg->deadline) {
+		*ptr++ = TAG_DEADLINE;
+		*ptr++ = DEADLINE_SIZE;
+		for (i = 0; i < DEADLINE_SIZE; i++)
+			*ptr++ = (msg->deadline >> (8 * i)) & 0xFF;
+	}
+
+	return ptr - buffer;
+}
+
+
+
+int packet_decode_v2(const char *buffer, int size, struct message *msg)
+{
+	unsigned int body_size;
+	unsigned int value;
+	unsigned int arg0;
+	unsigned int arg1;
+	int offset;
+	int end;
+	int ret;
+	int tag;
+	int i;
+
+	if (size < 3)
+		return 0;
+
+	if (((unsigned char)buffer[0] & MAGIC_MASK) != MAGIC)
+		return -EINVAL;
+
+	message_init(msg, (unsigned char)buffer[1], 0);
+	msg->flags = (unsigned char)buffer[2] & MESSAGE_FLAG_MASK;
+	msg->priority = (unsigned char)buffer[2] >> MESSAGE_PRIORITY_SHIFT;
+	offset = 3;
+
+	ret = get_varint(buffer + offset, size - offset, &msg->seq);
+	if (ret <= 0)
+		return ret;
+	offset += ret;
+
+	ret = get_varint(buffer + offset, size - offset, &body_size);
+	if (ret <= 0)
+		return ret;
+	offset += ret;
+
+	if (body_size > PACKET_MAX_PAYLOAD)
+		return -EINVAL;
+
+	if (size - offset < body_size)
+		return 0;
+
+	end = offset + body_size;
+
+	ret = get_varint(buffer + offset, end - offset, &arg0);
+	if (ret <= 0)
+		return -EINVAL;
+	offset += ret;
+
+	ret = get_varint(buffer + offset, end - offset, &arg1);
+	if (ret <= 0)
+		return -EINVAL;
+	offset += ret;
+
+	set_args(msg, unzigzag(arg0), unzigzag(arg1));
+
+	while (offset < end) {
+		tag = (unsigned char)buffer[offset++];
+
+		ret = get_varint(buffer + offset, end - offset, &value);
+		if (ret <= 0 || value > end - offset - ret)
+			return -EINVAL;
+		offset += ret;
+
+		if (tag > 0 && tag <= FIELD_MAX) {
+			if (!value || buffer[offset + value - 1] != '\0')
+				return -EINVAL;
+
+			msg->field[tag - 1].ptr = buffer + offset;
+			msg->field[tag - 1].size = value;
+		} else if (tag == TAG_DEADLINE && value == DEADLINE_SIZE) {
+			for (i = 0; i < DEADLINE_SIZE; i++)
+				msg->deadline |= (unsigned long long)(unsigned char)buffer[offset + i] << (8 * i);
+		}
+
+		/* Unknown tags are skipped */
+		offset += value;
+	}
+
+	if (msg->type == PACKET_ERR)
+		return -EINVAL;
+
+	return end;
+}
+
+
+
+int packet_peek(int version, const char *buffer, int size, unsigned int *seq, int *type)
+{
+	struct packet packet;
+	unsigned int body_size;
+	int offset;
+	int ret;
+
+	if (version < 2) {
+		if (size < sizeof(packet))
+			return 0;
+
+		memcpy(&packet, buffer, sizeof(packet));
+		if (packet.head.payload_size < 0 || packet.head.payload_size > PACKET_MAX_PAYLOAD)
+			return -EINVAL;
+
+		*seq = packet.head.seq;
+		*type = packet.head.type;
+		return sizeof(packet) + packet.head.payload_size;
+	}
+
+	if (size < 3)
+		return 0;
+
+	if (((unsigned char)buffer[0] & MAGIC_MASK) != MAGIC)
+		return -EINVAL;
+
+	*type = (unsigned char)buffer[1];
+	offset = 3;
+
+	ret = get_varint(buffer + offset, size - offset, seq);
+	if (ret <= 0)
+		return ret;
+	offset += ret;
+
+	ret = get_varint(buffer + offset, size - offset, &body_size);
+	if (ret <= 0)
+		return ret;
+	offset += ret;
+
+	if (body_size > PACKET_MAX_PAYLOAD)
+		return -EINVAL;
+
+	return offset + body_size;
+}
+
+
+
+int packet_priority(int version, const char *buffer, int size)
+{
+	int priority;
+
+	if (version < 2 || size < 3)
+		return MESSAGE_PRIORITY_NORMAL;
+
+	priority = (unsigned char)buffer[2] >> MESSAGE_PRIORITY_SHIFT;
+	return priority < MESSAGE_PRIORITY_MAX ? priority : MESSAGE_PRIORITY_NORMAL;
+}
+
+
+
+int packet_size(int version, const struct message *msg)
+{
+	return version >= 2 ? packet_size_v2(msg) : packet_size_v1(msg);
+}
+
+
+
+int packet_encode(int version, const struct message *msg, char *buffer)
+{
+	return version >= 2 ? packet_encode_v2(msg, buffer) : packet_encode_v1(msg, buffer);
+}
+
+
+
+int packet_decode(int version, const char *buffer, int size, struct message *msg)
+{
+	return version >= 2 ? packet_decode_v2(buffer, size, msg) : packet_decode_v1(buffer, size, msg);
+}
+
+
+
+/* End of a file */
@@ -0,0 +1,480 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Work-stealing pool.
+ *
+ * Every worker has its own queue, jobs are submitted to them in turn.
+ * A worker takes jobs from the head of its queue, and an idle worker steals from the tail of others.
+ *
+ * Jobs of a key are serialized by the key table, only the first one of a key is queued.
+ * Following ones wait on the key, and the worker which finished one queues the next to itself.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <errno.h>
+#include <dlog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include <pool.h>
+
+
+
+#define NR_BUCKETS 64
+#define MAX_WORKERS 16
+
+#define BUCKET(hash) ((hash) & (NR_BUCKETS - 1))
+
+
+
+extern int errno;
+
+
+
+struct pool_key;
+
+struct pool_job {
+	void (*run)(void *data);
+	void (*done)(void *data);
+	void *data;
+	struct pool_key *key;
+	struct pool_job *prev;
+	struct pool_job *next;
+};
+
+
+
+/*
+ * Exists while a job of the key is queued or running.
+ */
+struct pool_key {
+	uint32_t hash;
+	struct pool_key *next; /* Chain of the bucket */
+	struct pool_job *head; /* Waiting the running one */
+	struct pool_job *tail;
+	char name[];
+};
+
+
+
+struct pool_worker {
+	pthread_mutex_t lock;
+	struct pool_job *head;
+	struct pool_job *tail;
+};
+
+
+
+static struct info {
+	pthread_mutex_t lock; /* Keys, the done list and the idle workers */
+	pthread_cond_t cond;
+	int enabled;
+	int pipe[2];
+
+	struct pool_worker workers[MAX_WORKERS];
+	int nr_workers;
+	int next_worker; /* Of the next submission */
+	int ready; /* Jobs in queues of workers, which are not reserved yet */
+
+	struct pool_key *bucket[NR_BUCKETS];
+
+	struct pool_job *done_head;
+	struct pool_job *done_tail;
+	int count; /* Submitted, and not dispatched yet. Only for the main thread */
+} s_info = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.enabled = 0,
+	.pipe = { -1, -1 },
+	.nr_workers = 0,
+	.next_worker = 0,
+	.ready = 0,
+	.done_head = NULL,
+	.done_tail = NULL,
+	.count = 0,
+};
+
+
+
+static inline
+uint32_t hash_name(const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*name) {
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+
+static inline
+struct pool_key *find_key(const char *name, uint32_t hash)
+{
+	struct pool_key *key;
+
+	for (key = s_info.bucket[BUCKET(hash)]; key; key = key->next) {
+		if (key->hash == hash && !strcmp(key->name, name))
+			return key;
+	}
+
+	return NULL;
+}
+
+
+
+static inline
+void remove_key(struct pool_key *key)
+{
+	struct pool_key **ptr;
+
+	ptr = &s_info.bucket[BUCKET(key->hash)];
+	while (*ptr != key)
+		ptr = &(*ptr)->next;
+	*ptr = key->next;
+	free(key);
+}
+
+
+
+static inline
+void wakeup_main(void)
+{
+	char ch = 0;
+
+	if (write(s_info.pipe[1], &ch, sizeof(ch)) != sizeof(ch) && errno != EAGAIN)
+		LOGE("Failed to wake up the main loop (%s)\n", strerror(errno));
+}
+
+
+
+static inline
+void push_job(struct pool_worker *worker, struct pool_job *job)
+{
+	pthread_mutex_lock(&worker->lock);
+	job->next = NULL;
+	job->prev = worker->tail;
+	if (worker->tail)
+		worker->tail->next = job;
+	else
+		worker->head = job;
+	worker->tail = job;
+	pthread_mutex_unlock(&worker->lock);
+
+	/* Counted after it is queued, an idle worker finds it then */
+	pthread_mutex_lock(&s_info.lock);
+	s_info.ready++;
+	pthread_cond_signal(&s_info.cond);
+	pthread_mutex_unlock(&s_info.lock);
+}
+
+
+
+static inline
+struct pool_job *pop_head(struct pool_worker *worker)
+{
+	struct pool_job *job;
+
+	pthread_mutex_lock(&worker->lock);
+	job = worker->head;
+	if (job) {
+		worker->head = job->next;
+		if (worker->head)
+			worker->head->prev = NULL;
+		else
+			worker->tail = NULL;
+	}
+	pthread_mutex_unlock(&worker->lock);
+	return job;
+}
+
+
+
+static inline
+struct pool_job *steal_tail(struct pool_worker *worker, int wait)
+{
+	struct pool_job *job;
+
+	if (wait)
+		pthread_mutex_lock(&worker->lock);
+	else if (pthread_mutex_trylock(&worker->lock) != 0)
+		return NULL; /* Busy victim, try another one */
+
+	job = worker->tail;
+	if (job) {
+		worker->tail = job->prev;
+		if (worker->tail)
+			worker->tail->next = NULL;
+		else
+			worker->head = NULL;
+	}
+	pthread_mutex_unlock(&worker->lock);
+	return job;
+}
+
+
+
+/*
+ * Must be called after a job is reserved from the "ready",
+ * then there is a job in one of queues.
+ */
+static inline
+struct pool_job *take_job(int self)
+{
+	struct pool_job *job;
+	int wait;
+	int i;
+
+	job = pop_head(&s_info.workers[self]);
+	for (wait = 0; !job; wait = 1) {
+		for (i = 1; !job && i < s_info.nr_workers; i++)
+			job = steal_tail(&s_info.workers[(self + i) % s_info.nr_workers], wait);
+
+		if (!job)
+			job = pop_head(&s_info.workers[self]);
+	}
+
+	return job;
+}
+
+
+
+static
+void *worker_main(void *arg)
+{
+	int self = (int)(intptr_t)arg;
+	struct pool_job *job;
+	struct pool_job *next;
+	struct pool_key *key;
+
+	while (1) {
+		/* Reserve a job first, the worker sleeps until there is one */
+		pthread_mutex_lock(&s_info.lock);
+		while (!s_info.ready)
+			pthread_cond_wait(&s_info.cond, &s_info.lock);
+		s_info.ready--;
+		pthread_mutex_unlock(&s_info.lock);
+
+		job = take_job(self);
+		job->run(job->data);
+
+		pthread_mutex_lock(&s_info.lock);
+		key = job->key;
+		next = key->head;
+		if (next) {
+			key->head = next->next;
+			if (!key->head)
+				key->tail = NULL;
+		} else {
+			remove_key(key);
+		}
+
+		job->key = NULL;
+		job->next = NULL;
+		if (s_info.done_tail)
+			s_info.done_tail->next = job;
+		else
+			s_info.done_head = job;
+		s_info.done_tail = job;
+		pthread_mutex_unlock(&s_info.lock);
+
+		/* Next one of the key is likely to touch the same data */
+		if (next)
+			push_job(&s_info.workers[self], next);
+
+		wakeup_main();
+	}
+
+	return NULL;
+}
+
+
+
+int pool_init(int workers)
+{
+	pthread_attr_t attr;
+	pthread_t worker;
+	int started;
+	int ret;
+	int i;
+
+	if (workers <= 0 || workers > MAX_WORKERS)
+		return -EINVAL;
+
+	if (s_info.enabled)
+		return -EALREADY;
+
+	if (pipe2(s_info.pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+		LOGE("Failed to create a pipe (%s)\n", strerror(errno));
+		return -EFAULT;
+	}
+
+	for (i = 0; i < workers; i++)
+		pthread_mutex_init(&s_info.workers[i].lock, NULL);
+
+	/* Queues of workers which are not started are not used */
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for (started = 0; started < workers; started++) {
+		s_info.nr_workers = started + 1;
+		ret = pthread_create(&worker, &attr, worker_main, (void *)(intptr_t)started);
+		if (ret != 0) {
+			LOGE("Failed to create a worker (%s)\n", strerror(ret));
+			s_info.nr_workers = started;
+			break;
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	if (!started) {
+		close(s_info.pipe[0]);
+		close(s_info.pipe[1]);
+		s_info.pipe[0] = -1;
+		s_info.pipe[1] = -1;
+		return -EFAULT;
+	}
+
+	s_info.enabled = 1;
+	return s_info.pipe[0];
+}
+
+
+
+int pool_is_enabled(void)
+{
+	return s_info.enabled;
+}
+
+
+
+int pool_submit(const char *key, void (*run)(void *data), void (*done)(void *data), void *data)
+{
+	struct pool_key *pool_key;
+	struct pool_job *job;
+	uint32_t hash;
+	int len;
+
+	if (!s_info.enabled)
+		return -ENOSYS;
+
+	if (!key)
+		key = "";
+
+	job = calloc(1, sizeof(*job));
+	if (!job) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return -ENOMEM;
+	}
+
+	job->run = run;
+	job->done = done;
+	job->data = data;
+
+	hash = hash_name(key);
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		free(job);
+		return -EFAULT;
+	}
+
+	pool_key = find_key(key, hash);
+	if (pool_key) {
+		/* Run after the previous ones of the key */
+		job->key = pool_key;
+		if (pool_key->tail)
+			pool_key->tail->next = job;
+		else
+			pool_key->head = job;
+		pool_key->tail = job;
+		pthread_mutex_unlock(&s_info.lock);
+		s_info.count++;
+		return 0;
+	}
+
+	len = strlen(key);
+	pool_key = calloc(1, sizeof(*pool_key) + len + 1);
+	if (!pool_key) {
+		LOGE("Heap: %s\n", strerror(errno));
+		pthread_mutex_unlock(&s_info.lock);
+		free(job);
+		return -ENOMEM;
+	}
+
+	memcpy(pool_key->name, key, len + 1);
+	pool_key->hash = hash;
+	pool_key->next = s_info.bucket[BUCKET(hash)];
+	s_info.bucket[BUCKET(hash)] = pool_key;
+	job->key = pool_key;
+	pthread_mutex_unlock(&s_info.lock);
+
+	push_job(&s_info.workers[s_info.next_worker], job);
+	s_info.next_worker = (s_info.next_worker + 1) % s_info.nr_workers;
+	s_info.count++;
+	return 0;
+}
+
+
+
+int pool_dispatch(void)
+{
+	struct pool_job *job;
+	struct pool_job *next;
+	char buffer[64];
+	int count;
+
+	while (read(s_info.pipe[0], buffer, sizeof(buffer)) > 0);
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return -EFAULT;
+	}
+
+	job = s_info.done_head;
+	s_info.done_head = NULL;
+	s_info.done_tail = NULL;
+	pthread_mutex_unlock(&s_info.lock);
+
+	count = 0;
+	while (job) {
+		next = job->next;
+		s_info.count--;
+		if (job->done)
+			job->done(job->data);
+
+		free(job);
+		count++;
+		job = next;
+	}
+
+	return count;
+}
+
+
+
+int pool_count(void)
+{
+	return s_info.count;
+}
+
+/* End of a file */
@@ -0,0 +1,857 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Prefetch of targets of shortcuts.
+ *
+ * A SHORTCUT_FILE (or SHORTCUT_DATA which names a file) is resolved on a worker,
+ * the file is sniffed for its MIME type and the handler is found by the resolver of the homescreen.
+ * Other SHORTCUT_DATA is resolved by its URI scheme, x-scheme-handler/<scheme>.
+ *
+ * Targets are cached by the path, mtime and size of the file (or the scheme),
+ * so a modified file is resolved again. Resolved targets are kept in the LRU order,
+ * the least recently used ones are evicted over MAX_ENTRIES, referenced ones are not.
+ *
+ * Jobs are shared by requests of the same target, a job which only warms the cache
+ * (done is NULL) gets the "done" of the request which waits it.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <errno.h>
+#include <dlog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <sys/stat.h>
+
+#include <shortcut.h>
+#include <prefetch.h>
+
+
+
+#define NR_BUCKETS 256
+#define MAX_ENTRIES 1024
+#define MAX_WORKERS 8
+#define SNIFF_SIZE 64
+#define MIME_LEN 64
+#define APPID_LEN 256
+
+#define BUCKET(hash) ((hash) & (NR_BUCKETS - 1))
+
+
+
+extern int errno;
+
+
+
+struct prefetch_key {
+	const char *name; /* Path of the file, or "<scheme>:" */
+	long long mtime;
+	long long mtime_nsec;
+	long long size;
+	int is_file;
+};
+
+
+
+/*
+ * target is the first member, a reference is the entry itself.
+ */
+struct prefetch_entry {
+	struct prefetch_target target;
+	struct prefetch_key key;
+	uint32_t hash;
+	struct prefetch_entry *next; /* Chain of the key */
+	struct prefetch_entry *lru_prev;
+	struct prefetch_entry *lru_next;
+	int refcnt;
+
+	char mime[MIME_LEN];
+	char appid[APPID_LEN];
+	char name[];
+};
+
+
+
+struct prefetch_job {
+	struct prefetch_key key;
+	uint32_t hash;
+	void (*done)(void *data);
+	void *data;
+	struct prefetch_job *next;
+	struct prefetch_job *followers; /* Requests of the same target, done with this */
+	char name[];
+};
+
+
+
+struct magic {
+	int offset;
+	const char *bytes;
+	int len;
+	const char *mime;
+};
+
+
+
+struct extension {
+	const char *ext;
+	const char *mime;
+};
+
+
+
+static const struct magic s_magic[] = {
+	{ 0, "\x89PNG\r\n\x1a\n", 8, "image/png" },
+	{ 0, "\xff\xd8\xff", 3, "image/jpeg" },
+	{ 0, "GIF87a", 6, "image/gif" },
+	{ 0, "GIF89a", 6, "image/gif" },
+	{ 0, "BM", 2, "image/bmp" },
+	{ 8, "WEBP", 4, "image/webp" },
+	{ 8, "WAVE", 4, "audio/x-wav" },
+	{ 8, "AVI ", 4, "video/x-msvideo" },
+	{ 4, "ftyp", 4, "video/mp4" },
+	{ 0, "ID3", 3, "audio/mpeg" },
+	{ 0, "\xff\xfb", 2, "audio/mpeg" },
+	{ 0, "OggS", 4, "audio/ogg" },
+	{ 0, "fLaC", 4, "audio/flac" },
+	{ 0, "%PDF-", 5, "application/pdf" },
+	{ 0, "PK\x03\x04", 4, "application/zip" },
+	{ 0, "\x1f\x8b", 2, "application/gzip" },
+	{ 0, "BEGIN:VCARD", 11, "text/x-vcard" },
+	{ 0, "BEGIN:VCALENDAR", 15, "text/calendar" },
+	{ 0, "<?xml", 5, "application/xml" },
+	{ 0, "<!DOCTYPE html", 14, "text/html" },
+	{ 0, "<html", 5, "text/html" },
+};
+
+
+
+/* Formats which cannot be told by their magic */
+static const struct extension s_extension[] = {
+	{ ".txt", "text/plain" },
+	{ ".csv", "text/csv" },
+	{ ".htm", "text/html" },
+	{ ".html", "text/html" },
+	{ ".svg", "image/svg+xml" },
+	{ ".mp3", "audio/mpeg" },
+	{ ".aac", "audio/aac" },
+	{ ".3gp", "video/3gpp" },
+	{ ".docx", "application/vnd.openxmlformats-officedocument.wordprocessingml.document" },
+	{ ".xlsx", "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet" },
+	{ ".pptx", "application/vnd.openxmlformats-officedocument.presentationml.presentation" },
+	{ ".epub", "application/epub+zip" },
+	{ ".apk", "application/vnd.android.package-archive" },
+	{ ".tpk", "application/vnd.tizen.package" },
+	{ ".wgt", "application/widget" },
+};
+
+
+
+static struct info {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int enabled;
+	int pipe[2];
+
+	int (*resolve)(const char *target, const char *mime, char *appid, int appid_size, void *data);
+	void *data;
+
+	struct prefetch_entry *bucket[NR_BUCKETS];
+	struct prefetch_entry *lru_head; /* Most recently used */
+	struct prefetch_entry *lru_tail;
+	int count;
+
+	struct prefetch_job *queue_head;
+	struct prefetch_job *queue_tail;
+	struct prefetch_job *active; /* Being resolved by workers */
+	struct prefetch_job *done_head;
+	struct prefetch_job *done_tail;
+} s_info = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.enabled = 0,
+	.pipe = { -1, -1 },
+	.count = 0,
+};
+
+
+
+static inline
+uint32_t hash_key(const struct prefetch_key *key)
+{
+	const unsigned char *ptr;
+	uint32_t hash = 2166136261u;
+
+	/* FNV-1a of the name and the mtime */
+	for (ptr = (const unsigned char *)key->name; *ptr; ptr++) {
+		hash ^= *ptr;
+		hash *= 16777619u;
+	}
+
+	hash ^= (uint32_t)key->mtime ^ (uint32_t)key->mtime_nsec;
+	hash *= 16777619u;
+	return hash;
+}
+
+
+
+static inline
+int is_same_key(const struct prefetch_key *a, const struct prefetch_key *b)
+{
+	return a->mtime == b->mtime && a->mtime_nsec == b->mtime_nsec &&
+		a->size == b->size && a->is_file == b->is_file && !strcmp(a->name, b->name);
+}
+
+
+
+/*
+ * Name of the key, the path of a file or the scheme of a URI.
+ * Returns its length, or -ENOENT if there is nothing to resolve.
+ */
+static inline
+int target_name(int type, const char *content, char *scheme, int size, int *is_file)
+{
+	const char *ptr;
+
+	if (!content || !*content)
+		return -ENOENT;
+
+	if (type != SHORTCUT_FILE && type != SHORTCUT_DATA)
+		return -ENOENT;
+
+	*is_file = 1;
+	if (type == SHORTCUT_FILE || content[0] == '/')
+		return strlen(content);
+
+	if (!strncmp(content, "file://", 7) && content[7] == '/')
+		return strlen(content);
+
+	*is_file = 0;
+	for (ptr = content; *ptr && *ptr != ':'; ptr++) {
+		if (!isalnum((unsigned char)*ptr) && *ptr != '+' && *ptr != '-' && *ptr != '.')
+			return -ENOENT;
+	}
+
+	if (*ptr != ':' || ptr == content || ptr - content + 2 > size)
+		return -ENOENT;
+
+	memcpy(scheme, content, ptr - content + 1);
+	scheme[ptr - content + 1] = '\0';
+	return ptr - content + 1;
+}
+
+
+
+static inline
+int make_key(int type, const char *content, struct prefetch_key *key, char *scheme, int size)
+{
+	struct stat st;
+	int is_file;
+	int len;
+
+	len = target_name(type, content, scheme, size, &is_file);
+	if (len < 0)
+		return len;
+
+	memset(key, 0, sizeof(*key));
+	if (!is_file) {
+		key->name = scheme;
+		return len;
+	}
+
+	if (!strncmp(content, "file://", 7))
+		content += 7;
+
+	if (stat(content, &st) < 0)
+		return -ENOENT;
+
+	key->name = content;
+	key->is_file = 1;
+	key->mtime = st.st_mtim.tv_sec;
+	key->mtime_nsec = st.st_mtim.tv_nsec;
+	key->size = st.st_size;
+	return strlen(content);
+}
+
+
+
+static inline
+struct prefetch_entry *find_entry(const struct prefetch_key *key, uint32_t hash)
+{
+	struct prefetch_entry *entry;
+
+	for (entry = s_info.bucket[BUCKET(hash)]; entry; entry = entry->next) {
+		if (entry->hash == hash && is_same_key(&entry->key, key))
+			return entry;
+	}
+
+	return NULL;
+}
+
+
+
+static inline
+struct prefetch_job *find_job(struct prefetch_job *job, const struct prefetch_key *key, uint32_t hash)
+{
+	for (; job; job = job->next) {
+		if (job->hash == hash && is_same_key(&job->key, key))
+			return job;
+	}
+
+	return NULL;
+}
+
+
+
+static inline
+void lru_unlink(struct prefetch_entry *entry)
+{
+	if (entry->lru_prev)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		s_info.lru_head = entry->lru_next;
+
+	if (entry->lru_next)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		s_info.lru_tail = entry->lru_prev;
+
+	entry->lru_prev = NULL;
+	entry->lru_next = NULL;
+}
+
+
+
+static inline
+void lru_push(struct prefetch_entry *entry)
+{
+	entry->lru_prev = NULL;
+	entry->lru_next = s_info.lru_head;
+	if (s_info.lru_head)
+		s_info.lru_head->lru_prev = entry;
+	else
+		s_info.lru_tail = entry;
+
+	s_info.lru_head = entry;
+}
+
+
+
+static inline
+void unlink_entry(struct prefetch_entry *entry)
+{
+	struct prefetch_entry **ptr;
+
+	ptr = &s_info.bucket[BUCKET(entry->hash)];
+	while (*ptr != entry)
+		ptr = &(*ptr)->next;
+	*ptr = entry->next;
+
+	lru_unlink(entry);
+	s_info.count--;
+}
+
+
+
+/*
+ * Unlink entries over the limit, from the least recently used one.
+ * Unlinked entries are returned as a list, to free them without the lock.
+ */
+static inline
+struct prefetch_entry *evict(void)
+{
+	struct prefetch_entry *entry;
+	struct prefetch_entry *prev;
+	struct prefetch_entry *evicted = NULL;
+
+	entry = s_info.lru_tail;
+	while (entry && s_info.count > MAX_ENTRIES) {
+		prev = entry->lru_prev;
+		if (entry->refcnt == 0) {
+			unlink_entry(entry);
+			entry->next = evicted;
+			evicted = entry;
+		}
+		entry = prev;
+	}
+
+	return evicted;
+}
+
+
+
+static inline
+void free_entries(struct prefetch_entry *entry)
+{
+	struct prefetch_entry *next;
+
+	while (entry) {
+		next = entry->next;
+		free(entry);
+		entry = next;
+	}
+}
+
+
+
+static inline
+const char *sniff_magic(const char *path)
+{
+	unsigned char buffer[SNIFF_SIZE];
+	const struct magic *magic;
+	int size;
+	int fd;
+	int i;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+	if (fd < 0)
+		return NULL;
+
+	size = read(fd, buffer, sizeof(buffer));
+	close(fd);
+	if (size <= 0)
+		return size == 0 ? "text/plain" : NULL;
+
+	for (i = 0; i < sizeof(s_magic) / sizeof(s_magic[0]); i++) {
+		magic = s_magic + i;
+		if (magic->offset + magic->len <= size && !memcmp(buffer + magic->offset, magic->bytes, magic->len))
+			return magic->mime;
+	}
+
+	for (i = 0; i < size; i++) {
+		if (buffer[i] < 0x20 && !isspace(buffer[i]))
+			return NULL;
+	}
+
+	return "text/plain";
+}
+
+
+
+static inline
+const char *sniff_mime(const char *path, const struct stat *st)
+{
+	const char *ext;
+	const char *mime;
+	int i;
+
+	if (S_ISDIR(st->st_mode))
+		return "inode/directory";
+
+	if (!S_ISREG(st->st_mode))
+		return "application/octet-stream";
+
+	mime = sniff_magic(path);
+
+	/* Containers (zip) and plain texts are told by the extension */
+	ext = strrchr(path, '.');
+	if (ext && (!mime || !strcmp(mime, "application/zip") || !strcmp(mime, "text/plain"))) {
+		for (i = 0; i < sizeof(s_extension) / sizeof(s_extension[0]); i++) {
+			if (!strcasecmp(ext, s_extension[i].ext))
+				return s_extension[i].mime;
+		}
+	}
+
+	return mime ? mime : "application/octet-stream";
+}
+
+
+
+static inline
+struct prefetch_entry *resolve_target(const struct prefetch_job *job)
+{
+	struct prefetch_entry *entry;
+	struct stat st;
+	const char *mime;
+	int len;
+
+	len = strlen(job->key.name);
+	entry = calloc(1, sizeof(*entry) + len + 1);
+	if (!entry) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	memcpy(entry->name, job->key.name, len + 1);
+	entry->key = job->key;
+	entry->key.name = entry->name;
+	entry->hash = job->hash;
+
+	if (job->key.is_file) {
+		if (stat(entry->name, &st) < 0) {
+			LOGD("%s is gone\n", entry->name);
+			free(entry);
+			return NULL;
+		}
+
+		mime = sniff_mime(entry->name, &st);
+		entry->target.path = entry->name;
+		entry->target.size = st.st_size;
+		entry->target.mtime = st.st_mtim.tv_sec;
+	} else {
+		/* Name is "<scheme>:" */
+		snprintf(entry->mime, sizeof(entry->mime), "x-scheme-handler/%.*s", len - 1, entry->name);
+		mime = entry->mime;
+	}
+
+	if (mime != entry->mime)
+		snprintf(entry->mime, sizeof(entry->mime), "%s", mime);
+	entry->target.mime = entry->mime;
+
+	if (s_info.resolve && s_info.resolve(entry->name, entry->mime, entry->appid, sizeof(entry->appid), s_info.data) == 0 && entry->appid[0]) {
+		entry->appid[sizeof(entry->appid) - 1] = '\0';
+		entry->target.appid = entry->appid;
+	}
+
+	return entry;
+}
+
+
+
+static inline
+void wakeup_main(void)
+{
+	char ch = 0;
+
+	if (write(s_info.pipe[1], &ch, sizeof(ch)) != sizeof(ch) && errno != EAGAIN)
+		LOGE("Failed to wake up the main loop (%s)\n", strerror(errno));
+}
+
+
+
+static inline
+void remove_active(struct prefetch_job *job)
+{
+	struct prefetch_job **ptr;
+
+	ptr = &s_info.active;
+	while (*ptr != job)
+		ptr = &(*ptr)->next;
+	*ptr = job->next;
+}
+
+
+
+static
+void *worker_main(void *arg)
+{
+	struct prefetch_entry *entry;
+	struct prefetch_entry *evicted;
+	struct prefetch_job *job;
+
+	while (1) {
+		if (pthread_mutex_lock(&s_info.lock) != 0) {
+			LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+			break;
+		}
+
+		while (!s_info.queue_head)
+			pthread_cond_wait(&s_info.cond, &s_info.lock);
+
+		job = s_info.queue_head;
+		s_info.queue_head = job->next;
+		if (!s_info.queue_head)
+			s_info.queue_tail = NULL;
+
+		job->next = s_info.active;
+		s_info.active = job;
+		pthread_mutex_unlock(&s_info.lock);
+
+		entry = resolve_target(job);
+
+		if (pthread_mutex_lock(&s_info.lock) != 0) {
+			free(entry);
+			break;
+		}
+
+		evicted = NULL;
+		if (entry && !find_entry(&entry->key, entry->hash)) {
+			entry->next = s_info.bucket[BUCKET(entry->hash)];
+			s_info.bucket[BUCKET(entry->hash)] = entry;
+			lru_push(entry);
+			s_info.count++;
+			evicted = evict();
+		} else if (entry) {
+			/* Resolved by another worker, for another job */
+			entry->next = evicted;
+			evicted = entry;
+		}
+
+		remove_active(job);
+		job->next = job->followers;
+		job->followers = NULL;
+		if (s_info.done_tail)
+			s_info.done_tail->next = job;
+		else
+			s_info.done_head = job;
+
+		s_info.done_tail = job;
+		while (s_info.done_tail->next)
+			s_info.done_tail = s_info.done_tail->next;
+		pthread_mutex_unlock(&s_info.lock);
+
+		free_entries(evicted);
+		wakeup_main();
+	}
+
+	return NULL;
+}
+
+
+
+int prefetch_init(int workers, int (*resolve)(const char *target, const char *mime, char *appid, int appid_size, void *data), void *data)
+{
+	pthread_attr_t attr;
+	pthread_t worker;
+	int started;
+	int ret;
+
+	if (workers <= 0 || workers > MAX_WORKERS)
+		return -EINVAL;
+
+	if (s_info.enabled)
+		return -EALREADY;
+
+	if (pipe2(s_info.pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+		LOGE("Failed to create a pipe (%s)\n", strerror(errno));
+		return -EFAULT;
+	}
+
+	s_info.resolve = resolve;
+	s_info.data = data;
+
+	/* Workers live with the process */
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for (started = 0; started < workers; started++) {
+		ret = pthread_create(&worker, &attr, worker_main, NULL);
+		if (ret != 0) {
+			LOGE("Failed to create a worker (%s)\n", strerror(ret));
+			break;
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	if (!started) {
+		close(s_info.pipe[0]);
+		close(s_info.pipe[1]);
+		s_info.pipe[0] = -1;
+		s_info.pipe[1] = -1;
+		return -EFAULT;
+	}
+
+	s_info.enabled = 1;
+	return s_info.pipe[0];
+}
+
+
+
+int prefetch_is_enabled(void)
+{
+	return s_info.enabled;
+}
+
+
+
+void *prefetch_request(int type, const char *content, void (*done)(void *data), void *data)
+{
+	struct prefetch_job *leader;
+	struct prefetch_job *job;
+	struct prefetch_key key;
+	char scheme[64];
+	uint32_t hash;
+	int len;
+
+	if (!s_info.enabled)
+		return NULL;
+
+	len = make_key(type, content, &key, scheme, sizeof(scheme));
+	if (len < 0)
+		return NULL;
+
+	hash = hash_key(&key);
+
+	if (pthread_mutex_lock(&s_info.lock) != 0)
+		return NULL;
+
+	if (find_entry(&key, hash)) {
+		pthread_mutex_unlock(&s_info.lock);
+		return NULL;
+	}
+
+	leader = find_job(s_info.queue_head, &key, hash);
+	if (!leader)
+		leader = find_job(s_info.active, &key, hash);
+
+	if (leader && (!done || !leader->done)) {
+		/* The done is invoked from the main loop, it can be set here */
+		if (done) {
+			leader->done = done;
+			leader->data = data;
+		}
+
+		pthread_mutex_unlock(&s_info.lock);
+		return done ? leader : NULL;
+	}
+
+	job = calloc(1, sizeof(*job) + len + 1);
+	if (!job) {
+		LOGE("Heap: %s\n", strerror(errno));
+		pthread_mutex_unlock(&s_info.lock);
+		return NULL;
+	}
+
+	memcpy(job->name, key.name, len + 1);
+	job->key = key;
+	job->key.name = job->name;
+	job->hash = hash;
+	job->done = done;
+	job->data = data;
+
+	if (leader) {
+		/* Target is resolved once, for every request which waits it */
+		job->next = leader->followers;
+		leader->followers = job;
+	} else {
+		if (s_info.queue_tail)
+			s_info.queue_tail->next = job;
+		else
+			s_info.queue_head = job;
+		s_info.queue_tail = job;
+
+		pthread_cond_signal(&s_info.cond);
+	}
+
+	pthread_mutex_unlock(&s_info.lock);
+	return done ? job : NULL;
+}
+
+
+
+void prefetch_cancel(void *job)
+{
+	struct prefetch_job *prefetch_job = job;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0)
+		return;
+
+	/* Jobs are freed by the dispatcher, which runs in the same thread */
+	prefetch_job->done = NULL;
+	pthread_mutex_unlock(&s_info.lock);
+}
+
+
+
+int prefetch_dispatch(void)
+{
+	struct prefetch_job *job;
+	struct prefetch_job *next;
+	char buffer[64];
+	int count;
+
+	while (read(s_info.pipe[0], buffer, sizeof(buffer)) > 0);
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return -EFAULT;
+	}
+
+	job = s_info.done_head;
+	s_info.done_head = NULL;
+	s_info.done_tail = NULL;
+	pthread_mutex_unlock(&s_info.lock);
+
+	count = 0;
+	while (job) {
+		next = job->next;
+		if (job->done) {
+			job->done(job->data);
+			count++;
+		}
+
+		free(job);
+		job = next;
+	}
+
+	return count;
+}
+
+
+
+const struct prefetch_target *prefetch_get(int type, const char *content)
+{
+	struct prefetch_entry *entry;
+	struct prefetch_key key;
+	char scheme[64];
+	uint32_t hash;
+
+	if (!s_info.enabled || make_key(type, content, &key, scheme, sizeof(scheme)) < 0)
+		return NULL;
+
+	hash = hash_key(&key);
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return NULL;
+	}
+
+	entry = find_entry(&key, hash);
+	if (entry) {
+		entry->refcnt++;
+		lru_unlink(entry);
+		lru_push(entry);
+	}
+	pthread_mutex_unlock(&s_info.lock);
+
+	return entry ? &entry->target : NULL;
+}
+
+
+
+void prefetch_put(const struct prefetch_target *target)
+{
+	struct prefetch_entry *entry = (struct prefetch_entry *)target;
+	struct prefetch_entry *evicted;
+
+	if (!target)
+		return;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return;
+	}
+
+	entry->refcnt--;
+	evicted = entry->refcnt ? NULL : evict();
+	pthread_mutex_unlock(&s_info.lock);
+
+	free_entries(evicted);
+}
+
+
+
+/* End of a file */
@@ -0,0 +1,1222 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Registry of accepted shortcuts.
+ *
+ * File layout (host byte order, the file is a local cache)
+ *
+ * +--------+------------------+----------------------+----------+-----
+ * | header | key_bucket[nr]   | pkg_bucket[nr]       | record 0 | ...
+ * +--------+------------------+----------------------+----------+-----
+ *
+ * Records are only appended. There are two hash indexes,
+ * one for (pkgname, name) and one for pkgname only.
+ * Each bucket has the offset of the newest record of its chain,
+ * records of a chain are linked via "next" and "pkg_next" fields.
+ * Replaced or removed records are marked as DEAD and reclaimed by the
+ * compaction, which rewrites live records to a new file and renames it.
+ *
+ * Header and bucket are updated after a record is written,
+ * so an interrupted append leaves only garbage after the "tail".
+ *
+ * If there is no path, the same layout is kept in the anonymous memory.
+ * The server uses it as an in-memory table for serving queries.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <errno.h>
+#include <dlog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <shortcut.h>
+#include <registry.h>
+
+
+
+#define REGISTRY_MAGIC "SCREGSTR"
+#define REGISTRY_VERSION 2
+#define DEFAULT_BUCKETS 256
+#define RECORD_ALIGN 8
+#define COMPACT_THRESHOLD (64 * 1024)
+
+#define ALIGN(size) (((size) + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1))
+
+
+
+extern int errno;
+
+
+
+struct registry_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t nr_buckets;
+	uint32_t nr_entries; /* Live records */
+	uint32_t tail; /* End of used area */
+	uint32_t dead_bytes;
+	uint32_t reserved;
+	uint32_t bucket[]; /* key_bucket[nr_buckets], pkg_bucket[nr_buckets] */
+};
+
+
+
+struct registry_record {
+	uint32_t next;
+	uint32_t pkg_next;
+	uint32_t hash;
+	uint32_t pkg_hash;
+	uint32_t size;
+	uint32_t flags;
+	int32_t type;
+	uint32_t field_size[4]; /* pkgname, name, exec, icon, including NUL */
+	char data[];
+};
+
+
+
+enum {
+	FIELD_PKGNAME = 0,
+	FIELD_NAME,
+	FIELD_EXEC,
+	FIELD_ICON,
+};
+
+
+
+enum {
+	RECORD_DEAD = 0x01,
+};
+
+
+
+static struct info {
+	pthread_mutex_t lock;
+	int fd;
+	char *path;
+	char *map;
+	size_t map_size;
+	pthread_t compactor;
+	int compactor_running;
+	int compactor_joinable;
+} s_info = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.fd = -1,
+	.path = NULL,
+	.map = NULL,
+	.map_size = 0,
+	.compactor_running = 0,
+	.compactor_joinable = 0,
+};
+
+
+
+#define HEADER(map) ((struct registry_header *)(map))
+#define RECORD(map, offset) ((struct registry_record *)((map) + (offset)))
+#define KEY_BUCKET(header, hash) ((header)->bucket[(hash) & ((header)->nr_buckets - 1)])
+#define PKG_BUCKET(header, hash) ((header)->bucket[(header)->nr_buckets + ((hash) & ((header)->nr_buckets - 1))])
+
+
+
+static inline
+uint32_t hash_str(uint32_t hash, const char *str)
+{
+	/* FNV-1a */
+	if (str) {
+		while (*str) {
+			hash ^= (unsigned char)*str++;
+			hash *= 16777619u;
+		}
+	}
+
+	return hash;
+}
+
+
+
+static inline
+uint32_t hash_pkgname(const char *pkgname)
+{
+	return hash_str(2166136261u, pkgname);
+}
+
+
+
+static inline
+uint32_t hash_key(const char *pkgname, const char *name)
+{
+	/* "pkgname\0name" */
+	return hash_str(hash_pkgname(pkgname) * 16777619u, name);
+}
+
+
+
+static inline
+uint32_t data_offset(uint32_t nr_buckets)
+{
+	return ALIGN(sizeof(struct registry_header) + 2 * nr_buckets * sizeof(uint32_t));
+}
+
+
+
+static inline
+const char *record_field(struct registry_record *record, int field)
+{
+	const char *ptr;
+	int i;
+
+	if (!record->field_size[field])
+		return NULL;
+
+	ptr = record->data;
+	for (i = 0; i < field; i++)
+		ptr += record->field_size[i];
+
+	return ptr;
+}
+
+
+
+static inline
+void record_to_entry(struct registry_record *record, struct registry_entry *entry)
+{
+	entry->pkgname = record_field(record, FIELD_PKGNAME);
+	entry->name = record_field(record, FIELD_NAME);
+	entry->exec = record_field(record, FIELD_EXEC);
+	entry->icon = record_field(record, FIELD_ICON);
+	entry->type = record->type;
+}
+
+
+
+static inline
+int field_equal(const char *field, const char *str)
+{
+	if (!field || !str)
+		return field == str;
+
+	return !strcmp(field, str);
+}
+
+
+
+static inline
+struct registry_record *find_record(char *map, uint32_t hash, const char *pkgname, const char *name)
+{
+	struct registry_record *record;
+	uint32_t offset;
+
+	offset = KEY_BUCKET(HEADER(map), hash);
+	while (offset && offset < HEADER(map)->tail) {
+		record = RECORD(map, offset);
+
+		if (record->hash == hash && !(record->flags & RECORD_DEAD)
+			&& field_equal(record_field(record, FIELD_PKGNAME), pkgname)
+			&& field_equal(record_field(record, FIELD_NAME), name))
+			return record;
+
+		offset = record->next;
+	}
+
+	return NULL;
+}
+
+
+
+static inline
+void link_record(char *map, uint32_t offset)
+{
+	struct registry_header *header = HEADER(map);
+	struct registry_record *record = RECORD(map, offset);
+
+	record->next = KEY_BUCKET(header, record->hash);
+	record->pkg_next = PKG_BUCKET(header, record->pkg_hash);
+	header->tail = offset + record->size;
+	KEY_BUCKET(header, record->hash) = offset;
+	PKG_BUCKET(header, record->pkg_hash) = offset;
+}
+
+
+
+static inline
+int map_file(int fd, size_t size, char **map)
+{
+	char *ptr;
+
+	if (fd < 0)
+		ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	else
+		ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (ptr == MAP_FAILED) {
+		LOGE("Failed to map the registry (%s)\n", strerror(errno));
+		return -EFAULT;
+	}
+
+	*map = ptr;
+	return 0;
+}
+
+
+
+static inline
+int format_file(int fd, uint32_t nr_buckets, size_t size, char **map)
+{
+	struct registry_header *header;
+	int ret;
+
+	if (fd >= 0 && ftruncate(fd, size) < 0) {
+		LOGE("Failed to truncate the registry (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	ret = map_file(fd, size, map);
+	if (ret < 0)
+		return ret;
+
+	header = HEADER(*map);
+	memset(header, 0, data_offset(nr_buckets));
+	memcpy(header->magic, REGISTRY_MAGIC, sizeof(header->magic));
+	header->version = REGISTRY_VERSION;
+	header->nr_buckets = nr_buckets;
+	header->tail = data_offset(nr_buckets);
+	return 0;
+}
+
+
+
+static inline
+int grow(size_t need)
+{
+	size_t size;
+	char *map;
+	int ret;
+
+	size = s_info.map_size;
+	while (size < need)
+		size <<= 1;
+
+	if (s_info.fd >= 0 && ftruncate(s_info.fd, size) < 0) {
+		LOGE("Failed to grow the registry (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	ret = map_file(s_info.fd, size, &map);
+	if (ret < 0)
+		return ret;
+
+	if (s_info.fd < 0)
+		memcpy(map, s_info.map, HEADER(s_info.map)->tail);
+
+	munmap(s_info.map, s_info.map_size);
+	s_info.map = map;
+	s_info.map_size = size;
+	return 0;
+}
+
+
+
+static inline
+int is_valid(char *map, size_t size)
+{
+	struct registry_header *header = HEADER(map);
+
+	if (size < sizeof(*header))
+		return 0;
+
+	if (memcmp(header->magic, REGISTRY_MAGIC, sizeof(header->magic)))
+		return 0;
+
+	if (header->version != REGISTRY_VERSION)
+		return 0;
+
+	/* Buckets are masked by the hash, and their offset should not wrap around */
+	if (!header->nr_buckets || (header->nr_buckets & (header->nr_buckets - 1))
+			|| header->nr_buckets > size / (2 * sizeof(uint32_t))
+			|| data_offset(header->nr_buckets) > size)
+		return 0;
+
+	if (header->tail < data_offset(header->nr_buckets) || header->tail > size
+			|| (header->tail & (RECORD_ALIGN - 1)))
+		return 0;
+
+	return 1;
+}
+
+
+
+#define IS_START(starts, offset) ((starts)[(offset) / RECORD_ALIGN / 8] & (1 << ((offset) / RECORD_ALIGN % 8)))
+
+
+
+/*
+ * Every record and its fields should be in the used area,
+ * and chains should go to older records, so walking them ends.
+ * They are checked once when the file is loaded, chain walks trust them after this.
+ * Counters of the header are fixed, an update could be interrupted between them.
+ * Returns -EINVAL if the file is broken.
+ */
+static inline
+int validate_records(char *map)
+{
+	struct registry_header *header = HEADER(map);
+	struct registry_record *record;
+	unsigned char *starts;
+	uint32_t nr_entries;
+	uint32_t dead_bytes;
+	uint32_t offset;
+	uint32_t used;
+	uint32_t i;
+	int field;
+	int ret;
+
+	starts = calloc(header->tail / RECORD_ALIGN / 8 + 1, 1);
+	if (!starts) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return -ENOMEM;
+	}
+
+	ret = -EINVAL;
+	nr_entries = 0;
+	dead_bytes = 0;
+	offset = data_offset(header->nr_buckets);
+	while (offset < header->tail) {
+		if (header->tail - offset < sizeof(*record)) {
+			LOGE("Truncated record at %u\n", offset);
+			goto out;
+		}
+
+		record = RECORD(map, offset);
+		if (record->size < sizeof(*record) || (record->size & (RECORD_ALIGN - 1))
+				|| record->size > header->tail - offset) {
+			LOGE("Invalid size of the record at %u\n", offset);
+			goto out;
+		}
+
+		used = sizeof(*record);
+		for (field = FIELD_PKGNAME; field <= FIELD_ICON; field++) {
+			if (record->field_size[field] > record->size - used) {
+				LOGE("Invalid field of the record at %u\n", offset);
+				goto out;
+			}
+
+			used += record->field_size[field];
+
+			/* Fields are used as strings */
+			if (record->field_size[field] && map[offset + used - 1] != '\0') {
+				LOGE("Field of the record at %u is not terminated\n", offset);
+				goto out;
+			}
+		}
+
+		if ((record->next && (record->next >= offset || !IS_START(starts, record->next)))
+				|| (record->pkg_next && (record->pkg_next >= offset || !IS_START(starts, record->pkg_next)))) {
+			LOGE("Invalid chain of the record at %u\n", offset);
+			goto out;
+		}
+
+		starts[offset / RECORD_ALIGN / 8] |= 1 << (offset / RECORD_ALIGN % 8);
+
+		if (record->flags & RECORD_DEAD)
+			dead_bytes += record->size;
+		else
+			nr_entries++;
+
+		offset += record->size;
+	}
+
+	for (i = 0; i < 2 * header->nr_buckets; i++) {
+		if (header->bucket[i] && (header->bucket[i] >= header->tail || !IS_START(starts, header->bucket[i]))) {
+			LOGE("Invalid bucket %u\n", i);
+			goto out;
+		}
+	}
+
+	header->nr_entries = nr_entries;
+	header->dead_bytes = dead_bytes;
+	ret = 0;
+
+out:
+	free(starts);
+	return ret;
+}
+
+
+
+/*
+ * Copy live records of the "src" to the new registry.
+ */
+static inline
+int build_compacted(const char *src, int fd, char **map, size_t *size)
+{
+	struct registry_header *header = HEADER(src);
+	struct registry_record *record;
+	uint32_t nr_buckets;
+	uint32_t offset;
+	uint32_t tail;
+	int ret;
+
+	nr_buckets = DEFAULT_BUCKETS;
+	while (nr_buckets < header->nr_entries)
+		nr_buckets <<= 1;
+
+	*size = data_offset(nr_buckets)
+		+ (header->tail - data_offset(header->nr_buckets))
+		- header->dead_bytes;
+
+	ret = format_file(fd, nr_buckets, *size, map);
+	if (ret < 0)
+		return ret;
+
+	offset = data_offset(header->nr_buckets);
+	while (offset < header->tail) {
+		record = RECORD(src, offset);
+		if (record->size < sizeof(*record)) {
+			LOGE("Invalid record at %u\n", offset);
+			break;
+		}
+		offset += record->size;
+
+		if (record->flags & RECORD_DEAD)
+			continue;
+
+		tail = HEADER(*map)->tail;
+		memcpy(RECORD(*map, tail), record, record->size);
+		link_record(*map, tail);
+		HEADER(*map)->nr_entries++;
+	}
+
+	return 0;
+}
+
+
+
+/*
+ * Apply changes made after the "snapshot" to the compacted registry.
+ * Records killed since then are killed in it too, and newer records are appended.
+ * Must be called with the lock.
+ */
+static inline
+int catch_up(const char *snapshot, int fd, char **map, size_t *size)
+{
+	struct registry_header *header = HEADER(s_info.map);
+	struct registry_record *record;
+	struct registry_record *old;
+	uint32_t offset;
+	uint32_t tail;
+	size_t need;
+	char *ptr;
+	int ret;
+
+	offset = data_offset(HEADER(snapshot)->nr_buckets);
+	while (offset < HEADER(snapshot)->tail) {
+		record = RECORD(s_info.map, offset);
+		offset += record->size;
+
+		if (!(record->flags & RECORD_DEAD) || (RECORD(snapshot, offset - record->size)->flags & RECORD_DEAD))
+			continue;
+
+		old = find_record(*map, record->hash,
+				record_field(record, FIELD_PKGNAME), record_field(record, FIELD_NAME));
+		if (old) {
+			old->flags |= RECORD_DEAD;
+			HEADER(*map)->dead_bytes += old->size;
+			HEADER(*map)->nr_entries--;
+		}
+	}
+
+	if (header->tail == HEADER(snapshot)->tail)
+		return 0;
+
+	need = *size + (header->tail - HEADER(snapshot)->tail);
+	if (ftruncate(fd, need) < 0) {
+		LOGE("Failed to grow the registry (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	ret = map_file(fd, need, &ptr);
+	if (ret < 0)
+		return ret;
+
+	munmap(*map, *size);
+	*map = ptr;
+	*size = need;
+
+	while (offset < header->tail) {
+		record = RECORD(s_info.map, offset);
+		offset += record->size;
+
+		if (record->flags & RECORD_DEAD)
+			continue;
+
+		tail = HEADER(*map)->tail;
+		memcpy(RECORD(*map, tail), record, record->size);
+		link_record(*map, tail);
+		HEADER(*map)->nr_entries++;
+	}
+
+	return 0;
+}
+
+
+
+static
+void *compactor_main(void *arg)
+{
+	char *snapshot;
+	size_t size;
+	char *tmp_path;
+	char *map;
+	int fd;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		s_info.compactor_running = 0;
+		return NULL;
+	}
+
+	if (!s_info.map || !s_info.path) {
+		s_info.compactor_running = 0;
+		pthread_mutex_unlock(&s_info.lock);
+		return NULL;
+	}
+
+	/* Records are only appended, the used area is enough to see what is changed later */
+	snapshot = malloc(HEADER(s_info.map)->tail);
+	if (!snapshot) {
+		LOGE("Heap: %s\n", strerror(errno));
+		s_info.compactor_running = 0;
+		pthread_mutex_unlock(&s_info.lock);
+		return NULL;
+	}
+	memcpy(snapshot, s_info.map, HEADER(s_info.map)->tail);
+
+	/* Don't block the updater while the new file is built and flushed */
+	pthread_mutex_unlock(&s_info.lock);
+
+	tmp_path = malloc(strlen(s_info.path) + 5);
+	if (!tmp_path) {
+		LOGE("Heap: %s\n", strerror(errno));
+		goto free_snapshot_out;
+	}
+	sprintf(tmp_path, "%s.tmp", s_info.path);
+
+	fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		LOGE("Failed to open %s (%s)\n", tmp_path, strerror(errno));
+		goto free_out;
+	}
+
+	if (build_compacted(snapshot, fd, &map, &size) < 0) {
+		unlink(tmp_path);
+		goto close_out;
+	}
+
+	if (msync(map, size, MS_SYNC) < 0 || fsync(fd) < 0)
+		LOGE("Failed to sync the registry (%s)\n", strerror(errno));
+
+	pthread_mutex_lock(&s_info.lock);
+
+	if (!s_info.map || catch_up(snapshot, fd, &map, &size) < 0) {
+		pthread_mutex_unlock(&s_info.lock);
+		munmap(map, size);
+		unlink(tmp_path);
+		goto close_out;
+	}
+
+	if (rename(tmp_path, s_info.path) < 0) {
+		LOGE("Failed to rename %s (%s)\n", tmp_path, strerror(errno));
+		pthread_mutex_unlock(&s_info.lock);
+		munmap(map, size);
+		unlink(tmp_path);
+		goto close_out;
+	}
+
+	munmap(s_info.map, s_info.map_size);
+	close(s_info.fd);
+	s_info.map = map;
+	s_info.map_size = size;
+	s_info.fd = fd;
+	LOGD("Registry is compacted (%u entries)\n", HEADER(map)->nr_entries);
+
+	s_info.compactor_running = 0;
+	pthread_mutex_unlock(&s_info.lock);
+	free(tmp_path);
+	free(snapshot);
+	return NULL;
+
+close_out:
+	close(fd);
+free_out:
+	free(tmp_path);
+free_snapshot_out:
+	free(snapshot);
+	pthread_mutex_lock(&s_info.lock);
+	s_info.compactor_running = 0;
+	pthread_mutex_unlock(&s_info.lock);
+	return NULL;
+}
+
+
+
+/* Must be called with the lock */
+static inline
+void try_compaction(void)
+{
+	struct registry_header *header = HEADER(s_info.map);
+	uint32_t used;
+	size_t size;
+	char *map;
+
+	if (s_info.compactor_running)
+		return;
+
+	used = header->tail - data_offset(header->nr_buckets);
+	if (header->dead_bytes < COMPACT_THRESHOLD || header->dead_bytes < used - header->dead_bytes)
+		return;
+
+	if (!s_info.path) {
+		/* In-memory table, there is nothing to flush */
+		if (build_compacted(s_info.map, -1, &map, &size) < 0)
+			return;
+
+		munmap(s_info.map, s_info.map_size);
+		s_info.map = map;
+		s_info.map_size = size;
+		return;
+	}
+
+	if (s_info.compactor_joinable) {
+		/* Previous one was already finished */
+		pthread_join(s_info.compactor, NULL);
+		s_info.compactor_joinable = 0;
+	}
+
+	s_info.compactor_running = 1;
+	if (pthread_create(&s_info.compactor, NULL, compactor_main, NULL) != 0) {
+		LOGE("Failed to create a compactor (%s)\n", strerror(errno));
+		s_info.compactor_running = 0;
+		return;
+	}
+
+	s_info.compactor_joinable = 1;
+}
+
+
+
+/* Must be called with the lock */
+static inline
+int append_record(const char *pkgname, const char *name, int type, const char *exec, const char *icon)
+{
+	struct registry_header *header;
+	struct registry_record *record;
+	struct registry_record *old;
+	uint32_t field_size[4];
+	uint32_t offset;
+	uint32_t size;
+	uint32_t hash;
+	char *ptr;
+	int ret;
+
+	field_size[FIELD_PKGNAME] = pkgname ? strlen(pkgname) + 1 : 0;
+	field_size[FIELD_NAME] = name ? strlen(name) + 1 : 0;
+	field_size[FIELD_EXEC] = exec ? strlen(exec) + 1 : 0;
+	field_size[FIELD_ICON] = icon ? strlen(icon) + 1 : 0;
+
+	size = ALIGN(sizeof(*record) + field_size[0] + field_size[1] + field_size[2] + field_size[3]);
+	hash = hash_key(pkgname, name);
+
+	if ((size_t)HEADER(s_info.map)->tail + size > s_info.map_size) {
+		ret = grow((size_t)HEADER(s_info.map)->tail + size);
+		if (ret < 0)
+			return ret;
+	}
+
+	header = HEADER(s_info.map);
+	offset = header->tail;
+
+	record = RECORD(s_info.map, offset);
+	record->hash = hash;
+	record->pkg_hash = hash_pkgname(pkgname);
+	record->size = size;
+	record->flags = 0;
+	record->type = type;
+	memcpy(record->field_size, field_size, sizeof(field_size));
+
+	ptr = record->data;
+	memcpy(ptr, pkgname, field_size[FIELD_PKGNAME]);
+	ptr += field_size[FIELD_PKGNAME];
+	memcpy(ptr, name, field_size[FIELD_NAME]);
+	ptr += field_size[FIELD_NAME];
+	memcpy(ptr, exec, field_size[FIELD_EXEC]);
+	ptr += field_size[FIELD_EXEC];
+	memcpy(ptr, icon, field_size[FIELD_ICON]);
+
+	old = find_record(s_info.map, hash, pkgname, name);
+
+	/* Now publish it */
+	link_record(s_info.map, offset);
+
+	if (old) {
+		old->flags |= RECORD_DEAD;
+		header->dead_bytes += old->size;
+	} else {
+		header->nr_entries++;
+	}
+
+	return 0;
+}
+
+
+
+static inline
+int open_file(const char *path)
+{
+	struct stat st;
+	int ret;
+
+	s_info.path = strdup(path);
+	if (!s_info.path) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return -ENOMEM;
+	}
+
+	s_info.fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (s_info.fd < 0) {
+		LOGE("Failed to open %s (%s)\n", path, strerror(errno));
+		ret = -EIO;
+		goto errout;
+	}
+
+	if (fstat(s_info.fd, &st) < 0) {
+		LOGE("Failed to get stat of %s (%s)\n", path, strerror(errno));
+		ret = -EIO;
+		goto errout;
+	}
+
+	if (st.st_size > 0) {
+		ret = map_file(s_info.fd, st.st_size, &s_info.map);
+		if (ret < 0)
+			goto errout;
+
+		ret = is_valid(s_info.map, st.st_size) ? validate_records(s_info.map) : -EINVAL;
+		if (ret == 0) {
+			s_info.map_size = st.st_size;
+			return 0;
+		}
+
+		if (ret != -EINVAL) {
+			munmap(s_info.map, st.st_size);
+			goto errout;
+		}
+
+		LOGE("Registry %s is broken, reset it\n", path);
+		munmap(s_info.map, st.st_size);
+		s_info.map = NULL;
+	}
+
+	s_info.map_size = data_offset(DEFAULT_BUCKETS) + getpagesize();
+	ret = format_file(s_info.fd, DEFAULT_BUCKETS, s_info.map_size, &s_info.map);
+	if (ret < 0)
+		goto errout;
+
+	return 0;
+
+errout:
+	if (s_info.fd >= 0)
+		close(s_info.fd);
+	s_info.fd = -1;
+	s_info.map = NULL;
+	s_info.map_size = 0;
+	free(s_info.path);
+	s_info.path = NULL;
+	return ret;
+}
+
+
+
+int registry_init(const char *path)
+{
+	struct registry_record *record;
+	uint32_t offset;
+	uint32_t tail;
+	size_t old_size;
+	char *old_map;
+	int ret;
+
+	if (!path) {
+		if (s_info.map)
+			return 0;
+
+		s_info.map_size = data_offset(DEFAULT_BUCKETS) + getpagesize();
+		ret = format_file(-1, DEFAULT_BUCKETS, s_info.map_size, &s_info.map);
+		if (ret < 0) {
+			s_info.map = NULL;
+			s_info.map_size = 0;
+		}
+
+		return ret;
+	}
+
+	if (s_info.path) {
+		LOGE("Already initialized\n");
+		return -EALREADY;
+	}
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return -EFAULT;
+	}
+
+	/* Records of the in-memory table are moved to the file */
+	old_map = s_info.map;
+	old_size = s_info.map_size;
+
+	ret = open_file(path);
+	if (ret < 0) {
+		s_info.map = old_map;
+		s_info.map_size = old_size;
+		pthread_mutex_unlock(&s_info.lock);
+		return ret;
+	}
+
+	if (old_map) {
+		tail = HEADER(old_map)->tail;
+		offset = data_offset(HEADER(old_map)->nr_buckets);
+		while (offset < tail) {
+			record = RECORD(old_map, offset);
+			offset += record->size;
+
+			if (record->flags & RECORD_DEAD)
+				continue;
+
+			if (append_record(record_field(record, FIELD_PKGNAME),
+					record_field(record, FIELD_NAME),
+					record->type,
+					record_field(record, FIELD_EXEC),
+					record_field(record, FIELD_ICON)) < 0)
+				LOGE("Failed to move a record\n");
+		}
+
+		munmap(old_map, old_size);
+	}
+
+	pthread_mutex_unlock(&s_info.lock);
+	return 0;
+}
+
+
+
+int registry_fini(void)
+{
+	if (s_info.compactor_joinable) {
+		pthread_join(s_info.compactor, NULL);
+		s_info.compactor_joinable = 0;
+	}
+
+	if (!s_info.map)
+		return -EINVAL;
+
+	if (s_info.fd >= 0) {
+		msync(s_info.map, s_info.map_size, MS_SYNC);
+		close(s_info.fd);
+	}
+
+	munmap(s_info.map, s_info.map_size);
+	free(s_info.path);
+
+	s_info.map = NULL;
+	s_info.map_size = 0;
+	s_info.fd = -1;
+	s_info.path = NULL;
+	return 0;
+}
+
+
+
+int registry_is_enabled(void)
+{
+	return !!s_info.map;
+}
+
+
+
+int registry_add(const char *pkgname, const char *name, int type, const char *exec, const char *icon)
+{
+	int ret;
+
+	if (!s_info.map)
+		return -EINVAL;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return -EFAULT;
+	}
+
+	ret = append_record(pkgname, name, type, exec, icon);
+	if (ret == 0)
+		try_compaction();
+
+	pthread_mutex_unlock(&s_info.lock);
+	return ret;
+}
+
+
+
+int registry_remove(const char *pkgname, const char *name)
+{
+	struct registry_header *header;
+	struct registry_record *record;
+	int ret;
+
+	if (!s_info.map)
+		return -EINVAL;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return -EFAULT;
+	}
+
+	header = HEADER(s_info.map);
+	record = find_record(s_info.map, hash_key(pkgname, name), pkgname, name);
+	if (record) {
+		record->flags |= RECORD_DEAD;
+		header->dead_bytes += record->size;
+		header->nr_entries--;
+		try_compaction();
+		ret = 0;
+	} else {
+		ret = -ENOENT;
+	}
+
+	pthread_mutex_unlock(&s_info.lock);
+	return ret;
+}
+
+
+
+static inline
+char *dup_field(const char *str)
+{
+	char *ret;
+
+	if (!str)
+		return NULL;
+
+	ret = strdup(str);
+	if (!ret)
+		LOGE("Heap: %s\n", strerror(errno));
+
+	return ret;
+}
+
+
+
+int registry_update(const char *pkgname, const char *name, int mask, const char *new_name, int type, const char *exec, const char *icon)
+{
+	struct registry_record *record;
+	char *old_name;
+	char *old_exec;
+	char *old_icon;
+	int old_type;
+	int ret;
+
+	if (!s_info.map)
+		return -EINVAL;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return -EFAULT;
+	}
+
+	record = find_record(s_info.map, hash_key(pkgname, name), pkgname, name);
+	if (!record) {
+		pthread_mutex_unlock(&s_info.lock);
+		return -ENOENT;
+	}
+
+	/* Mapping can be moved by the append, keep the unchanged fields */
+	old_name = dup_field(record_field(record, FIELD_NAME));
+	old_exec = dup_field(record_field(record, FIELD_EXEC));
+	old_icon = dup_field(record_field(record, FIELD_ICON));
+	old_type = record->type;
+
+	ret = append_record(pkgname,
+		(mask & SHORTCUT_UPDATE_NAME) ? new_name : old_name,
+		(mask & SHORTCUT_UPDATE_TYPE) ? type : old_type,
+		(mask & SHORTCUT_UPDATE_CONTENT_INFO) ? exec : old_exec,
+		(mask & SHORTCUT_UPDATE_ICON) ? icon : old_icon);
+
+	if (ret == 0 && (mask & SHORTCUT_UPDATE_NAME) && !field_equal(old_name, new_name)) {
+		/* Record of the old name is not replaced by the append */
+		record = find_record(s_info.map, hash_key(pkgname, name), pkgname, name);
+		if (record) {
+			record->flags |= RECORD_DEAD;
+			HEADER(s_info.map)->dead_bytes += record->size;
+			HEADER(s_info.map)->nr_entries--;
+		}
+	}
+
+	if (ret == 0)
+		try_compaction();
+
+	free(old_name);
+	free(old_exec);
+	free(old_icon);
+	pthread_mutex_unlock(&s_info.lock);
+	return ret;
+}
+
+
+
+int registry_find(const char *pkgname, const char *name, int (*cb)(const struct registry_entry *entry, void *data), void *data)
+{
+	struct registry_record *record;
+	struct registry_entry entry;
+	int ret;
+
+	if (!s_info.map)
+		return -EINVAL;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return -EFAULT;
+	}
+
+	record = find_record(s_info.map, hash_key(pkgname, name), pkgname, name);
+	if (record) {
+		if (cb) {
+			record_to_entry(record, &entry);
+			cb(&entry, data);
+		}
+		ret = 1;
+	} else {
+		ret = 0;
+	}
+
+	pthread_mutex_unlock(&s_info.lock);
+	return ret;
+}
+
+
+
+int registry_foreach(int (*cb)(const struct registry_entry *entry, void *data), void *data)
+{
+	struct registry_header *header;
+	struct registry_record *record;
+	struct registry_entry entry;
+	uint32_t offset;
+	int cnt;
+
+	if (!s_info.map || !cb)
+		return -EINVAL;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return -EFAULT;
+	}
+
+	cnt = 0;
+	header = HEADER(s_info.map);
+	offset = data_offset(header->nr_buckets);
+	while (offset < header->tail) {
+		record = RECORD(s_info.map, offset);
+		if (record->size < sizeof(*record)) {
+			LOGE("Invalid record at %u\n", offset);
+			break;
+		}
+		offset += record->size;
+
+		if (record->flags & RECORD_DEAD)
+			continue;
+
+		record_to_entry(record, &entry);
+
+		cnt++;
+		if (cb(&entry, data) < 0)
+			break;
+	}
+
+	pthread_mutex_unlock(&s_info.lock);
+	return cnt;
+}
+
+
+
+int registry_foreach_pkgname(const char *pkgname, int (*cb)(const struct registry_entry *entry, void *data), void *data)
+{
+	struct registry_header *header;
+	struct registry_record *record;
+	struct registry_entry entry;
+	uint32_t offset;
+	uint32_t hash;
+	int cnt;
+
+	if (!pkgname)
+		return registry_foreach(cb, data);
+
+	if (!s_info.map || !cb)
+		return -EINVAL;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0) {
+		LOGE("[%s:%d] Failed to get lock (%s)\n",
+					__func__, __LINE__, strerror(errno));
+		return -EFAULT;
+	}
+
+	cnt = 0;
+	hash = hash_pkgname(pkgname);
+	header = HEADER(s_info.map);
+	offset = PKG_BUCKET(header, hash);
+	while (offset && offset < header->tail) {
+		record = RECORD(s_info.map, offset);
+		offset = record->pkg_next;
+
+		if (record->pkg_hash != hash || (record->flags & RECORD_DEAD))
+			continue;
+
+		if (!field_equal(record_field(record, FIELD_PKGNAME), pkgname))
+			continue;
+
+		record_to_entry(record, &entry);
+
+		cnt++;
+		if (cb(&entry, data) < 0)
+			break;
+	}
+
+	pthread_mutex_unlock(&s_info.lock);
+	return cnt;
+}
+
+
+
+/* End of a file */
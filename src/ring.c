@@ -0,0 +1,519 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Requests through the shared ring.
+ *
+ * Client
+ * A published request waits its ACK in the wait list, ACKs are in the order of requests.
+ * If the server limits requests by credits (FEATURE_CREDIT), a request is published only with a credit.
+ * Otherwise it is queued here, bounded by RING_QUEUE_MAX and RING_QUEUE_BYTES,
+ * and published in order as ACKs return credits.
+ *
+ * Server
+ * Records are copied to the inbox of the connection, they are dispatched as received packets.
+ * Draining is paused while the inbox has a ring of packets, the producer finds the ring is full.
+ * It is also paused while the client has more requests than its window, until it gets credits back.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <dlog.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <shortcut.h>
+#include <packet.h>
+#include <shm_ring.h>
+#include <trace.h>
+#include <ring.h>
+
+
+
+#define CREDIT_WINDOW 64 /* Requests of a ring which can be outstanding, with the FEATURE_CREDIT */
+#define RING_QUEUE_MAX 1024 /* Requests which are queued in the client, waiting credits */
+#define RING_QUEUE_BYTES (1024 * 1024) /* Of the queue of the client */
+
+
+
+extern int errno;
+
+
+
+/*
+ * Request which is sent through the ring, waiting its ACK.
+ */
+struct ring_wait {
+	unsigned int seq;
+	void *data;
+	char *packet; /* Encoded request, while it is queued in the client */
+	int size;
+	struct ring_wait *next;
+};
+
+
+
+struct ring_server {
+	struct shm_ring ring;
+	int paused; /* Inbox is full, or credits are exhausted. Records are kept in the ring */
+	int window; /* Requests of the ring which can be outstanding, 0 if they are not limited */
+	int outstanding; /* Requests of the ring which are not acknowledged yet */
+};
+
+
+
+static struct info {
+	struct shm_ring *ring; /* Requests of this client are sent through it, if it is opened */
+	int conn_fd; /* Connection of the ring, for ACKs */
+	struct ring_wait *list; /* Waiting ACKs */
+	struct ring_wait **tail;
+	int credits; /* Requests which can be published to the ring, -1 if the server doesn't limit them */
+	int window; /* Credits which are granted first */
+	struct ring_wait *queue; /* Waiting credits or a space of the ring */
+	struct ring_wait **queue_tail;
+	int queued;
+	int queued_bytes;
+	int max_queued; /* Deepest queue which is seen */
+	int max_outstanding; /* Of rings of the server */
+} s_info = {
+	.ring = NULL,
+	.conn_fd = -1,
+	.list = NULL,
+	.tail = &s_info.list,
+	.credits = -1,
+	.window = 0,
+	.queue = NULL,
+	.queue_tail = &s_info.queue,
+	.queued = 0,
+	.queued_bytes = 0,
+	.max_queued = 0,
+	.max_outstanding = 0,
+};
+
+
+
+int ring_client_create(int size, int *fd, int *event_fd)
+{
+	struct shm_ring *ring;
+	int ret;
+
+	/* Left requests should be taken first */
+	if (s_info.ring || s_info.list || s_info.queue)
+		return -EALREADY;
+
+	ring = malloc(sizeof(*ring));
+	if (!ring) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return -ENOMEM;
+	}
+
+	ret = shm_ring_create(ring, size);
+	if (ret < 0) {
+		free(ring);
+		return ret;
+	}
+
+	s_info.ring = ring;
+	s_info.conn_fd = -1;
+	*fd = ring->fd;
+	*event_fd = ring->event_fd;
+	return 0;
+}
+
+
+
+int ring_client_start(int conn_fd, int credits)
+{
+	if (!s_info.ring)
+		return -EINVAL;
+
+	/* Server keeps the memfd, this only needs the mapping */
+	close(s_info.ring->fd);
+	s_info.ring->fd = -1;
+
+	s_info.conn_fd = conn_fd;
+	s_info.credits = credits;
+	s_info.window = credits;
+	LOGD("Ring (%u bytes, %d credits) is opened\n", s_info.ring->size, credits);
+	return 0;
+}
+
+
+
+/*
+ * Copy the encoded request to the ring, it waits its ACK after this.
+ * Returns -EAGAIN if the ring is full.
+ */
+static inline
+int publish_request(struct ring_wait *wait, const struct message *msg)
+{
+	char *ptr;
+
+	ptr = shm_ring_reserve(s_info.ring, wait->size);
+	if (!ptr)
+		return -EAGAIN;
+
+	if (msg)
+		packet_encode_v2(msg, ptr);
+	else
+		memcpy(ptr, wait->packet, wait->size);
+
+	wait->next = NULL;
+	*s_info.tail = wait;
+	s_info.tail = &wait->next;
+
+	if (s_info.credits > 0)
+		s_info.credits--;
+
+	TRACE_CLIENT_SEND(wait->seq, s_info.conn_fd, wait->size);
+	if (shm_ring_commit(s_info.ring, wait->size) < 0)
+		LOGE("Request %u is published, but the server is not woken up\n", wait->seq);
+
+	return 0;
+}
+
+
+
+int ring_client_send(const struct message *msg, void *data)
+{
+	struct ring_wait *wait;
+	int ret;
+
+	if (!s_info.ring)
+		return -EINVAL;
+
+	wait = malloc(sizeof(*wait));
+	if (!wait) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return -ENOMEM;
+	}
+
+	wait->seq = msg->seq;
+	wait->data = data;
+	wait->packet = NULL;
+	wait->size = packet_size_v2(msg);
+
+	/* Queued ones are published first, requests are kept in order */
+	if (!s_info.queue && s_info.credits != 0) {
+		ret = publish_request(wait, msg);
+		if (ret == 0 || s_info.credits < 0) {
+			if (ret < 0)
+				free(wait);
+			return ret;
+		}
+	}
+
+	if (s_info.queued >= RING_QUEUE_MAX || s_info.queued_bytes + wait->size > RING_QUEUE_BYTES) {
+		free(wait);
+		return -EBUSY;
+	}
+
+	wait->packet = malloc(wait->size);
+	if (!wait->packet) {
+		LOGE("Heap: %s\n", strerror(errno));
+		free(wait);
+		return -ENOMEM;
+	}
+
+	packet_encode_v2(msg, wait->packet);
+
+	wait->next = NULL;
+	*s_info.queue_tail = wait;
+	s_info.queue_tail = &wait->next;
+
+	s_info.queued++;
+	s_info.queued_bytes += wait->size;
+	if (s_info.queued > s_info.max_queued)
+		s_info.max_queued = s_info.queued;
+
+	return 0;
+}
+
+
+
+void *ring_client_ack(unsigned int seq, int credits)
+{
+	struct ring_wait **ptr;
+	struct ring_wait *wait;
+	void *data;
+
+	/* ACKs are in the order of requests */
+	ptr = &s_info.list;
+	while (*ptr && (*ptr)->seq != seq)
+		ptr = &(*ptr)->next;
+
+	wait = *ptr;
+	if (!wait)
+		return NULL;
+
+	*ptr = wait->next;
+	if (s_info.tail == &wait->next)
+		s_info.tail = ptr;
+
+	if (s_info.credits >= 0)
+		s_info.credits += credits;
+
+	data = wait->data;
+	free(wait);
+	return data;
+}
+
+
+
+void ring_client_publish(void)
+{
+	struct ring_wait *wait;
+
+	if (!s_info.ring)
+		return;
+
+	while ((wait = s_info.queue) && s_info.credits != 0) {
+		s_info.queue = wait->next;
+		if (!s_info.queue)
+			s_info.queue_tail = &s_info.queue;
+
+		if (publish_request(wait, NULL) < 0) {
+			/* Back to the head, the ring has a space after the server drains it */
+			wait->next = s_info.queue;
+			s_info.queue = wait;
+			if (s_info.queue_tail == &s_info.queue)
+				s_info.queue_tail = &wait->next;
+			break;
+		}
+
+		s_info.queued--;
+		s_info.queued_bytes -= wait->size;
+		free(wait->packet);
+		wait->packet = NULL;
+	}
+}
+
+
+
+void ring_client_close(void)
+{
+	if (!s_info.ring)
+		return;
+
+	shm_ring_destroy(s_info.ring);
+	free(s_info.ring);
+	s_info.ring = NULL;
+	s_info.conn_fd = -1;
+	s_info.credits = -1;
+}
+
+
+
+void *ring_client_take(unsigned int *seq)
+{
+	struct ring_wait *wait;
+	void *data;
+
+	wait = s_info.list;
+	if (wait) {
+		s_info.list = wait->next;
+		if (!s_info.list)
+			s_info.tail = &s_info.list;
+	} else {
+		/* Queued ones are not published, they get the same result */
+		wait = s_info.queue;
+		if (!wait)
+			return NULL;
+
+		s_info.queue = wait->next;
+		if (!s_info.queue)
+			s_info.queue_tail = &s_info.queue;
+
+		s_info.queued--;
+		s_info.queued_bytes -= wait->size;
+	}
+
+	*seq = wait->seq;
+	data = wait->data;
+	free(wait->packet);
+	free(wait);
+	return data;
+}
+
+
+
+void ring_client_stats(struct shortcut_queue_stats *stats)
+{
+	struct ring_wait *wait;
+
+	if (s_info.ring && s_info.credits >= 0) {
+		stats->connections = 1;
+		stats->window = s_info.window;
+	}
+
+	for (wait = s_info.list; wait; wait = wait->next)
+		stats->outstanding++;
+
+	stats->queued = s_info.queued;
+	stats->queued_bytes = s_info.queued_bytes;
+	stats->max_queued = s_info.max_queued;
+}
+
+
+
+int ring_server_attach(struct ring_server **server, int fd, int event_fd, int credit)
+{
+	struct ring_server *ptr;
+	int ret;
+
+	ptr = calloc(1, sizeof(*ptr));
+	if (!ptr) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return -ENOMEM;
+	}
+
+	ret = shm_ring_attach(&ptr->ring, fd, event_fd);
+	if (ret < 0) {
+		free(ptr);
+		return ret;
+	}
+
+	ptr->window = credit ? CREDIT_WINDOW : 0;
+	*server = ptr;
+	return 0;
+}
+
+
+
+void ring_server_detach(struct ring_server *server)
+{
+	shm_ring_destroy(&server->ring);
+	free(server);
+}
+
+
+
+void ring_server_fds(struct ring_server *server, int *fd, int *event_fd)
+{
+	*fd = server->ring.fd;
+	*event_fd = server->ring.event_fd;
+}
+
+
+
+static inline
+int is_exhausted(struct ring_server *server)
+{
+	return server->window && server->outstanding >= server->window;
+}
+
+
+
+int ring_server_drain(struct ring_server *server, int (*deliver)(const char *record, int size, void *data), void *data)
+{
+	unsigned long long value;
+	const char *record;
+	int size;
+	int ret;
+
+	server->paused = 0;
+	do {
+		while ((record = shm_ring_peek(&server->ring, &size))) {
+			if (size <= 0) {
+				LOGE("Ring is broken\n");
+				return -EINVAL;
+			}
+
+			ret = is_exhausted(server) ? 1 : deliver(record, size, data);
+			if (ret < 0)
+				return ret;
+
+			if (ret > 0) {
+				/* Idle is not set, the producer doesn't wake this up until it is resumed */
+				if (read(server->ring.event_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+					LOGE("Failed to read the eventfd (%s)\n", strerror(errno));
+				server->paused = 1;
+				return 0;
+			}
+
+			shm_ring_consume(&server->ring, size);
+
+			if (server->window && ++server->outstanding > s_info.max_outstanding)
+				s_info.max_outstanding = server->outstanding;
+		}
+
+		if (size < 0)
+			return size;
+	} while (shm_ring_wait(&server->ring) == -EAGAIN);
+
+	return 0;
+}
+
+
+
+int ring_server_resume(struct ring_server *server, int backlog, int (*deliver)(const char *record, int size, void *data), void *data)
+{
+	if (!server->paused || backlog >= server->ring.size / 2 || is_exhausted(server))
+		return 0;
+
+	return ring_server_drain(server, deliver, data);
+}
+
+
+
+int ring_server_size(struct ring_server *server)
+{
+	return server->ring.size;
+}
+
+
+
+int ring_server_ack(struct ring_server *server)
+{
+	if (!server->window || server->outstanding <= 0)
+		return 0;
+
+	server->outstanding--;
+	return 1;
+}
+
+
+
+void ring_server_hold(struct ring_server *server, int outstanding)
+{
+	if (server->window)
+		server->outstanding = outstanding;
+}
+
+
+
+int ring_server_window(struct ring_server *server)
+{
+	return server->window;
+}
+
+
+
+int ring_server_outstanding(struct ring_server *server)
+{
+	return server->outstanding;
+}
+
+
+
+int ring_server_max_outstanding(void)
+{
+	return s_info.max_outstanding;
+}
+
+
+
+/* End of a file */
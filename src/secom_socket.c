@@ -23,10 +23,14 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
 #include <netinet/in.h>
 #include <errno.h>
+#include <string.h>
 
 #include <secom_socket.h>
+#include <transport.h>
 #include <dlog.h>
 
 
@@ -36,7 +40,7 @@ extern int errno;
 
 
 inline static
-int create_socket(const char *peer, struct sockaddr_un *addr)
+int create_socket(const char *peer, struct sockaddr_un *addr, int flags)
 {
 	int len;
 	int handle;
@@ -54,7 +58,7 @@ int create_socket(const char *peer, struct sockaddr_un *addr)
 	strcpy(addr->sun_path, peer);
 	addr->sun_family = AF_UNIX;
 
-	handle = socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	handle = socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | flags, 0);
 	if (handle < 0) {
 		LOGE("Failed to create a socket %s\n", strerror(errno));
 		return -1;
@@ -65,23 +69,28 @@ int create_socket(const char *peer, struct sockaddr_un *addr)
 
 
 
-int secom_create_client(const char *peer)
+inline static
+int create_client(const char *peer, int flags)
 {
 	struct sockaddr_un addr;
 	int handle;
 	int state;
 	int on = 1;
 
-	handle = create_socket(peer, &addr);
+	handle = create_socket(peer, &addr, flags);
 	if (handle < 0)
 		return handle;
 
 	state = connect(handle, (struct sockaddr*)&addr, sizeof(addr));
 	if (state < 0) {
-		LOGE("Failed to connect to server [%s] %s\n", peer, strerror(errno));
+		/* Caller checks it, e.g. EAGAIN */
+		int err = errno;
+
+		LOGE("Failed to connect to server [%s] %s\n", peer, strerror(err));
 		if (close(handle) < 0)
 			LOGE("Failed to close a handle\n");
 
+		errno = err;
 		return -1;
 	}
 
@@ -93,13 +102,27 @@ int secom_create_client(const char *peer)
 
 
 
+int secom_create_client(const char *peer)
+{
+	return create_client(peer, 0);
+}
+
+
+
+int secom_create_client_nonblock(const char *peer)
+{
+	return create_client(peer, SOCK_NONBLOCK);
+}
+
+
+
 int secom_create_server(const char *peer)
 {
 	int handle;
 	int state;
 	struct sockaddr_un addr;
 
-	handle = create_socket(peer, &addr);
+	handle = create_socket(peer, &addr, 0);
 	if (handle < 0) return handle;
 
 	state = bind(handle, &addr, sizeof(addr));
@@ -162,42 +185,73 @@ int secom_put_connection_handle(int conn_handle)
 
 
 
-int secom_send(int handle, const char *buffer, int size)
+int secom_send_fds(int handle, const char *buffer, int size, const int *fds, int nr_fds)
 {
 	struct msghdr msg;
+	struct cmsghdr *cmsg;
 	struct iovec iov;
+	char control[CMSG_SPACE(sizeof(int) * SECOM_MAX_FDS)];
 	int ret;
 
+	if (nr_fds < 0 || nr_fds > SECOM_MAX_FDS)
+		return -1;
+
 	memset(&msg, 0, sizeof(msg));
 	iov.iov_base = (char*)buffer;
 	iov.iov_len = size;
 	msg.msg_iov = &iov;
 	msg.msg_iovlen = 1;
 
-	ret = sendmsg(handle, &msg, 0);
+	if (nr_fds > 0) {
+		msg.msg_control = control;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * nr_fds);
+
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nr_fds);
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nr_fds);
+	}
+
+	/* Peer can be gone (e.g. timed out), it should not kill this */
+	ret = sendmsg(handle, &msg, MSG_NOSIGNAL);
 	if (ret < 0) {
 		LOGE("Failed to send message [%s]\n", strerror(errno));
 		return -1;
 	}
-	LOGD("Send done: %d\n", ret);
+	LOGD("Send done: %d (%d fds)\n", ret, nr_fds);
 
-	return iov.iov_len;
+	return ret;
 }
 
 
 
-int secom_recv(int handle, char *buffer, int size, int *sender_pid)
+int secom_send(int handle, const char *buffer, int size)
+{
+	return secom_send_fds(handle, buffer, size, NULL, 0);
+}
+
+
+
+int secom_recv_fds(int handle, char *buffer, int size, int *sender_pid, int *fds, int *nr_fds)
 {
 	struct msghdr msg;
 	struct cmsghdr *cmsg;
 	struct iovec iov;
 	int _pid;
+	int max_fds;
 	int ret;
 	char control[1024];
 
 	if (!sender_pid) sender_pid = &_pid;
 	*sender_pid = -1;
 
+	max_fds = 0;
+	if (nr_fds) {
+		max_fds = *nr_fds;
+		*nr_fds = 0;
+	}
+
 	memset(&msg, 0, sizeof(msg));
 	iov.iov_base = buffer;
 	iov.iov_len = size;
@@ -206,12 +260,15 @@ int secom_recv(int handle, char *buffer, int size, int *sender_pid)
 	msg.msg_control = control;
 	msg.msg_controllen = sizeof(control);
 
-	ret = recvmsg(handle, &msg, 0);
+	ret = recvmsg(handle, &msg, MSG_CMSG_CLOEXEC);
 	if (ret < 0) {
 		LOGE("Failed to recvmsg [%s] (%d)\n", strerror(errno), ret);
 		return -1;
 	}
 
+	if (msg.msg_flags & MSG_CTRUNC)
+		LOGE("Control message is truncated\n");
+
 	cmsg = CMSG_FIRSTHDR(&msg);
 	while (cmsg) {
 		if (cmsg->cmsg_level == SOL_SOCKET
@@ -220,12 +277,35 @@ int secom_recv(int handle, char *buffer, int size, int *sender_pid)
 			struct ucred *cred;
 			cred = (struct ucred*)CMSG_DATA(cmsg);
 			*sender_pid = cred->pid;
+		} else if (cmsg->cmsg_level == SOL_SOCKET
+			&& cmsg->cmsg_type == SCM_RIGHTS)
+		{
+			int *received = (int *)CMSG_DATA(cmsg);
+			int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			int i;
+
+			for (i = 0; i < count; i++) {
+				if (nr_fds && *nr_fds < max_fds) {
+					fds[(*nr_fds)++] = received[i];
+				} else {
+					/* Nobody takes this, don't leak it */
+					LOGE("Unexpected fd is dropped\n");
+					close(received[i]);
+				}
+			}
 		}
 
 		cmsg = CMSG_NXTHDR(&msg, cmsg);
 	}
 
-	return iov.iov_len;
+	return ret;
+}
+
+
+
+int secom_recv(int handle, char *buffer, int size, int *sender_pid)
+{
+	return secom_recv_fds(handle, buffer, size, sender_pid, NULL, NULL);
 }
 
 
@@ -241,5 +321,69 @@ int secom_destroy(int handle)
 
 
 
+int secom_sendv(int handle, const struct iovec *iov, int count)
+{
+	struct msghdr msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = (struct iovec *)iov;
+	msg.msg_iovlen = count;
+
+	return sendmsg(handle, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+
+
+int secom_pending(int handle)
+{
+	int size;
+
+	if (ioctl(handle, FIONREAD, &size) < 0) {
+		LOGE("Failed to get q size\n");
+		return -1;
+	}
+
+	return size;
+}
+
+
+
+int secom_peer_credentials(int handle, int *pid, int *uid)
+{
+	struct ucred cred;
+	socklen_t len;
+
+	len = sizeof(cred);
+	if (getsockopt(handle, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+		LOGE("Failed to get the peer (%s)\n", strerror(errno));
+		return -1;
+	}
+
+	if (pid)
+		*pid = cred.pid;
+	if (uid)
+		*uid = cred.uid;
+
+	return 0;
+}
+
+
+
+const struct transport transport_unix = {
+	.name = "unix",
+	.connect = secom_create_client,
+	.connect_nonblock = secom_create_client_nonblock,
+	.listen = secom_create_server,
+	.accept = secom_get_connection_handle,
+	.send = secom_send_fds,
+	.sendv = secom_sendv,
+	.recv = secom_recv_fds,
+	.pending = secom_pending,
+	.credentials = secom_peer_credentials,
+	.close = secom_destroy,
+};
+
+
+
 #undef _GNU_SOURCE
 // End of a file
@@ -0,0 +1,380 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Shared ring of packets.
+ *
+ * Layout of the memfd
+ *
+ * +--------+---------------------------------------------------------+
+ * | header | record | record | ... | WRAP |                          |
+ * +--------+---------------------------------------------------------+
+ * DATA_OFFSET
+ *
+ * A record is a 32 bits length and its packet, aligned to RECORD_ALIGN.
+ * A record is not split at the end of the data, WRAP marks the rest is skipped.
+ * head and tail are free running positions, only the producer writes the head,
+ * only the consumer writes the tail.
+ *
+ * The consumer sets the idle before it sleeps on the eventfd, and checks the head again.
+ * The producer publishes the head and writes the eventfd only if it takes the idle,
+ * so a burst of records costs one wakeup.
+ *
+ * The consumer doesn't trust the producer, a broken length is reported,
+ * and records should be copied before they are decoded.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <dlog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(HAVE_MEMFD_CREATE)
+#include <sys/eventfd.h>
+#endif
+
+#include <shm_ring.h>
+
+
+
+#define RING_MAGIC 0x53524E47 /* SRNG */
+#define RING_MIN_SIZE 4096
+#define RING_MAX_SIZE (16 * 1024 * 1024)
+#define DATA_OFFSET 256
+#define RECORD_ALIGN 8
+#define RECORD_WRAP 0xFFFFFFFFu
+
+/* Ring should not be resized while it is mapped */
+#define RING_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+
+
+extern int errno;
+
+
+
+/*
+ * Positions are in their own cache lines, each one is written by one side.
+ */
+struct shm_ring_header {
+	uint32_t magic;
+	uint32_t size;
+	uint32_t head __attribute__((aligned(64)));
+	uint32_t idle __attribute__((aligned(64)));
+	uint32_t tail __attribute__((aligned(64)));
+};
+
+
+
+static inline
+uint32_t record_size(uint32_t size)
+{
+	return (sizeof(uint32_t) + size + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+}
+
+
+
+static inline
+int map_ring(struct shm_ring *ring, int map_size)
+{
+	void *ptr;
+
+	ptr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+	if (ptr == MAP_FAILED) {
+		LOGE("Failed to map the ring (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	ring->header = ptr;
+	ring->data = (char *)ptr + DATA_OFFSET;
+	ring->map_size = map_size;
+	return 0;
+}
+
+
+
+#if defined(HAVE_MEMFD_CREATE)
+int shm_ring_create(struct shm_ring *ring, int size)
+{
+	unsigned int data_size;
+
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+	ring->event_fd = -1;
+
+	if (size <= 0 || size > RING_MAX_SIZE)
+		return -EINVAL;
+
+	data_size = RING_MIN_SIZE;
+	while (data_size < (unsigned int)size)
+		data_size <<= 1;
+
+	ring->fd = memfd_create("shortcut-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (ring->fd < 0) {
+		LOGE("Failed to create a memfd (%s)\n", strerror(errno));
+		return -EFAULT;
+	}
+
+	if (ftruncate(ring->fd, DATA_OFFSET + data_size) < 0 || fcntl(ring->fd, F_ADD_SEALS, RING_SEALS) < 0) {
+		LOGE("Failed to prepare the ring (%s)\n", strerror(errno));
+		shm_ring_destroy(ring);
+		return -EIO;
+	}
+
+	if (map_ring(ring, DATA_OFFSET + data_size) < 0) {
+		shm_ring_destroy(ring);
+		return -EIO;
+	}
+
+	ring->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (ring->event_fd < 0) {
+		LOGE("Failed to create an eventfd (%s)\n", strerror(errno));
+		shm_ring_destroy(ring);
+		return -EFAULT;
+	}
+
+	ring->size = data_size;
+	ring->header->magic = RING_MAGIC;
+	ring->header->size = data_size;
+	/* The first record wakes the consumer up */
+	ring->header->idle = 1;
+	return 0;
+}
+
+
+
+int shm_ring_attach(struct shm_ring *ring, int fd, int event_fd)
+{
+	struct stat st;
+	uint32_t size;
+	int seals;
+
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+	ring->event_fd = -1;
+
+	seals = fcntl(fd, F_GET_SEALS);
+	if (seals < 0 || (seals & RING_SEALS) != RING_SEALS) {
+		LOGE("Ring is not sealed\n");
+		return -EPERM;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		LOGE("Failed to get the size of the ring (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	if (st.st_size < DATA_OFFSET + RING_MIN_SIZE || st.st_size > DATA_OFFSET + RING_MAX_SIZE) {
+		LOGE("Invalid size of the ring: %lld\n", (long long)st.st_size);
+		return -EINVAL;
+	}
+
+	ring->fd = fd;
+	if (map_ring(ring, st.st_size) < 0) {
+		ring->fd = -1;
+		return -EIO;
+	}
+
+	/* The size is kept here, the producer can change the header */
+	size = st.st_size - DATA_OFFSET;
+	if (ring->header->magic != RING_MAGIC || ring->header->size != size || (size & (size - 1))) {
+		LOGE("Invalid ring\n");
+		munmap(ring->header, ring->map_size);
+		ring->fd = -1;
+		return -EINVAL;
+	}
+
+	ring->size = size;
+	ring->pos = __atomic_load_n(&ring->header->tail, __ATOMIC_ACQUIRE);
+	ring->event_fd = event_fd;
+	return 0;
+}
+#else
+int shm_ring_create(struct shm_ring *ring, int size)
+{
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+	ring->event_fd = -1;
+	return -ENOSYS;
+}
+
+
+
+int shm_ring_attach(struct shm_ring *ring, int fd, int event_fd)
+{
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+	ring->event_fd = -1;
+	return -ENOSYS;
+}
+#endif
+
+
+
+void shm_ring_destroy(struct shm_ring *ring)
+{
+	if (ring->header)
+		munmap(ring->header, ring->map_size);
+
+	if (ring->fd >= 0)
+		close(ring->fd);
+
+	if (ring->event_fd >= 0)
+		close(ring->event_fd);
+
+	ring->header = NULL;
+	ring->data = NULL;
+	ring->fd = -1;
+	ring->event_fd = -1;
+}
+
+
+
+char *shm_ring_reserve(struct shm_ring *ring, int size)
+{
+	uint32_t tail;
+	uint32_t offset;
+	uint32_t need;
+	uint32_t skip;
+
+	/* Before the record_size, it wraps around for a huge size */
+	if (size <= 0 || (uint32_t)size > ring->size / 2)
+		return NULL;
+
+	need = record_size(size);
+	if (need > ring->size / 2)
+		return NULL;
+
+	tail = __atomic_load_n(&ring->header->tail, __ATOMIC_ACQUIRE);
+	offset = ring->pos & (ring->size - 1);
+	skip = ring->size - offset < need ? ring->size - offset : 0;
+
+	if (ring->size - (ring->pos - tail) < skip + need)
+		return NULL;
+
+	if (skip) {
+		*(uint32_t *)(ring->data + offset) = RECORD_WRAP;
+		ring->pos += skip;
+		offset = 0;
+	}
+
+	*(uint32_t *)(ring->data + offset) = size;
+	return ring->data + offset + sizeof(uint32_t);
+}
+
+
+
+int shm_ring_commit(struct shm_ring *ring, int size)
+{
+	uint64_t value = 1;
+
+	ring->pos += record_size(size);
+	__atomic_store_n(&ring->header->head, ring->pos, __ATOMIC_RELEASE);
+
+	/* The head should be visible before the idle is taken */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!__atomic_exchange_n(&ring->header->idle, 0, __ATOMIC_SEQ_CST))
+		return 0;
+
+	if (write(ring->event_fd, &value, sizeof(value)) != sizeof(value) && errno != EAGAIN) {
+		LOGE("Failed to wake the consumer up (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	return 0;
+}
+
+
+
+const char *shm_ring_peek(struct shm_ring *ring, int *size)
+{
+	uint32_t head;
+	uint32_t avail;
+	uint32_t offset;
+	uint32_t len;
+
+	*size = 0;
+	while (1) {
+		head = __atomic_load_n(&ring->header->head, __ATOMIC_ACQUIRE);
+		if (head == ring->pos)
+			return NULL;
+
+		avail = head - ring->pos;
+		if (avail > ring->size)
+			break;
+
+		offset = ring->pos & (ring->size - 1);
+		len = __atomic_load_n((uint32_t *)(ring->data + offset), __ATOMIC_RELAXED);
+		if (len != RECORD_WRAP) {
+			/* Length is written by the producer, check it before the record_size wraps it around */
+			if (!len || len > ring->size - sizeof(uint32_t)
+					|| record_size(len) > avail || offset + record_size(len) > ring->size)
+				break;
+
+			*size = len;
+			return ring->data + offset + sizeof(uint32_t);
+		}
+
+		if (ring->size - offset > avail)
+			break;
+
+		ring->pos += ring->size - offset;
+		__atomic_store_n(&ring->header->tail, ring->pos, __ATOMIC_RELEASE);
+	}
+
+	LOGE("Ring is broken\n");
+	*size = -EINVAL;
+	return NULL;
+}
+
+
+
+void shm_ring_consume(struct shm_ring *ring, int size)
+{
+	ring->pos += record_size(size);
+	__atomic_store_n(&ring->header->tail, ring->pos, __ATOMIC_RELEASE);
+}
+
+
+
+int shm_ring_wait(struct shm_ring *ring)
+{
+	uint64_t value;
+
+	/* Before the idle, not to lose a wakeup which is raised after it */
+	if (read(ring->event_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+		LOGE("Failed to read the eventfd (%s)\n", strerror(errno));
+
+	__atomic_store_n(&ring->header->idle, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&ring->header->head, __ATOMIC_ACQUIRE) != ring->pos) {
+		__atomic_store_n(&ring->header->idle, 0, __ATOMIC_SEQ_CST);
+		return -EAGAIN;
+	}
+
+	return 0;
+}
+
+
+
+/* End of a file */
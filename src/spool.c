@@ -0,0 +1,421 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Spool of requests which are made while the server is not running.
+ *
+ * Every request is a file in the spool directory, "<time>-<pid>-<seq>.req".
+ * It is written to a temporary file and renamed, so the server never sees a partial one.
+ * Names are sorted in the order of spooling.
+ *
+ * The server delivers spooled requests when it starts. A request is claimed by renaming
+ * it to "<name>.run", and the result is written as "<name>.ret" if its client is still alive.
+ * Results are removed by the server after a while.
+ *
+ * The directory is writable by everyone, as the socket of the server is, with the sticky bit as the /tmp.
+ * It should be owned by the root or the user of this process, the owner could remove or replace files in it.
+ * So the server should run as the root, or as the user of its clients, to claim their requests.
+ *
+ * Name of a request is not trusted, the pid in it can be spoofed by anyone.
+ * Request is delivered with the uid of its file, results are only taken from the root or this user.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <dlog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <dirent.h>
+#include <signal.h>
+#include <time.h>
+
+#include <sys/stat.h>
+
+#include <spool.h>
+
+
+
+#define SPOOL_DIR "/tmp/.shortcut.spool"
+#define SPOOL_MAX 512
+#define SPOOL_MAX_SIZE (1024 * 1024)
+#define RESULT_TIMEOUT 600 /* seconds */
+
+#define REQ_SUFFIX ".req"
+#define RUN_SUFFIX ".run"
+#define RET_SUFFIX ".ret"
+
+
+
+extern int errno;
+
+
+
+static struct info {
+	unsigned int seq;
+} s_info = {
+	.seq = 0,
+};
+
+
+
+static inline
+int is_trusted_uid(uid_t uid)
+{
+	return uid == 0 || uid == geteuid();
+}
+
+
+
+/*
+ * Create the directory, or check the one which exists already. It can be planted by another user.
+ */
+static inline
+int make_dir(void)
+{
+	struct stat st;
+
+	if (mkdir(SPOOL_DIR, 01777) < 0 && errno != EEXIST) {
+		LOGE("Failed to create the spool (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	if (lstat(SPOOL_DIR, &st) < 0) {
+		LOGE("Failed to get the spool (%s)\n", strerror(errno));
+		return -EIO;
+	}
+
+	if (!S_ISDIR(st.st_mode) || !is_trusted_uid(st.st_uid)) {
+		LOGE("Spool is not a directory of a trusted user\n");
+		return -EPERM;
+	}
+
+	/* Regardless of the umask */
+	if (st.st_uid == geteuid() && (st.st_mode & 07777) != 01777) {
+		if (chmod(SPOOL_DIR, 01777) < 0) {
+			LOGE("Failed to change the permission of the spool (%s)\n", strerror(errno));
+			return -EIO;
+		}
+
+		st.st_mode = (st.st_mode & ~07777) | 01777;
+	}
+
+	/* Others could remove or replace files of this user */
+	if ((st.st_mode & (S_IWGRP | S_IWOTH)) && !(st.st_mode & S_ISVTX)) {
+		LOGE("Spool is writable by others without the sticky bit\n");
+		return -EPERM;
+	}
+
+	return 0;
+}
+
+
+
+static inline
+int has_suffix(const char *name, const char *suffix)
+{
+	int len = strlen(name);
+	int suffix_len = strlen(suffix);
+
+	return len > suffix_len && !strcmp(name + len - suffix_len, suffix);
+}
+
+
+
+static
+int is_request(const struct dirent *entry)
+{
+	return has_suffix(entry->d_name, REQ_SUFFIX);
+}
+
+
+
+static
+int is_finished(const struct dirent *entry)
+{
+	return has_suffix(entry->d_name, RET_SUFFIX) || has_suffix(entry->d_name, RUN_SUFFIX);
+}
+
+
+
+/*
+ * Write a file at once, via a temporary file.
+ */
+static inline
+int write_file(const char *path, const char *buffer, int size, mode_t mode)
+{
+	char tmp[512];
+	int fd;
+
+	snprintf(tmp, sizeof(tmp), "%s/.tmp-%d-%u", SPOOL_DIR, getpid(), s_info.seq++);
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, mode);
+	if (fd < 0) {
+		LOGE("Failed to create %s (%s)\n", tmp, strerror(errno));
+		return -EIO;
+	}
+
+	if (fchmod(fd, mode) < 0)
+		LOGE("Failed to change the permission (%s)\n", strerror(errno));
+
+	if (write(fd, buffer, size) != size) {
+		LOGE("Failed to write %s (%s)\n", tmp, strerror(errno));
+		close(fd);
+		unlink(tmp);
+		return -EIO;
+	}
+
+	close(fd);
+
+	if (rename(tmp, path) < 0) {
+		LOGE("Failed to rename %s (%s)\n", tmp, strerror(errno));
+		unlink(tmp);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+
+
+/*
+ * Only a regular file is read, a fifo or a link can be planted with the name.
+ * uid is of the owner of the file.
+ */
+static inline
+char *read_file(const char *path, int *size, uid_t *uid)
+{
+	struct stat st;
+	char *buffer;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size > SPOOL_MAX_SIZE) {
+		close(fd);
+		return NULL;
+	}
+
+	buffer = malloc(st.st_size + 1);
+	if (!buffer) {
+		LOGE("Heap: %s\n", strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	if (read(fd, buffer, st.st_size) != st.st_size) {
+		free(buffer);
+		close(fd);
+		return NULL;
+	}
+
+	close(fd);
+	buffer[st.st_size] = '\0';
+	*size = st.st_size;
+	*uid = st.st_uid;
+	return buffer;
+}
+
+
+
+int spool_write(int pid, const char *buffer, int size, char *name)
+{
+	struct timespec ts;
+	char path[512];
+
+	if (size > SPOOL_MAX_SIZE)
+		return -EINVAL;
+
+	if (make_dir() < 0)
+		return -EIO;
+
+	if (spool_count() >= SPOOL_MAX) {
+		LOGE("Spool is full\n");
+		return -EAGAIN;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	snprintf(name, SPOOL_NAME_LEN, "%016llx-%08x-%08x",
+			(unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec,
+			pid, s_info.seq++);
+	snprintf(path, sizeof(path), "%s/%s" REQ_SUFFIX, SPOOL_DIR, name);
+
+	/* Only for the server, it runs as the root or this user */
+	return write_file(path, buffer, size, 0600);
+}
+
+
+
+int spool_read_result(const char *name, int *ret, int *server_pid)
+{
+	char path[512];
+	char *buffer;
+	uid_t uid;
+	int size;
+
+	snprintf(path, sizeof(path), "%s/%s" RET_SUFFIX, SPOOL_DIR, name);
+	buffer = read_file(path, &size, &uid);
+	if (buffer && !is_trusted_uid(uid)) {
+		/* Forged by another user */
+		LOGE("Result of %s is not from the server\n", name);
+		free(buffer);
+		buffer = NULL;
+	}
+
+	if (buffer) {
+		if (sscanf(buffer, "%d %d", ret, server_pid) != 2) {
+			free(buffer);
+			return -EINVAL;
+		}
+
+		free(buffer);
+		unlink(path);
+		return 0;
+	}
+
+	snprintf(path, sizeof(path), "%s/%s" REQ_SUFFIX, SPOOL_DIR, name);
+	if (access(path, F_OK) == 0)
+		return -EINPROGRESS;
+
+	snprintf(path, sizeof(path), "%s/%s" RUN_SUFFIX, SPOOL_DIR, name);
+	if (access(path, F_OK) == 0)
+		return -EINPROGRESS;
+
+	return -ENOENT;
+}
+
+
+
+/*
+ * Remove results which are not taken, and requests of a server which was killed while delivering them.
+ */
+static inline
+void remove_old_results(void)
+{
+	struct dirent **list;
+	struct stat st;
+	char path[512];
+	time_t now;
+	int count;
+	int i;
+
+	count = scandir(SPOOL_DIR, &list, is_finished, NULL);
+	if (count < 0)
+		return;
+
+	now = time(NULL);
+	for (i = 0; i < count; i++) {
+		snprintf(path, sizeof(path), "%s/%s", SPOOL_DIR, list[i]->d_name);
+		if (lstat(path, &st) == 0 && now - st.st_mtime > RESULT_TIMEOUT)
+			unlink(path);
+		free(list[i]);
+	}
+
+	free(list);
+}
+
+
+
+int spool_drain(int (*deliver)(int pid, int uid, const char *buffer, int size, void *data), void *data)
+{
+	struct dirent **list;
+	char path[512];
+	char run[512];
+	char result[32];
+	char *name;
+	char *buffer;
+	unsigned int pid;
+	uid_t uid;
+	int delivered;
+	int count;
+	int size;
+	int ret;
+	int i;
+
+	if (make_dir() < 0)
+		return 0;
+
+	count = scandir(SPOOL_DIR, &list, is_request, alphasort);
+	if (count < 0)
+		return 0;
+
+	delivered = 0;
+	for (i = 0; i < count; i++) {
+		name = list[i]->d_name;
+		name[strlen(name) - strlen(REQ_SUFFIX)] = '\0';
+
+		snprintf(path, sizeof(path), "%s/%s" REQ_SUFFIX, SPOOL_DIR, name);
+		snprintf(run, sizeof(run), "%s/%s" RUN_SUFFIX, SPOOL_DIR, name);
+		if (rename(path, run) < 0) {
+			/* Taken by another server */
+			free(list[i]);
+			continue;
+		}
+
+		buffer = read_file(run, &size, &uid);
+		if (buffer) {
+			if (sscanf(name, "%*[0-9a-f]-%8x-", &pid) != 1)
+				pid = 0;
+
+			ret = deliver(pid, uid, buffer, size, data);
+			free(buffer);
+			delivered++;
+
+			/* Result is only for the client which is still waiting it */
+			if (pid > 0 && (kill((pid_t)pid, 0) == 0 || errno == EPERM)) {
+				snprintf(path, sizeof(path), "%s/%s" RET_SUFFIX, SPOOL_DIR, name);
+				size = snprintf(result, sizeof(result), "%d %d\n", ret, getpid());
+				/* Client can be another user, when the server is the root */
+				write_file(path, result, size, 0644);
+			}
+		}
+
+		unlink(run);
+		free(list[i]);
+	}
+
+	free(list);
+
+	remove_old_results();
+	return delivered;
+}
+
+
+
+int spool_count(void)
+{
+	struct dirent **list;
+	int count;
+	int i;
+
+	count = scandir(SPOOL_DIR, &list, is_request, NULL);
+	if (count < 0)
+		return 0;
+
+	for (i = 0; i < count; i++)
+		free(list[i]);
+	free(list);
+
+	return count;
+}
+
+
+
+/* End of a file */
@@ -0,0 +1,531 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Fan-out of events.
+ *
+ * Events are encoded into the pending buffer as they are accepted.
+ * ADD and REMOVE drop the pending events of the same (pkgname, name),
+ * and the live events are compacted in place when the batch is published.
+ * The buffer becomes a refcounted batch, every subscriber queues an item which points it,
+ * so an event is encoded and stored once, whatever the number of subscribers is.
+ *
+ * A subscriber which doesn't read its socket is bounded by QUEUE_LIMIT,
+ * its queue is dropped and replaced by an EVENT_OVERFLOW.
+ * The batch which is partially sent is kept, not to break the stream.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <dlog.h>
+#include <string.h>
+
+#include <sys/uio.h>
+
+#include <packet.h>
+#include <transport.h>
+#include <subscription.h>
+
+
+
+#define QUEUE_LIMIT (256 * 1024) /* Bytes which are queued for a subscriber */
+#define MAX_IOV 16
+
+
+
+extern int errno;
+
+
+
+struct batch {
+	int refcnt;
+	int size;
+	char *data;
+};
+
+
+
+struct item {
+	struct batch *batch;
+	struct item *next;
+};
+
+
+
+struct subscriber {
+	const struct transport *transport;
+	int fd;
+	struct item *head;
+	struct item **tail;
+	int offset; /* Sent bytes of the head */
+	int queued; /* Bytes of batches in the queue */
+	struct subscriber *next;
+};
+
+
+
+/*
+ * Event in the pending buffer.
+ */
+struct pending {
+	char *key; /* pkgname, '\0', name */
+	int key_len;
+	int offset;
+	int size;
+	int live;
+};
+
+
+
+static struct info {
+	struct subscriber *list;
+	int count;
+	unsigned int seq;
+
+	/* Pending batch */
+	char *data;
+	int length;
+	int size;
+	struct pending *events;
+	int nr_events;
+	int max_events;
+	int dropped; /* Bytes of events which are dropped */
+} s_info = {
+	.list = NULL,
+	.count = 0,
+	.seq = 0,
+	.data = NULL,
+	.length = 0,
+	.size = 0,
+	.events = NULL,
+	.nr_events = 0,
+	.max_events = 0,
+	.dropped = 0,
+};
+
+
+
+static inline
+void unref_batch(struct batch *batch)
+{
+	if (--batch->refcnt > 0)
+		return;
+
+	free(batch->data);
+	free(batch);
+}
+
+
+
+static inline
+void drop_items(struct subscriber *sub, struct item *item)
+{
+	struct item *next;
+
+	while (item) {
+		next = item->next;
+		sub->queued -= item->batch->size;
+		unref_batch(item->batch);
+		free(item);
+		item = next;
+	}
+}
+
+
+
+static inline
+int append_item(struct subscriber *sub, struct batch *batch)
+{
+	struct item *item;
+
+	item = malloc(sizeof(*item));
+	if (!item) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return -ENOMEM;
+	}
+
+	item->batch = batch;
+	item->next = NULL;
+	batch->refcnt++;
+
+	*sub->tail = item;
+	sub->tail = &item->next;
+	sub->queued += batch->size;
+	return 0;
+}
+
+
+
+struct subscriber *subscription_add(const struct transport *transport, int fd)
+{
+	struct subscriber *sub;
+
+	sub = calloc(1, sizeof(*sub));
+	if (!sub) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	sub->transport = transport;
+	sub->fd = fd;
+	sub->tail = &sub->head;
+	sub->next = s_info.list;
+	s_info.list = sub;
+	s_info.count++;
+	return sub;
+}
+
+
+
+void subscription_remove(struct subscriber *sub)
+{
+	struct subscriber **ptr;
+
+	for (ptr = &s_info.list; *ptr; ptr = &(*ptr)->next) {
+		if (*ptr == sub) {
+			*ptr = sub->next;
+			s_info.count--;
+			break;
+		}
+	}
+
+	drop_items(sub, sub->head);
+	free(sub);
+}
+
+
+
+int subscription_count(void)
+{
+	return s_info.count;
+}
+
+
+
+static inline
+void drop_pending(void)
+{
+	int i;
+
+	for (i = 0; i < s_info.nr_events; i++)
+		free(s_info.events[i].key);
+
+	s_info.nr_events = 0;
+	s_info.length = 0;
+	s_info.dropped = 0;
+}
+
+
+
+static inline
+int reserve_pending(int size)
+{
+	struct pending *events;
+	char *data;
+	int new_size;
+
+	if (s_info.nr_events == s_info.max_events) {
+		new_size = s_info.max_events ? s_info.max_events * 2 : 16;
+		events = realloc(s_info.events, new_size * sizeof(*events));
+		if (!events) {
+			LOGE("Heap: %s\n", strerror(errno));
+			return -ENOMEM;
+		}
+
+		s_info.events = events;
+		s_info.max_events = new_size;
+	}
+
+	if (s_info.size - s_info.length >= size)
+		return 0;
+
+	new_size = s_info.size ? s_info.size : 4096;
+	while (new_size - s_info.length < size)
+		new_size *= 2;
+
+	data = realloc(s_info.data, new_size);
+	if (!data) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return -ENOMEM;
+	}
+
+	s_info.data = data;
+	s_info.size = new_size;
+	return 0;
+}
+
+
+
+static inline
+char *make_key(const struct message *msg, int *key_len)
+{
+	const struct field *pkgname = msg->field + FIELD_PKGNAME;
+	const struct field *name = msg->field + FIELD_NAME;
+	char *key;
+
+	/* Sizes of fields include the NUL */
+	*key_len = pkgname->size + name->size;
+	key = malloc(*key_len ? *key_len : 1);
+	if (!key) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	if (pkgname->size)
+		memcpy(key, pkgname->ptr, pkgname->size);
+
+	if (name->size)
+		memcpy(key + pkgname->size, name->ptr, name->size);
+
+	return key;
+}
+
+
+
+int subscription_event(const struct message *msg)
+{
+	struct pending *event;
+	struct message ev;
+	char *key;
+	int key_len;
+	int size;
+	int i;
+
+	if (!s_info.count)
+		return 0;
+
+	ev = *msg;
+	ev.type = PACKET_EVENT;
+	ev.seq = s_info.seq++;
+	ev.flags = 0;
+	ev.priority = 0;
+	ev.deadline = 0;
+
+	key = make_key(&ev, &key_len);
+	if (!key)
+		return -ENOMEM;
+
+	size = packet_size_v2(&ev);
+	if (reserve_pending(size) < 0) {
+		free(key);
+		return -ENOMEM;
+	}
+
+	if (ev.kind == EVENT_ADD || ev.kind == EVENT_REMOVE) {
+		for (i = 0; i < s_info.nr_events; i++) {
+			event = s_info.events + i;
+			if (!event->live || event->key_len != key_len || memcmp(event->key, key, key_len))
+				continue;
+
+			event->live = 0;
+			s_info.dropped += event->size;
+		}
+	}
+
+	event = s_info.events + s_info.nr_events++;
+	event->key = key;
+	event->key_len = key_len;
+	event->offset = s_info.length;
+	event->size = packet_encode_v2(&ev, s_info.data + s_info.length);
+	event->live = 1;
+	s_info.length += event->size;
+	return s_info.length - s_info.dropped;
+}
+
+
+
+static inline
+struct batch *create_overflow(void)
+{
+	struct batch *batch;
+	struct message msg;
+
+	batch = malloc(sizeof(*batch));
+	if (!batch) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	message_init(&msg, PACKET_EVENT, s_info.seq++);
+	msg.kind = EVENT_OVERFLOW;
+
+	batch->size = packet_size_v2(&msg);
+	batch->data = malloc(batch->size);
+	if (!batch->data) {
+		LOGE("Heap: %s\n", strerror(errno));
+		free(batch);
+		return NULL;
+	}
+
+	packet_encode_v2(&msg, batch->data);
+	batch->refcnt = 1;
+	return batch;
+}
+
+
+
+static inline
+void overflow(struct subscriber *sub, struct batch **overflow_batch)
+{
+	struct item *item;
+
+	/* Rest of the head is sent before the overflow */
+	item = sub->head;
+	if (item && sub->offset) {
+		drop_items(sub, item->next);
+		item->next = NULL;
+		sub->tail = &item->next;
+	} else {
+		drop_items(sub, item);
+		sub->head = NULL;
+		sub->tail = &sub->head;
+		sub->offset = 0;
+	}
+
+	if (!*overflow_batch)
+		*overflow_batch = create_overflow();
+
+	if (*overflow_batch)
+		append_item(sub, *overflow_batch);
+
+	LOGE("Events of a subscriber (%d) are dropped\n", sub->fd);
+}
+
+
+
+int subscription_publish(void)
+{
+	struct subscriber *sub;
+	struct batch *overflow_batch;
+	struct batch *batch;
+	struct pending *event;
+	int length;
+	int count;
+	int i;
+
+	if (!s_info.nr_events)
+		return 0;
+
+	if (!s_info.count) {
+		drop_pending();
+		return 0;
+	}
+
+	/* Live events are moved in place, in their order */
+	if (s_info.dropped) {
+		length = 0;
+		for (i = 0; i < s_info.nr_events; i++) {
+			event = s_info.events + i;
+			if (!event->live)
+				continue;
+
+			memmove(s_info.data + length, s_info.data + event->offset, event->size);
+			length += event->size;
+		}
+
+		s_info.length = length;
+	}
+
+	batch = malloc(sizeof(*batch));
+	if (!batch) {
+		LOGE("Heap: %s\n", strerror(errno));
+		drop_pending();
+		return -ENOMEM;
+	}
+
+	/* Buffer is owned by the batch */
+	batch->refcnt = 1;
+	batch->size = s_info.length;
+	batch->data = s_info.data;
+	s_info.data = NULL;
+	s_info.size = 0;
+	drop_pending();
+
+	overflow_batch = NULL;
+	count = 0;
+	for (sub = s_info.list; sub; sub = sub->next) {
+		/* A large batch is queued to the subscriber which has sent everything */
+		if (sub->queued && sub->queued + batch->size > QUEUE_LIMIT)
+			overflow(sub, &overflow_batch);
+		else if (append_item(sub, batch) < 0)
+			overflow(sub, &overflow_batch);
+
+		if (sub->head)
+			count++;
+	}
+
+	if (overflow_batch)
+		unref_batch(overflow_batch);
+
+	unref_batch(batch);
+	return count;
+}
+
+
+
+int subscription_flush(struct subscriber *sub)
+{
+	struct iovec iov[MAX_IOV];
+	struct item *item;
+	int offset;
+	int count;
+	int ret;
+
+	while (sub->head) {
+		count = 0;
+		offset = sub->offset;
+		for (item = sub->head; item && count < MAX_IOV; item = item->next) {
+			iov[count].iov_base = item->batch->data + offset;
+			iov[count].iov_len = item->batch->size - offset;
+			offset = 0;
+			count++;
+		}
+
+		ret = sub->transport->sendv(sub->fd, iov, count);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 1;
+
+			LOGE("Failed to send events (%s)\n", strerror(errno));
+			return -EIO;
+		}
+
+		while ((item = sub->head) && ret >= item->batch->size - sub->offset) {
+			ret -= item->batch->size - sub->offset;
+			sub->offset = 0;
+			sub->head = item->next;
+			sub->queued -= item->batch->size;
+			unref_batch(item->batch);
+			free(item);
+		}
+
+		if (!sub->head) {
+			sub->tail = &sub->head;
+			break;
+		}
+
+		sub->offset += ret;
+	}
+
+	return 0;
+}
+
+
+
+/* End of a file */
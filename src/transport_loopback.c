@@ -0,0 +1,639 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Loopback transport.
+ *
+ * A connection is a pair of endpoints in this process, sent data is queued to the peer as a chunk.
+ * The handle of an endpoint is an eventfd, which is readable while the endpoint has something to receive
+ * (data, a disconnected peer, or connections to accept), so the main loop watches it as a socket.
+ * Nothing else enters the kernel, data is copied once into the chunk and once out of it.
+ *
+ * Passed fds are duplicated, as the SCM_RIGHTS does.
+ * Receiving blocks by the poll on the eventfd, unless the handle is O_NONBLOCK.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <errno.h>
+#include <dlog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <poll.h>
+
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+
+#include <secom_socket.h>
+#include <transport.h>
+
+
+
+extern int errno;
+
+
+
+struct chunk {
+	struct chunk *next;
+	int size;
+	int offset; /* Received bytes */
+	int fds[SECOM_MAX_FDS];
+	int nr_fds;
+	char data[];
+};
+
+
+
+struct endpoint {
+	int fd; /* eventfd, the handle */
+	int signaled; /* Counter of the eventfd is not 0 */
+
+	/* Listener */
+	char *name;
+	struct endpoint *backlog;
+	struct endpoint **backlog_tail;
+	struct endpoint *backlog_next;
+
+	/* Connection */
+	struct endpoint *peer; /* NULL if the peer is disconnected */
+	struct chunk *head;
+	struct chunk **tail;
+	int length; /* Bytes in the queue */
+};
+
+
+
+static struct info {
+	pthread_mutex_t lock;
+	struct endpoint **table; /* Indexed by the handle */
+	int table_size;
+} s_info = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.table = NULL,
+	.table_size = 0,
+};
+
+
+
+static inline
+struct endpoint *find_endpoint(int fd)
+{
+	if (fd < 0 || fd >= s_info.table_size || !s_info.table[fd]) {
+		errno = EBADF;
+		return NULL;
+	}
+
+	return s_info.table[fd];
+}
+
+
+
+static inline
+int is_readable(const struct endpoint *ep)
+{
+	if (ep->name)
+		return ep->backlog != NULL;
+
+	return ep->head || !ep->peer;
+}
+
+
+
+/*
+ * Keep the eventfd readable while the endpoint has something to receive.
+ */
+static inline
+void update_endpoint(struct endpoint *ep)
+{
+	uint64_t value = 1;
+
+	if (is_readable(ep) == ep->signaled)
+		return;
+
+	if (ep->signaled) {
+		if (read(ep->fd, &value, sizeof(value)) != sizeof(value))
+			LOGE("Failed to read the eventfd (%s)\n", strerror(errno));
+	} else {
+		if (write(ep->fd, &value, sizeof(value)) != sizeof(value))
+			LOGE("Failed to write the eventfd (%s)\n", strerror(errno));
+	}
+
+	ep->signaled = !ep->signaled;
+}
+
+
+
+static inline
+struct endpoint *create_endpoint(void)
+{
+	struct endpoint **table;
+	struct endpoint *ep;
+	int size;
+
+	ep = calloc(1, sizeof(*ep));
+	if (!ep) {
+		LOGE("Heap: %s\n", strerror(errno));
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	ep->fd = eventfd(0, EFD_CLOEXEC);
+	if (ep->fd < 0) {
+		LOGE("Failed to create an eventfd (%s)\n", strerror(errno));
+		free(ep);
+		return NULL;
+	}
+
+	if (ep->fd >= s_info.table_size) {
+		size = s_info.table_size ? s_info.table_size : 64;
+		while (size <= ep->fd)
+			size *= 2;
+
+		table = realloc(s_info.table, size * sizeof(*table));
+		if (!table) {
+			LOGE("Heap: %s\n", strerror(errno));
+			close(ep->fd);
+			free(ep);
+			errno = ENOMEM;
+			return NULL;
+		}
+
+		memset(table + s_info.table_size, 0, (size - s_info.table_size) * sizeof(*table));
+		s_info.table = table;
+		s_info.table_size = size;
+	}
+
+	ep->tail = &ep->head;
+	ep->backlog_tail = &ep->backlog;
+	s_info.table[ep->fd] = ep;
+	return ep;
+}
+
+
+
+static inline
+void destroy_endpoint(struct endpoint *ep)
+{
+	struct chunk *chunk;
+	int i;
+
+	if (ep->peer) {
+		ep->peer->peer = NULL;
+		update_endpoint(ep->peer);
+	}
+
+	while ((chunk = ep->head)) {
+		ep->head = chunk->next;
+		for (i = 0; i < chunk->nr_fds; i++)
+			close(chunk->fds[i]);
+		free(chunk);
+	}
+
+	s_info.table[ep->fd] = NULL;
+	close(ep->fd);
+	free(ep->name);
+	free(ep);
+}
+
+
+
+static inline
+struct endpoint *find_listener(const char *name)
+{
+	int i;
+
+	for (i = 0; i < s_info.table_size; i++) {
+		if (s_info.table[i] && s_info.table[i]->name && !strcmp(s_info.table[i]->name, name))
+			return s_info.table[i];
+	}
+
+	return NULL;
+}
+
+
+
+static
+int loopback_listen(const char *peer)
+{
+	struct endpoint *ep;
+	int fd = -1;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0)
+		return -1;
+
+	if (find_listener(peer)) {
+		LOGE("%s is already listened\n", peer);
+		errno = EADDRINUSE;
+		goto out;
+	}
+
+	ep = create_endpoint();
+	if (!ep)
+		goto out;
+
+	ep->name = strdup(peer);
+	if (!ep->name) {
+		destroy_endpoint(ep);
+		errno = ENOMEM;
+		goto out;
+	}
+
+	fd = ep->fd;
+out:
+	pthread_mutex_unlock(&s_info.lock);
+	return fd;
+}
+
+
+
+static
+int loopback_connect(const char *peer)
+{
+	struct endpoint *listener;
+	struct endpoint *client;
+	struct endpoint *server;
+	int fd = -1;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0)
+		return -1;
+
+	listener = find_listener(peer);
+	if (!listener) {
+		LOGE("Failed to connect to server [%s]\n", peer);
+		errno = ECONNREFUSED;
+		goto out;
+	}
+
+	client = create_endpoint();
+	if (!client)
+		goto out;
+
+	server = create_endpoint();
+	if (!server) {
+		destroy_endpoint(client);
+		goto out;
+	}
+
+	client->peer = server;
+	server->peer = client;
+
+	*listener->backlog_tail = server;
+	listener->backlog_tail = &server->backlog_next;
+	update_endpoint(listener);
+
+	fd = client->fd;
+out:
+	pthread_mutex_unlock(&s_info.lock);
+	return fd;
+}
+
+
+
+static
+int loopback_accept(int server)
+{
+	struct endpoint *listener;
+	struct endpoint *ep;
+	int fd = -1;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0)
+		return -1;
+
+	listener = find_endpoint(server);
+	if (!listener || !listener->name) {
+		errno = EINVAL;
+		goto out;
+	}
+
+	ep = listener->backlog;
+	if (!ep) {
+		errno = EAGAIN;
+		goto out;
+	}
+
+	listener->backlog = ep->backlog_next;
+	if (!listener->backlog)
+		listener->backlog_tail = &listener->backlog;
+	ep->backlog_next = NULL;
+	update_endpoint(listener);
+
+	fd = ep->fd;
+out:
+	pthread_mutex_unlock(&s_info.lock);
+	return fd;
+}
+
+
+
+static inline
+struct chunk *create_chunk(int size, const int *fds, int nr_fds)
+{
+	struct chunk *chunk;
+	int i;
+
+	if (nr_fds < 0 || nr_fds > SECOM_MAX_FDS) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	chunk = malloc(sizeof(*chunk) + size);
+	if (!chunk) {
+		LOGE("Heap: %s\n", strerror(errno));
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->offset = 0;
+	for (chunk->nr_fds = 0; chunk->nr_fds < nr_fds; chunk->nr_fds++) {
+		chunk->fds[chunk->nr_fds] = fcntl(fds[chunk->nr_fds], F_DUPFD_CLOEXEC, 0);
+		if (chunk->fds[chunk->nr_fds] < 0) {
+			LOGE("Failed to duplicate a fd (%s)\n", strerror(errno));
+			for (i = 0; i < chunk->nr_fds; i++)
+				close(chunk->fds[i]);
+			free(chunk);
+			return NULL;
+		}
+	}
+
+	return chunk;
+}
+
+
+
+/*
+ * The chunk is freed if it is not queued.
+ */
+static inline
+int queue_chunk(int conn, struct chunk *chunk)
+{
+	struct endpoint *ep;
+	int i;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0)
+		goto err;
+
+	ep = find_endpoint(conn);
+	if (!ep || !ep->peer) {
+		if (ep)
+			errno = EPIPE;
+		pthread_mutex_unlock(&s_info.lock);
+		goto err;
+	}
+
+	*ep->peer->tail = chunk;
+	ep->peer->tail = &chunk->next;
+	ep->peer->length += chunk->size;
+	update_endpoint(ep->peer);
+	pthread_mutex_unlock(&s_info.lock);
+	return chunk->size;
+
+err:
+	for (i = 0; i < chunk->nr_fds; i++)
+		close(chunk->fds[i]);
+	free(chunk);
+	return -1;
+}
+
+
+
+static
+int loopback_send(int conn, const char *buffer, int size, const int *fds, int nr_fds)
+{
+	struct chunk *chunk;
+
+	chunk = create_chunk(size, fds, nr_fds);
+	if (!chunk)
+		return -1;
+
+	memcpy(chunk->data, buffer, size);
+	return queue_chunk(conn, chunk);
+}
+
+
+
+/*
+ * Queues are not bounded, it never returns EAGAIN.
+ */
+static
+int loopback_sendv(int conn, const struct iovec *iov, int count)
+{
+	struct chunk *chunk;
+	int offset;
+	int size;
+	int i;
+
+	size = 0;
+	for (i = 0; i < count; i++)
+		size += iov[i].iov_len;
+
+	chunk = create_chunk(size, NULL, 0);
+	if (!chunk)
+		return -1;
+
+	offset = 0;
+	for (i = 0; i < count; i++) {
+		memcpy(chunk->data + offset, iov[i].iov_base, iov[i].iov_len);
+		offset += iov[i].iov_len;
+	}
+
+	return queue_chunk(conn, chunk);
+}
+
+
+
+/*
+ * As the recvmsg does, a chunk with fds is not merged after other data.
+ */
+static inline
+int dequeue(struct endpoint *ep, char *buffer, int size, int *fds, int *nr_fds)
+{
+	struct chunk *chunk;
+	int max_fds;
+	int copied;
+	int len;
+	int i;
+
+	max_fds = 0;
+	if (nr_fds) {
+		max_fds = *nr_fds;
+		*nr_fds = 0;
+	}
+
+	copied = 0;
+	while ((chunk = ep->head) && copied < size) {
+		if (chunk->nr_fds && copied)
+			break;
+
+		for (i = 0; i < chunk->nr_fds; i++) {
+			if (nr_fds && *nr_fds < max_fds) {
+				fds[(*nr_fds)++] = chunk->fds[i];
+			} else {
+				/* Nobody takes this, don't leak it */
+				LOGE("Unexpected fd is dropped\n");
+				close(chunk->fds[i]);
+			}
+		}
+		chunk->nr_fds = 0;
+
+		len = chunk->size - chunk->offset;
+		if (len > size - copied)
+			len = size - copied;
+
+		memcpy(buffer + copied, chunk->data + chunk->offset, len);
+		chunk->offset += len;
+		copied += len;
+
+		if (chunk->offset == chunk->size) {
+			ep->head = chunk->next;
+			if (!ep->head)
+				ep->tail = &ep->head;
+			free(chunk);
+		}
+	}
+
+	ep->length -= copied;
+	update_endpoint(ep);
+	return copied;
+}
+
+
+
+static
+int loopback_recv(int conn, char *buffer, int size, int *sender_pid, int *fds, int *nr_fds)
+{
+	struct endpoint *ep;
+	struct pollfd pfd;
+	int ret;
+
+	if (sender_pid)
+		*sender_pid = -1;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0)
+		return -1;
+
+	while ((ep = find_endpoint(conn)) && !ep->head && ep->peer) {
+		pthread_mutex_unlock(&s_info.lock);
+
+		if (fcntl(conn, F_GETFL) & O_NONBLOCK) {
+			errno = EAGAIN;
+			return -1;
+		}
+
+		pfd.fd = conn;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+			return -1;
+
+		if (pthread_mutex_lock(&s_info.lock) != 0)
+			return -1;
+	}
+
+	if (!ep) {
+		pthread_mutex_unlock(&s_info.lock);
+		return -1;
+	}
+
+	ret = dequeue(ep, buffer, size, fds, nr_fds);
+	pthread_mutex_unlock(&s_info.lock);
+
+	if (sender_pid)
+		*sender_pid = getpid();
+
+	return ret;
+}
+
+
+
+static
+int loopback_pending(int conn)
+{
+	struct endpoint *ep;
+	int size;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0)
+		return -1;
+
+	ep = find_endpoint(conn);
+	size = ep ? ep->length : -1;
+	pthread_mutex_unlock(&s_info.lock);
+	return size;
+}
+
+
+
+static
+int loopback_credentials(int conn, int *pid, int *uid)
+{
+	if (pid)
+		*pid = getpid();
+	if (uid)
+		*uid = getuid();
+
+	return 0;
+}
+
+
+
+static
+int loopback_close(int conn)
+{
+	struct endpoint *listener;
+	struct endpoint *ep;
+
+	if (pthread_mutex_lock(&s_info.lock) != 0)
+		return -1;
+
+	listener = find_endpoint(conn);
+	if (!listener) {
+		pthread_mutex_unlock(&s_info.lock);
+		return -1;
+	}
+
+	/* Connections which are not accepted are refused */
+	while ((ep = listener->backlog)) {
+		listener->backlog = ep->backlog_next;
+		destroy_endpoint(ep);
+	}
+
+	destroy_endpoint(listener);
+	pthread_mutex_unlock(&s_info.lock);
+	return 0;
+}
+
+
+
+const struct transport transport_loopback = {
+	.name = "loopback",
+	.connect = loopback_connect,
+	.connect_nonblock = loopback_connect, /* Never blocks */
+	.listen = loopback_listen,
+	.accept = loopback_accept,
+	.send = loopback_send,
+	.sendv = loopback_sendv,
+	.recv = loopback_recv,
+	.pending = loopback_pending,
+	.credentials = loopback_credentials,
+	.close = loopback_close,
+};
+
+
+
+/* End of a file */
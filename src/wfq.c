@@ -0,0 +1,341 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Weighted fair queuing.
+ *
+ * An entry gets the virtual finish time, max(vtime, finish of its flow) + COST / weight.
+ * The entry which has the earliest finish time is popped first, and the vtime follows it.
+ * A flow which has a backlog gets finish times in the future,
+ * so an entry of an idle flow is popped before the backlog.
+ *
+ * Entries are kept in a binary heap (1-based), flows in a hash table by their id.
+ * A flow is released when it has no entry and its finish time is passed.
+ * Until then, a flow whose entries are removed is kept in the idle list.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <dlog.h>
+#include <string.h>
+
+#include <wfq.h>
+
+
+
+#define COST 0x10000ull
+#define FLOW_BUCKETS 64
+
+
+
+extern int errno;
+
+
+
+struct wfq_flow {
+	int id;
+	int queued;
+	unsigned long long finish;
+	int idle; /* In the idle list */
+	struct wfq_flow *next;
+	struct wfq_flow *idle_next;
+};
+
+
+
+static struct info {
+	struct wfq_entry **heap;
+	int count;
+	int size;
+	unsigned long long vtime;
+	unsigned long long order;
+	struct wfq_flow *flows[FLOW_BUCKETS];
+	struct wfq_flow *idle;
+} s_info = {
+	.heap = NULL,
+	.count = 0,
+	.size = 0,
+	.vtime = 0,
+	.order = 0,
+	.idle = NULL,
+};
+
+
+
+static inline
+int is_before(const struct wfq_entry *a, const struct wfq_entry *b)
+{
+	if (a->tag != b->tag)
+		return a->tag < b->tag;
+
+	return a->order < b->order;
+}
+
+
+
+static inline
+void set_slot(int index, struct wfq_entry *entry)
+{
+	s_info.heap[index] = entry;
+	entry->index = index;
+}
+
+
+
+static inline
+void sift_up(int index)
+{
+	struct wfq_entry *entry = s_info.heap[index];
+
+	while (index > 1 && is_before(entry, s_info.heap[index >> 1])) {
+		set_slot(index, s_info.heap[index >> 1]);
+		index >>= 1;
+	}
+
+	set_slot(index, entry);
+}
+
+
+
+static inline
+void sift_down(int index)
+{
+	struct wfq_entry *entry = s_info.heap[index];
+	int child;
+
+	while ((child = index << 1) <= s_info.count) {
+		if (child < s_info.count && is_before(s_info.heap[child + 1], s_info.heap[child]))
+			child++;
+
+		if (!is_before(s_info.heap[child], entry))
+			break;
+
+		set_slot(index, s_info.heap[child]);
+		index = child;
+	}
+
+	set_slot(index, entry);
+}
+
+
+
+static inline
+struct wfq_flow *find_flow(int id, int create)
+{
+	struct wfq_flow *flow;
+	int bucket;
+
+	bucket = (unsigned int)id % FLOW_BUCKETS;
+	for (flow = s_info.flows[bucket]; flow; flow = flow->next) {
+		if (flow->id == id)
+			return flow;
+	}
+
+	if (!create)
+		return NULL;
+
+	flow = calloc(1, sizeof(*flow));
+	if (!flow) {
+		LOGE("Heap: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	flow->id = id;
+	flow->next = s_info.flows[bucket];
+	s_info.flows[bucket] = flow;
+	return flow;
+}
+
+
+
+static inline
+void release_flow(struct wfq_flow *flow)
+{
+	struct wfq_flow **ptr;
+
+	ptr = &s_info.flows[(unsigned int)flow->id % FLOW_BUCKETS];
+	while (*ptr != flow)
+		ptr = &(*ptr)->next;
+
+	*ptr = flow->next;
+	free(flow);
+}
+
+
+
+/*
+ * Flow which is idle long enough doesn't need its finish time.
+ */
+static inline
+void put_flow(struct wfq_flow *flow)
+{
+	flow->queued--;
+	if (flow->queued > 0)
+		return;
+
+	if (flow->finish <= s_info.vtime) {
+		if (!flow->idle)
+			release_flow(flow);
+		return;
+	}
+
+	/* Its entries are removed before they are popped */
+	if (!flow->idle) {
+		flow->idle = 1;
+		flow->idle_next = s_info.idle;
+		s_info.idle = flow;
+	}
+}
+
+
+
+/*
+ * Release idle flows whose finish time is passed.
+ * Flows which have entries again are just dropped from the list.
+ */
+static inline
+void release_idle_flows(void)
+{
+	struct wfq_flow **ptr;
+	struct wfq_flow *flow;
+
+	ptr = &s_info.idle;
+	while (*ptr) {
+		flow = *ptr;
+		if (flow->queued > 0 || flow->finish <= s_info.vtime) {
+			*ptr = flow->idle_next;
+			flow->idle = 0;
+			if (!flow->queued)
+				release_flow(flow);
+			continue;
+		}
+
+		ptr = &flow->idle_next;
+	}
+}
+
+
+
+int wfq_push(struct wfq_entry *entry, int id, int weight)
+{
+	struct wfq_entry **heap;
+	struct wfq_flow *flow;
+	unsigned long long start;
+	int size;
+
+	if (entry->index || weight <= 0)
+		return -EINVAL;
+
+	if (s_info.count + 1 >= s_info.size) {
+		size = s_info.size ? s_info.size << 1 : 64;
+		heap = realloc(s_info.heap, size * sizeof(*heap));
+		if (!heap) {
+			LOGE("Heap: %s\n", strerror(errno));
+			return -ENOMEM;
+		}
+
+		s_info.heap = heap;
+		s_info.size = size;
+	}
+
+	flow = find_flow(id, 1);
+	if (!flow)
+		return -ENOMEM;
+
+	start = flow->finish > s_info.vtime ? flow->finish : s_info.vtime;
+	flow->finish = start + COST / weight;
+	flow->queued++;
+
+	entry->tag = flow->finish;
+	entry->order = s_info.order++;
+	entry->flow = flow;
+
+	s_info.count++;
+	set_slot(s_info.count, entry);
+	sift_up(s_info.count);
+	return 0;
+}
+
+
+
+static inline
+void remove_at(int index)
+{
+	struct wfq_entry *entry = s_info.heap[index];
+	struct wfq_entry *last;
+
+	last = s_info.heap[s_info.count];
+	s_info.count--;
+
+	if (entry != last) {
+		set_slot(index, last);
+		if (index > 1 && is_before(last, s_info.heap[index >> 1]))
+			sift_up(index);
+		else
+			sift_down(index);
+	}
+
+	entry->index = 0;
+	put_flow(entry->flow);
+	entry->flow = NULL;
+}
+
+
+
+struct wfq_entry *wfq_pop(void)
+{
+	struct wfq_entry *entry;
+
+	if (!s_info.count)
+		return NULL;
+
+	entry = s_info.heap[1];
+	if (entry->tag > s_info.vtime)
+		s_info.vtime = entry->tag;
+
+	remove_at(1);
+
+	if (s_info.idle)
+		release_idle_flows();
+
+	return entry;
+}
+
+
+
+void wfq_remove(struct wfq_entry *entry)
+{
+	if (entry->index)
+		remove_at(entry->index);
+}
+
+
+
+int wfq_is_queued(const struct wfq_entry *entry)
+{
+	return entry->index != 0;
+}
+
+
+
+int wfq_count(void)
+{
+	return s_info.count;
+}
+
+
+
+/* End of a file */
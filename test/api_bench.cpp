@@ -0,0 +1,179 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Cost of a request for each API, shortcut::add_to_home, shortcut_add_to_home_n and shortcut_add_to_home.
+ * The homescreen is served in this process over the loopback transport,
+ * so the time is of the library and the protocol, not of the kernel.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <glib.h>
+
+#include <shortcut.hpp>
+
+#define LOOP 100000
+#define BATCH 64 /* Outstanding requests */
+
+#define PKGNAME "org.tizen.application"
+#define NAME "Shortcut"
+#define EXEC "/opt/usr/media/Images/image.jpg"
+#define ICON "/opt/usr/apps/org.tizen.application/res/icon.png"
+
+
+
+static struct info {
+	int sent;
+	int done;
+	int failed;
+} s_info = {
+	.sent = 0,
+	.done = 0,
+	.failed = 0,
+};
+
+
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000.0 + ts.tv_nsec;
+}
+
+
+
+static int request_cb(const char *pkgname, const char *name, int type, const char *content_info, const char *icon, int pid, void *data)
+{
+	return 0;
+}
+
+
+
+static void done(int ret)
+{
+	s_info.done++;
+	if (ret < 0)
+		s_info.failed++;
+}
+
+
+
+static int result_cb(int ret, int pid, void *data)
+{
+	done(ret);
+	return 0;
+}
+
+
+
+static void wait_results(int count)
+{
+	while (s_info.done < count)
+		g_main_context_iteration(NULL, TRUE);
+}
+
+
+
+static void send_c(void)
+{
+	int ret;
+
+	ret = shortcut_add_to_home(PKGNAME, NAME, 1, EXEC, ICON, result_cb, NULL);
+	if (ret < 0)
+		done(ret);
+}
+
+
+
+static void send_n(void)
+{
+	static const struct shortcut_field pkgname = { PKGNAME, sizeof(PKGNAME) - 1 };
+	static const struct shortcut_field name = { NAME, sizeof(NAME) - 1 };
+	static const struct shortcut_field exec = { EXEC, sizeof(EXEC) - 1 };
+	static const struct shortcut_field icon = { ICON, sizeof(ICON) - 1 };
+	int ret;
+
+	ret = shortcut_add_to_home_n(&pkgname, &name, 1, &exec, &icon, result_cb, NULL);
+	if (ret < 0)
+		done(ret);
+}
+
+
+
+static void send_cxx(void)
+{
+	shortcut::result result = shortcut::add_to_home(PKGNAME, NAME, 1, EXEC, ICON);
+
+	result.then(done);
+}
+
+
+
+static void run(const char *title, void (*send)(void))
+{
+	double begin;
+	int i;
+
+	s_info.sent = 0;
+	s_info.done = 0;
+	s_info.failed = 0;
+
+	begin = now();
+	for (i = 0; i < LOOP; i++) {
+		send();
+		s_info.sent++;
+
+		if (s_info.sent - s_info.done >= BATCH)
+			wait_results(s_info.sent - BATCH / 2);
+	}
+	wait_results(LOOP);
+
+	printf("%-22s: %7.2f us/request, failed %d\n", title, (now() - begin) / LOOP / 1000.0, s_info.failed);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	int ret;
+
+	ret = shortcut_set_transport(SHORTCUT_TRANSPORT_LOOPBACK);
+	if (ret < 0) {
+		printf("Failed to set the transport (%s)\n", strerror(-ret));
+		return 1;
+	}
+
+	ret = shortcut_set_request_cb(request_cb, NULL);
+	if (ret < 0) {
+		printf("Failed to create the server (%s)\n", strerror(-ret));
+		return 1;
+	}
+
+	/* Warm up the allocator and the server */
+	run("warm up", send_c);
+
+	run("shortcut_add_to_home", send_c);
+	run("shortcut_add_to_home_n", send_n);
+	run("shortcut::add_to_home", send_cxx);
+	return 0;
+}
+
+/* End of a file */
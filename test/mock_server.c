@@ -0,0 +1,466 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Headless homescreen for measuring and testing clients.
+ * Latency of callbacks, results, dropped connections and slow reads are programmable.
+ * It is linked with sources of the library, faults are injected by a wrapper of the transport_unix.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <glib.h>
+
+#include <shortcut.h>
+#include <transport.h>
+
+#define MAX_ERRORS 16
+#define CHECK_INTERVAL 100 /* ms, for signals */
+
+enum latency_type {
+	LATENCY_NONE,
+	LATENCY_FIXED, /* a */
+	LATENCY_UNIFORM, /* a ~ b */
+	LATENCY_EXP, /* Mean a */
+	LATENCY_NORMAL, /* Mean a, standard deviation b */
+	LATENCY_PARETO, /* Minimum a, shape b. Long tail */
+};
+
+struct error_rule {
+	int ret;
+	double rate;
+};
+
+static struct info {
+	GMainLoop *loop;
+	enum latency_type latency;
+	double a;
+	double b;
+	struct error_rule errors[MAX_ERRORS];
+	int nr_errors;
+	double drop_rate;
+	int read_size; /* 0 if it is not limited */
+	int read_delay; /* ms */
+	int limit; /* Exit after this number of requests, 0 if there is no limit */
+	int quiet;
+	volatile sig_atomic_t stop;
+
+	unsigned long requests;
+	unsigned long failed;
+	unsigned long drops;
+	double delayed; /* ms */
+} s_info = {
+	.loop = NULL,
+	.latency = LATENCY_NONE,
+	.a = 0.0,
+	.b = 0.0,
+	.nr_errors = 0,
+	.drop_rate = 0.0,
+	.read_size = 0,
+	.read_delay = 0,
+	.limit = 0,
+	.quiet = 0,
+	.stop = 0,
+	.requests = 0,
+	.failed = 0,
+	.drops = 0,
+	.delayed = 0.0,
+};
+
+
+
+static double uniform(void)
+{
+	/* (0, 1), for the log */
+	return (random() + 1.0) / (RAND_MAX + 2.0);
+}
+
+
+
+static double sample_latency(void)
+{
+	double value;
+
+	switch (s_info.latency) {
+	case LATENCY_FIXED:
+		value = s_info.a;
+		break;
+	case LATENCY_UNIFORM:
+		value = s_info.a + (s_info.b - s_info.a) * uniform();
+		break;
+	case LATENCY_EXP:
+		value = -s_info.a * log(uniform());
+		break;
+	case LATENCY_NORMAL:
+		/* Box-Muller */
+		value = s_info.a + s_info.b * sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+		break;
+	case LATENCY_PARETO:
+		value = s_info.a / pow(uniform(), 1.0 / s_info.b);
+		break;
+	default:
+		value = 0.0;
+		break;
+	}
+
+	return value > 0.0 ? value : 0.0;
+}
+
+
+
+static void sleep_ms(double ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t)(ms / 1000.0);
+	ts.tv_nsec = (long)((ms - ts.tv_sec * 1000.0) * 1000000.0);
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR && !s_info.stop);
+}
+
+
+
+/*
+ * Callbacks of the library are synchronous, the latency blocks the main loop as a busy homescreen does.
+ */
+static int serve(const char *kind, const char *pkgname, const char *name, int pid)
+{
+	double latency;
+	double dice;
+	int ret;
+	int i;
+
+	latency = sample_latency();
+	if (latency > 0.0) {
+		sleep_ms(latency);
+		s_info.delayed += latency;
+	}
+
+	ret = 0;
+	dice = uniform();
+	for (i = 0; i < s_info.nr_errors; i++) {
+		if (dice < s_info.errors[i].rate) {
+			ret = s_info.errors[i].ret;
+			break;
+		}
+
+		dice -= s_info.errors[i].rate;
+	}
+
+	s_info.requests++;
+	if (ret < 0)
+		s_info.failed++;
+
+	if (!s_info.quiet)
+		printf("%s %s/%s from %d: %.1f ms, %d\n", kind, pkgname, name, pid, latency, ret);
+
+	if (s_info.limit && s_info.requests >= (unsigned long)s_info.limit)
+		s_info.stop = 1;
+
+	return ret;
+}
+
+
+
+static int request_cb(const char *pkgname, const char *name, int type, const char *content_info, const char *icon, int pid, void *data)
+{
+	return serve("ADD", pkgname, name, pid);
+}
+
+
+
+static int update_cb(const char *pkgname, const char *name, int mask, const char *new_name, int type, const char *content_info, const char *icon, int pid, void *data)
+{
+	return serve("UPDATE", pkgname, name, pid);
+}
+
+
+
+static int remove_cb(const char *pkgname, const char *name, int pid, void *data)
+{
+	return serve("REMOVE", pkgname, name, pid);
+}
+
+
+
+static int fault_recv(int conn, char *buffer, int size, int *sender_pid, int *fds, int *nr_fds)
+{
+	if (s_info.read_delay)
+		sleep_ms(s_info.read_delay);
+
+	if (s_info.read_size && size > s_info.read_size)
+		size = s_info.read_size;
+
+	return transport_unix.recv(conn, buffer, size, sender_pid, fds, nr_fds);
+}
+
+
+
+/*
+ * Send the first half of replies, and shut the connection down.
+ */
+static int drop(int conn, const char *buffer, int size)
+{
+	int ret;
+
+	s_info.drops++;
+	if (!s_info.quiet)
+		printf("DROP %d after %d of %d bytes\n", conn, size / 2, size);
+
+	ret = send(conn, buffer, size / 2, MSG_NOSIGNAL | MSG_DONTWAIT);
+	if (ret < 0)
+		return ret;
+
+	shutdown(conn, SHUT_RDWR);
+	errno = EPIPE;
+	return -1;
+}
+
+
+
+static int fault_send(int conn, const char *buffer, int size, const int *fds, int nr_fds)
+{
+	if (size > 1 && uniform() < s_info.drop_rate)
+		return drop(conn, buffer, size);
+
+	return transport_unix.send(conn, buffer, size, fds, nr_fds);
+}
+
+
+
+static int fault_sendv(int conn, const struct iovec *iov, int count)
+{
+	/* Half of the first one, it is a part of a packet */
+	if (count > 0 && iov[0].iov_len > 1 && uniform() < s_info.drop_rate)
+		return drop(conn, iov[0].iov_base, iov[0].iov_len);
+
+	return transport_unix.sendv(conn, iov, count);
+}
+
+
+
+static struct transport s_fault_transport;
+
+
+
+static int parse_latency(const char *spec)
+{
+	static const struct {
+		const char *name;
+		enum latency_type type;
+		int nr_args;
+	} table[] = {
+		{ "fixed", LATENCY_FIXED, 1 },
+		{ "uniform", LATENCY_UNIFORM, 2 },
+		{ "exp", LATENCY_EXP, 1 },
+		{ "normal", LATENCY_NORMAL, 2 },
+		{ "pareto", LATENCY_PARETO, 2 },
+	};
+	const char *args;
+	int len;
+	int i;
+
+	args = strchr(spec, ':');
+	if (!args)
+		return -EINVAL;
+
+	len = args - spec;
+	for (i = 0; i < sizeof(table) / sizeof(table[0]); i++) {
+		if (strlen(table[i].name) != len || strncmp(spec, table[i].name, len))
+			continue;
+
+		if (sscanf(args, ":%lf:%lf", &s_info.a, &s_info.b) < table[i].nr_args)
+			return -EINVAL;
+
+		if (s_info.a < 0.0 || (table[i].type == LATENCY_PARETO && s_info.b <= 0.0))
+			return -EINVAL;
+
+		s_info.latency = table[i].type;
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+
+
+static int parse_error(const char *spec)
+{
+	struct error_rule *rule;
+
+	if (s_info.nr_errors >= MAX_ERRORS)
+		return -ENOMEM;
+
+	rule = &s_info.errors[s_info.nr_errors];
+	if (sscanf(spec, "%d:%lf", &rule->ret, &rule->rate) != 2 || rule->rate < 0.0 || rule->rate > 1.0)
+		return -EINVAL;
+
+	/* Both of "5" and "-5" are -EIO */
+	if (rule->ret > 0)
+		rule->ret = -rule->ret;
+
+	s_info.nr_errors++;
+	return 0;
+}
+
+
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [options]\n"
+		"  -l DIST    Latency of callbacks in ms\n"
+		"             fixed:MS, uniform:MIN:MAX, exp:MEAN, normal:MEAN:STDDEV, pareto:MIN:SHAPE\n"
+		"  -e ERR:P   Result is -ERR with the probability P, it can be repeated\n"
+		"  -d P       Connection is dropped in the middle of a reply with the probability P\n"
+		"  -r BYTES   Read at most BYTES from a socket at once\n"
+		"  -s MS      Sleep before each read\n"
+		"  -S SEED    Seed of the random numbers\n"
+		"  -n COUNT   Exit after COUNT requests\n"
+		"  -q         Don't print each request\n", name);
+}
+
+
+
+static void stop_cb(int signum)
+{
+	s_info.stop = 1;
+}
+
+
+
+static gboolean check_cb(gpointer data)
+{
+	if (!s_info.stop)
+		return TRUE;
+
+	g_main_loop_quit(s_info.loop);
+	return FALSE;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	double total_rate;
+	unsigned int seed;
+	int ret;
+	int opt;
+	int i;
+
+	seed = time(NULL);
+	while ((opt = getopt(argc, argv, "l:e:d:r:s:S:n:qh")) != -1) {
+		switch (opt) {
+		case 'l':
+			ret = parse_latency(optarg);
+			break;
+		case 'e':
+			ret = parse_error(optarg);
+			break;
+		case 'd':
+			s_info.drop_rate = atof(optarg);
+			ret = s_info.drop_rate < 0.0 || s_info.drop_rate > 1.0 ? -EINVAL : 0;
+			break;
+		case 'r':
+			s_info.read_size = atoi(optarg);
+			ret = s_info.read_size < 0 ? -EINVAL : 0;
+			break;
+		case 's':
+			s_info.read_delay = atoi(optarg);
+			ret = s_info.read_delay < 0 ? -EINVAL : 0;
+			break;
+		case 'S':
+			seed = strtoul(optarg, NULL, 10);
+			ret = 0;
+			break;
+		case 'n':
+			s_info.limit = atoi(optarg);
+			ret = s_info.limit < 0 ? -EINVAL : 0;
+			break;
+		case 'q':
+			s_info.quiet = 1;
+			ret = 0;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+
+		if (ret < 0) {
+			printf("Invalid option: -%c %s\n", opt, optarg);
+			return 1;
+		}
+	}
+
+	total_rate = 0.0;
+	for (i = 0; i < s_info.nr_errors; i++)
+		total_rate += s_info.errors[i].rate;
+
+	if (total_rate > 1.0) {
+		printf("Sum of error rates is larger than 1\n");
+		return 1;
+	}
+
+	srandom(seed);
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	signal(SIGINT, stop_cb);
+	signal(SIGTERM, stop_cb);
+	signal(SIGPIPE, SIG_IGN);
+
+	s_fault_transport = transport_unix;
+	s_fault_transport.name = "fault";
+	s_fault_transport.recv = fault_recv;
+	s_fault_transport.send = fault_send;
+	s_fault_transport.sendv = fault_sendv;
+
+	ret = transport_install(&s_fault_transport);
+	if (ret < 0) {
+		printf("Failed to install the transport (%d)\n", ret);
+		return 1;
+	}
+
+	s_info.loop = g_main_loop_new(NULL, FALSE);
+	if (!s_info.loop)
+		return 1;
+
+	shortcut_set_update_cb(update_cb, NULL);
+	shortcut_set_remove_cb(remove_cb, NULL);
+	ret = shortcut_set_request_cb(request_cb, NULL);
+	if (ret < 0) {
+		printf("Failed to start the server (%d)\n", ret);
+		g_main_loop_unref(s_info.loop);
+		return 1;
+	}
+
+	printf("Serving, seed %u\n", seed);
+	g_timeout_add(CHECK_INTERVAL, check_cb, NULL);
+	g_main_loop_run(s_info.loop);
+	g_main_loop_unref(s_info.loop);
+
+	printf("Requests %lu, failed %lu, drops %lu, mean latency %.2f ms\n",
+			s_info.requests, s_info.failed, s_info.drops,
+			s_info.requests ? s_info.delayed / s_info.requests : 0.0);
+	return 0;
+}
+
+/* End of a file */
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Encode/decode cost and the size of packets for each version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <packet.h>
+
+#define LOOP 1000000
+
+
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000.0 + ts.tv_nsec;
+}
+
+
+
+static void run(const char *title, int version, const struct message *msg)
+{
+	struct message out;
+	char *buffer;
+	double begin;
+	double encode;
+	double decode;
+	int size;
+	int i;
+
+	size = packet_size(version, msg);
+	buffer = malloc(size);
+	if (!buffer)
+		return;
+
+	begin = now();
+	for (i = 0; i < LOOP; i++)
+		packet_encode(version, msg, buffer);
+	encode = (now() - begin) / LOOP;
+
+	begin = now();
+	for (i = 0; i < LOOP; i++) {
+		if (packet_decode(version, buffer, size, &out) != size) {
+			printf("%s v%d: failed to decode\n", title, version);
+			break;
+		}
+	}
+	decode = (now() - begin) / LOOP;
+
+	printf("%-8s v%d: %4d bytes, encode %6.1f ns, decode %6.1f ns\n",
+					title, version, size, encode, decode);
+	free(buffer);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	struct message msg;
+	int version;
+
+	for (version = 1; version <= PACKET_VERSION; version++) {
+		message_init(&msg, PACKET_REQ, 1234);
+		msg.shortcut_type = 1;
+		message_set_field(&msg, FIELD_PKGNAME, "org.tizen.application");
+		message_set_field(&msg, FIELD_NAME, "Shortcut");
+		message_set_field(&msg, FIELD_EXEC, "/opt/usr/media/Images/image.jpg");
+		message_set_field(&msg, FIELD_ICON, "/opt/usr/apps/org.tizen.application/res/icon.png");
+		run("request", version, &msg);
+
+		message_init(&msg, PACKET_ACK, 1234);
+		msg.ret = 0;
+		run("ack", version, &msg);
+
+		message_init(&msg, PACKET_QUERY, 1234);
+		msg.kind = QUERY_EXISTS;
+		message_set_field(&msg, FIELD_PKGNAME, "org.tizen.application");
+		message_set_field(&msg, FIELD_NAME, "Shortcut");
+		run("query", version, &msg);
+	}
+
+	return 0;
+}
+
+/* End of a file */
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2012  Samsung Electronics Co., Ltd
+ *
+ * Licensed under the Flora License, Version 1.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.tizenopensource.org/license
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Requests through the shared ring, against a connection for each request.
+ * The homescreen is a child process, it should be the only one of the system.
+ * The library should be built with HAVE_MEMFD_CREATE for the ring.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+
+#include <sys/wait.h>
+
+#include <glib.h>
+
+#include <shortcut.h>
+
+#define LOOP 10000
+#define BATCH 64 /* Outstanding requests, within the credits of a ring */
+#define RING_SIZE (64 * 1024)
+#define SERVER_DELAY 300000 /* us, to start the server */
+
+
+
+static struct info {
+	int sent;
+	int done;
+	int failed;
+} s_info = {
+	.sent = 0,
+	.done = 0,
+	.failed = 0,
+};
+
+
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000.0 + ts.tv_nsec;
+}
+
+
+
+static int request_cb(const char *pkgname, const char *name, int type, const char *content_info, const char *icon, int pid, void *data)
+{
+	return 0;
+}
+
+
+
+static int result_cb(int ret, int pid, void *data)
+{
+	s_info.done++;
+	if (ret < 0)
+		s_info.failed++;
+
+	return 0;
+}
+
+
+
+static void wait_results(int count)
+{
+	while (s_info.done < count)
+		g_main_context_iteration(NULL, TRUE);
+}
+
+
+
+static void run(const char *title, int loop)
+{
+	double begin;
+	int i;
+
+	s_info.sent = 0;
+	s_info.done = 0;
+	s_info.failed = 0;
+
+	begin = now();
+	for (i = 0; i < loop; i++) {
+		if (shortcut_add_to_home("org.tizen.application", "Shortcut", 1,
+				"/opt/usr/media/Images/image.jpg",
+				"/opt/usr/apps/org.tizen.application/res/icon.png", result_cb, NULL) < 0) {
+			s_info.done++;
+			s_info.failed++;
+		}
+		s_info.sent++;
+
+		if (s_info.sent - s_info.done >= BATCH)
+			wait_results(s_info.sent - BATCH / 2);
+	}
+	wait_results(loop);
+
+	printf("%-8s: %7.2f us/request, failed %d\n", title, (now() - begin) / loop / 1000.0, s_info.failed);
+}
+
+
+
+static void serve(void)
+{
+	GMainLoop *loop;
+
+	if (shortcut_set_request_cb(request_cb, NULL) < 0) {
+		printf("Failed to create the server, is the homescreen running?\n");
+		exit(1);
+	}
+
+	loop = g_main_loop_new(NULL, FALSE);
+	g_main_loop_run(loop);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	pid_t server;
+	int loop;
+	int ret;
+
+	loop = argc > 1 ? atoi(argv[1]) : LOOP;
+	if (loop <= 0)
+		loop = LOOP;
+
+	server = fork();
+	if (server < 0) {
+		printf("Failed to fork (%s)\n", strerror(errno));
+		return 1;
+	}
+
+	if (!server)
+		serve();
+
+	usleep(SERVER_DELAY);
+
+	/* Warm up the server */
+	run("warm up", BATCH);
+
+	run("socket", loop);
+
+	ret = shortcut_ring_open(RING_SIZE);
+	if (ret < 0) {
+		printf("Failed to open the ring (%s)\n", strerror(-ret));
+	} else {
+		run("ring", loop);
+		shortcut_ring_close();
+	}
+
+	kill(server, SIGTERM);
+	waitpid(server, NULL, 0);
+	return 0;
+}
+
+/* End of a file */